@@ -0,0 +1,610 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Statistical quality analysis of the generator, with the hash constants
+ * of the dprpwg_config.h it is built with.
+ *
+ * It generates passwords from controlled inputs: one analysis master
+ * password, and numbered domains of the same length. Each sample i runs
+ * these generations:
+ * - the base password, of domain i;
+ * - the same with one domain char changed, one master password char
+ *   changed, or the next year (at the same length);
+ * - the password of another, unrelated domain, with the base master
+ *   password and the changed one.
+ *
+ * From them, it reports:
+ * - the symbol distribution at each password position (chi-square);
+ * - the avalanche effect of each change: password symbols changed, overall
+ *   and at the least changed position;
+ * - cross-domain correlation: symbols equal at the same position in the
+ *   passwords of two domains, and how often the offset between their
+ *   symbols (in the alphabet) survives a change of the master password;
+ * - category retries: passwords needing extension rounds to hold every
+ *   requested symbol category.
+ *
+ * Every measure is given with its ideal value, for a random generator,
+ * and flagged with '!' if it is more than Z_SUSPICIOUS standard deviations
+ * away. Samples are shared among threads, each one counting on its own. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_tools.h"
+
+/* Default number of samples */
+#define SAMPLE_COUNT 1000000U
+
+/* Samples taken by a thread at once */
+#define CHUNK_SIZE 1024U
+
+/* Default analysis master password */
+#define MASTER_PASSWORD "dprpwg analysis master password"
+
+/* Domain of sample i: fixed length, so only the chars differ */
+#define DOMAIN_FORMAT "www.%016zx.com"
+#define DOMAIN_MAXLENGTH 32U
+
+#define YEAR_MAXLENGTH 24U
+
+/* Distance to the ideal value, in standard deviations, flagged with '!' */
+#define Z_SUSPICIOUS 4.0
+
+/* Changes of the avalanche analysis */
+enum {
+  CHANGE_DOMAIN,
+  CHANGE_MASTER,
+  CHANGE_YEAR,
+  CHANGE_COUNT
+};
+
+/* Avalanche counters of one change */
+typedef struct {
+  uint64_t symbols_changed;
+  uint64_t position_changes[OUTPUT_MAX_LENGTH];
+} s_avalanche;
+
+/* What one thread counts */
+typedef struct {
+  s_avalanche avalanche[CHANGE_COUNT];
+  uint64_t cross_matches;       /* Same symbol at the same position */
+  uint64_t cross_stable;        /* Same symbol offset, other master password */
+  uint64_t retried;             /* Passwords with extension rounds */
+  uint64_t extension_rounds;
+  uint64_t iteration_max;       /* Passwords whose loop reached ITERATION_MAX */
+  uint64_t missing_categories;
+  uint64_t failures;            /* Generations that failed */
+  uint64_t symbol_counts[];     /* [position * alphabet_size + symbol] */
+} s_tally;
+
+/* Everything the threads share */
+typedef struct {
+  const char *master;
+  const char *year;
+  const char *next_year;
+  unsigned int flags;
+  size_t length;
+  size_t sample_count;
+  _Atomic size_t next_chunk;
+
+  /* Symbol index of each char, -1 if out of the alphabet */
+  int symbol_index[256];
+  size_t alphabet_size;
+} s_analysis;
+
+/* One thread */
+typedef struct {
+  s_analysis *analysis;
+  s_tally *tally;
+} s_worker;
+
+/* Print the command line help */
+static void usage(const char *program);
+
+/* Change one char of a string, to another printable char */
+static void change_char(char *string, size_t seek);
+
+/* Run one generation, with the analysis year, flags and length. Return
+ * TRUE on success. */
+static int generate(const s_analysis *analysis, const char *master, const char *domain,
+                    const char *year, char *passwd, s_generation_stats *stats);
+
+/* Count the differences between a password and a changed one */
+static void count_avalanche(s_avalanche *avalanche, size_t length,
+                            const char *passwd, const char *changed_passwd);
+
+/* Analyse sample 'sample' */
+static void analyse_sample(const s_analysis *analysis, s_tally *tally, size_t sample);
+
+/* Worker thread main function */
+static void *worker_run(void *data);
+
+/* Add the counts of 'from' into 'to' */
+static void merge_tally(s_tally *to, const s_tally *from, size_t symbol_count);
+
+/* Distance of a measured rate to its ideal value, in standard deviations */
+static double rate_z(double rate, double ideal, double trials);
+
+/* Print a measured rate, its ideal value and its deviation */
+static void print_rate(const char *name, double count, double trials, double ideal);
+
+/* Print the reports */
+static void print_distribution(const s_analysis *analysis, const s_tally *tally);
+static void print_avalanche(const s_analysis *analysis, const s_tally *tally);
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [-n samples] [-y year] [-c categories] [-j threads] [-e engine]\n"
+          "          [-m master_password]\n"
+          "  -n  Number of samples (default: %u), 6 generations each.\n"
+          "  -y  Year (default: current year). The year change uses the next one.\n"
+          "  -c  Symbol categories: any of l (lower case), u (upper case),\n"
+          "      d (digits), s (symbols). Default: luds.\n"
+          "  -j  Number of threads (default: number of cores).\n"
+          "  -e  Generation engine: reference, closed-form (default) or checked.\n"
+          "  -m  Analysis master password (default: a fixed one).\n",
+          program, SAMPLE_COUNT);
+}
+
+void change_char(char *string, size_t seek)
+{
+  string[seek] = string[seek] < '~' ? (char) (string[seek] + 1) : '!';
+}
+
+int generate(const s_analysis *analysis, const char *master, const char *domain,
+             const char *year, char *passwd, s_generation_stats *stats)
+{
+  return generate_password_stats(master, domain, year, analysis->length, analysis->flags,
+                                 passwd, analysis->length + 1, NULL, 0, stats) == GENERATE_OK;
+}
+
+void count_avalanche(s_avalanche *avalanche, size_t length,
+                     const char *passwd, const char *changed_passwd)
+{
+  size_t seek;
+
+  for (seek = 0; seek < length; seek++) {
+    if (passwd[seek] != changed_passwd[seek]) {
+      avalanche->symbols_changed++;
+      avalanche->position_changes[seek]++;
+    }
+  }
+}
+
+void analyse_sample(const s_analysis *analysis, s_tally *tally, size_t sample)
+{
+  const size_t length = analysis->length;
+  char master[256], domain[DOMAIN_MAXLENGTH], other_domain[DOMAIN_MAXLENGTH];
+  char passwd[OUTPUT_MAX_LENGTH + 1], changed_passwd[OUTPUT_MAX_LENGTH + 1];
+  char other_passwd[OUTPUT_MAX_LENGTH + 1], other_changed_passwd[OUTPUT_MAX_LENGTH + 1];
+  s_generation_stats stats;
+  size_t domain_length, seek;
+
+  snprintf(master, sizeof(master), "%s", analysis->master);
+  domain_length = (size_t) snprintf(domain, sizeof(domain), DOMAIN_FORMAT, sample);
+
+  /* The unrelated domain: a scrambled sample number */
+  snprintf(other_domain, sizeof(other_domain), DOMAIN_FORMAT,
+           (size_t) ((uint64_t) sample * UINT64_C(0x9E3779B97F4A7C15) + 1));
+
+  /* Base password: symbol distribution and category retries */
+  if (!generate(analysis, master, domain, analysis->year, passwd, &stats)) {
+    tally->failures++;
+    return;
+  }
+
+  for (seek = 0; seek < length; seek++) {
+    const int symbol = analysis->symbol_index[(unsigned char) passwd[seek]];
+
+    if (symbol >= 0) {
+      tally->symbol_counts[seek * analysis->alphabet_size + (size_t) symbol]++;
+    }
+  }
+
+  if (stats.extension_rounds) {
+    tally->retried++;
+    tally->extension_rounds += stats.extension_rounds;
+  }
+
+  tally->iteration_max += stats.iteration_max_reached ? 1U : 0U;
+  tally->missing_categories += stats.all_categories_present ? 0U : 1U;
+
+  /* One domain char changed, every position in turn */
+  change_char(domain, sample % domain_length);
+
+  if (generate(analysis, master, domain, analysis->year, changed_passwd, &stats)) {
+    count_avalanche(&tally->avalanche[CHANGE_DOMAIN], length, passwd, changed_passwd);
+  } else {
+    tally->failures++;
+  }
+
+  snprintf(domain, sizeof(domain), DOMAIN_FORMAT, sample);
+
+  /* Next year */
+  if (generate(analysis, master, domain, analysis->next_year, changed_passwd, &stats)) {
+    count_avalanche(&tally->avalanche[CHANGE_YEAR], length, passwd, changed_passwd);
+  } else {
+    tally->failures++;
+  }
+
+  /* Unrelated domain, same master password */
+  if (!generate(analysis, master, other_domain, analysis->year, other_passwd, &stats)) {
+    tally->failures++;
+    return;
+  }
+
+  for (seek = 0; seek < length; seek++) {
+    tally->cross_matches += passwd[seek] == other_passwd[seek] ? 1U : 0U;
+  }
+
+  /* One master password char changed, for both domains */
+  change_char(master, sample % strlen(master));
+
+  if (!generate(analysis, master, domain, analysis->year, changed_passwd, &stats)
+      || !generate(analysis, master, other_domain, analysis->year, other_changed_passwd,
+                   &stats)) {
+    tally->failures++;
+    return;
+  }
+
+  count_avalanche(&tally->avalanche[CHANGE_MASTER], length, passwd, changed_passwd);
+
+  for (seek = 0; seek < length; seek++) {
+    const size_t size = analysis->alphabet_size;
+    const int symbol = analysis->symbol_index[(unsigned char) passwd[seek]];
+    const int other_symbol = analysis->symbol_index[(unsigned char) other_passwd[seek]];
+    const int changed_symbol = analysis->symbol_index[(unsigned char) changed_passwd[seek]];
+    const int other_changed_symbol = analysis->symbol_index[(unsigned char) other_changed_passwd[seek]];
+
+    if (symbol >= 0 && other_symbol >= 0 && changed_symbol >= 0 && other_changed_symbol >= 0) {
+      tally->cross_stable += (size_t) (symbol - other_symbol + (int) size) % size
+                             == (size_t) (changed_symbol - other_changed_symbol + (int) size) % size
+                             ? 1U : 0U;
+    }
+  }
+}
+
+void *worker_run(void *data)
+{
+  s_worker *worker = (s_worker *) data;
+  s_analysis *analysis = worker->analysis;
+  size_t chunk, sample;
+
+  while ((chunk = atomic_fetch_add_explicit(&analysis->next_chunk, 1, memory_order_relaxed))
+         * CHUNK_SIZE < analysis->sample_count) {
+    size_t end = (chunk + 1) * CHUNK_SIZE;
+
+    end = end < analysis->sample_count ? end : analysis->sample_count;
+
+    for (sample = chunk * CHUNK_SIZE; sample < end; sample++) {
+      analyse_sample(analysis, worker->tally, sample);
+    }
+  }
+
+  return NULL;
+}
+
+void merge_tally(s_tally *to, const s_tally *from, size_t symbol_count)
+{
+  size_t change, seek;
+
+  for (change = 0; change < CHANGE_COUNT; change++) {
+    to->avalanche[change].symbols_changed += from->avalanche[change].symbols_changed;
+
+    for (seek = 0; seek < OUTPUT_MAX_LENGTH; seek++) {
+      to->avalanche[change].position_changes[seek] += from->avalanche[change].position_changes[seek];
+    }
+  }
+
+  to->cross_matches += from->cross_matches;
+  to->cross_stable += from->cross_stable;
+  to->retried += from->retried;
+  to->extension_rounds += from->extension_rounds;
+  to->iteration_max += from->iteration_max;
+  to->missing_categories += from->missing_categories;
+  to->failures += from->failures;
+
+  for (seek = 0; seek < symbol_count; seek++) {
+    to->symbol_counts[seek] += from->symbol_counts[seek];
+  }
+}
+
+double rate_z(double rate, double ideal, double trials)
+{
+  const double deviation = sqrt(ideal * (1.0 - ideal) / trials);
+
+  return deviation > 0.0 ? (rate - ideal) / deviation : 0.0;
+}
+
+void print_rate(const char *name, double count, double trials, double ideal)
+{
+  const double rate = trials > 0.0 ? count / trials : 0.0;
+  const double z = rate_z(rate, ideal, trials);
+
+  printf("  %-42s %10.6f %10.6f %9.1f %s\n", name, rate, ideal, z,
+         fabs(z) > Z_SUSPICIOUS ? "!" : "");
+}
+
+void print_distribution(const s_analysis *analysis, const s_tally *tally)
+{
+  const double degrees = (double) analysis->alphabet_size - 1.0;
+  const double per_symbol = (double) (analysis->sample_count - tally->failures)
+                            / (double) analysis->alphabet_size;
+  double total_chi2 = 0.0;
+  size_t seek, symbol;
+
+  printf("Symbol distribution: chi-square per position, %.0f degrees of freedom\n", degrees);
+  printf("  %-8s %12s %9s %10s\n", "position", "chi2", "z", "p-value");
+
+  for (seek = 0; seek <= analysis->length; seek++) {
+    double chi2 = 0.0, degrees_here = degrees, z;
+
+    if (seek < analysis->length) {
+      for (symbol = 0; symbol < analysis->alphabet_size; symbol++) {
+        const double difference = (double) tally->symbol_counts[seek * analysis->alphabet_size + symbol]
+                                  - per_symbol;
+
+        chi2 += difference * difference / per_symbol;
+      }
+
+      total_chi2 += chi2;
+    } else {
+      chi2 = total_chi2;
+      degrees_here = degrees * (double) analysis->length;
+    }
+
+    /* Wilson-Hilferty: (chi2 / k)^(1/3) is close to a normal law */
+    z = (cbrt(chi2 / degrees_here) - (1.0 - 2.0 / (9.0 * degrees_here)))
+        / sqrt(2.0 / (9.0 * degrees_here));
+
+    if (seek < analysis->length) {
+      printf("  %-8zu", seek);
+    } else {
+      printf("  %-8s", "all");
+    }
+
+    printf(" %12.1f %9.1f %10.2g %s\n", chi2, z, 0.5 * erfc(z / sqrt(2.0)),
+           fabs(z) > Z_SUSPICIOUS ? "!" : "");
+  }
+}
+
+void print_avalanche(const s_analysis *analysis, const s_tally *tally)
+{
+  static const char *const names[CHANGE_COUNT] = { "domain char", "master password char", "year" };
+  const double symbol_ideal = 1.0 - 1.0 / (double) analysis->alphabet_size;
+  const double pairs = (double) (analysis->sample_count - tally->failures);
+  size_t change, seek;
+
+  printf("Avalanche: one input changed                     rate      ideal         z\n");
+
+  for (change = 0; change < CHANGE_COUNT; change++) {
+    const s_avalanche *avalanche = &tally->avalanche[change];
+    char name[64];
+    uint64_t worst = avalanche->position_changes[0];
+    size_t worst_seek = 0;
+
+    for (seek = 1; seek < analysis->length; seek++) {
+      if (avalanche->position_changes[seek] < worst) {
+        worst = avalanche->position_changes[seek];
+        worst_seek = seek;
+      }
+    }
+
+    snprintf(name, sizeof(name), "%s: symbols changed", names[change]);
+    print_rate(name, (double) avalanche->symbols_changed, pairs * (double) analysis->length,
+               symbol_ideal);
+    snprintf(name, sizeof(name), "%s: least changed (%zu)", names[change], worst_seek);
+    print_rate(name, (double) worst, pairs, symbol_ideal);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *const categories[4] = { OUTPUT_LOW, OUTPUT_UPP, OUTPUT_DIG, OUTPUT_SYM };
+  char year[YEAR_MAXLENGTH], next_year[YEAR_MAXLENGTH];
+  size_t thread_count = 0, started = 0, index, symbol_count;
+  s_analysis analysis;
+  s_worker *workers;
+  pthread_t *threads;
+  s_tally *total;
+  struct timespec start, end;
+  double seconds, pairs;
+  char *year_end;
+  long year_value;
+  unsigned int engine;
+  int option, result = TRUE;
+
+  memset(&analysis, 0, sizeof(analysis));
+  analysis.master = MASTER_PASSWORD;
+  analysis.flags = FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL;
+  analysis.sample_count = SAMPLE_COUNT;
+  atomic_init(&analysis.next_chunk, 0);
+
+  /* Default year: the current one */
+  {
+    time_t time_value = time(NULL);
+    struct tm *time_data = localtime(&time_value);
+    snprintf(year, YEAR_MAXLENGTH, "%d", time_data->tm_year + 1900);
+  }
+
+  set_generation_engine(ENGINE_CLOSED_FORM);
+
+  while ((option = getopt(argc, argv, "n:y:c:j:e:m:h")) != -1) {
+    switch (option) {
+      case 'n':
+        analysis.sample_count = strtoul(optarg, NULL, 10);
+        break;
+      case 'y':
+        snprintf(year, YEAR_MAXLENGTH, "%s", optarg);
+        break;
+      case 'c':
+        if (!parse_categories(optarg, &analysis.flags) || !analysis.flags) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'j':
+        thread_count = strtoul(optarg, NULL, 10);
+        break;
+      case 'e':
+        if (!parse_engine(optarg, &engine)) {
+          usage(argv[0]);
+          return 1;
+        }
+        set_generation_engine(engine);
+        break;
+      case 'm':
+        analysis.master = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  year_value = strtol(year, &year_end, 10);
+
+  if (optind < argc || !analysis.sample_count || !*analysis.master || *year_end
+      || year_end == year || strlen(analysis.master) >= 256) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  snprintf(next_year, YEAR_MAXLENGTH, "%ld", year_value + 1);
+  analysis.year = year;
+  analysis.next_year = next_year;
+  analysis.length = get_password_length(year, 0);
+
+  if (!thread_count) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cores > 0 ? (size_t) cores : 1;
+  }
+
+  /* The alphabet: symbols of the selected categories */
+  for (index = 0; index < 256; index++) {
+    analysis.symbol_index[index] = -1;
+  }
+
+  for (index = 0; index < 4; index++) {
+    const char *symbol;
+
+    if (!(analysis.flags & (1U << index))) {
+      continue;
+    }
+
+    for (symbol = categories[index]; *symbol; symbol++) {
+      analysis.symbol_index[(unsigned char) *symbol] = (int) analysis.alphabet_size++;
+    }
+  }
+
+  /* One tally per thread, plus the total */
+  symbol_count = analysis.length * analysis.alphabet_size;
+  workers = calloc(thread_count, sizeof(s_worker));
+  threads = calloc(thread_count, sizeof(pthread_t));
+  total = calloc(1, sizeof(s_tally) + symbol_count * sizeof(uint64_t));
+
+  for (index = 0; workers && index < thread_count; index++) {
+    workers[index].analysis = &analysis;
+    workers[index].tally = calloc(1, sizeof(s_tally) + symbol_count * sizeof(uint64_t));
+    result = result && workers[index].tally;
+  }
+
+  if (!workers || !threads || !total || !result) {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (index = 0; index < thread_count; index++) {
+    if (pthread_create(&threads[index], NULL, worker_run, &workers[index])) {
+      break;
+    }
+    started++;
+  }
+
+  /* If no thread started, work alone */
+  if (!started) {
+    worker_run(&workers[0]);
+  }
+
+  for (index = 0; index < started; index++) {
+    pthread_join(threads[index], NULL);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  for (index = 0; index < thread_count; index++) {
+    merge_tally(total, workers[index].tally, symbol_count);
+    free(workers[index].tally);
+  }
+
+  pairs = (double) (analysis.sample_count - total->failures);
+
+  printf("%zu samples, year %s, %zu chars passwords of %zu symbols, %s engine\n\n",
+         analysis.sample_count, year, analysis.length, analysis.alphabet_size,
+         get_engine_name(get_generation_engine()));
+
+  if (total->failures) {
+    printf("%llu samples failed to generate\n\n", (unsigned long long) total->failures);
+  }
+
+  print_distribution(&analysis, total);
+  printf("\n");
+  print_avalanche(&analysis, total);
+
+  printf("\nCross-domain correlation                         rate      ideal         z\n");
+  print_rate("same symbol at the same position", (double) total->cross_matches,
+             pairs * (double) analysis.length, 1.0 / (double) analysis.alphabet_size);
+  print_rate("symbol offset kept, other master", (double) total->cross_stable,
+             pairs * (double) analysis.length, 1.0 / (double) analysis.alphabet_size);
+
+  printf("\nCategory retries\n");
+  printf("  passwords with extension rounds %10.4f %%\n", 100.0 * (double) total->retried / pairs);
+  printf("  extension rounds per password   %10.4f\n", (double) total->extension_rounds / pairs);
+  printf("  ITERATION_MAX reached           %10llu\n", (unsigned long long) total->iteration_max);
+  printf("  passwords missing a category    %10llu\n",
+         (unsigned long long) total->missing_categories);
+
+  fprintf(stderr, "%.0f generations in %.3f s (%.0f generations/s, %zu threads)\n",
+          (double) analysis.sample_count * 6.0, seconds,
+          (double) analysis.sample_count * 6.0 / seconds, started ? started : 1);
+
+  result = !total->failures;
+  free(total);
+  free(workers);
+  free(threads);
+
+  return result ? 0 : 1;
+}
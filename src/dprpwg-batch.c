@@ -0,0 +1,1300 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* This is a headless, multithreaded client for dprpwg.
+ *
+ * It reads a list of records, one per line:
+ *     <domain> [<categories> [<size>]]
+ * where <categories> is any combination of the letters l (lower case), u
+ * (upper case), d (digits) and s (symbols), "luds" by default, and <size>
+ * a fixed password size, 0 (not fixed) by default. Empty lines and lines
+ * starting with '#' are ignored.
+ *
+ * It writes one "<domain> <password>" line per record, in input order.
+ *
+ * Given a range of years and/or a list of sizes, it generates all of their
+ * combinations for every record, and writes "<domain> <year> <size>
+ * <password>" lines instead.
+ *
+ * The input is processed as a stream, one window of records at a time:
+ * files are memory-mapped and split in place (pages are given back once
+ * their records are written), pipes are read through a fixed buffer.
+ * The worker threads live for the whole run: while they generate a window
+ * and format its output lines (or fixed-size binary records, see
+ * s_binary_record), the main thread writes the previous window and parses
+ * the next one. Memory use does not depend on the input size.
+ *
+ * With a key stretching cost, the master password is stretched once, on
+ * all the threads, and the key is used for every record. */
+
+#define _DEFAULT_SOURCE /* madvise() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_tools.h"
+
+/* Number of records a worker takes at once */
+#define CHUNK_SIZE 256U
+
+/* Number of passwords generated per window of records */
+#define WINDOW_PASSWORDS 16384U
+
+/* Input buffer size, when the input cannot be mapped. Also the maximum
+ * line length in that case. */
+#define INPUT_BUFFER_SIZE (4U << 20)
+
+/* Output buffer size */
+#define OUTPUT_BUFFER_SIZE (1U << 20)
+
+/* Binary output file identification, see s_binary_header */
+#define BINARY_MAGIC "DPRPWGB1"
+
+/* Longest master password we read */
+#define MASTER_PASSWORD_MAXLENGTH 1024U
+
+/* Maximum number of years, and of sizes, of a sweep */
+#define SWEEP_MAX 256U
+
+/* Longest year string */
+#define YEAR_MAXLENGTH 16U
+
+/* Longest " <year> <size>" of a sweep output line */
+#define SWEEP_FIELDS_MAXLENGTH (YEAR_MAXLENGTH + 22U)
+
+/* ---- Internal function declarations ---- */
+
+/* Print the command line help */
+static void usage(const char *program);
+
+/* The input: a memory-mapped file, or a buffer refilled from a pipe.
+ * [position, lines_end) holds complete lines not parsed yet. */
+typedef struct {
+  int fd;
+  char *data;
+  size_t size;
+  size_t capacity;    /* Buffer size, 0 if mapped */
+  size_t position;
+  size_t lines_end;
+  size_t written;     /* Offset of the lines whose output is written */
+  size_t released;    /* Mapped bytes given back to the system */
+  int eof;
+} s_input;
+
+/* Open the input file (or stdin if path is NULL) */
+static int open_input(const char *path, s_input *input);
+
+/* Get the next complete lines of the input, split in place by
+ * parse_records(). Mapped lines stay in place, and their pages are given
+ * back once before 'written'. Buffered lines are moved by a refill, see
+ * refill_pending(). Return FALSE on error; '*size' is zero at the end of
+ * the input. */
+static int fill_input(s_input *input, char **text, size_t *size);
+
+/* TRUE if the next fill_input() refills the buffer: the previous lines
+ * must not be used any more */
+static int refill_pending(const s_input *input);
+
+/* Unmap or free the input, and close it */
+static void close_input(s_input *input, const char *path);
+
+/* One window of records to generate passwords for. Domains point inside
+ * the input. */
+typedef struct {
+  const char **domains;
+  unsigned int *flags;
+  size_t *fixed_sizes;
+  size_t *lines;
+  size_t count;
+  size_t capacity;
+} s_records;
+
+/* Split complete lines of input in records, until the records are full.
+ * '*consumed' is the number of bytes parsed, '*line_number' the number of
+ * the last line. Return FALSE on syntax error. */
+static int parse_records(char *text, size_t size, size_t *consumed, s_records *records,
+                         size_t *line_number);
+
+/* Parse "<year>" or "<first>-<last>" into a list of years */
+static int parse_years(const char *range, char years[][YEAR_MAXLENGTH], size_t *count);
+
+/* Parse a comma separated list of sizes and size ranges ("8,12-16") */
+static int parse_sizes(const char *list, size_t *sizes, size_t *count);
+
+/* Chunks of records still to be generated by one worker: [next, end) */
+typedef struct {
+  pthread_mutex_t lock;
+  size_t next;
+  size_t end;
+} s_worker_queue;
+
+/* One window of records, with their passwords and their formatted output.
+ * Two windows are used in turn: while the workers generate one, the main
+ * thread writes the previous one and parses the next one. */
+typedef struct {
+  s_records records;
+
+  /* Passwords of record r from output + r * per_record * output_stride */
+  char *output;
+  size_t output_stride;
+
+  /* Output of chunk c, formatted by its worker: text_sizes[c] bytes from
+   * text + text_offsets[c] */
+  char *text;
+  size_t text_capacity;
+  size_t *text_offsets;
+  size_t *text_sizes;
+
+  size_t chunk_count;
+  size_t input_end;   /* Input offset after the last line of the window */
+  int result;
+} s_window;
+
+/* Everything the workers share. The workers live as long as the pool, and
+ * wait for a window between two. */
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t window_ready;
+  pthread_cond_t window_done;
+  s_window *window;           /* Window being generated, NULL if none */
+  size_t window_number;       /* Incremented for every window */
+  size_t busy;                /* Workers still on the window */
+  int stop;
+
+  s_worker_queue *queues;
+  size_t worker_count;
+  const char *password;
+
+  /* Years, and fixed sizes overriding the record ones (if size_count > 0) */
+  const char * const *years;
+  size_t year_count;
+  const size_t *sizes;
+  size_t size_count;
+  size_t per_record;
+
+  int binary;                 /* Binary records instead of text lines */
+} s_pool;
+
+/* One worker thread */
+typedef struct {
+  s_pool *pool;
+  size_t index;
+  pthread_t thread;
+} s_worker;
+
+/* Allocate the records, passwords and output chunks of a window */
+static int alloc_window(s_window *window, size_t capacity, size_t per_record);
+
+/* Wipe and free a window */
+static void free_window(s_window *window, size_t per_record);
+
+/* Set the password slots and the output chunks of a freshly parsed
+ * window. Return FALSE if out of memory. */
+static int layout_window(const s_pool *pool, s_window *window);
+
+/* Start 'worker_count' threads waiting for windows. Return the number of
+ * threads started: if not all, the others take over their share. */
+static size_t start_pool(s_pool *pool, s_worker *workers, size_t worker_count);
+
+/* Stop and join the 'started' first threads */
+static void stop_pool(s_pool *pool, s_worker *workers, size_t started);
+
+/* Hand a window over to the workers, or generate it right away if no
+ * thread could be started */
+static void start_window(s_pool *pool, s_window *window, size_t started);
+
+/* Wait for the workers to be done with the window. Return FALSE if a
+ * password could not be generated. */
+static int finish_window(s_pool *pool, s_window *window);
+
+/* Worker thread main function */
+static void *worker_run(void *data);
+
+/* Generate and format the chunks of a window, our own queue first.
+ * Return FALSE if a password could not be generated. */
+static int run_chunks(s_pool *pool, s_window *window, size_t index);
+
+/* Take the next chunk of our own queue */
+static int take_chunk(s_worker_queue *queue, size_t *chunk);
+
+/* Steal half of the remaining chunks of another worker */
+static int steal_chunks(s_pool *pool, size_t thief);
+
+/* Generate the passwords of one chunk of records */
+static int generate_chunk(const s_pool *pool, s_window *window, size_t chunk);
+
+/* Output, through a buffer written when full */
+typedef struct {
+  int fd;
+  char *buffer;
+  size_t used;
+  int error;
+} s_writer;
+
+/* Append to the output */
+static void put_output(s_writer *writer, const void *data, size_t size);
+
+/* Write the buffered output, and wipe the buffer. Return FALSE if any
+ * write failed. */
+static int flush_output(s_writer *writer);
+
+/* Write straight to the output, with no buffering */
+static void write_output(s_writer *writer, const char *data, size_t size);
+
+/* Binary output header */
+typedef struct {
+  char magic[8];              /* BINARY_MAGIC, not null-terminated */
+  uint32_t record_size;       /* sizeof(s_binary_record) */
+  uint32_t password_width;    /* OUTPUT_MAX_LENGTH */
+  uint32_t reserved[4];
+} s_binary_header;
+
+/* Binary output record, one per password, in output order. All integers
+ * are in host byte order. */
+typedef struct {
+  uint64_t line;              /* Input line of the record */
+  uint16_t year;              /* Numeric value of the year, 0 if not a number
+                               * up to 65535 */
+  uint16_t fixed_size;        /* Fixed size asked, 0 if none */
+  uint16_t length;            /* Password length */
+  uint16_t reserved;
+  char password[OUTPUT_MAX_LENGTH];  /* Null-padded, not terminated if full */
+} s_binary_record;
+
+/* Format the results of one chunk of records, in input order */
+static void format_chunk(const s_pool *pool, s_window *window, size_t chunk);
+
+/* Year field of a binary record: 0 if 'year' is not a number that fits */
+static uint16_t get_record_year(const char *year);
+
+/* Write the formatted output of a window */
+static int write_window(s_writer *writer, const s_window *window);
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [-p password_file] [-y year[-last]] [-s sizes] [-j threads] [-e engine]\n"
+          "          [-k cost] [-b] [input [output]]\n"
+          "       %s [-j threads] -K seconds\n"
+          "  -p  Read the master password from the first line of this file.\n"
+          "      By default, it is asked on the terminal.\n"
+          "  -y  Year (default: current year), or range of years.\n"
+          "  -s  Fixed sizes to generate for every record, overriding theirs.\n"
+          "      Comma separated sizes or ranges, e.g. 8,12-16. 0 is the default.\n"
+          "  With a range of years or -s, every combination is generated, and\n"
+          "  the output lines are: <domain> <year> <size> <password>\n"
+          "  -j  Number of threads (default: number of cores).\n"
+          "  -e  Generation engine: reference, closed-form (default) or checked.\n"
+          "  -k  Key stretching cost, %u to %u: the master password is stretched\n"
+          "      with 2^cost KiB of memory first. Default: none.\n"
+          "  -K  Print the highest key stretching cost taking at most this many\n"
+          "      seconds here (e.g. 0.25), and exit.\n"
+          "  -b  Binary output: fixed-size records, see the README.\n"
+          "Input records, one per line: <domain> [<categories> [<size>]]\n"
+          "  categories: any of l (lower case), u (upper case), d (digits),\n"
+          "              s (symbols). Default: luds.\n"
+          "  size:       fixed password size. Default: 0 (not fixed).\n",
+          program, program, STRETCH_COST_MIN, STRETCH_COST_MAX);
+}
+
+int open_input(const char *path, s_input *input)
+{
+  struct stat status;
+
+  memset(input, 0, sizeof(*input));
+  input->fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+
+  if (input->fd < 0) {
+    perror(path);
+    return FALSE;
+  }
+
+  /* Map regular files. Lines are split in place in private pages: the
+   * last line needs a null char after it, in the last page. A file filling
+   * its last page, without a final newline, has no room for it. */
+  if (!fstat(input->fd, &status) && S_ISREG(status.st_mode) && status.st_size > 0) {
+    input->size = (size_t) status.st_size;
+    input->data = mmap(NULL, input->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, input->fd, 0);
+
+    if (input->data == MAP_FAILED) {
+      input->data = NULL;
+    } else if (!(input->size % (size_t) sysconf(_SC_PAGESIZE))
+               && input->data[input->size - 1] != '\n') {
+      munmap(input->data, input->size);
+      input->data = NULL;
+    } else {
+      madvise(input->data, input->size, MADV_SEQUENTIAL);
+      input->lines_end = input->size;
+      input->eof = TRUE;
+      return TRUE;
+    }
+  }
+
+  /* Anything else is read through a buffer */
+  input->size = 0;
+  input->capacity = INPUT_BUFFER_SIZE;
+  input->data = malloc(input->capacity + 1);
+
+  if (!input->data) {
+    fputs("Out of memory\n", stderr);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int fill_input(s_input *input, char **text, size_t *size)
+{
+  if (input->position >= input->lines_end && !input->eof) {
+    ssize_t chunk;
+
+    /* Keep the partial line, and read more after it */
+    memmove(input->data, input->data + input->position, input->size - input->position);
+    input->size -= input->position;
+    input->position = 0;
+
+    while (!input->eof && input->size < input->capacity) {
+      chunk = read(input->fd, input->data + input->size, input->capacity - input->size);
+
+      if (chunk < 0 && errno != EINTR) {
+        perror("read");
+        return FALSE;
+      }
+
+      input->eof = !chunk;
+      input->size += chunk > 0 ? (size_t) chunk : 0;
+    }
+
+    /* Complete lines only, unless it is the end */
+    input->lines_end = input->size;
+
+    while (!input->eof && input->lines_end && input->data[input->lines_end - 1] != '\n') {
+      input->lines_end--;
+    }
+
+    if (!input->lines_end && input->size) {
+      fprintf(stderr, "Line longer than %u bytes\n", INPUT_BUFFER_SIZE);
+      return FALSE;
+    }
+
+    input->data[input->size] = '\0';
+  }
+
+  /* Mapped input: give back the pages of the records already written */
+  if (!input->capacity) {
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t release = input->written / page_size * page_size;
+
+    if (release > input->released) {
+      madvise(input->data + input->released, release - input->released, MADV_DONTNEED);
+      input->released = release;
+    }
+  }
+
+  *text = input->data + input->position;
+  *size = input->lines_end - input->position;
+
+  return TRUE;
+}
+
+int refill_pending(const s_input *input)
+{
+  return input->capacity && input->position >= input->lines_end && !input->eof;
+}
+
+void close_input(s_input *input, const char *path)
+{
+  if (input->capacity) {
+    free(input->data);
+  } else if (input->data) {
+    munmap(input->data, input->size);
+  }
+
+  if (path && input->fd >= 0) {
+    close(input->fd);
+  }
+}
+
+int parse_years(const char *range, char years[][YEAR_MAXLENGTH], size_t *count)
+{
+  char *end;
+  long first, last;
+
+  first = strtol(range, &end, 10);
+
+  /* Not a number: a single year, given as is to the library */
+  if (end == range || (*end && *end != '-')) {
+    snprintf(years[0], YEAR_MAXLENGTH, "%s", range);
+    *count = 1;
+    return TRUE;
+  }
+
+  last = *end ? strtol(end + 1, &end, 10) : first;
+
+  if (*end || last < first || last - first >= (long) SWEEP_MAX) {
+    fprintf(stderr, "Invalid year range \"%s\" (up to %u years)\n", range, SWEEP_MAX);
+    return FALSE;
+  }
+
+  for (*count = 0; first <= last; first++) {
+    snprintf(years[(*count)++], YEAR_MAXLENGTH, "%ld", first);
+  }
+
+  return TRUE;
+}
+
+int parse_sizes(const char *list, size_t *sizes, size_t *count)
+{
+  const char *item = list;
+  char *end;
+
+  *count = 0;
+
+  for (;;) {
+    unsigned long first = strtoul(item, &end, 10), last = first;
+
+    if (end != item && *end == '-') {
+      item = end + 1;
+      last = strtoul(item, &end, 10);
+    }
+
+    if (end == item || (*end && *end != ',') || last < first || last > OUTPUT_MAX_LENGTH
+        || *count + (last - first) >= SWEEP_MAX) {
+      fprintf(stderr, "Invalid size list \"%s\" (sizes 0 to %u, up to %u sizes)\n",
+              list, OUTPUT_MAX_LENGTH, SWEEP_MAX);
+      return FALSE;
+    }
+
+    for (; first <= last; first++) {
+      sizes[(*count)++] = first;
+    }
+
+    if (!*end) {
+      return TRUE;
+    }
+
+    item = end + 1;
+  }
+}
+
+int parse_records(char *text, size_t size, size_t *consumed, s_records *records,
+                  size_t *line_number)
+{
+  size_t seek = 0;
+
+  records->count = 0;
+  *consumed = 0;
+
+  while (seek < size && records->count < records->capacity) {
+    char *line = text + seek, *line_end, *domain, *categories, *fixed_size, *end;
+    const char *separators = " \t\r";
+
+    /* The last line may not end with '\n': there is room for a null char */
+    line_end = memchr(line, '\n', size - seek);
+    line_end = line_end ? line_end : text + size;
+    *line_end = '\0';
+    seek = (size_t) (line_end - text) + 1;
+    (*line_number)++;
+
+    domain = strtok(line, separators);
+
+    if (!domain || domain[0] == '#') {
+      continue;
+    }
+
+    categories = strtok(NULL, separators);
+    fixed_size = strtok(NULL, separators);
+
+    records->domains[records->count] = domain;
+    records->lines[records->count] = *line_number;
+    records->flags[records->count] = FLAG_LOW_AVAIL | FLAG_UPP_AVAIL
+                                     | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL;
+    records->fixed_sizes[records->count] = 0;
+
+    if (categories && !parse_categories(categories, &records->flags[records->count])) {
+      fprintf(stderr, "Line %zu: invalid symbol categories \"%s\"\n", *line_number, categories);
+      return FALSE;
+    }
+
+    if (fixed_size) {
+      records->fixed_sizes[records->count] = strtoul(fixed_size, &end, 10);
+
+      if (*end || records->fixed_sizes[records->count] > OUTPUT_MAX_LENGTH) {
+        fprintf(stderr, "Line %zu: invalid size \"%s\" (0 to %u)\n",
+                *line_number, fixed_size, OUTPUT_MAX_LENGTH);
+        return FALSE;
+      }
+    }
+
+    if (strtok(NULL, separators)) {
+      fprintf(stderr, "Line %zu: too many fields\n", *line_number);
+      return FALSE;
+    }
+
+    records->count++;
+  }
+
+  *consumed = seek < size ? seek : size;
+
+  return TRUE;
+}
+
+int alloc_window(s_window *window, size_t capacity, size_t per_record)
+{
+  const size_t chunk_count = (capacity + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+  memset(window, 0, sizeof(*window));
+  window->records.capacity = capacity;
+  window->records.domains = malloc(capacity * sizeof(char *));
+  window->records.flags = malloc(capacity * sizeof(unsigned int));
+  window->records.fixed_sizes = malloc(capacity * sizeof(size_t));
+  window->records.lines = malloc(capacity * sizeof(size_t));
+  window->output = malloc(capacity * per_record * (OUTPUT_MAX_LENGTH + 1));
+  window->text_offsets = malloc(chunk_count * sizeof(size_t));
+  window->text_sizes = malloc(chunk_count * sizeof(size_t));
+
+  return window->records.domains && window->records.flags && window->records.fixed_sizes
+         && window->records.lines && window->output && window->text_offsets
+         && window->text_sizes;
+}
+
+void free_window(s_window *window, size_t per_record)
+{
+  /* Both hold passwords */
+  if (window->output) {
+    memset(window->output, 0, window->records.capacity * per_record * (OUTPUT_MAX_LENGTH + 1));
+  }
+
+  if (window->text) {
+    memset(window->text, 0, window->text_capacity);
+  }
+
+  free(window->records.domains);
+  free(window->records.flags);
+  free(window->records.fixed_sizes);
+  free(window->records.lines);
+  free(window->output);
+  free(window->text);
+  free(window->text_offsets);
+  free(window->text_sizes);
+}
+
+int layout_window(const s_pool *pool, s_window *window)
+{
+  const s_records *records = &window->records;
+  const int sweep = pool->per_record > 1 || pool->size_count;
+  size_t record, year, size, max_length = 0, text_size = 0;
+
+  /* One fixed-size slot per password, large enough for the longest one */
+  for (year = 0; year < pool->year_count; year++) {
+    for (record = 0; record < (pool->size_count ? 1 : records->count); record++) {
+      for (size = 0; size < (pool->size_count ? pool->size_count : 1); size++) {
+        size_t length = get_password_length(pool->years[year],
+                                            pool->size_count ? pool->sizes[size]
+                                                             : records->fixed_sizes[record]);
+        max_length = length > max_length ? length : max_length;
+      }
+    }
+  }
+
+  window->output_stride = max_length + 1;
+  window->chunk_count = (records->count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  window->result = TRUE;
+
+  /* Room for the output of each chunk: binary records, or
+   * "<domain>[ <year> <size>] <password>\n" lines */
+  for (record = 0; record < records->count; record++) {
+    if (!(record % CHUNK_SIZE)) {
+      window->text_offsets[record / CHUNK_SIZE] = text_size;
+    }
+
+    text_size += pool->per_record
+                 * (pool->binary ? sizeof(s_binary_record)
+                                 : strlen(records->domains[record]) + max_length + 2
+                                   + (sweep ? SWEEP_FIELDS_MAXLENGTH : 0));
+  }
+
+  if (text_size > window->text_capacity) {
+    if (window->text) {
+      memset(window->text, 0, window->text_capacity);
+      free(window->text);
+    }
+
+    window->text = malloc(text_size);
+    window->text_capacity = window->text ? text_size : 0;
+  }
+
+  return window->text != NULL;
+}
+
+size_t start_pool(s_pool *pool, s_worker *workers, size_t worker_count)
+{
+  size_t index, started = 0;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->window_ready, NULL);
+  pthread_cond_init(&pool->window_done, NULL);
+  pool->window = NULL;
+  pool->window_number = 0;
+  pool->busy = 0;
+  pool->stop = FALSE;
+  pool->worker_count = worker_count;
+
+  for (index = 0; index < worker_count; index++) {
+    pthread_mutex_init(&pool->queues[index].lock, NULL);
+    workers[index].pool = pool;
+    workers[index].index = index;
+  }
+
+  for (index = 0; index < worker_count; index++) {
+    if (pthread_create(&workers[index].thread, NULL, worker_run, &workers[index])) {
+      break;
+    }
+    started++;
+  }
+
+  return started;
+}
+
+void stop_pool(s_pool *pool, s_worker *workers, size_t started)
+{
+  size_t index;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = TRUE;
+  pthread_cond_broadcast(&pool->window_ready);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (index = 0; index < started; index++) {
+    pthread_join(workers[index].thread, NULL);
+  }
+
+  for (index = 0; index < pool->worker_count; index++) {
+    pthread_mutex_destroy(&pool->queues[index].lock);
+  }
+
+  pthread_cond_destroy(&pool->window_done);
+  pthread_cond_destroy(&pool->window_ready);
+  pthread_mutex_destroy(&pool->lock);
+}
+
+void start_window(s_pool *pool, s_window *window, size_t started)
+{
+  size_t index;
+
+  /* Each worker starts with a contiguous share of the chunks. They are
+   * all waiting: no queue is in use. */
+  for (index = 0; index < pool->worker_count; index++) {
+    pool->queues[index].next = window->chunk_count * index / pool->worker_count;
+    pool->queues[index].end = window->chunk_count * (index + 1) / pool->worker_count;
+  }
+
+  if (!started) {
+    window->result = run_chunks(pool, window, 0);
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->window = window;
+  pool->window_number++;
+  pool->busy = started;
+  pthread_cond_broadcast(&pool->window_ready);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+int finish_window(s_pool *pool, s_window *window)
+{
+  pthread_mutex_lock(&pool->lock);
+
+  while (pool->busy) {
+    pthread_cond_wait(&pool->window_done, &pool->lock);
+  }
+
+  pool->window = NULL;
+  pthread_mutex_unlock(&pool->lock);
+
+  return window->result;
+}
+
+void *worker_run(void *data)
+{
+  s_worker *worker = (s_worker *) data;
+  s_pool *pool = worker->pool;
+  s_window *window;
+  size_t window_number = 0;
+  int result;
+
+  pthread_mutex_lock(&pool->lock);
+
+  for (;;) {
+    while (!pool->stop && pool->window_number == window_number) {
+      pthread_cond_wait(&pool->window_ready, &pool->lock);
+    }
+
+    if (pool->stop) {
+      break;
+    }
+
+    window_number = pool->window_number;
+    window = pool->window;
+    pthread_mutex_unlock(&pool->lock);
+
+    result = run_chunks(pool, window, worker->index);
+
+    /* The last one out wakes the main thread up */
+    pthread_mutex_lock(&pool->lock);
+    window->result = window->result && result;
+
+    if (!--pool->busy) {
+      pthread_cond_signal(&pool->window_done);
+    }
+  }
+
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+
+int run_chunks(s_pool *pool, s_window *window, size_t index)
+{
+  size_t chunk;
+  int result = TRUE;
+
+  /* Our own queue first, then refill it from the others until all is done */
+  do {
+    while (take_chunk(&pool->queues[index], &chunk)) {
+      result = generate_chunk(pool, window, chunk) && result;
+      format_chunk(pool, window, chunk);
+    }
+  } while (steal_chunks(pool, index));
+
+  return result;
+}
+
+int take_chunk(s_worker_queue *queue, size_t *chunk)
+{
+  int found = FALSE;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if (queue->next < queue->end) {
+    *chunk = queue->next++;
+    found = TRUE;
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return found;
+}
+
+int steal_chunks(s_pool *pool, size_t thief)
+{
+  size_t offset;
+
+  /* Visit the other workers, starting with our neighbour */
+  for (offset = 1; offset < pool->worker_count; offset++) {
+    s_worker_queue *victim = &pool->queues[(thief + offset) % pool->worker_count];
+    size_t begin = 0, end = 0;
+
+    pthread_mutex_lock(&victim->lock);
+
+    if (victim->next < victim->end) {
+      /* Take the upper half, rounded up so the last chunk can be stolen */
+      begin = victim->next + (victim->end - victim->next) / 2;
+      end = victim->end;
+      victim->end = begin;
+    }
+
+    pthread_mutex_unlock(&victim->lock);
+
+    if (begin < end) {
+      s_worker_queue *own = &pool->queues[thief];
+
+      pthread_mutex_lock(&own->lock);
+      own->next = begin;
+      own->end = end;
+      pthread_mutex_unlock(&own->lock);
+
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+int generate_chunk(const s_pool *pool, s_window *window, size_t chunk)
+{
+  const s_records *records = &window->records;
+  const size_t first = chunk * CHUNK_SIZE;
+  const size_t count = records->count - first < CHUNK_SIZE ? records->count - first : CHUNK_SIZE;
+  size_t record;
+  int result = TRUE;
+
+  /* One password per record: the whole chunk at once */
+  if (pool->per_record == 1 && !pool->size_count) {
+    return generate_password_batch(pool->password, pool->years[0],
+                                   records->domains + first, records->flags + first,
+                                   records->fixed_sizes + first, count,
+                                   window->output + first * window->output_stride,
+                                   window->output_stride);
+  }
+
+  /* Sweep: all years and sizes of one record at once */
+  for (record = first; record < first + count; record++) {
+    if (!generate_password_sweep(pool->password, records->domains[record],
+                                 pool->years, pool->year_count,
+                                 pool->size_count ? pool->sizes : &records->fixed_sizes[record],
+                                 pool->size_count ? pool->size_count : 1,
+                                 records->flags[record],
+                                 window->output + record * pool->per_record * window->output_stride,
+                                 window->output_stride)) {
+      result = FALSE;
+    }
+  }
+
+  return result;
+}
+
+void put_output(s_writer *writer, const void *data, size_t size)
+{
+  if (writer->used + size > OUTPUT_BUFFER_SIZE) {
+    flush_output(writer);
+  }
+
+  /* Larger than the buffer: straight out */
+  if (size > OUTPUT_BUFFER_SIZE) {
+    write_output(writer, data, size);
+    return;
+  }
+
+  memcpy(writer->buffer + writer->used, data, size);
+  writer->used += size;
+}
+
+int flush_output(s_writer *writer)
+{
+  write_output(writer, writer->buffer, writer->used);
+
+  /* The buffer holds passwords */
+  memset(writer->buffer, 0, writer->used);
+  writer->used = 0;
+
+  return !writer->error;
+}
+
+void write_output(s_writer *writer, const char *data, size_t size)
+{
+  size_t written = 0;
+
+  while (written < size && !writer->error) {
+    ssize_t chunk = write(writer->fd, data + written, size - written);
+
+    if (chunk < 0 && errno != EINTR) {
+      perror("write");
+      writer->error = TRUE;
+    }
+
+    written += chunk > 0 ? (size_t) chunk : 0;
+  }
+}
+
+void format_chunk(const s_pool *pool, s_window *window, size_t chunk)
+{
+  const s_records *records = &window->records;
+  const size_t first = chunk * CHUNK_SIZE;
+  const size_t last = records->count - first < CHUNK_SIZE ? records->count : first + CHUNK_SIZE;
+  const char *output = window->output + first * pool->per_record * window->output_stride;
+  char *text = window->text + window->text_offsets[chunk], *seek = text;
+  size_t record, year, size, length;
+  s_binary_record binary_record;
+  char numbers[64];
+
+  for (record = first; record < last; record++) {
+    for (year = 0; year < pool->year_count; year++) {
+      for (size = 0; size < (pool->size_count ? pool->size_count : 1); size++) {
+        const size_t fixed_size = pool->size_count ? pool->sizes[size]
+                                                   : records->fixed_sizes[record];
+        const size_t password_length = strlen(output);
+
+        if (pool->binary) {
+          memset(&binary_record, 0, sizeof(binary_record));
+          binary_record.line = records->lines[record];
+          binary_record.year = get_record_year(pool->years[year]);
+          binary_record.fixed_size = (uint16_t) fixed_size;
+          binary_record.length = (uint16_t) password_length;
+          memcpy(binary_record.password, output, password_length);
+          memcpy(seek, &binary_record, sizeof(binary_record));
+          seek += sizeof(binary_record);
+        } else {
+          length = strlen(records->domains[record]);
+          memcpy(seek, records->domains[record], length);
+          seek += length;
+
+          if (pool->per_record > 1 || pool->size_count) {
+            length = (size_t) snprintf(numbers, sizeof(numbers), " %s %zu",
+                                       pool->years[year], fixed_size);
+            memcpy(seek, numbers, length);
+            seek += length;
+          }
+
+          *seek++ = ' ';
+          memcpy(seek, output, password_length);
+          seek += password_length;
+          *seek++ = '\n';
+        }
+
+        output += window->output_stride;
+      }
+    }
+  }
+
+  window->text_sizes[chunk] = (size_t) (seek - text);
+
+  memset(&binary_record, 0, sizeof(binary_record));
+}
+
+uint16_t get_record_year(const char *year)
+{
+  unsigned long value;
+  char *end;
+
+  /* strtoul() would take signs and spaces */
+  if (*year < '0' || *year > '9') {
+    return 0;
+  }
+
+  errno = 0;
+  value = strtoul(year, &end, 10);
+
+  return !errno && !*end && value <= UINT16_MAX ? (uint16_t) value : 0;
+}
+
+int write_window(s_writer *writer, const s_window *window)
+{
+  size_t chunk;
+
+  for (chunk = 0; chunk < window->chunk_count; chunk++) {
+    put_output(writer, window->text + window->text_offsets[chunk], window->text_sizes[chunk]);
+  }
+
+  return !writer->error;
+}
+
+int main(int argc, char *argv[])
+{
+  char password[MASTER_PASSWORD_MAXLENGTH];
+  char years[SWEEP_MAX][YEAR_MAXLENGTH];
+  const char *year_list[SWEEP_MAX];
+  size_t sizes[SWEEP_MAX];
+  const char *password_path = NULL, *input_path = NULL, *output_path = NULL;
+  size_t thread_count = 0, year, text_size = 0, consumed, capacity, started = 0;
+  size_t year_count = 1, size_count = 0, password_count = 0, line_number = 0;
+  char *text;
+  s_input input;
+  s_window windows[2], *current = NULL, *next;
+  s_pool pool;
+  s_worker *workers;
+  s_writer writer;
+  unsigned int engine;
+  struct timespec start, end;
+  s_generation_counters counters;
+  double seconds, stretch_budget = 0.0;
+  unsigned int stretch_cost = 0;
+  int option, result, parsed, done = FALSE, pool_running = FALSE, binary = FALSE;
+
+  /* Default year: the current one */
+  {
+    time_t time_value = time(NULL);
+    struct tm *time_data = localtime(&time_value);
+    snprintf(years[0], YEAR_MAXLENGTH, "%d", time_data->tm_year + 1900);
+  }
+
+  set_generation_engine(ENGINE_CLOSED_FORM);
+
+  while ((option = getopt(argc, argv, "p:y:s:j:e:k:K:bh")) != -1) {
+    switch (option) {
+      case 'p':
+        password_path = optarg;
+        break;
+      case 'y':
+        if (!parse_years(optarg, years, &year_count)) {
+          return 1;
+        }
+        break;
+      case 's':
+        if (!parse_sizes(optarg, sizes, &size_count)) {
+          return 1;
+        }
+        break;
+      case 'j':
+        thread_count = strtoul(optarg, NULL, 10);
+        break;
+      case 'e':
+        if (!parse_engine(optarg, &engine)) {
+          usage(argv[0]);
+          return 1;
+        }
+        set_generation_engine(engine);
+        break;
+      case 'k':
+        stretch_cost = (unsigned int) strtoul(optarg, NULL, 10);
+        if (stretch_cost < STRETCH_COST_MIN || stretch_cost > STRETCH_COST_MAX) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'K':
+        stretch_budget = atof(optarg);
+        break;
+      case 'b':
+        binary = TRUE;
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind < argc) {
+    input_path = argv[optind++];
+  }
+
+  if (optind < argc) {
+    output_path = argv[optind++];
+  }
+
+  if (optind < argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (!thread_count) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cores > 0 ? (size_t) cores : 1;
+  }
+
+  set_stretch_threads((unsigned int) thread_count);
+
+  /* Key stretching calibration only */
+  if (stretch_budget > 0) {
+    stretch_cost = calibrate_stretch_cost(stretch_budget);
+
+    if (!stretch_cost) {
+      fputs("Out of memory\n", stderr);
+      return 1;
+    }
+
+    printf("%u\n", stretch_cost);
+    return 0;
+  }
+
+  /* Open the input first: the master password may come from the
+   * terminal, better ask it only once the input is known to exist */
+  if (!open_input(input_path, &input)) {
+    return 1;
+  }
+
+  if (!read_master_password(password_path, password, sizeof(password))) {
+    fputs("No master password\n", stderr);
+    close_input(&input, input_path);
+    return 1;
+  }
+
+  /* The stretched key replaces the master password */
+  if (stretch_cost) {
+    char key[STRETCH_KEY_LENGTH + 1];
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    result = stretch_master_password(password, stretch_cost, key, sizeof(key));
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    memcpy(password, key, sizeof(key));
+    memset(key, 0, sizeof(key));
+
+    if (result != GENERATE_OK) {
+      fputs("Out of memory\n", stderr);
+      memset(password, 0, sizeof(password));
+      close_input(&input, input_path);
+      return 1;
+    }
+
+    seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "Master password stretched in %.3f s (cost %u, %zu threads)\n",
+            seconds, stretch_cost, thread_count);
+  }
+
+  for (year = 0; year < year_count; year++) {
+    year_list[year] = years[year];
+  }
+
+  pool.password = password;
+  pool.years = year_list;
+  pool.year_count = year_count;
+  pool.sizes = sizes;
+  pool.size_count = size_count;
+  pool.per_record = year_count * (size_count ? size_count : 1);
+  pool.binary = binary;
+
+  /* Fixed-size working memory: two windows of records and passwords, and
+   * the output buffer */
+  capacity = pool.per_record < WINDOW_PASSWORDS ? WINDOW_PASSWORDS / pool.per_record : 1;
+  result = alloc_window(&windows[0], capacity, pool.per_record);
+  result = alloc_window(&windows[1], capacity, pool.per_record) && result;
+  pool.queues = calloc(thread_count, sizeof(s_worker_queue));
+  workers = calloc(thread_count, sizeof(s_worker));
+  writer.buffer = malloc(OUTPUT_BUFFER_SIZE);
+  writer.used = 0;
+  writer.error = FALSE;
+  writer.fd = output_path ? open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0600)
+                          : STDOUT_FILENO;
+
+  result = result && pool.queues && workers && writer.buffer;
+
+  if (!result) {
+    fputs("Out of memory\n", stderr);
+  } else if (writer.fd < 0) {
+    perror(output_path);
+    result = FALSE;
+  }
+
+  if (result && binary) {
+    s_binary_header header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BINARY_MAGIC, sizeof(header.magic));
+    header.record_size = sizeof(s_binary_record);
+    header.password_width = OUTPUT_MAX_LENGTH;
+    put_output(&writer, &header, sizeof(header));
+  }
+
+  /* The pipeline: while the workers generate a window, the previous one
+   * is written and the next one parsed */
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (result) {
+    started = start_pool(&pool, workers, thread_count);
+    pool_running = TRUE;
+  }
+
+  while (result && !done) {
+    next = current == &windows[0] ? &windows[1] : &windows[0];
+
+    /* Refilling the buffer moves the lines of the window in flight */
+    if (current && refill_pending(&input)) {
+      result = finish_window(&pool, current) && write_window(&writer, current);
+      password_count += current->records.count * pool.per_record;
+      input.written = current->input_end;
+      current = NULL;
+      continue;
+    }
+
+    next->records.count = 0;
+    parsed = fill_input(&input, &text, &text_size);
+
+    if (parsed && text_size) {
+      parsed = parse_records(text, text_size, &consumed, &next->records, &line_number);
+      input.position += consumed;
+      next->input_end = input.position;
+    }
+
+    if (parsed && next->records.count && !layout_window(&pool, next)) {
+      fputs("Out of memory\n", stderr);
+      parsed = FALSE;
+    }
+
+    /* Hand the next window over, then write the current one */
+    if (current) {
+      result = finish_window(&pool, current);
+    }
+
+    if (result && parsed && next->records.count) {
+      start_window(&pool, next, started);
+    }
+
+    if (current && result) {
+      result = write_window(&writer, current);
+      password_count += current->records.count * pool.per_record;
+      input.written = current->input_end;
+    }
+
+    current = parsed && next->records.count ? next : NULL;
+    done = parsed && !text_size;
+    result = result && parsed;
+  }
+
+  /* On error, the window in flight is not written */
+  if (current) {
+    finish_window(&pool, current);
+  }
+
+  if (pool_running) {
+    stop_pool(&pool, workers, started);
+  }
+
+  if (writer.buffer && writer.fd >= 0) {
+    result = flush_output(&writer) && result;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  memset(password, 0, sizeof(password));
+
+  if (output_path && writer.fd >= 0) {
+    result = !close(writer.fd) && result;
+  }
+
+  /* Throughput report */
+  seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(stderr, "%zu passwords in %.3f s (%.0f passwords/s, %zu threads)\n",
+          password_count, seconds, seconds > 0 ? (double) password_count / seconds : 0.0,
+          thread_count);
+
+  /* Degenerate inputs: the loop ran up to ITERATION_MAX, or the password
+   * lacks some requested symbol categories */
+  get_generation_counters(&counters);
+
+  if (counters.iteration_max_hits || counters.missing_categories) {
+    fprintf(stderr, "%llu passwords reached ITERATION_MAX, %llu lack a requested category\n",
+            (unsigned long long) counters.iteration_max_hits,
+            (unsigned long long) counters.missing_categories);
+  }
+
+  /* Cleanup */
+  free_window(&windows[0], pool.per_record);
+  free_window(&windows[1], pool.per_record);
+  free(pool.queues);
+  free(workers);
+  free(writer.buffer);
+  close_input(&input, input_path);
+
+  return result ? 0 : 1;
+}
@@ -0,0 +1,508 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Microbenchmark of the library: generate_password() and
+ * get_password_strength().
+ *
+ * The "profile" group compares the built-in constants (generate_password_r())
+ * to a hash profile loaded at run time (generate_password_profile()). Given
+ * the dprpwg_config.h the library was built with, both run the very same
+ * iterations.
+ *
+ * The "cache" group compares generate_password_ctx() with and without a
+ * result cache (see enable_password_cache()). The same domain is asked
+ * again and again: all the cached calls but the warm up ones are hits.
+ *
+ * Every case is run repeatedly for a minimum time, each call being timed.
+ * Results are written as CSV on the standard output, one line per case and
+ * engine, so runs can be compared with any spreadsheet or diff tool.
+ *
+ * Allocations are counted by wrapping malloc(), calloc() and realloc() at
+ * link time (see the Makefile "bench" target). */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_tools.h"
+
+/* Default minimum time spent on each case, in seconds */
+#define CASE_MIN_TIME 0.1
+
+/* Bounds of the number of timed calls of each case */
+#define CASE_MIN_CALLS 16U
+#define CASE_MAX_CALLS 200000U
+
+#define ALL_FLAGS (FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL)
+
+/* Benchmark year. 2026 gives 17 chars passwords. */
+#define BENCH_YEAR "2026"
+
+/* Result cache capacity of the "cache" group */
+#define BENCH_CACHE_CAPACITY 1024U
+
+/* Default profile file of the "profile" group: the built-in constants,
+ * when run from the top directory like "make bench" does */
+#define BENCH_PROFILE "src/dprpwg_config.h"
+
+/* One benchmark case */
+typedef struct {
+  const char *group;          /* What the case sweeps */
+  int strength;               /* TRUE to time get_password_strength() */
+  int context;                /* TRUE to time generate_password_ctx() */
+  int caller_buffers;         /* TRUE to time generate_password_r() */
+  int profile;                /* TRUE to time generate_password_profile() */
+  int cache;                  /* TRUE to enable the context result cache */
+  size_t password_length;
+  size_t domain_length;
+  unsigned int flags;
+  size_t fixed_size;
+} s_bench_case;
+
+/* Measures of one case */
+typedef struct {
+  size_t calls;
+  double ns_per_op;
+  double p50_ns;
+  double p99_ns;
+  double allocs_per_call;
+  s_generation_stats stats;   /* Of one generation, see generate_password_stats() */
+} s_bench_result;
+
+/* ---- Internal function declarations ---- */
+
+/* Allocation counter, updated by the malloc() wrappers */
+static size_t allocation_count = 0;
+
+/* Profile of the generate_password_profile() cases, see -P */
+static dprpwg_profile *bench_profile = NULL;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+void *__wrap_malloc(size_t size);
+void *__wrap_calloc(size_t count, size_t size);
+void *__wrap_realloc(void *pointer, size_t size);
+
+/* Print the command line help */
+static void usage(const char *program);
+
+/* Fill 'string' with 'length' printable chars, from a fixed seed */
+static void make_string(char *string, size_t length, unsigned int seed);
+
+/* Monotonic time in nanoseconds */
+static double now_ns(void);
+
+/* Sort helper for the latency samples */
+static int compare_doubles(const void *a, const void *b);
+
+/* Run one case with the current engine */
+static int run_case(const s_bench_case *bench_case, double min_time,
+                    double *samples, s_bench_result *result);
+
+/* Build the case list. Return the number of cases written in 'cases'. */
+static size_t make_cases(s_bench_case *cases, size_t max_cases);
+
+void *__wrap_malloc(size_t size)
+{
+  allocation_count++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+  allocation_count++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+  allocation_count++;
+  return __real_realloc(pointer, size);
+}
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [-e engine] [-t seconds] [-g group] [-P profile]\n"
+          "  -e  Only bench this engine: reference, closed-form or checked.\n"
+          "      Default: reference and closed-form.\n"
+          "  -t  Minimum time spent on each case (default: %.1f s).\n"
+          "  -g  Only run the cases of this group: password, context, domain,\n"
+          "      flags, size, pathological, strength, profile or cache.\n"
+          "  -P  Hash profile file of the profile group (default: %s).\n"
+          "Results are written as CSV on the standard output.\n",
+          program, CASE_MIN_TIME, BENCH_PROFILE);
+}
+
+void make_string(char *string, size_t length, unsigned int seed)
+{
+  static const char symbols[] = "abcdefghijklmnopqrstuvwxyz"
+                                "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                                "0123456789.-_!?";
+  unsigned int state = seed * 2654435761U + 1;
+  size_t seek;
+
+  for (seek = 0; seek < length; seek++) {
+    state = state * 1103515245U + 12345U;
+    string[seek] = symbols[(state >> 16) % (sizeof(symbols) - 1)];
+  }
+
+  string[length] = '\0';
+}
+
+double now_ns(void)
+{
+  struct timespec time_value;
+
+  clock_gettime(CLOCK_MONOTONIC, &time_value);
+
+  return (double) time_value.tv_sec * 1e9 + (double) time_value.tv_nsec;
+}
+
+int compare_doubles(const void *a, const void *b)
+{
+  const double value_a = *(const double *) a;
+  const double value_b = *(const double *) b;
+
+  return (value_a > value_b) - (value_a < value_b);
+}
+
+int run_case(const s_bench_case *bench_case, double min_time,
+             double *samples, s_bench_result *result)
+{
+  const size_t output_length = get_password_length(BENCH_YEAR, bench_case->fixed_size);
+  char *password = malloc(bench_case->password_length + 1);
+  char *domain = malloc(bench_case->domain_length + 1);
+  char *generated = malloc(output_length + 1);
+  uint16_t *hash = malloc(output_length * sizeof(uint16_t));
+  double start, total = 0.0;
+  size_t allocations = 0, call, strength_year = (size_t) atoi(BENCH_YEAR);
+  volatile double strength_sink = 0.0;
+  dprpwg_ctx *ctx = NULL;
+
+  if (!password || !domain || !generated || !hash) {
+    free(password);
+    free(domain);
+    free(generated);
+    free(hash);
+    return FALSE;
+  }
+
+  make_string(password, bench_case->password_length, 1);
+  make_string(domain, bench_case->domain_length, 2);
+
+  /* The context is built once, out of the timed calls */
+  if (bench_case->context) {
+    ctx = create_password_context(password);
+
+    if (!ctx || (bench_case->cache && !enable_password_cache(ctx, BENCH_CACHE_CAPACITY))) {
+      free_password_context(ctx);
+      free(password);
+      free(domain);
+      free(generated);
+      free(hash);
+      return FALSE;
+    }
+  }
+
+  /* What the hash loop does for this case. The strength cases score
+   * this generated password. */
+  if (bench_case->profile) {
+    generate_password_profile(bench_profile, password, domain, BENCH_YEAR,
+                              bench_case->fixed_size, bench_case->flags, generated,
+                              output_length + 1, hash, output_length, &result->stats);
+  } else {
+    generate_password_stats(password, domain, BENCH_YEAR, bench_case->fixed_size,
+                            bench_case->flags, generated, output_length + 1,
+                            hash, output_length, &result->stats);
+  }
+
+  /* Warm up caches and branch predictors */
+  for (call = 0; call < 2; call++) {
+    if (bench_case->strength) {
+      strength_sink += get_password_strength(generated, (unsigned int) strength_year,
+                                             bench_case->flags);
+    } else if (ctx) {
+      generate_password_ctx(ctx, domain, BENCH_YEAR, bench_case->fixed_size, bench_case->flags,
+                            generated, output_length + 1, hash, output_length, NULL);
+    } else if (bench_case->profile) {
+      generate_password_profile(bench_profile, password, domain, BENCH_YEAR,
+                                bench_case->fixed_size, bench_case->flags, generated,
+                                output_length + 1, hash, output_length, NULL);
+    } else if (bench_case->caller_buffers) {
+      generate_password_r(password, domain, BENCH_YEAR, bench_case->fixed_size,
+                          bench_case->flags, generated, output_length + 1,
+                          hash, output_length);
+    } else {
+      char *new_passwd;
+
+      generate_password(password, domain, BENCH_YEAR, bench_case->fixed_size,
+                        &new_passwd, bench_case->flags);
+      free(new_passwd);
+    }
+  }
+
+  for (call = 0; call < CASE_MAX_CALLS && (call < CASE_MIN_CALLS || total < min_time * 1e9); call++) {
+    size_t allocations_before = allocation_count;
+    char *new_passwd = NULL;
+
+    start = now_ns();
+
+    if (bench_case->strength) {
+      strength_sink += get_password_strength(generated, (unsigned int) strength_year,
+                                             bench_case->flags);
+    } else if (ctx) {
+      generate_password_ctx(ctx, domain, BENCH_YEAR, bench_case->fixed_size, bench_case->flags,
+                            generated, output_length + 1, hash, output_length, NULL);
+    } else if (bench_case->profile) {
+      generate_password_profile(bench_profile, password, domain, BENCH_YEAR,
+                                bench_case->fixed_size, bench_case->flags, generated,
+                                output_length + 1, hash, output_length, NULL);
+    } else if (bench_case->caller_buffers) {
+      generate_password_r(password, domain, BENCH_YEAR, bench_case->fixed_size,
+                          bench_case->flags, generated, output_length + 1,
+                          hash, output_length);
+    } else {
+      generate_password(password, domain, BENCH_YEAR, bench_case->fixed_size,
+                        &new_passwd, bench_case->flags);
+    }
+
+    samples[call] = now_ns() - start;
+    allocations += allocation_count - allocations_before;
+    total += samples[call];
+    free(new_passwd);
+  }
+
+  qsort(samples, call, sizeof(double), compare_doubles);
+  result->calls = call;
+  result->ns_per_op = total / (double) call;
+  result->p50_ns = samples[call / 2];
+  result->p99_ns = samples[call * 99 / 100];
+  result->allocs_per_call = (double) allocations / (double) call;
+
+  free_password_context(ctx);
+  free(generated);
+  free(hash);
+  free(password);
+  free(domain);
+
+  return TRUE;
+}
+
+size_t make_cases(s_bench_case *cases, size_t max_cases)
+{
+  static const size_t lengths[] = { 1, 4, 8, 16, 32, 64, 128, 256, 1024 };
+  static const size_t sizes[] = { 4, 8, 12, 16, 32, 64, 128, 256, 512, 1024 };
+  const s_bench_case base = { "", FALSE, FALSE, FALSE, FALSE, FALSE, 16, 12, ALL_FLAGS, 0 };
+  size_t count = 0, index;
+  unsigned int flags;
+
+#define ADD_CASE(...) do { \
+    if (count < max_cases) { \
+      cases[count] = base; \
+      __VA_ARGS__; \
+      count++; \
+    } \
+  } while (0)
+
+  /* Master password length sweep */
+  for (index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+    ADD_CASE(cases[count].group = "password"; cases[count].password_length = lengths[index]);
+  }
+
+  /* Same sweep, the master password being digested once in a context */
+  for (index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+    ADD_CASE(cases[count].group = "context"; cases[count].context = TRUE;
+             cases[count].password_length = lengths[index]);
+  }
+
+  /* Domain length sweep */
+  for (index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+    ADD_CASE(cases[count].group = "domain"; cases[count].domain_length = lengths[index]);
+  }
+
+  /* Every flag combination */
+  for (flags = 1; flags <= ALL_FLAGS; flags++) {
+    ADD_CASE(cases[count].group = "flags"; cases[count].flags = flags);
+  }
+
+  /* Fixed sizes, up to OUTPUT_MAX_LENGTH and beyond */
+  for (index = 0; index < sizeof(sizes) / sizeof(sizes[0]); index++) {
+    ADD_CASE(cases[count].group = "size"; cases[count].fixed_size = sizes[index]);
+  }
+
+  /* Fewer chars than categories: the password can never hold all of them,
+   * the loop is extended up to ITERATION_MAX */
+  for (index = 1; index <= 3; index++) {
+    ADD_CASE(cases[count].group = "pathological"; cases[count].fixed_size = index);
+  }
+
+  /* Inputs so long that the base limit is already over ITERATION_MAX */
+  ADD_CASE(cases[count].group = "pathological"; cases[count].password_length = 1024;
+           cases[count].domain_length = 1024);
+
+  /* Strength of passwords of growing length */
+  for (index = 0; index < sizeof(sizes) / sizeof(sizes[0]); index++) {
+    ADD_CASE(cases[count].group = "strength"; cases[count].strength = TRUE;
+             cases[count].fixed_size = sizes[index]);
+  }
+
+  /* Master password length sweep, built-in constants against a hash
+   * profile, both in caller buffers */
+  for (index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+    ADD_CASE(cases[count].group = "profile"; cases[count].caller_buffers = TRUE;
+             cases[count].password_length = lengths[index]);
+    ADD_CASE(cases[count].group = "profile"; cases[count].profile = TRUE;
+             cases[count].password_length = lengths[index]);
+  }
+
+  /* Domain length sweep, master password context without and with a
+   * result cache */
+  for (index = 0; index < sizeof(lengths) / sizeof(lengths[0]); index++) {
+    ADD_CASE(cases[count].group = "cache"; cases[count].context = TRUE;
+             cases[count].domain_length = lengths[index]);
+    ADD_CASE(cases[count].group = "cache"; cases[count].context = TRUE;
+             cases[count].cache = TRUE; cases[count].domain_length = lengths[index]);
+  }
+
+#undef ADD_CASE
+
+  return count;
+}
+
+int main(int argc, char *argv[])
+{
+  s_bench_case cases[128];
+  s_bench_result result;
+  size_t case_count, index;
+  const char *only_group = NULL, *profile_path = BENCH_PROFILE;
+  double min_time = CASE_MIN_TIME, *samples;
+  unsigned int engine, only_engine = 0;
+  int option, error, one_engine = FALSE;
+
+  while ((option = getopt(argc, argv, "e:t:g:P:h")) != -1) {
+    switch (option) {
+      case 'e':
+        if (!parse_engine(optarg, &only_engine)) {
+          usage(argv[0]);
+          return 1;
+        }
+        one_engine = TRUE;
+        break;
+      case 't':
+        min_time = atof(optarg);
+        break;
+      case 'g':
+        only_group = optarg;
+        break;
+      case 'P':
+        profile_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  /* Without a profile, the generate_password_profile() cases are skipped */
+  if (!only_group || !strcmp(only_group, "profile")) {
+    bench_profile = load_hash_profile(profile_path, &error);
+
+    if (!bench_profile) {
+      fprintf(stderr, "Cannot load hash profile %s (error %d): profile cases skipped\n",
+              profile_path, error);
+    }
+  }
+
+  case_count = make_cases(cases, sizeof(cases) / sizeof(cases[0]));
+  samples = malloc(CASE_MAX_CALLS * sizeof(double));
+
+  if (!samples) {
+    fputs("Out of memory\n", stderr);
+    free_hash_profile(bench_profile);
+    return 1;
+  }
+
+  printf("group,function,engine,password_length,domain_length,flags,fixed_size,"
+         "output_length,base_iterations,iterations,extension_rounds,iteration_max,"
+         "calls,ns_per_op,p50_ns,p99_ns,allocs_per_call\n");
+
+  for (engine = ENGINE_REFERENCE; engine <= ENGINE_CHECKED; engine++) {
+    if (one_engine ? engine != only_engine : engine == ENGINE_CHECKED) {
+      continue;
+    }
+
+    set_generation_engine(engine);
+
+    for (index = 0; index < case_count; index++) {
+      const s_bench_case *bench_case = &cases[index];
+
+      if (only_group && strcmp(only_group, bench_case->group)) {
+        continue;
+      }
+
+      /* The strength does not depend on the engine */
+      if (bench_case->strength && engine != ENGINE_REFERENCE && !one_engine) {
+        continue;
+      }
+
+      if (bench_case->profile && !bench_profile) {
+        continue;
+      }
+
+      if (!run_case(bench_case, min_time, samples, &result)) {
+        fputs("Out of memory\n", stderr);
+        free_hash_profile(bench_profile);
+        free(samples);
+        return 1;
+      }
+
+      printf("%s,%s,%s,%zu,%zu,%u,%zu,%zu,%zu,%zu,%zu,%d,%zu,%.1f,%.1f,%.1f,%.2f\n",
+             bench_case->group,
+             bench_case->strength ? "get_password_strength"
+             : bench_case->cache ? "generate_password_ctx+cache"
+             : bench_case->context ? "generate_password_ctx"
+             : bench_case->profile ? "generate_password_profile"
+             : bench_case->caller_buffers ? "generate_password_r" : "generate_password",
+             bench_case->strength ? "-" : get_engine_name(engine),
+             bench_case->password_length, bench_case->domain_length,
+             bench_case->flags, bench_case->fixed_size,
+             get_password_length(BENCH_YEAR, bench_case->fixed_size),
+             result.stats.base_limit, result.stats.iterations,
+             result.stats.extension_rounds, result.stats.iteration_max_reached,
+             result.calls, result.ns_per_op, result.p50_ns, result.p99_ns,
+             result.allocs_per_call);
+      fflush(stdout);
+    }
+  }
+
+  free_hash_profile(bench_profile);
+  free(samples);
+
+  return 0;
+}
@@ -0,0 +1,719 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * dprpwg-daemon: generate passwords for local clients, over a Unix domain
+ * socket, without a process per lookup.
+ *
+ * Each connection is a session. Requests and responses are text lines:
+ *     PROFILE <name>                -> OK
+ *     PASSWORD <master password>    -> OK
+ *     GET <domain> <year> [<categories> [<size>]]
+ *                                   -> OK <password>
+ *     STATS                         -> OK <generations> <iterations>
+ *                                      <extension_rounds>
+ *                                      <iteration_max_hits>
+ *                                      <missing_categories>
+ *     CACHE                         -> OK <capacity> <entries> <hits>
+ *                                      <misses> <insertions> <evictions>
+ *                                      <bypasses> <timed_lookups>
+ *                                      <lookup_time_ns>
+ *     QUIT                          -> (connection closed)
+ * Errors are answered with "ERR <reason>". Responses come in request
+ * order. <categories> and <size> are as in dprpwg-batch.
+ *
+ * PROFILE selects one of the hash profiles given with -P, or "default"
+ * for the built-in constants, and forgets the master password: the next
+ * PASSWORD digests it for this profile. Sessions start with the default
+ * profile.
+ *
+ * With -C, each session context caches its passwords (see
+ * enable_password_cache()): clients asking for the same passwords again
+ * and again do not have them generated each time. CACHE gives the cache
+ * statistics of the session, since its last PASSWORD.
+ *
+ * The master password is digested once per session, in a dprpwg_ctx.
+ * A single thread serves all the sessions from a poll() loop. All the
+ * requests a session has pipelined are answered with one batch
+ * generation per year. The whole process memory is locked (mlockall()),
+ * and the session buffers are wiped when done with. */
+
+#define _DEFAULT_SOURCE /* mlockall() */
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_tools.h"
+
+/* Maximum number of sessions at once */
+#define SESSION_MAX 64U
+
+/* Session buffers. The input one is also the maximum request length. */
+#define SESSION_INPUT_SIZE  8192U
+#define SESSION_OUTPUT_SIZE 32768U
+
+/* Longest response: "OK <password>\n" */
+#define RESPONSE_MAXLENGTH (OUTPUT_MAX_LENGTH + 4U)
+
+/* Maximum number of requests generated at once */
+#define BATCH_MAX (SESSION_OUTPUT_SIZE / RESPONSE_MAXLENGTH)
+
+/* Maximum number of hash profiles (-P) */
+#define PROFILE_MAX 16U
+
+/* ---- Internal function declarations ---- */
+
+/* One client connection */
+typedef struct {
+  int fd;
+  const dprpwg_profile *profile;
+  dprpwg_ctx *ctx;
+  char input[SESSION_INPUT_SIZE];
+  size_t input_used;
+  char output[SESSION_OUTPUT_SIZE];
+  size_t output_used;
+  int closing;
+} s_session;
+
+/* GET requests waiting to be generated together: all of the same year */
+typedef struct {
+  const char *year;
+  const char *domains[BATCH_MAX];
+  unsigned int flags[BATCH_MAX];
+  size_t fixed_sizes[BATCH_MAX];
+  size_t count;
+  char output[BATCH_MAX][OUTPUT_MAX_LENGTH + 1];
+} s_batch;
+
+/* A hash profile loaded with -P */
+typedef struct {
+  const char *name;
+  dprpwg_profile *profile;
+} s_named_profile;
+
+/* Print the command line help */
+static void usage(const char *program);
+
+/* Load a "name=path" hash profile into 'profiles'. Return FALSE, with a
+ * message, if it cannot be. */
+static int add_profile(char *argument);
+
+/* Profile of a PROFILE request, NULL if unknown */
+static const dprpwg_profile *find_profile(const char *name);
+
+/* Free the profiles loaded with -P */
+static void free_profiles(void);
+
+/* memset() to zero that the compiler may not remove */
+static void wipe_memory(void *memory, size_t size);
+
+/* Create the listening socket. An existing socket file is replaced if no
+ * daemon answers on it any more. */
+static int open_socket(const char *path);
+
+/* Append a response to the session output */
+static void respond(s_session *session, const char *status, const char *text);
+
+/* Generate the pending GET requests, and append their responses */
+static void run_batch(s_session *session, s_batch *batch);
+
+/* Answer all the complete requests of the session input, as long as the
+ * output has room for their responses */
+static void process_requests(s_session *session, s_batch *batch);
+
+/* Write as much of the session output as possible. Return FALSE if the
+ * connection is broken. */
+static int flush_session(s_session *session);
+
+/* Close a session, and wipe everything it held */
+static void close_session(s_session *session);
+
+/* Set by SIGINT and SIGTERM */
+static volatile sig_atomic_t stop_requested = 0;
+
+/* The profiles loaded with -P */
+static s_named_profile profiles[PROFILE_MAX];
+static size_t profile_count = 0;
+
+/* Result cache capacity of each session (-C), 0 for none */
+static size_t cache_capacity = 0;
+
+static void cb_stop(int signal_number)
+{
+  (void) signal_number;
+  stop_requested = 1;
+}
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [-e engine] [-u] [-P name=profile_file]... [-C entries] socket_path\n"
+          "  -e  Generation engine: reference, closed-form (default) or checked.\n"
+          "  -u  Run even if the memory cannot be locked.\n"
+          "  -P  Load a hash profile, for the PROFILE request. Up to %u.\n"
+          "  -C  Cache up to this many passwords per session.\n"
+          "Requests, one per line:\n"
+          "  PROFILE <name>\n"
+          "  PASSWORD <master password>\n"
+          "  GET <domain> <year> [<categories> [<size>]]\n"
+          "  STATS\n"
+          "  CACHE\n"
+          "  QUIT\n",
+          program, PROFILE_MAX);
+}
+
+int add_profile(char *argument)
+{
+  char *separator = strchr(argument, '=');
+  int error;
+
+  if (!separator || separator == argument) {
+    fprintf(stderr, "Invalid profile \"%s\": expected name=profile_file\n", argument);
+    return FALSE;
+  }
+
+  *separator = '\0';
+
+  if (!strcmp(argument, "default") || find_profile(argument)) {
+    fprintf(stderr, "Profile name \"%s\" already used\n", argument);
+    return FALSE;
+  }
+
+  if (profile_count == PROFILE_MAX) {
+    fprintf(stderr, "Too many profiles, at most %u\n", PROFILE_MAX);
+    return FALSE;
+  }
+
+  profiles[profile_count].profile = load_hash_profile(separator + 1, &error);
+
+  if (!profiles[profile_count].profile) {
+    fprintf(stderr, "Cannot load hash profile %s: %s\n", separator + 1,
+            error == PROFILE_UNREADABLE ? strerror(errno)
+            : error == PROFILE_SYNTAX ? "syntax error" : "missing or repeated constant");
+    return FALSE;
+  }
+
+  profiles[profile_count].name = argument;
+  profile_count++;
+
+  return TRUE;
+}
+
+void free_profiles(void)
+{
+  size_t index;
+
+  for (index = 0; index < profile_count; index++) {
+    free_hash_profile(profiles[index].profile);
+  }
+
+  profile_count = 0;
+}
+
+const dprpwg_profile *find_profile(const char *name)
+{
+  size_t index;
+
+  if (!strcmp(name, "default")) {
+    return get_default_hash_profile();
+  }
+
+  for (index = 0; index < profile_count; index++) {
+    if (!strcmp(name, profiles[index].name)) {
+      return profiles[index].profile;
+    }
+  }
+
+  return NULL;
+}
+
+void wipe_memory(void *memory, size_t size)
+{
+  static void *(*volatile wipe)(void *, int, size_t) = memset;
+
+  wipe(memory, 0, size);
+}
+
+int open_socket(const char *path)
+{
+  struct sockaddr_un address;
+  int fd, bound;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return -1;
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+  if (fd < 0) {
+    perror("socket");
+    return -1;
+  }
+
+  /* Only our user may connect */
+  umask(077);
+
+  bound = !bind(fd, (struct sockaddr *) &address, sizeof(address));
+
+  if (!bound && errno == EADDRINUSE) {
+    int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (probe >= 0 && !connect(probe, (struct sockaddr *) &address, sizeof(address))) {
+      fprintf(stderr, "%s: a daemon is already running\n", path);
+      close(probe);
+      close(fd);
+      return -1;
+    }
+
+    if (probe >= 0) {
+      close(probe);
+    }
+
+    unlink(path);
+    bound = !bind(fd, (struct sockaddr *) &address, sizeof(address));
+  }
+
+  if (!bound || listen(fd, (int) SESSION_MAX) || fcntl(fd, F_SETFL, O_NONBLOCK)) {
+    perror(path);
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+void respond(s_session *session, const char *status, const char *text)
+{
+  size_t status_length = strlen(status), text_length = text ? strlen(text) : 0;
+  char *output = session->output + session->output_used;
+
+  memcpy(output, status, status_length);
+  output += status_length;
+
+  if (text) {
+    *output++ = ' ';
+    memcpy(output, text, text_length);
+    output += text_length;
+  }
+
+  *output++ = '\n';
+  session->output_used = (size_t) (output - session->output);
+}
+
+void run_batch(s_session *session, s_batch *batch)
+{
+  size_t request;
+
+  if (!batch->count) {
+    return;
+  }
+
+  generate_password_batch_ctx(session->ctx, batch->year, batch->domains, batch->flags,
+                              batch->fixed_sizes, batch->count, batch->output[0],
+                              sizeof(batch->output[0]));
+
+  for (request = 0; request < batch->count; request++) {
+    respond(session, "OK", batch->output[request]);
+  }
+
+  wipe_memory(batch->output, batch->count * sizeof(batch->output[0]));
+  batch->count = 0;
+}
+
+void process_requests(s_session *session, s_batch *batch)
+{
+  char *line = session->input, *line_end, *command, *save;
+  const char *separators = " \t\r";
+  size_t remaining;
+
+  batch->count = 0;
+
+  /* Room for the responses of the batch, and of this request */
+  while (!session->closing
+         && session->output_used + (batch->count + 1) * RESPONSE_MAXLENGTH <= SESSION_OUTPUT_SIZE
+         && (line_end = memchr(line, '\n', (size_t) (session->input + session->input_used - line)))) {
+    *line_end = '\0';
+
+    if (line_end > line && line_end[-1] == '\r') {
+      line_end[-1] = '\0';
+    }
+
+    command = strtok_r(line, separators, &save);
+
+    if (command && !strcmp(command, "GET")) {
+      const char *domain = strtok_r(NULL, separators, &save);
+      const char *year = strtok_r(NULL, separators, &save);
+      const char *categories = strtok_r(NULL, separators, &save);
+      const char *fixed_size = strtok_r(NULL, separators, &save);
+      unsigned int flags = FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL;
+      unsigned long size = 0;
+      char *end = NULL;
+
+      if (fixed_size) {
+        size = strtoul(fixed_size, &end, 10);
+      }
+
+      if (!domain || !year || strtok_r(NULL, separators, &save)
+          || (categories && !parse_categories(categories, &flags))
+          || (fixed_size && (*end || size > OUTPUT_MAX_LENGTH))) {
+        run_batch(session, batch);
+        respond(session, "ERR", "invalid request");
+      } else if (!session->ctx) {
+        run_batch(session, batch);
+        respond(session, "ERR", "no master password");
+      } else {
+        if (batch->count && strcmp(batch->year, year)) {
+          run_batch(session, batch);
+        }
+
+        batch->year = year;
+        batch->domains[batch->count] = domain;
+        batch->flags[batch->count] = flags;
+        batch->fixed_sizes[batch->count] = size;
+        batch->count++;
+      }
+    } else {
+      run_batch(session, batch);
+
+      if (command && !strcmp(command, "PASSWORD")) {
+        /* The master password is the rest of the line, spaces included */
+        const char *password = command + strlen(command) + 1;
+
+        free_password_context(session->ctx);
+        session->ctx = password < line_end
+                       ? create_password_context_profile(session->profile, password) : NULL;
+
+        /* Without memory for the cache, passwords are just not cached */
+        if (session->ctx && cache_capacity) {
+          enable_password_cache(session->ctx, cache_capacity);
+        }
+
+        respond(session, session->ctx ? "OK" : "ERR", session->ctx ? NULL : "no master password");
+      } else if (command && !strcmp(command, "PROFILE")) {
+        const char *name = strtok_r(NULL, separators, &save);
+        const dprpwg_profile *profile = name && !strtok_r(NULL, separators, &save)
+                                        ? find_profile(name) : NULL;
+
+        if (profile) {
+          /* The master password was digested for the previous profile */
+          free_password_context(session->ctx);
+          session->ctx = NULL;
+          session->profile = profile;
+        }
+
+        respond(session, profile ? "OK" : "ERR", profile ? NULL : "unknown profile");
+      } else if (command && !strcmp(command, "STATS")) {
+        s_generation_counters counters;
+        char text[128];
+
+        get_generation_counters(&counters);
+        snprintf(text, sizeof(text), "%llu %llu %llu %llu %llu",
+                 (unsigned long long) counters.generations,
+                 (unsigned long long) counters.iterations,
+                 (unsigned long long) counters.extension_rounds,
+                 (unsigned long long) counters.iteration_max_hits,
+                 (unsigned long long) counters.missing_categories);
+        respond(session, "OK", text);
+      } else if (command && !strcmp(command, "CACHE")) {
+        s_cache_stats stats;
+        char text[256];
+
+        if (get_password_cache_stats(session->ctx, &stats)) {
+          snprintf(text, sizeof(text), "%zu %zu %llu %llu %llu %llu %llu %llu %llu",
+                   stats.capacity, stats.entries,
+                   (unsigned long long) stats.hits,
+                   (unsigned long long) stats.misses,
+                   (unsigned long long) stats.insertions,
+                   (unsigned long long) stats.evictions,
+                   (unsigned long long) stats.bypasses,
+                   (unsigned long long) stats.timed_lookups,
+                   (unsigned long long) stats.lookup_time_ns);
+          respond(session, "OK", text);
+        } else {
+          respond(session, "ERR", "no cache");
+        }
+      } else if (command && !strcmp(command, "QUIT")) {
+        session->closing = TRUE;
+      } else if (command) {
+        respond(session, "ERR", "unknown command");
+      }
+    }
+
+    line = line_end + 1;
+  }
+
+  run_batch(session, batch);
+
+  /* Keep the incomplete request, wipe the others */
+  remaining = (size_t) (session->input + session->input_used - line);
+  memmove(session->input, line, remaining);
+  wipe_memory(session->input + remaining, session->input_used - remaining);
+  session->input_used = remaining;
+
+  if (session->input_used == SESSION_INPUT_SIZE && !memchr(session->input, '\n', remaining)
+      && session->output_used + RESPONSE_MAXLENGTH <= SESSION_OUTPUT_SIZE) {
+    respond(session, "ERR", "request too long");
+    session->closing = TRUE;
+  }
+}
+
+int flush_session(s_session *session)
+{
+  size_t written = 0;
+
+  while (written < session->output_used) {
+    ssize_t chunk = send(session->fd, session->output + written,
+                         session->output_used - written, MSG_NOSIGNAL);
+
+    if (chunk < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        return FALSE;
+      }
+
+      break;
+    }
+
+    written += (size_t) chunk;
+  }
+
+  memmove(session->output, session->output + written, session->output_used - written);
+  wipe_memory(session->output + session->output_used - written, written);
+  session->output_used -= written;
+
+  return TRUE;
+}
+
+void close_session(s_session *session)
+{
+  close(session->fd);
+  free_password_context(session->ctx);
+  wipe_memory(session, sizeof(*session));
+  free(session);
+}
+
+int main(int argc, char *argv[])
+{
+  s_session *sessions[SESSION_MAX];
+  struct pollfd fds[SESSION_MAX + 1];
+  size_t session_count = 0, index, kept;
+  s_batch *batch;
+  struct sigaction action;
+  struct rlimit no_core = { 0, 0 };
+  const char *socket_path;
+  unsigned int engine;
+  int option, listen_fd, allow_unlocked = FALSE, status = 0;
+
+  set_generation_engine(ENGINE_CLOSED_FORM);
+
+  while ((option = getopt(argc, argv, "e:uP:C:h")) != -1) {
+    switch (option) {
+      case 'e':
+        if (!parse_engine(optarg, &engine)) {
+          usage(argv[0]);
+          return 1;
+        }
+        set_generation_engine(engine);
+        break;
+      case 'u':
+        allow_unlocked = TRUE;
+        break;
+      case 'P':
+        if (!add_profile(optarg)) {
+          status = 1;
+        }
+        break;
+      case 'C':
+        cache_capacity = strtoul(optarg, NULL, 10);
+        break;
+      default:
+        usage(argv[0]);
+        free_profiles();
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!status && optind != argc - 1) {
+    usage(argv[0]);
+    status = 1;
+  }
+
+  if (status) {
+    free_profiles();
+    return status;
+  }
+
+  socket_path = argv[optind];
+
+  /* Master passwords must not reach the swap, nor a core file */
+  setrlimit(RLIMIT_CORE, &no_core);
+
+  if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+    perror("mlockall");
+
+    if (!allow_unlocked) {
+      fputs("Cannot lock the memory: raise \"ulimit -l\", or run with -u\n", stderr);
+      free_profiles();
+      return 1;
+    }
+  }
+
+  batch = calloc(1, sizeof(*batch));
+  listen_fd = batch ? open_socket(socket_path) : -1;
+
+  if (listen_fd < 0) {
+    free(batch);
+    free_profiles();
+    return 1;
+  }
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = cb_stop;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  /* The event loop */
+  while (!stop_requested) {
+    /* New connections only when there is room for them */
+    fds[0].fd = session_count < SESSION_MAX ? listen_fd : -1;
+    fds[0].events = POLLIN;
+
+    /* Read only when the input has room, and the output is not full */
+    for (index = 0; index < session_count; index++) {
+      const s_session *session = sessions[index];
+
+      fds[index + 1].fd = session->fd;
+      fds[index + 1].events = (short) ((session->output_used ? POLLOUT : 0)
+                                       | (!session->closing && session->input_used < SESSION_INPUT_SIZE
+                                          && session->output_used + RESPONSE_MAXLENGTH <= SESSION_OUTPUT_SIZE
+                                          ? POLLIN : 0));
+      fds[index + 1].revents = 0;
+    }
+
+    if (poll(fds, session_count + 1, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      perror("poll");
+      break;
+    }
+
+    for (index = 0; index < session_count; index++) {
+      s_session *session = sessions[index];
+      const short revents = fds[index + 1].revents;
+
+      if (revents & POLLIN) {
+        ssize_t chunk = read(session->fd, session->input + session->input_used,
+                             SESSION_INPUT_SIZE - session->input_used);
+
+        if (chunk > 0) {
+          session->input_used += (size_t) chunk;
+        } else if (!chunk || (errno != EINTR && errno != EAGAIN)) {
+          session->closing = TRUE;
+        }
+      } else if (revents & (POLLHUP | POLLERR | POLLNVAL)) {
+        session->closing = TRUE;
+        session->output_used = 0;
+      }
+
+      /* Answer right away: most of the time, the responses fit in the
+       * socket buffer, and no other poll() round is needed. Go on while
+       * they do: pending requests may fill the whole input. */
+      do {
+        process_requests(session, batch);
+
+        if (!flush_session(session)) {
+          session->closing = TRUE;
+          session->output_used = 0;
+        }
+      } while (!session->closing && !session->output_used
+               && memchr(session->input, '\n', session->input_used));
+    }
+
+    /* Drop the closed sessions, once their responses are written */
+    for (index = kept = 0; index < session_count; index++) {
+      if (sessions[index]->closing && !sessions[index]->output_used) {
+        close_session(sessions[index]);
+      } else {
+        sessions[kept++] = sessions[index];
+      }
+    }
+
+    session_count = kept;
+
+    if (fds[0].revents & POLLIN) {
+      int fd = accept(listen_fd, NULL, NULL);
+      s_session *session;
+
+      if (fd < 0) {
+        continue;
+      }
+
+      session = calloc(1, sizeof(*session));
+
+      if (!session || fcntl(fd, F_SETFL, O_NONBLOCK)) {
+        free(session);
+        close(fd);
+        continue;
+      }
+
+      session->fd = fd;
+      session->profile = get_default_hash_profile();
+      sessions[session_count++] = session;
+    }
+  }
+
+  /* Cleanup */
+  for (index = 0; index < session_count; index++) {
+    close_session(sessions[index]);
+  }
+
+  close(listen_fd);
+  unlink(socket_path);
+  wipe_memory(batch, sizeof(*batch));
+  free(batch);
+  free_profiles();
+
+  return 0;
+}
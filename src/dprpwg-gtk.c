@@ -25,27 +25,111 @@
  * It should build with either GTK2 or GTK3 if I did not mess up. */
 
 #include <gtk/gtk.h>
+#include <math.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 #include <string.h>
 #include "dprpwg_lib.h"
+#include "dprpwg_tools.h"
 
 /* We do not use all parameters of GTK callbacks */
 #define UNUSED_PARAM(Param) ((void) Param)
 
+/* Delay without input changes before generating, in milliseconds. Typing
+ * a domain name triggers one generation, not one per keystroke. */
+#define GENERATE_DELAY_MS 150
+
+#define ALL_FLAGS (FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL)
+
+/* Domain list view: rows kept ahead and behind the visible ones. The list
+ * worker drops the requests of rows scrolled further away. */
+#define LIST_VISIBLE_MARGIN 64
+
+/* Domain list row cache states */
+#define ROW_EMPTY   0   /* Not generated */
+#define ROW_PENDING 1   /* Requested to the list worker */
+#define ROW_DONE    2   /* Password and strength cached */
+
+/* Domain list view columns */
+#define LIST_COLUMN_DOMAIN     0
+#define LIST_COLUMN_CATEGORIES 1
+#define LIST_COLUMN_SIZE       2
+#define LIST_COLUMN_PASSWORD   3
+#define LIST_COLUMN_STRENGTH   4
+
+/* List worker requests */
+#define LIST_REQUEST_QUIT   0   /* Stop the worker */
+#define LIST_REQUEST_MASTER 1   /* New master password and year */
+#define LIST_REQUEST_ROW    2   /* Generate one row */
+
+/* Time spent measuring the attacker speed, before the first generation */
+#define CALIBRATION_SECONDS 0.2
+
+/* Crack times go on the strength bar on a log scale, from 1 second to
+ * 10^12 seconds (about 30000 years) */
+#define CRACK_TIME_LOG10_MAX 12.0
+
+/* Password strength levels: upper bound, name, and security icon */
+static const struct {
+  double below;
+  const char *name;
+  int icon;
+} strength_levels[] = {
+  { 0.25,  "ridiculously low", 0 },
+  { 0.375, "very low",         0 },
+  { 0.5,   "low",              0 },
+  { 0.625, "fair",             0 },
+  { 0.75,  "good",             1 },
+  { 0.875, "great",            1 },
+  { 1,     "excellent",        2 },
+  { 0,     "overkill",         2 }   /* Anything above */
+};
+
+#define STRENGTH_LEVEL_COUNT (sizeof(strength_levels) / sizeof(strength_levels[0]))
+
 /* ---- Internal function declarations ---- */
 
 /* Callback called when program is terminated */
 static void cb_destroy(GtkWidget *widget, gpointer data);
 
-/* Callback called when password needs to be generated */
+/* Callback called when password needs to be generated: (re)start the
+ * generation delay */
 static void cb_generate(GtkWidget *widget, gpointer data);
 
+/* Callback called when the generation delay expires: hand the inputs to
+ * the worker thread */
+static gboolean cb_generate_timeout(gpointer data);
+
+/* Callback called in the GTK thread when the worker has generated a password */
+static gboolean cb_generate_done(gpointer data);
+
+/* Worker thread: generates the passwords requested by cb_generate_timeout() */
+static gpointer generate_worker(gpointer data);
+
+/* Display a generated password and its crack time estimate (NULL if none) */
+static void display_password(gpointer data, const char *new_passwd,
+                             const s_crack_estimate *estimate);
+
+/* Attacker speed, measured once for both workers. NULL if it cannot be. */
+static const s_attack_rate *get_attack_rate(void);
+
+/* Crack time of an estimate: the quicker of the password and master
+ * password attacks. 'master_weaker' tells which one, if not NULL. */
+static double get_crack_seconds(const s_crack_estimate *estimate, int *master_weaker);
+
+/* Position of a crack time on the strength bar, from 0 to 1 */
+static double get_crack_strength(double seconds);
+
+/* Write a duration as a few words */
+static void format_duration(double seconds, char *text, size_t size);
+
 /* Callback called when the "fixed size" is ticked, to enable the size input */
 static void cb_fixedsize_changed(GtkWidget *widget, gpointer data);
 
-/* Function to fill the program window */
-static void window_fill(GtkWidget *window);
+/* Function to fill the program window. 'domain_list_path' is a domain
+ * list to open, or NULL. */
+static void window_fill(GtkWidget *window, const char *domain_list_path);
 
 /* Ugly function to clear the internal text input buffers */
 static void clean_entry_buffer(GtkEntry *gtk_entry);
@@ -55,6 +139,12 @@ static int check_password_entries(GtkWidget *text_passwd,
                                   GtkWidget *text_passwd_check,
                                   GtkWidget *label_passwd_status);
 
+/* Index in strength_levels of a password strength */
+static size_t get_strength_level(double password_strength);
+
+/* Domain list window, see open_domain_list() */
+typedef struct s_domain_list s_domain_list;
+
 /* All a bunch of widget that must be consulted when a password is to
  * be generated (note: nearly all widgets...) */
 typedef struct {
@@ -71,8 +161,169 @@ typedef struct {
   GtkWidget *check_dig_avail;
   GtkWidget *check_sym_avail;
   GtkWidget *security_icons[3];
+
+  /* Pending generation delay, 0 if none */
+  guint generate_timeout;
+
+  /* Worker thread, and its queue of s_generate_request */
+  GThread *generate_worker;
+  GAsyncQueue *generate_requests;
+
+  /* Identifier of the newest request. Older ones are stale: the worker
+   * skips them, and their results are not displayed. */
+  volatile gint latest_request;
+
+  /* Open domain list window, or NULL */
+  s_domain_list *domain_list;
 } s_generate_data;
 
+/* One password generation, from the GTK thread to the worker and back */
+typedef struct {
+  s_generate_data *generate_data;
+  gint id;
+  int quit;           /* TRUE to stop the worker */
+
+  /* Inputs, copied from the widgets */
+  char *passwd;
+  char *domain;
+  char *year;
+  size_t fixed_size;
+  unsigned int flags;
+
+  /* Outputs. 'estimated' is FALSE if the attacker speed is unknown. */
+  char new_passwd[OUTPUT_MAX_LENGTH + 1];
+  s_crack_estimate estimate;
+  int estimated;
+} s_generate_request;
+
+/* Clean and free a request: it holds the master password */
+static void free_request(s_generate_request *request);
+
+/* One domain of a domain list, and its cached password */
+typedef struct {
+  const char *domain;         /* In the list file text */
+  unsigned int flags;
+  size_t fixed_size;
+  int state;                  /* ROW_* */
+  char *password;             /* Secure buffer, when ROW_DONE */
+  double strength;
+} s_list_row;
+
+/* A domain list window. Only the GTK thread touches the rows: the list
+ * worker gets the inputs of a row in its request, and gives the password
+ * back the same way. */
+struct s_domain_list {
+  s_generate_data *generate_data;
+  GtkWidget *window;
+  GtkWidget *tree_view;
+  GtkTreeModel *model;        /* One row index per row */
+
+  char *text;                 /* List file contents, the domains point there */
+  s_list_row *rows;
+  size_t row_count;
+
+  /* Master password (secure buffer, NULL until both entries match) and
+   * year the cache is for */
+  char *passwd;
+  char *year;
+
+  /* Cache generation, bumped when the master password or the year
+   * changes. Requests of older ones are stale. */
+  volatile gint epoch;
+
+  /* Visible rows, so the worker can drop the requests scrolled away */
+  volatile gint visible_first;
+  volatile gint visible_last;
+
+  /* List worker thread, and its queue of s_list_request */
+  GThread *worker;
+  GAsyncQueue *requests;
+};
+
+/* One request to the list worker, and its result */
+typedef struct {
+  s_domain_list *list;
+  gint epoch;
+  int kind;                   /* LIST_REQUEST_* */
+
+  /* LIST_REQUEST_MASTER: passwd is a secure buffer, NULL to forget it */
+  char *passwd;
+  char *year;
+
+  /* LIST_REQUEST_ROW inputs, copied from the row */
+  size_t row;
+  const char *domain;
+  unsigned int flags;
+  size_t fixed_size;
+
+  /* LIST_REQUEST_ROW outputs. 'generated' is FALSE if the row was dropped,
+   * 'password_strength' is the crack time on the strength bar, < 0 if
+   * unknown. */
+  int generated;
+  char new_passwd[OUTPUT_MAX_LENGTH + 1];
+  double password_strength;
+} s_list_request;
+
+/* Callback called when the "Domain list..." button is clicked */
+static void cb_open_domain_list(GtkWidget *widget, gpointer data);
+
+/* Read a domain list file and open its window. Return FALSE, after telling
+ * the user, if it cannot be. */
+static int open_domain_list(s_generate_data *generate_data, const char *path);
+
+/* Split the list file text into rows. Return 0, or the number of the first
+ * invalid line. */
+static size_t parse_domain_list(s_domain_list *list, size_t length);
+
+/* Write the symbol categories of flags ("luds"), 5 chars at most */
+static void format_categories(unsigned int flags, char *categories);
+
+/* Function to fill a domain list window */
+static void list_window_fill(s_domain_list *list, const char *path);
+
+/* Follow the master password and year of the main window. When they
+ * change, the cache is wiped and the worker gets the new ones. */
+static void list_update_master(s_domain_list *list);
+
+/* Cell renderer callback: show one cell of a row, and request the row
+ * password if it is not cached */
+static void cb_list_cell_data(GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                              GtkTreeModel *model, GtkTreeIter *iter, gpointer data);
+
+/* Request the password of a row to the list worker */
+static void request_row(s_domain_list *list, size_t index);
+
+/* Callback called when the list is scrolled or resized */
+static void cb_list_scrolled(GtkAdjustment *adjustment, gpointer data);
+
+/* Store the visible row range for the list worker */
+static void update_visible_range(s_domain_list *list);
+
+/* Check if a row is within the visible range, margin included */
+static int is_row_visible(s_domain_list *list, size_t index);
+
+/* List worker thread: generates the rows requested by cb_list_cell_data() */
+static gpointer list_worker(gpointer data);
+
+/* Callback called in the GTK thread when the list worker is done with a row */
+static gboolean cb_list_row_done(gpointer data);
+
+/* Callback called on a row double-click: copy its password */
+static void cb_list_row_activated(GtkTreeView *tree_view, GtkTreePath *path,
+                                  GtkTreeViewColumn *column, gpointer data);
+
+/* Callback called when a domain list window is closed */
+static void cb_list_destroy(GtkWidget *widget, gpointer data);
+
+/* Clean and free a list worker request */
+static void free_list_request(s_list_request *request);
+
+/* Copy a string into a secure buffer. NULL if memory is short. */
+static char *secure_strdup(const char *string);
+
+/* Display an error message box */
+static void show_error(GtkWidget *parent, const char *message);
+
 void clean_entry_buffer(GtkEntry *gtk_entry)
 {
   /*
@@ -95,6 +346,28 @@ void cb_destroy(GtkWidget *widget, gpointer data)
 
   /* Get the pointers to all widgets */
   s_generate_data *generate_data = (s_generate_data *) data;
+  s_generate_request *quit_request = NULL;
+
+  /* Close the domain list first: it wipes its cache */
+  if (generate_data->domain_list) {
+    gtk_widget_destroy(generate_data->domain_list->window);
+  }
+
+  /* Stop the worker thread. A generation in progress is not displayed. */
+  if (generate_data->generate_timeout) {
+    g_source_remove(generate_data->generate_timeout);
+    generate_data->generate_timeout = 0;
+  }
+
+  g_atomic_int_inc(&generate_data->latest_request);
+  quit_request = g_new0(s_generate_request, 1);
+  quit_request->quit = TRUE;
+  g_async_queue_push(generate_data->generate_requests, quit_request);
+  g_thread_join(generate_data->generate_worker);
+
+  /* Results not displayed yet are stale now: let them be cleaned */
+  while (g_main_context_iteration(NULL, FALSE)) {
+  }
 
   /* Clean the input/output buffers that need it (i.e. password entries) */
   clean_entry_buffer(GTK_ENTRY(generate_data->text_newpasswd));
@@ -142,49 +415,79 @@ static int check_password_entries(GtkWidget *text_passwd,
   }
 }
 
-/* Password generation callback */
+/* Clean and free a request */
+void free_request(s_generate_request *request)
+{
+  if (request->passwd) {
+    memset(request->passwd, 0, strlen(request->passwd));
+  }
+
+  memset(request->new_passwd, 0, sizeof(request->new_passwd));
+  g_free(request->passwd);
+  g_free(request->domain);
+  g_free(request->year);
+  g_free(request);
+}
+
+/* Password generation callback: wait for the input to settle */
 void cb_generate(GtkWidget *widget, gpointer data)
+{
+  s_generate_data *generate_data = (s_generate_data *) data;
+
+  UNUSED_PARAM(widget);
+
+  if (generate_data->generate_timeout) {
+    g_source_remove(generate_data->generate_timeout);
+  }
+
+  generate_data->generate_timeout = g_timeout_add(GENERATE_DELAY_MS, cb_generate_timeout, data);
+}
+
+/* Generation delay expired: read the inputs, and request a password */
+gboolean cb_generate_timeout(gpointer data)
 {
   s_generate_data *generate_data = NULL;
-  const char *passwd = NULL;
-  const char *domain = NULL;
-  const char *year = NULL;
-  char *new_passwd = NULL;
-  char *password_strength_str;
-  double password_strength;
+  s_generate_request *request = NULL;
   unsigned int flags;
   size_t fixed_size = 0;
 
-  UNUSED_PARAM(widget);
-
   /* Get the pointers to all widgets */
   generate_data = (s_generate_data *) data;
+  generate_data->generate_timeout = 0;
 
   /* Hide all funny icons by default */
   gtk_widget_hide(generate_data->security_icons[0]);
   gtk_widget_hide(generate_data->security_icons[1]);
   gtk_widget_hide(generate_data->security_icons[2]);
 
+  /* The domain list follows the master password and year */
+  if (generate_data->domain_list) {
+    list_update_master(generate_data->domain_list);
+  }
+
   /* First, check both master password input match */
   if (!check_password_entries(generate_data->text_origpasswd,
                               generate_data->text_origpasswd_check,
                               generate_data->label_origpasswd_status)) {
-    /* Nope, mismatch. Generate nothing */
+    /* Nope, mismatch. Generate nothing, and forget what is being generated */
+    g_atomic_int_inc(&generate_data->latest_request);
     gtk_progress_bar_set_text(GTK_PROGRESS_BAR(generate_data->label_entropy), "N/A");
     gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(generate_data->label_entropy), 0);
     gtk_entry_set_text(GTK_ENTRY(generate_data->text_newpasswd), "");
     gtk_widget_show(generate_data->security_icons[0]);
-    return;
+    return FALSE;
   }
 
-  /* Get the input text entries */
-  passwd = gtk_entry_get_text(GTK_ENTRY(generate_data->text_origpasswd));
-  domain = gtk_entry_get_text(GTK_ENTRY(generate_data->text_domain));
-  year = gtk_entry_get_text(GTK_ENTRY(generate_data->text_year));
-
-  /* Get the fixed size input if the fixed size option is enabled */
+  /* Get the fixed size input if the fixed size option is enabled. The
+   * text may be anything while being typed: keep it in the spin range. */
   if (gtk_widget_get_sensitive(generate_data->text_fixed_size)) {
-    fixed_size = (unsigned int) atoi(gtk_entry_get_text(GTK_ENTRY(generate_data->text_fixed_size)));
+    int size = atoi(gtk_entry_get_text(GTK_ENTRY(generate_data->text_fixed_size)));
+
+    if (size > (int) OUTPUT_MAX_LENGTH) {
+      size = (int) OUTPUT_MAX_LENGTH;
+    }
+
+    fixed_size = size > 0 ? (size_t) size : 0;
   }
 
   /* Generate the symbol category flags */
@@ -206,59 +509,200 @@ void cb_generate(GtkWidget *widget, gpointer data)
     flags |= FLAG_SYM_AVAIL;
   }
 
-  /* Generate the password */
-  generate_password(passwd, domain, year, fixed_size, &new_passwd, flags);
+  /* Copy the inputs: the worker must not touch the widgets */
+  request = g_new0(s_generate_request, 1);
+  request->generate_data = generate_data;
+  request->passwd = g_strdup(gtk_entry_get_text(GTK_ENTRY(generate_data->text_origpasswd)));
+  request->domain = g_strdup(gtk_entry_get_text(GTK_ENTRY(generate_data->text_domain)));
+  request->year = g_strdup(gtk_entry_get_text(GTK_ENTRY(generate_data->text_year)));
+  request->fixed_size = fixed_size;
+  request->flags = flags;
+
+  /* This request makes all the previous ones stale */
+  request->id = g_atomic_int_add(&generate_data->latest_request, 1) + 1;
+  g_async_queue_push(generate_data->generate_requests, request);
+
+  return FALSE;
+}
+
+/* Worker thread main function */
+gpointer generate_worker(gpointer data)
+{
+  GAsyncQueue *requests = (GAsyncQueue *) data;
+
+  for (;;) {
+    s_generate_request *request = g_async_queue_pop(requests);
+    s_generate_request *newer;
+    const s_attack_rate *attack_rate;
+
+    /* Only the newest of the queued requests is worth generating */
+    while (!request->quit && (newer = g_async_queue_try_pop(requests))) {
+      free_request(request);
+      request = newer;
+    }
+
+    if (request->quit) {
+      free_request(request);
+      break;
+    }
+
+    if (request->id != g_atomic_int_get(&request->generate_data->latest_request)) {
+      free_request(request);
+      continue;
+    }
+
+    /* Generate the password, and estimate how long it resists */
+    generate_password_r(request->passwd, request->domain, request->year,
+                        request->fixed_size, request->flags,
+                        request->new_passwd, sizeof(request->new_passwd), NULL, 0);
+
+    attack_rate = get_attack_rate();
+
+    if (attack_rate) {
+      estimate_crack_time(request->new_passwd, request->flags, request->passwd,
+                          attack_rate, &request->estimate);
+      request->estimated = TRUE;
+    }
+
+    g_idle_add(cb_generate_done, request);
+  }
+
+  return NULL;
+}
+
+/* Back in the GTK thread: display the password, unless it is stale */
+gboolean cb_generate_done(gpointer data)
+{
+  s_generate_request *request = (s_generate_request *) data;
+
+  if (request->id == g_atomic_int_get(&request->generate_data->latest_request)) {
+    display_password(request->generate_data, request->new_passwd,
+                     request->estimated ? &request->estimate : NULL);
+  }
+
+  free_request(request);
+
+  return FALSE;
+}
+
+/* Display a generated password and its crack time */
+void display_password(gpointer data, const char *new_passwd, const s_crack_estimate *estimate)
+{
+  s_generate_data *generate_data = (s_generate_data *) data;
+  char password_strength_str[128], duration[64];
+  double seconds, password_strength;
+  size_t level;
+  int master_weaker;
 
   /* Display the new password */
   gtk_entry_set_text(GTK_ENTRY(generate_data->text_newpasswd), new_passwd);
 
-  /* Get password strength for display */
-  password_strength = get_password_strength(new_passwd, (unsigned int) atoi(year), flags);
-
-  /* TODO: Put this part elswhere. Or at least remove all the magic numbers */
-  if (password_strength < 0.25) {
-    password_strength_str = "Strength: ridiculously low";
-    gtk_widget_show(generate_data->security_icons[0]);
-  } else if (password_strength < 0.375) {
-    password_strength_str = "Strength: very low";
-    gtk_widget_show(generate_data->security_icons[0]);
-  } else if (password_strength < 0.5) {
-    password_strength_str = "Strength: low";
+  if (!estimate) {
     gtk_widget_show(generate_data->security_icons[0]);
-  } else if (password_strength < 0.625) {
-    password_strength_str = "Strength: fair";
-    gtk_widget_show(generate_data->security_icons[0]);
-  } else if (password_strength < 0.75) {
-    password_strength_str = "Strength: good";
-    gtk_widget_show(generate_data->security_icons[1]);
-  } else if (password_strength < 0.875) {
-    password_strength_str = "Strength: great";
-    gtk_widget_show(generate_data->security_icons[1]);
-  } else if (password_strength < 1) {
-    password_strength_str = "Strength: excellent";
-    gtk_widget_show(generate_data->security_icons[2]);
-  } else {
-    password_strength_str = "Strength: overkill";
-    gtk_widget_show(generate_data->security_icons[2]);
+    gtk_progress_bar_set_text(GTK_PROGRESS_BAR(generate_data->label_entropy), "Crack time: N/A");
+    gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(generate_data->label_entropy), 0);
+    return;
   }
 
+  seconds = get_crack_seconds(estimate, &master_weaker);
+  password_strength = get_crack_strength(seconds);
+  level = get_strength_level(password_strength);
+  format_duration(seconds, duration, sizeof(duration));
+  snprintf(password_strength_str, sizeof(password_strength_str), "Crack time: %s%s (%s)",
+           duration, master_weaker ? " via the master password" : "",
+           strength_levels[level].name);
+  gtk_widget_show(generate_data->security_icons[strength_levels[level].icon]);
   gtk_progress_bar_set_text(GTK_PROGRESS_BAR(generate_data->label_entropy), password_strength_str);
+  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(generate_data->label_entropy), password_strength);
+}
 
-  if (password_strength > 1) {
-    password_strength = 1;
-  } else if (password_strength < 0) {
-    password_strength = 0;
+/* Attacker speed, measured once for both workers */
+const s_attack_rate *get_attack_rate(void)
+{
+  static s_attack_rate attack_rate;
+  static gsize calibration = 0;
+
+  /* The attacker speed is measured once, on all the cores: 2 if it could
+   * be, 1 if not */
+  if (g_once_init_enter(&calibration)) {
+    g_once_init_leave(&calibration,
+                      calibrate_attack_rate(0, CALIBRATION_SECONDS, &attack_rate) ? 2 : 1);
   }
 
-  gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(generate_data->label_entropy), password_strength);
+  return calibration == 2 ? &attack_rate : NULL;
+}
+
+/* Crack time of an estimate */
+double get_crack_seconds(const s_crack_estimate *estimate, int *master_weaker)
+{
+  /* Finding the master password gives this password too: the quicker of
+   * the two attacks is the one that counts */
+  const int weaker = estimate->master_seconds < estimate->password_seconds;
+
+  if (master_weaker) {
+    *master_weaker = weaker;
+  }
 
-  /* Cleanup */
-  memset(new_passwd, 0, strlen(new_passwd));
-  free(new_passwd);
+  return weaker ? estimate->master_seconds : estimate->password_seconds;
+}
+
+/* Position of a crack time on the strength bar */
+double get_crack_strength(double seconds)
+{
+  const double strength = seconds > 1 ? log10(seconds) / CRACK_TIME_LOG10_MAX : 0;
+
+  return strength > 1 ? 1 : strength;
+}
+
+/* Write a duration as a few words */
+void format_duration(double seconds, char *text, size_t size)
+{
+  static const struct {
+    double length;
+    const char *name;
+  } units[] = {
+    { 1.0,        "second" },
+    { 60.0,       "minute" },
+    { 3600.0,     "hour" },
+    { 86400.0,    "day" },
+    { 31557600.0, "year" }
+  };
+  const size_t last = sizeof(units) / sizeof(units[0]) - 1;
+  size_t unit = 0;
+  double count;
+
+  if (seconds < 1) {
+    snprintf(text, size, "less than a second");
+    return;
+  }
+
+  if (seconds >= 1e9 * units[last].length) {
+    snprintf(text, size, "over a billion years");
+    return;
+  }
+
+  while (unit < last && seconds >= units[unit + 1].length) {
+    unit++;
+  }
+
+  count = floor(seconds / units[unit].length + 0.5);
+  snprintf(text, size, "%.0f %s%s", count, units[unit].name, count > 1 ? "s" : "");
+}
+
+/* Index in strength_levels of a password strength */
+size_t get_strength_level(double password_strength)
+{
+  size_t level = 0;
+
+  while (level < STRENGTH_LEVEL_COUNT - 1 && password_strength >= strength_levels[level].below) {
+    level++;
+  }
+
+  return level;
 }
 
 /* Main window filling and callback attaching */
-void window_fill(GtkWidget* window)
+void window_fill(GtkWidget* window, const char *domain_list_path)
 {
   /* Lots of widgets */
   GtkWidget* table_global = NULL;
@@ -290,6 +734,8 @@ void window_fill(GtkWidget* window)
 
   GtkWidget* hseparator = NULL;
 
+  GtkWidget* button_domain_list = NULL;
+
   GtkWidget* box_security = NULL;
   GtkWidget* label_entropy = NULL;
   GtkWidget* icon_security_low = NULL;
@@ -304,7 +750,7 @@ void window_fill(GtkWidget* window)
   time_t time_value;
 
   /* Global table to put all the other widgets */
-  table_global = gtk_table_new(13, 2, FALSE);
+  table_global = gtk_table_new(14, 2, FALSE);
   gtk_table_set_row_spacings(GTK_TABLE(table_global), 3);
   gtk_table_set_col_spacings(GTK_TABLE(table_global), 3);
 
@@ -419,6 +865,10 @@ void window_fill(GtkWidget* window)
   gtk_box_pack_start(GTK_BOX(box_security), icon_security_high, FALSE, FALSE, 0);
   gtk_table_attach_defaults(GTK_TABLE(table_global), box_security, 0, 2, 12, 13);
 
+  /* Button to open a domain list, in its own window */
+  button_domain_list = gtk_button_new_with_label("Domain list...");
+  gtk_table_attach_defaults(GTK_TABLE(table_global), button_domain_list, 0, 2, 13, 14);
+
   /* Add the global table to the main window */
   gtk_container_add(GTK_CONTAINER(window), table_global);
 
@@ -440,6 +890,11 @@ void window_fill(GtkWidget* window)
   generate_data->security_icons[1] = icon_security_med;
   generate_data->security_icons[2] = icon_security_high;
 
+  /* Passwords are generated in a worker thread, not to freeze the window */
+  generate_data->generate_requests = g_async_queue_new();
+  generate_data->generate_worker = g_thread_new("generate", generate_worker,
+                                                generate_data->generate_requests);
+
   /* Password generated upon text entry and button click */
   g_signal_connect(check_low_avail, "clicked", G_CALLBACK(cb_generate), (void*) generate_data);
   g_signal_connect(check_upp_avail, "clicked", G_CALLBACK(cb_generate), (void*) generate_data);
@@ -451,6 +906,7 @@ void window_fill(GtkWidget* window)
   g_signal_connect(text_domain, "changed", G_CALLBACK(cb_generate), (void*) generate_data);
   g_signal_connect(text_year, "changed", G_CALLBACK(cb_generate), (void*) generate_data);
   g_signal_connect(text_fixed_size, "changed", G_CALLBACK(cb_generate), (void*) generate_data);
+  g_signal_connect(button_domain_list, "clicked", G_CALLBACK(cb_open_domain_list), (void*) generate_data);
 
   /* Call it once to display the funny icon correctly */
   cb_generate(NULL, (void*) generate_data);
@@ -482,9 +938,650 @@ void window_fill(GtkWidget* window)
   gtk_widget_show(text_newpasswd);
   gtk_widget_show(table_global);
   gtk_widget_show(box_security);
+  gtk_widget_show(button_domain_list);
   /* Funny icons are not diplayed here */
+
+  /* Domain list given on the command line */
+  if (domain_list_path) {
+    open_domain_list(generate_data, domain_list_path);
+  }
+}
+
+
+/* "Domain list..." button callback: ask for the file */
+void cb_open_domain_list(GtkWidget *widget, gpointer data)
+{
+  s_generate_data *generate_data = (s_generate_data *) data;
+  GtkWidget *dialog;
+  char *path = NULL;
+
+  dialog = gtk_file_chooser_dialog_new("Open a domain list",
+                                       GTK_WINDOW(gtk_widget_get_toplevel(widget)),
+                                       GTK_FILE_CHOOSER_ACTION_OPEN,
+                                       "_Cancel", GTK_RESPONSE_CANCEL,
+                                       "_Open", GTK_RESPONSE_ACCEPT,
+                                       NULL);
+
+  if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+    path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+  }
+
+  gtk_widget_destroy(dialog);
+
+  if (path) {
+    open_domain_list(generate_data, path);
+    g_free(path);
+  }
+}
+
+/* Read a domain list file and open its window */
+int open_domain_list(s_generate_data *generate_data, const char *path)
+{
+  GtkWidget *main_window = gtk_widget_get_toplevel(generate_data->text_domain);
+  s_domain_list *list;
+  GError *error = NULL;
+  gsize length = 0;
+  size_t invalid_line;
+  char *message;
+
+  list = g_new0(s_domain_list, 1);
+  list->generate_data = generate_data;
+
+  if (!g_file_get_contents(path, &list->text, &length, &error)) {
+    message = g_strdup_printf("Cannot read the domain list: %s", error->message);
+    show_error(main_window, message);
+    g_free(message);
+    g_error_free(error);
+    g_free(list);
+    return FALSE;
+  }
+
+  invalid_line = parse_domain_list(list, length);
+
+  if (invalid_line || !list->row_count) {
+    message = invalid_line
+              ? g_strdup_printf("%s, line %zu: expected <domain> [<categories> [<size>]]",
+                                path, invalid_line)
+              : g_strdup_printf("%s: no domain", path);
+    show_error(main_window, message);
+    g_free(message);
+    g_free(list->rows);
+    g_free(list->text);
+    g_free(list);
+    return FALSE;
+  }
+
+  /* One list at a time */
+  if (generate_data->domain_list) {
+    gtk_widget_destroy(generate_data->domain_list->window);
+  }
+
+  generate_data->domain_list = list;
+
+  /* Rows are generated in a worker thread of their own, not to delay the
+   * main window ones */
+  list->visible_first = 0;
+  list->visible_last = 0;
+  list->requests = g_async_queue_new();
+  list->worker = g_thread_new("domain-list", list_worker, list);
+
+  list_window_fill(list, path);
+  list_update_master(list);
+
+  return TRUE;
+}
+
+/* Split the list file text into rows, in place */
+size_t parse_domain_list(s_domain_list *list, size_t length)
+{
+  const char *separators = " \t\r";
+  char *line = list->text, *end = list->text + length, *line_end, *save;
+  size_t line_count = 1, line_number = 0;
+
+  for (line_end = line; line_end < end; line_end++) {
+    line_count += *line_end == '\n';
+  }
+
+  list->rows = g_new0(s_list_row, line_count);
+
+  while (line < end) {
+    const char *domain, *categories, *fixed_size;
+    s_list_row *row = &list->rows[list->row_count];
+
+    line_end = memchr(line, '\n', (size_t) (end - line));
+
+    if (!line_end) {
+      line_end = end;
+    }
+
+    /* The text from g_file_get_contents() ends with a null char: the last
+     * line can be ended there too */
+    *line_end = '\0';
+    line_number++;
+
+    domain = strtok_r(line, separators, &save);
+    line = line_end + 1;
+
+    /* Empty lines and comments, like dprpwg-batch */
+    if (!domain || *domain == '#') {
+      continue;
+    }
+
+    categories = strtok_r(NULL, separators, &save);
+    fixed_size = strtok_r(NULL, separators, &save);
+    row->flags = ALL_FLAGS;
+
+    if (strtok_r(NULL, separators, &save)
+        || (categories && !parse_categories(categories, &row->flags))
+        || list->row_count == G_MAXINT) {
+      return line_number;
+    }
+
+    if (fixed_size) {
+      char *size_end;
+      unsigned long size = strtoul(fixed_size, &size_end, 10);
+
+      if (*size_end || size > OUTPUT_MAX_LENGTH) {
+        return line_number;
+      }
+
+      row->fixed_size = size;
+    }
+
+    row->domain = domain;
+    list->row_count++;
+  }
+
+  return 0;
+}
+
+/* Write the symbol categories of flags ("luds"), 5 chars at most */
+void format_categories(unsigned int flags, char *categories)
+{
+  if (flags & FLAG_LOW_AVAIL) {
+    *categories++ = 'l';
+  }
+
+  if (flags & FLAG_UPP_AVAIL) {
+    *categories++ = 'u';
+  }
+
+  if (flags & FLAG_DIG_AVAIL) {
+    *categories++ = 'd';
+  }
+
+  if (flags & FLAG_SYM_AVAIL) {
+    *categories++ = 's';
+  }
+
+  *categories = '\0';
+}
+
+/* Domain list window filling and callback attaching */
+void list_window_fill(s_domain_list *list, const char *path)
+{
+  static const struct {
+    int id;
+    const char *title;
+    int width;
+  } columns[] = {
+    { LIST_COLUMN_DOMAIN,     "Domain",     240 },
+    { LIST_COLUMN_CATEGORIES, "Categories",  80 },
+    { LIST_COLUMN_SIZE,       "Size",        50 },
+    { LIST_COLUMN_PASSWORD,   "Password",   240 },
+    { LIST_COLUMN_STRENGTH,   "Strength",   140 }
+  };
+  GtkWidget *window, *box_list, *scrolled_list, *tree_view, *label_status;
+  GtkListStore *store;
+  GtkAdjustment *adjustment;
+  char *basename, *text;
+  size_t index;
+
+  /* The model only holds row indexes: everything shown comes from the rows,
+   * through cb_list_cell_data(). Filled before being attached to the view,
+   * so no signal is emitted per row. */
+  store = gtk_list_store_new(1, G_TYPE_UINT);
+
+  for (index = 0; index < list->row_count; index++) {
+    gtk_list_store_insert_with_values(store, NULL, -1, 0, (guint) index, -1);
+  }
+
+  list->model = GTK_TREE_MODEL(store);
+  tree_view = gtk_tree_view_new_with_model(list->model);
+
+  for (index = 0; index < sizeof(columns) / sizeof(columns[0]); index++) {
+    GtkTreeViewColumn *column = gtk_tree_view_column_new();
+    GtkCellRenderer *renderer = columns[index].id == LIST_COLUMN_STRENGTH
+                                ? gtk_cell_renderer_progress_new()
+                                : gtk_cell_renderer_text_new();
+
+    if (columns[index].id == LIST_COLUMN_PASSWORD) {
+      g_object_set(renderer, "family", "monospace", NULL);
+    }
+
+    gtk_tree_view_column_set_title(column, columns[index].title);
+    gtk_tree_view_column_pack_start(column, renderer, TRUE);
+    gtk_tree_view_column_set_sizing(column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(column, columns[index].width);
+    gtk_tree_view_column_set_resizable(column, TRUE);
+    g_object_set_data(G_OBJECT(column), "list-column", GINT_TO_POINTER(columns[index].id));
+    gtk_tree_view_column_set_cell_data_func(column, renderer, cb_list_cell_data, list, NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view), column);
+  }
+
+  /* All the rows have the same height: only the visible ones are measured
+   * and drawn, whatever the row count */
+  gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(tree_view), TRUE);
+
+  scrolled_list = gtk_scrolled_window_new(NULL, NULL);
+  gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(scrolled_list),
+                                 GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
+  gtk_container_add(GTK_CONTAINER(scrolled_list), tree_view);
+
+  text = g_strdup_printf("%zu domains. Double-click a row to copy its password.",
+                         list->row_count);
+  label_status = gtk_label_new(text);
+  g_free(text);
+
+  box_list = gtk_vbox_new(FALSE, 4);
+  gtk_box_pack_start(GTK_BOX(box_list), scrolled_list, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(box_list), label_status, FALSE, FALSE, 0);
+
+  window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+  basename = g_path_get_basename(path);
+  text = g_strdup_printf("Domain list: %s", basename);
+  gtk_window_set_title(GTK_WINDOW(window), text);
+  g_free(text);
+  g_free(basename);
+  gtk_window_set_default_size(GTK_WINDOW(window), 780, 480);
+  gtk_container_set_border_width(GTK_CONTAINER(window), 10);
+  gtk_window_set_icon_name(GTK_WINDOW(window), "dialog-password");
+  gtk_container_add(GTK_CONTAINER(window), box_list);
+
+  list->window = window;
+  list->tree_view = tree_view;
+
+  /* Follow the visible rows, and copy passwords on double-click */
+  adjustment = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_list));
+  g_signal_connect(adjustment, "value-changed", G_CALLBACK(cb_list_scrolled), (void*) list);
+  g_signal_connect(adjustment, "changed", G_CALLBACK(cb_list_scrolled), (void*) list);
+  g_signal_connect(tree_view, "row-activated", G_CALLBACK(cb_list_row_activated), (void*) list);
+
+  /* The cache is wiped when the window is closed */
+  g_signal_connect(window, "destroy", G_CALLBACK(cb_list_destroy), (void*) list);
+
+  gtk_widget_show_all(window);
+}
+
+/* Follow the master password and year of the main window */
+void list_update_master(s_domain_list *list)
+{
+  const s_generate_data *generate_data = list->generate_data;
+  const char *passwd = gtk_entry_get_text(GTK_ENTRY(generate_data->text_origpasswd));
+  const char *passwd_check = gtk_entry_get_text(GTK_ENTRY(generate_data->text_origpasswd_check));
+  const char *year = gtk_entry_get_text(GTK_ENTRY(generate_data->text_year));
+  s_list_request *request;
+  size_t index;
+
+  /* Like the main window: no master password until both entries match */
+  if (!*passwd || strcmp(passwd, passwd_check)) {
+    passwd = NULL;
+  }
+
+  if ((passwd ? list->passwd && !strcmp(passwd, list->passwd) : !list->passwd)
+      && list->year && !strcmp(year, list->year)) {
+    return;
+  }
+
+  /* Everything cached or requested so far is stale */
+  request = g_new0(s_list_request, 1);
+  request->list = list;
+  request->kind = LIST_REQUEST_MASTER;
+  request->epoch = g_atomic_int_add(&list->epoch, 1) + 1;
+
+  for (index = 0; index < list->row_count; index++) {
+    free_secure_buffer(list->rows[index].password);
+    list->rows[index].password = NULL;
+    list->rows[index].state = ROW_EMPTY;
+  }
+
+  free_secure_buffer(list->passwd);
+  g_free(list->year);
+  list->passwd = passwd ? secure_strdup(passwd) : NULL;
+  list->year = g_strdup(year);
+
+  /* The worker digests the master password once for all the rows */
+  request->passwd = list->passwd ? secure_strdup(list->passwd) : NULL;
+  request->year = g_strdup(year);
+  g_async_queue_push(list->requests, request);
+
+  /* Visible rows are requested again when drawn */
+  gtk_widget_queue_draw(list->tree_view);
 }
 
+/* Show one cell of a row */
+void cb_list_cell_data(GtkTreeViewColumn *column, GtkCellRenderer *renderer,
+                       GtkTreeModel *model, GtkTreeIter *iter, gpointer data)
+{
+  s_domain_list *list = (s_domain_list *) data;
+  const int column_id = GPOINTER_TO_INT(g_object_get_data(G_OBJECT(column), "list-column"));
+  guint index = 0;
+  const s_list_row *row;
+  char text[32];
+
+  gtk_tree_model_get(model, iter, 0, &index, -1);
+  row = &list->rows[index];
+
+  switch (column_id) {
+    case LIST_COLUMN_DOMAIN:
+      g_object_set(renderer, "text", row->domain, NULL);
+      break;
+
+    case LIST_COLUMN_CATEGORIES:
+      format_categories(row->flags, text);
+      g_object_set(renderer, "text", *text ? text : "-", NULL);
+      break;
+
+    case LIST_COLUMN_SIZE:
+      if (row->fixed_size) {
+        snprintf(text, sizeof(text), "%zu", row->fixed_size);
+      } else {
+        strcpy(text, "auto");
+      }
+      g_object_set(renderer, "text", text, NULL);
+      break;
+
+    default:
+      /* Rows are generated when first drawn, never before */
+      if (row->state == ROW_EMPTY && list->passwd) {
+        request_row(list, index);
+      }
+
+      if (column_id == LIST_COLUMN_PASSWORD) {
+        g_object_set(renderer, "text",
+                     row->state == ROW_DONE ? row->password
+                     : row->state == ROW_PENDING ? "..." : "", NULL);
+      } else if (row->state == ROW_DONE && *row->password && row->strength >= 0) {
+        /* Same scale and levels as the strength bar of the main window */
+        g_object_set(renderer, "value", (int) (row->strength * 100),
+                     "text", strength_levels[get_strength_level(row->strength)].name, NULL);
+      } else if (row->state == ROW_DONE && *row->password) {
+        g_object_set(renderer, "value", 0, "text", "N/A", NULL);
+      } else {
+        g_object_set(renderer, "value", 0, "text", "", NULL);
+      }
+      break;
+  }
+}
+
+/* Request the password of a row */
+void request_row(s_domain_list *list, size_t index)
+{
+  s_list_row *row = &list->rows[index];
+  s_list_request *request = g_new0(s_list_request, 1);
+
+  request->list = list;
+  request->kind = LIST_REQUEST_ROW;
+  request->epoch = g_atomic_int_get(&list->epoch);
+  request->row = index;
+  request->domain = row->domain;
+  request->flags = row->flags;
+  request->fixed_size = row->fixed_size;
+
+  row->state = ROW_PENDING;
+  g_async_queue_push(list->requests, request);
+}
+
+/* The list was scrolled or resized */
+void cb_list_scrolled(GtkAdjustment *adjustment, gpointer data)
+{
+  UNUSED_PARAM(adjustment);
+
+  update_visible_range((s_domain_list *) data);
+}
+
+/* Store the visible row range */
+void update_visible_range(s_domain_list *list)
+{
+  GtkTreePath *first = NULL, *last = NULL;
+
+  if (gtk_tree_view_get_visible_range(GTK_TREE_VIEW(list->tree_view), &first, &last)) {
+    g_atomic_int_set(&list->visible_first, gtk_tree_path_get_indices(first)[0]);
+    g_atomic_int_set(&list->visible_last, gtk_tree_path_get_indices(last)[0]);
+    gtk_tree_path_free(first);
+    gtk_tree_path_free(last);
+  }
+}
+
+/* Check if a row is within the visible range, margin included */
+int is_row_visible(s_domain_list *list, size_t index)
+{
+  const gint64 first = g_atomic_int_get(&list->visible_first);
+  const gint64 last = g_atomic_int_get(&list->visible_last);
+
+  return (gint64) index + LIST_VISIBLE_MARGIN >= first
+         && (gint64) index <= last + LIST_VISIBLE_MARGIN;
+}
+
+/* List worker thread main function */
+gpointer list_worker(gpointer data)
+{
+  s_domain_list *list = (s_domain_list *) data;
+  dprpwg_ctx *ctx = NULL;
+  char *passwd = NULL;        /* Secure buffer, for the crack time estimates */
+  char *year = NULL;
+
+  for (;;) {
+    s_list_request *request = g_async_queue_pop(list->requests);
+    const s_attack_rate *attack_rate;
+    s_crack_estimate estimate;
+
+    if (request->kind == LIST_REQUEST_QUIT) {
+      free_list_request(request);
+      break;
+    }
+
+    /* The master password or the year changed since: the cache entry this
+     * was for is gone */
+    if (request->epoch != g_atomic_int_get(&list->epoch)) {
+      free_list_request(request);
+      continue;
+    }
+
+    if (request->kind == LIST_REQUEST_MASTER) {
+      free_password_context(ctx);
+      free_secure_buffer(passwd);
+      g_free(year);
+      ctx = request->passwd ? create_password_context(request->passwd) : NULL;
+      passwd = request->passwd;
+      request->passwd = NULL;
+      year = g_strdup(request->year);
+      free_list_request(request);
+      continue;
+    }
+
+    /* Rows scrolled away are dropped: they are requested again if they
+     * come back into view */
+    if (ctx && is_row_visible(list, request->row)) {
+      /* A row which cannot be generated is cached empty, not requested
+       * over and over */
+      if (generate_password_ctx(ctx, request->domain, year, request->fixed_size,
+                                request->flags, request->new_passwd,
+                                sizeof(request->new_passwd), NULL, 0, NULL) != GENERATE_OK) {
+        request->new_passwd[0] = '\0';
+      }
+
+      request->generated = TRUE;
+    }
+
+    /* Rated like the password of the main window, by how long it resists */
+    if (request->generated && request->new_passwd[0]) {
+      attack_rate = get_attack_rate();
+      request->password_strength = -1;
+
+      if (attack_rate) {
+        estimate_crack_time(request->new_passwd, request->flags, passwd,
+                            attack_rate, &estimate);
+        request->password_strength = get_crack_strength(get_crack_seconds(&estimate, NULL));
+      }
+    }
+
+    g_idle_add(cb_list_row_done, request);
+  }
+
+  free_password_context(ctx);
+  free_secure_buffer(passwd);
+  g_free(year);
+
+  return NULL;
+}
+
+/* Back in the GTK thread: cache the row password, unless it is stale */
+gboolean cb_list_row_done(gpointer data)
+{
+  s_list_request *request = (s_list_request *) data;
+  s_domain_list *list = request->list;
+  s_list_row *row = &list->rows[request->row];
+  int redraw = FALSE;
+
+  if (request->epoch == g_atomic_int_get(&list->epoch) && row->state == ROW_PENDING) {
+    row->state = ROW_EMPTY;
+
+    if (request->generated) {
+      row->password = secure_strdup(request->new_passwd);
+
+      if (row->password) {
+        row->strength = request->password_strength;
+        row->state = ROW_DONE;
+        redraw = TRUE;
+      }
+    } else {
+      /* Dropped: request it again if it is in view after all */
+      update_visible_range(list);
+      redraw = is_row_visible(list, request->row);
+    }
+  }
+
+  if (redraw) {
+    GtkTreePath *path = gtk_tree_path_new_from_indices((gint) request->row, -1);
+    GtkTreeIter iter;
+
+    if (gtk_tree_model_get_iter(list->model, &iter, path)) {
+      gtk_tree_model_row_changed(list->model, path, &iter);
+    }
+
+    gtk_tree_path_free(path);
+  }
+
+  free_list_request(request);
+
+  return FALSE;
+}
+
+/* Row double-click: copy its password to the clipboard */
+void cb_list_row_activated(GtkTreeView *tree_view, GtkTreePath *path,
+                           GtkTreeViewColumn *column, gpointer data)
+{
+  const s_domain_list *list = (const s_domain_list *) data;
+  const s_list_row *row = &list->rows[gtk_tree_path_get_indices(path)[0]];
+
+  UNUSED_PARAM(tree_view);
+  UNUSED_PARAM(column);
+
+  if (row->state == ROW_DONE && *row->password) {
+    gtk_clipboard_set_text(gtk_clipboard_get(GDK_SELECTION_CLIPBOARD), row->password, -1);
+  }
+}
+
+/* Domain list window termination callback */
+void cb_list_destroy(GtkWidget *widget, gpointer data)
+{
+  s_domain_list *list = (s_domain_list *) data;
+  s_list_request *request;
+  GList *columns, *column;
+  size_t index;
+
+  UNUSED_PARAM(widget);
+
+  /* No new request from now on: neither from the main window (master
+   * password changes) nor from the rows drawn while the events are
+   * flushed below */
+  if (list->generate_data->domain_list == list) {
+    list->generate_data->domain_list = NULL;
+  }
+
+  columns = gtk_tree_view_get_columns(GTK_TREE_VIEW(list->tree_view));
+
+  for (column = columns; column; column = column->next) {
+    gtk_tree_view_column_clear(GTK_TREE_VIEW_COLUMN(column->data));
+  }
+
+  g_list_free(columns);
+
+  /* Stop the worker thread. Rows in progress are not cached. */
+  g_atomic_int_inc(&list->epoch);
+  request = g_new0(s_list_request, 1);
+  request->kind = LIST_REQUEST_QUIT;
+  g_async_queue_push(list->requests, request);
+  g_thread_join(list->worker);
+
+  /* Results not cached yet are stale now: let them be cleaned */
+  while (g_main_context_iteration(NULL, FALSE)) {
+  }
+
+  /* So are the requests the worker did not get to: they may hold the
+   * master password */
+  while ((request = g_async_queue_try_pop(list->requests))) {
+    free_list_request(request);
+  }
+
+  /* Secure buffers are wiped when freed */
+  for (index = 0; index < list->row_count; index++) {
+    free_secure_buffer(list->rows[index].password);
+  }
+
+  free_secure_buffer(list->passwd);
+
+  g_async_queue_unref(list->requests);
+  g_object_unref(list->model);
+  g_free(list->year);
+  g_free(list->rows);
+  g_free(list->text);
+  g_free(list);
+}
+
+/* Clean and free a list worker request */
+void free_list_request(s_list_request *request)
+{
+  memset(request->new_passwd, 0, sizeof(request->new_passwd));
+  free_secure_buffer(request->passwd);
+  g_free(request->year);
+  g_free(request);
+}
+
+/* Copy a string into a secure buffer */
+char *secure_strdup(const char *string)
+{
+  const size_t size = strlen(string) + 1;
+  char *copy = alloc_secure_buffer(size);
+
+  if (copy) {
+    memcpy(copy, string, size);
+  }
+
+  return copy;
+}
+
+/* Display an error message box */
+void show_error(GtkWidget *parent, const char *message)
+{
+  GtkWidget *dialog = gtk_message_dialog_new(GTK_WINDOW(parent), GTK_DIALOG_MODAL,
+                                             GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                             "%s", message);
+
+  gtk_dialog_run(GTK_DIALOG(dialog));
+  gtk_widget_destroy(dialog);
+}
 
 /* Useful function */
 int main(int argc, char *argv[])
@@ -501,8 +1598,9 @@ int main(int argc, char *argv[])
   /* Set window border width to a nicer value */
   gtk_container_set_border_width(GTK_CONTAINER(window), 10);
 
-  /* Now fill the window */
-  window_fill(window);
+  /* Now fill the window. The only argument left by GTK is an optional
+   * domain list. */
+  window_fill(window, argc > 1 ? argv[1] : NULL);
 
   /* Set the window icon */
   gtk_window_set_icon_name(GTK_WINDOW(window), "dialog-password");
@@ -0,0 +1,955 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Reverse lookup: which domain, and year, a leaked password was generated
+ * for.
+ *
+ * It reads the same records as dprpwg-batch (<domain> [<categories>
+ * [<size>]]), and generates their passwords for every year of a range, in
+ * parallel. No password is kept: only fingerprints, 64 bits keyed hashes
+ * (with a random key of the index) of each password. They are sorted by
+ * a counting sort on their top bits, which also gives a directory: the
+ * fingerprints of one top bits value are between two directory entries,
+ * about one or two of them. A lookup is one directory read and a few
+ * compares.
+ *
+ * The index (fingerprints, directory and records) can be written to a
+ * file, then mapped by later runs, which answer lookups without the
+ * master password. The index does not hold the passwords, but a
+ * fingerprint can confirm a guessed password: keep it as private as the
+ * passwords it was built from.
+ *
+ * A 64 bits fingerprint can match by chance: with 10 million passwords,
+ * about once in 2 million lookups of passwords not in the index. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_tools.h"
+
+/* Records generated at once, and by one thread */
+#define CHUNK_SIZE 256U
+
+#define MASTER_PASSWORD_MAXLENGTH 1024U
+#define YEAR_MAXLENGTH 16U
+
+/* Maximum number of years of an index */
+#define YEAR_MAX 64U
+
+/* Largest directory: 2^DIRECTORY_MAX_BITS + 1 entries */
+#define DIRECTORY_MAX_BITS 26U
+
+/* Index file magic value and version */
+#define INDEX_MAGIC "DPRPWGI1"
+
+/* Index file header. It is followed by the fingerprints (entry_count
+ * uint64_t), the directory (2^directory_bits + 1 uint32_t), the entry
+ * records (entry_count uint32_t: year * record_count + record), the
+ * domain offsets (record_count uint32_t), the fixed sizes (record_count
+ * uint16_t), the flags (record_count uint8_t) and the domains text
+ * (text_size chars, each domain null-terminated). */
+typedef struct {
+  char magic[8];
+  uint64_t key;
+  uint64_t record_count;
+  uint64_t entry_count;
+  uint64_t text_size;
+  uint32_t year_count;
+  uint32_t directory_bits;
+  char years[YEAR_MAX][YEAR_MAXLENGTH];
+} s_index_header;
+
+/* Records read from the inventory */
+typedef struct {
+  const char **domains;          /* Set once the whole text is read */
+  uint32_t *domain_offsets;
+  unsigned int *flags;
+  size_t *fixed_sizes;
+  size_t count;
+  size_t capacity;
+  char *text;
+  size_t text_used;
+  size_t text_size;
+} s_inventory;
+
+/* An index: built in memory, or mapped from a file */
+typedef struct {
+  s_index_header header;
+  uint64_t *fingerprints;
+  uint32_t *directory;
+  uint32_t *entries;
+  uint32_t *domain_offsets;
+  uint16_t *fixed_sizes;
+  uint8_t *flags;
+  const char *text;
+  void *mapping;
+  size_t mapping_size;
+} s_index;
+
+/* Everything the generation threads share */
+typedef struct {
+  dprpwg_ctx *ctx;
+  const s_inventory *inventory;
+  const s_index_header *header;
+  uint64_t *fingerprints;        /* Unsorted: entry year * count + record */
+  size_t chunks_per_year;
+  _Atomic size_t next_chunk;
+  _Atomic int failed;
+} s_generation;
+
+/* Print the command line help */
+static void usage(const char *program);
+
+/* Write categories as letters, "-" for none */
+static void format_categories(unsigned int flags, char *categories);
+
+/* Parse a year or a range of years: "2020" or "2020-2024" */
+static int parse_years(const char *range, s_index_header *header);
+
+/* Read all the inventory records. Return FALSE on error. */
+static int read_inventory(FILE *input, s_inventory *inventory);
+
+/* Get a random fingerprint key */
+static int make_key(uint64_t *key);
+
+/* Generation thread main function */
+static void *generation_run(void *data);
+
+/* Generate and fingerprint every record for every year, with
+ * 'thread_count' threads */
+static int generate_inventory(s_generation *generation, size_t thread_count);
+
+/* Sort the fingerprints into the index, and build its directory */
+static int build_index(s_index *index, const uint64_t *fingerprints);
+
+/* Give the index the records of the inventory, in the index file layout */
+static int pack_records(s_index *index, const s_inventory *inventory);
+
+/* Write an index file */
+static int write_index(const s_index *index, const char *path);
+
+/* Map an index file */
+static int map_index(s_index *index, const char *path);
+
+/* Answer the lookups of a file, one password per line */
+static int run_queries(const s_index *index, FILE *queries);
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [-p password_file] [-y year[-last]] [-j threads] [-e engine]\n"
+          "          [-w index_file] [-q queries] [input]\n"
+          "       %s -r index_file [queries]\n"
+          "  -p  Read the master password from the first line of this file.\n"
+          "      By default, it is asked on the terminal.\n"
+          "  -y  Year, or range of years (default: current year), up to %u.\n"
+          "  -j  Number of threads (default: number of cores).\n"
+          "  -e  Generation engine: reference, closed-form (default) or checked.\n"
+          "  -w  Write the index to this file.\n"
+          "  -q  Look up the passwords of this file.\n"
+          "  -r  Look up passwords in an index file, from queries or the\n"
+          "      standard input. No master password is needed.\n"
+          "Input records, one per line, as for dprpwg-batch:\n"
+          "  <domain> [<categories> [<size>]]\n"
+          "Queries: one password per line. Each match is written as\n"
+          "  <query line> <domain> <year> <categories> <size>\n"
+          "and a query without match as <query line> -\n",
+          program, program, YEAR_MAX);
+}
+
+void format_categories(unsigned int flags, char *categories)
+{
+  static const struct {
+    unsigned int flag;
+    char letter;
+  } letters[] = {
+    { FLAG_LOW_AVAIL, 'l' },
+    { FLAG_UPP_AVAIL, 'u' },
+    { FLAG_DIG_AVAIL, 'd' },
+    { FLAG_SYM_AVAIL, 's' }
+  };
+  size_t letter;
+
+  for (letter = 0; letter < sizeof(letters) / sizeof(letters[0]); letter++) {
+    if (flags & letters[letter].flag) {
+      *categories++ = letters[letter].letter;
+    }
+  }
+
+  if (!flags) {
+    *categories++ = '-';
+  }
+
+  *categories = '\0';
+}
+
+int parse_years(const char *range, s_index_header *header)
+{
+  char *end;
+  long first, last;
+
+  first = strtol(range, &end, 10);
+
+  /* Not a number: a single year, given as is to the library */
+  if (end == range || (*end && *end != '-')) {
+    snprintf(header->years[0], YEAR_MAXLENGTH, "%s", range);
+    header->year_count = 1;
+    return TRUE;
+  }
+
+  last = *end ? strtol(end + 1, &end, 10) : first;
+
+  if (*end || last < first || last - first >= (long) YEAR_MAX) {
+    fprintf(stderr, "Invalid year range \"%s\" (up to %u years)\n", range, YEAR_MAX);
+    return FALSE;
+  }
+
+  for (header->year_count = 0; first <= last; first++) {
+    snprintf(header->years[header->year_count++], YEAR_MAXLENGTH, "%ld", first);
+  }
+
+  return TRUE;
+}
+
+int read_inventory(FILE *input, s_inventory *inventory)
+{
+  const char *separators = " \t\r\n";
+  char *line = NULL;
+  size_t line_size = 0, line_number = 0, record;
+  int result = TRUE;
+
+  while (result && getline(&line, &line_size, input) >= 0) {
+    char *domain, *categories, *fixed_size, *end;
+    size_t domain_size;
+
+    line_number++;
+    domain = strtok(line, separators);
+
+    if (!domain || domain[0] == '#') {
+      continue;
+    }
+
+    domain_size = strlen(domain) + 1;
+    categories = strtok(NULL, separators);
+    fixed_size = strtok(NULL, separators);
+
+    /* Grow the arrays and the text as needed */
+    if (inventory->count == inventory->capacity) {
+      const size_t capacity = inventory->capacity ? 2 * inventory->capacity : 65536;
+      uint32_t *domain_offsets = realloc(inventory->domain_offsets, capacity * sizeof(uint32_t));
+      unsigned int *flags = domain_offsets
+                            ? realloc(inventory->flags, capacity * sizeof(unsigned int)) : NULL;
+      size_t *fixed_sizes = flags ? realloc(inventory->fixed_sizes, capacity * sizeof(size_t)) : NULL;
+
+      inventory->domain_offsets = domain_offsets ? domain_offsets : inventory->domain_offsets;
+      inventory->flags = flags ? flags : inventory->flags;
+      inventory->fixed_sizes = fixed_sizes ? fixed_sizes : inventory->fixed_sizes;
+
+      if (!fixed_sizes) {
+        fputs("Out of memory\n", stderr);
+        result = FALSE;
+        break;
+      }
+
+      inventory->capacity = capacity;
+    }
+
+    /* Domains are found by 32 bits offsets in the index */
+    if (inventory->text_used + domain_size > UINT32_MAX) {
+      fprintf(stderr, "Line %zu: too many domains\n", line_number);
+      result = FALSE;
+      break;
+    }
+
+    if (inventory->text_used + domain_size > inventory->text_size) {
+      const size_t text_size = 2 * (inventory->text_size + domain_size);
+      char *text = realloc(inventory->text, text_size);
+
+      if (!text) {
+        fputs("Out of memory\n", stderr);
+        result = FALSE;
+        break;
+      }
+
+      inventory->text = text;
+      inventory->text_size = text_size;
+    }
+
+    inventory->flags[inventory->count] = FLAG_LOW_AVAIL | FLAG_UPP_AVAIL
+                                         | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL;
+    inventory->fixed_sizes[inventory->count] = 0;
+
+    if (categories && !parse_categories(categories, &inventory->flags[inventory->count])) {
+      fprintf(stderr, "Line %zu: invalid symbol categories \"%s\"\n", line_number, categories);
+      result = FALSE;
+      break;
+    }
+
+    if (fixed_size) {
+      inventory->fixed_sizes[inventory->count] = strtoul(fixed_size, &end, 10);
+
+      if (*end || inventory->fixed_sizes[inventory->count] > OUTPUT_MAX_LENGTH) {
+        fprintf(stderr, "Line %zu: invalid size \"%s\" (0 to %u)\n",
+                line_number, fixed_size, OUTPUT_MAX_LENGTH);
+        result = FALSE;
+        break;
+      }
+    }
+
+    if (strtok(NULL, separators)) {
+      fprintf(stderr, "Line %zu: too many fields\n", line_number);
+      result = FALSE;
+      break;
+    }
+
+    memcpy(inventory->text + inventory->text_used, domain, domain_size);
+    inventory->domain_offsets[inventory->count++] = (uint32_t) inventory->text_used;
+    inventory->text_used += domain_size;
+  }
+
+  free(line);
+
+  if (result && ferror(input)) {
+    perror("input");
+    result = FALSE;
+  }
+
+  /* Domain pointers, now that the text does not move anymore */
+  if (result && inventory->count) {
+    inventory->domains = malloc(inventory->count * sizeof(const char *));
+
+    if (!inventory->domains) {
+      fputs("Out of memory\n", stderr);
+      return FALSE;
+    }
+
+    for (record = 0; record < inventory->count; record++) {
+      inventory->domains[record] = inventory->text + inventory->domain_offsets[record];
+    }
+  }
+
+  return result;
+}
+
+int make_key(uint64_t *key)
+{
+  FILE *random = fopen("/dev/urandom", "r");
+  int result;
+
+  if (!random) {
+    perror("/dev/urandom");
+    return FALSE;
+  }
+
+  result = fread(key, sizeof(uint64_t), 1, random) == 1;
+  fclose(random);
+
+  return result;
+}
+
+void *generation_run(void *data)
+{
+  s_generation *generation = (s_generation *) data;
+  const s_inventory *inventory = generation->inventory;
+  const size_t stride = OUTPUT_MAX_LENGTH + 1;
+  char *passwords = alloc_secure_buffer(CHUNK_SIZE * stride);
+  size_t chunk;
+
+  if (!passwords) {
+    atomic_store_explicit(&generation->failed, TRUE, memory_order_relaxed);
+    return NULL;
+  }
+
+  /* Chunks of one year's records, all the chunks of a year in a row */
+  while ((chunk = atomic_fetch_add_explicit(&generation->next_chunk, 1, memory_order_relaxed))
+         < generation->chunks_per_year * generation->header->year_count) {
+    const size_t year = chunk / generation->chunks_per_year;
+    const size_t first = (chunk % generation->chunks_per_year) * CHUNK_SIZE;
+    const size_t count = inventory->count - first < CHUNK_SIZE ? inventory->count - first : CHUNK_SIZE;
+    uint64_t *fingerprints = generation->fingerprints + year * inventory->count + first;
+    size_t record;
+
+    if (!generate_password_batch_ctx(generation->ctx, generation->header->years[year],
+                                     inventory->domains + first, inventory->flags + first,
+                                     inventory->fixed_sizes + first, count, passwords, stride)) {
+      atomic_store_explicit(&generation->failed, TRUE, memory_order_relaxed);
+    }
+
+    for (record = 0; record < count; record++) {
+      const char *password = passwords + record * stride;
+
+      fingerprints[record] = fingerprint(password, strlen(password), generation->header->key);
+    }
+  }
+
+  /* Secure buffers are wiped when freed */
+  free_secure_buffer(passwords);
+
+  return NULL;
+}
+
+int generate_inventory(s_generation *generation, size_t thread_count)
+{
+  pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+  size_t index, started = 0;
+
+  generation->chunks_per_year = (generation->inventory->count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  atomic_store(&generation->next_chunk, 0);
+  atomic_store(&generation->failed, FALSE);
+
+  for (index = 0; threads && index < thread_count; index++) {
+    if (pthread_create(&threads[index], NULL, generation_run, generation)) {
+      break;
+    }
+    started++;
+  }
+
+  /* If no thread started, work alone */
+  if (!started) {
+    generation_run(generation);
+  }
+
+  for (index = 0; index < started; index++) {
+    pthread_join(threads[index], NULL);
+  }
+
+  free(threads);
+
+  return !atomic_load(&generation->failed);
+}
+
+int build_index(s_index *index, const uint64_t *fingerprints)
+{
+  const size_t entry_count = index->header.entry_count;
+  size_t bits = 1, bucket_count, bucket, entry;
+  uint32_t *cursors;
+
+  /* About one entry per bucket */
+  while (bits < DIRECTORY_MAX_BITS && ((size_t) 1 << (bits + 1)) <= entry_count) {
+    bits++;
+  }
+
+  bucket_count = (size_t) 1 << bits;
+  index->header.directory_bits = (uint32_t) bits;
+  index->fingerprints = malloc(entry_count * sizeof(uint64_t));
+  index->entries = malloc(entry_count * sizeof(uint32_t));
+  index->directory = calloc(bucket_count + 1, sizeof(uint32_t));
+  cursors = malloc(bucket_count * sizeof(uint32_t));
+
+  if (!index->fingerprints || !index->entries || !index->directory || !cursors) {
+    free(cursors);
+    return FALSE;
+  }
+
+  /* Counting sort on the top bits: bucket sizes, then their starts */
+  for (entry = 0; entry < entry_count; entry++) {
+    index->directory[(fingerprints[entry] >> (64 - bits)) + 1]++;
+  }
+
+  for (bucket = 0; bucket < bucket_count; bucket++) {
+    index->directory[bucket + 1] += index->directory[bucket];
+    cursors[bucket] = index->directory[bucket];
+  }
+
+  for (entry = 0; entry < entry_count; entry++) {
+    const uint32_t position = cursors[fingerprints[entry] >> (64 - bits)]++;
+
+    index->fingerprints[position] = fingerprints[entry];
+    index->entries[position] = (uint32_t) entry;
+  }
+
+  free(cursors);
+
+  /* Buckets are tiny: insertion sort them, so equal fingerprints are
+   * adjacent, in entry order */
+  for (bucket = 0; bucket < bucket_count; bucket++) {
+    for (entry = index->directory[bucket] + 1; entry < index->directory[bucket + 1]; entry++) {
+      const uint64_t key = index->fingerprints[entry];
+      const uint32_t value = index->entries[entry];
+      size_t position = entry;
+
+      while (position > index->directory[bucket] && index->fingerprints[position - 1] > key) {
+        index->fingerprints[position] = index->fingerprints[position - 1];
+        index->entries[position] = index->entries[position - 1];
+        position--;
+      }
+
+      index->fingerprints[position] = key;
+      index->entries[position] = value;
+    }
+  }
+
+  return TRUE;
+}
+
+int pack_records(s_index *index, const s_inventory *inventory)
+{
+  size_t record;
+
+  index->domain_offsets = inventory->domain_offsets;
+  index->text = inventory->text;
+  index->fixed_sizes = malloc(inventory->count * sizeof(uint16_t));
+  index->flags = malloc(inventory->count);
+
+  if (!index->fixed_sizes || !index->flags) {
+    return FALSE;
+  }
+
+  for (record = 0; record < inventory->count; record++) {
+    index->fixed_sizes[record] = (uint16_t) inventory->fixed_sizes[record];
+    index->flags[record] = (uint8_t) inventory->flags[record];
+  }
+
+  return TRUE;
+}
+
+int write_index(const s_index *index, const char *path)
+{
+  const size_t record_count = (size_t) index->header.record_count;
+  const size_t entry_count = (size_t) index->header.entry_count;
+  const size_t bucket_count = (size_t) 1 << index->header.directory_bits;
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600), result;
+  FILE *output = fd >= 0 ? fdopen(fd, "wb") : NULL;
+
+  /* A fingerprint confirms a guessed password: owner only, like the
+   * passwords written by dprpwg-batch */
+  if (!output) {
+    perror(path);
+
+    if (fd >= 0) {
+      close(fd);
+    }
+    return FALSE;
+  }
+
+  result = fwrite(&index->header, sizeof(index->header), 1, output) == 1
+           && fwrite(index->fingerprints, sizeof(uint64_t), entry_count, output) == entry_count
+           && fwrite(index->directory, sizeof(uint32_t), bucket_count + 1, output)
+              == bucket_count + 1
+           && fwrite(index->entries, sizeof(uint32_t), entry_count, output) == entry_count
+           && fwrite(index->domain_offsets, sizeof(uint32_t), record_count, output) == record_count
+           && fwrite(index->fixed_sizes, sizeof(uint16_t), record_count, output) == record_count
+           && fwrite(index->flags, 1, record_count, output) == record_count
+           && fwrite(index->text, 1, (size_t) index->header.text_size, output)
+              == index->header.text_size;
+
+  if (fclose(output) || !result) {
+    perror(path);
+    result = FALSE;
+  }
+
+  return result;
+}
+
+int map_index(s_index *index, const char *path)
+{
+  const s_index_header *header;
+  struct stat status;
+  size_t expected_size, record_count, entry_count, bucket, bucket_count;
+  char *data;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0 || fstat(fd, &status)) {
+    perror(path);
+
+    if (fd >= 0) {
+      close(fd);
+    }
+    return FALSE;
+  }
+
+  index->mapping_size = (size_t) status.st_size;
+  index->mapping = index->mapping_size >= sizeof(s_index_header)
+                   ? mmap(NULL, index->mapping_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+  close(fd);
+
+  if (index->mapping == MAP_FAILED) {
+    fprintf(stderr, "%s: not an index file\n", path);
+    index->mapping = NULL;
+    return FALSE;
+  }
+
+  /* Check the header, then that the arrays it gives fill the file */
+  header = index->mapping;
+
+  if (header->record_count > UINT32_MAX || header->text_size > UINT32_MAX) {
+    fprintf(stderr, "%s: not an index file, or a damaged one\n", path);
+    munmap(index->mapping, index->mapping_size);
+    index->mapping = NULL;
+    return FALSE;
+  }
+
+  record_count = (size_t) header->record_count;
+  entry_count = (size_t) header->entry_count;
+  expected_size = sizeof(s_index_header) + entry_count * sizeof(uint64_t)
+                  + (((size_t) 1 << header->directory_bits) + 1) * sizeof(uint32_t)
+                  + entry_count * sizeof(uint32_t)
+                  + record_count * (sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint8_t))
+                  + (size_t) header->text_size;
+
+  if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic))
+      || header->directory_bits > DIRECTORY_MAX_BITS || !header->year_count
+      || header->year_count > YEAR_MAX || header->entry_count != header->record_count * header->year_count
+      || expected_size != index->mapping_size || !header->text_size) {
+    fprintf(stderr, "%s: not an index file, or a damaged one\n", path);
+    munmap(index->mapping, index->mapping_size);
+    index->mapping = NULL;
+    return FALSE;
+  }
+
+  index->header = *header;
+  data = (char *) index->mapping + sizeof(s_index_header);
+  index->fingerprints = (uint64_t *) data;
+  data += entry_count * sizeof(uint64_t);
+  index->directory = (uint32_t *) data;
+  data += (((size_t) 1 << header->directory_bits) + 1) * sizeof(uint32_t);
+  index->entries = (uint32_t *) data;
+  data += entry_count * sizeof(uint32_t);
+  index->domain_offsets = (uint32_t *) data;
+  data += record_count * sizeof(uint32_t);
+  index->fixed_sizes = (uint16_t *) data;
+  data += record_count * sizeof(uint16_t);
+  index->flags = (uint8_t *) data;
+  data += record_count;
+  index->text = data;
+
+  /* The directory is read without bounds checks: it must not decrease,
+   * and end with the last entry */
+  bucket_count = (size_t) 1 << header->directory_bits;
+
+  for (bucket = 0; bucket < bucket_count; bucket++) {
+    if (index->directory[bucket] > index->directory[bucket + 1]) {
+      break;
+    }
+  }
+
+  if (bucket < bucket_count || index->directory[bucket_count] != entry_count
+      || index->text[header->text_size - 1]) {
+    fprintf(stderr, "%s: damaged index file\n", path);
+    munmap(index->mapping, index->mapping_size);
+    index->mapping = NULL;
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int run_queries(const s_index *index, FILE *queries)
+{
+  const unsigned int bits = index->header.directory_bits;
+  const size_t record_count = (size_t) index->header.record_count;
+  char *line = NULL;
+  size_t line_size = 0, line_number = 0, match_count = 0;
+  struct timespec start, end;
+  double seconds = 0;
+  ssize_t length;
+
+  while ((length = getline(&line, &line_size, queries)) >= 0) {
+    uint64_t key;
+    size_t bucket, entry, matches = 0;
+
+    line_number++;
+
+    /* The password is the whole line, spaces included */
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      line[--length] = '\0';
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    key = fingerprint(line, (size_t) length, index->header.key);
+    bucket = (size_t) (key >> (64 - bits));
+
+    for (entry = index->directory[bucket];
+         entry < index->directory[bucket + 1] && index->fingerprints[entry] <= key; entry++) {
+      const size_t year = index->entries[entry] / record_count;
+      const size_t record = index->entries[entry] % record_count;
+      char categories[8];
+
+      if (index->fingerprints[entry] != key) {
+        continue;
+      }
+
+      /* Damaged index: better no answer than a wrong one */
+      if (year >= index->header.year_count
+          || index->domain_offsets[record] >= index->header.text_size) {
+        continue;
+      }
+
+      format_categories(index->flags[record], categories);
+      printf("%zu %s %s %s %u\n", line_number, index->text + index->domain_offsets[record],
+             index->header.years[year], categories, (unsigned int) index->fixed_sizes[record]);
+      matches++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds += (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+    if (!matches) {
+      printf("%zu -\n", line_number);
+    }
+
+    match_count += matches != 0;
+  }
+
+  /* The queries are leaked passwords: do not leave them around */
+  if (line) {
+    memset(line, 0, line_size);
+  }
+
+  free(line);
+
+  if (ferror(queries)) {
+    perror("queries");
+    return FALSE;
+  }
+
+  fprintf(stderr, "%zu lookups, %zu found, %.2f us per lookup\n", line_number, match_count,
+          line_number ? seconds * 1e6 / (double) line_number : 0.0);
+
+  return TRUE;
+}
+
+int main(int argc, char *argv[])
+{
+  char password[MASTER_PASSWORD_MAXLENGTH];
+  const char *password_path = NULL, *input_path = NULL, *write_path = NULL;
+  const char *query_path = NULL, *read_path = NULL;
+  size_t thread_count = 0;
+  FILE *input = stdin, *queries = stdin;
+  s_inventory inventory;
+  s_index index;
+  s_generation generation;
+  struct timespec start, end;
+  double seconds;
+  uint64_t *fingerprints;
+  unsigned int engine;
+  int option, result = TRUE;
+
+  memset(&inventory, 0, sizeof(inventory));
+  memset(&index, 0, sizeof(index));
+  memset(&generation, 0, sizeof(generation));
+
+  /* Default year: the current one */
+  {
+    time_t time_value = time(NULL);
+    struct tm *time_data = localtime(&time_value);
+    snprintf(index.header.years[0], YEAR_MAXLENGTH, "%d", time_data->tm_year + 1900);
+    index.header.year_count = 1;
+  }
+
+  set_generation_engine(ENGINE_CLOSED_FORM);
+
+  while ((option = getopt(argc, argv, "p:y:j:e:w:q:r:h")) != -1) {
+    switch (option) {
+      case 'p':
+        password_path = optarg;
+        break;
+      case 'y':
+        if (!parse_years(optarg, &index.header)) {
+          return 1;
+        }
+        break;
+      case 'j':
+        thread_count = strtoul(optarg, NULL, 10);
+        break;
+      case 'e':
+        if (!parse_engine(optarg, &engine)) {
+          usage(argv[0]);
+          return 1;
+        }
+        set_generation_engine(engine);
+        break;
+      case 'w':
+        write_path = optarg;
+        break;
+      case 'q':
+        query_path = optarg;
+        break;
+      case 'r':
+        read_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind < argc) {
+    input_path = argv[optind++];
+  }
+
+  /* Lookups in an index file: the argument is the queries */
+  if (read_path) {
+    if (optind < argc || write_path || query_path) {
+      usage(argv[0]);
+      return 1;
+    }
+
+    if (input_path && !(queries = fopen(input_path, "r"))) {
+      perror(input_path);
+      return 1;
+    }
+
+    result = map_index(&index, read_path) && run_queries(&index, queries);
+
+    if (index.mapping) {
+      munmap(index.mapping, index.mapping_size);
+    }
+
+    if (queries != stdin) {
+      fclose(queries);
+    }
+
+    return result ? 0 : 1;
+  }
+
+  if (optind < argc || (!write_path && !query_path)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (!thread_count) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cores > 0 ? (size_t) cores : 1;
+  }
+
+  if (input_path && !(input = fopen(input_path, "r"))) {
+    perror(input_path);
+    return 1;
+  }
+
+  if (query_path && !(queries = fopen(query_path, "r"))) {
+    perror(query_path);
+    return 1;
+  }
+
+  if (!read_inventory(input, &inventory)) {
+    return 1;
+  }
+
+  if (input != stdin) {
+    fclose(input);
+  }
+
+  /* Entries are numbered on 32 bits */
+  if (!inventory.count || (uint64_t) inventory.count * index.header.year_count > UINT32_MAX) {
+    fprintf(stderr, "%zu records: expected 1 to %llu for %u years\n", inventory.count,
+            (unsigned long long) (UINT32_MAX / index.header.year_count), index.header.year_count);
+    return 1;
+  }
+
+  memcpy(index.header.magic, INDEX_MAGIC, sizeof(index.header.magic));
+  index.header.record_count = inventory.count;
+  index.header.entry_count = (uint64_t) inventory.count * index.header.year_count;
+  index.header.text_size = inventory.text_used;
+
+  if (!make_key(&index.header.key)) {
+    fputs("No random fingerprint key\n", stderr);
+    return 1;
+  }
+
+  if (!read_master_password(password_path, password, sizeof(password))) {
+    fputs("No master password\n", stderr);
+    return 1;
+  }
+
+  fingerprints = malloc((size_t) index.header.entry_count * sizeof(uint64_t));
+  generation.ctx = create_password_context(password);
+  generation.inventory = &inventory;
+  generation.header = &index.header;
+  generation.fingerprints = fingerprints;
+  memset(password, 0, sizeof(password));
+
+  if (!fingerprints || !generation.ctx) {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (!generate_inventory(&generation, thread_count)) {
+    fputs("Generation failed\n", stderr);
+    result = FALSE;
+  }
+
+  free_password_context(generation.ctx);
+
+  if (result && !build_index(&index, fingerprints)) {
+    fputs("Out of memory\n", stderr);
+    result = FALSE;
+  }
+
+  free(fingerprints);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  if (result) {
+    fprintf(stderr, "%llu passwords (%zu domains, %u years) indexed in %.3f s "
+            "(%.0f passwords/s, %zu threads)\n",
+            (unsigned long long) index.header.entry_count, inventory.count,
+            index.header.year_count, seconds, (double) index.header.entry_count / seconds,
+            thread_count);
+  }
+
+  if (result && !pack_records(&index, &inventory)) {
+    fputs("Out of memory\n", stderr);
+    result = FALSE;
+  }
+
+  if (result && write_path) {
+    result = write_index(&index, write_path);
+  }
+
+  if (result && query_path) {
+    result = run_queries(&index, queries);
+  }
+
+  if (queries != stdin) {
+    fclose(queries);
+  }
+
+  free(index.fingerprints);
+  free(index.directory);
+  free(index.entries);
+  free(index.fixed_sizes);
+  free(index.flags);
+  free(inventory.domains);
+  free(inventory.domain_offsets);
+  free(inventory.flags);
+  free(inventory.fixed_sizes);
+  free(inventory.text);
+
+  return result ? 0 : 1;
+}
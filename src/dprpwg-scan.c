@@ -0,0 +1,830 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Collision scanner: checks that the domains of an inventory, under one
+ * master password, get distinct passwords.
+ *
+ * It reads the same records as dprpwg-batch (<domain> [<categories>
+ * [<size>]]), and generates their passwords in parallel, one window at a
+ * time. No password is kept: only fingerprints, 64 bits keyed hashes
+ * (with a random key of this run) of each password, and of its prefix and
+ * suffix of the length given with -l.
+ *
+ * Fingerprints go in an open-addressing hash table (linear probing, keys
+ * inline), where an equal fingerprint is a match with an earlier record.
+ * It doubles when 70% full. When it would outgrow the memory limit, it is
+ * sorted and written to a temporary file, then so is every next full
+ * buffer of fingerprints, and the sorted runs are merged at the end, equal
+ * fingerprints being adjacent. Memory use stays within the limit, plus one
+ * read buffer per run during the merge.
+ *
+ * A 64 bits fingerprint can match by chance: with 10 million passwords,
+ * less than once in 100000 scans. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_tools.h"
+
+/* Records generated at once, and by one thread */
+#define WINDOW_RECORDS 65536U
+#define CHUNK_SIZE 256U
+
+/* Domain chars of one window, null chars included */
+#define WINDOW_TEXT_SIZE (4U << 20)
+
+#define MASTER_PASSWORD_MAXLENGTH 1024U
+#define YEAR_MAXLENGTH 16U
+
+/* Defaults: memory limit (MiB), shared prefix/suffix length, matches listed */
+#define MEMORY_LIMIT 1024U
+#define SHARED_LENGTH 8U
+#define LISTED_MATCHES 100U
+
+/* First size of the hash table, doubled as it fills up to the limit */
+#define TABLE_MIN_CAPACITY 65536U
+
+/* Entries read at once from each run during the merge */
+#define RUN_BUFFER_ENTRIES 65536U
+
+/* Fingerprint kinds */
+enum {
+  KIND_PASSWORD,
+  KIND_PREFIX,
+  KIND_SUFFIX,
+  KIND_COUNT
+};
+
+/* Entry value: kind in the top bits, input line number below */
+#define KIND_SHIFT 62
+#define LINE_MASK ((UINT64_C(1) << KIND_SHIFT) - 1)
+
+/* One fingerprint. A zero key is an empty table slot (or no fingerprint,
+ * for prefixes and suffixes of short passwords). */
+typedef struct {
+  uint64_t key;
+  uint64_t value;
+} s_entry;
+
+/* One window of records */
+typedef struct {
+  const char *domains[WINDOW_RECORDS];
+  unsigned int flags[WINDOW_RECORDS];
+  size_t fixed_sizes[WINDOW_RECORDS];
+  size_t lines[WINDOW_RECORDS];
+  size_t count;
+  char *text;
+  size_t text_used;
+
+  /* Last line read. Pending if it did not fit in the window. */
+  char *line;
+  size_t line_size;
+  int pending;
+} s_window;
+
+/* Everything the generation threads share */
+typedef struct {
+  dprpwg_ctx *ctx;
+  const char *year;
+  const s_window *window;
+  char *passwords;               /* OUTPUT_MAX_LENGTH + 1 chars per record */
+  s_entry *entries;              /* KIND_COUNT per record */
+  size_t shared_length;
+  uint64_t keys[KIND_COUNT];
+  _Atomic size_t next_chunk;
+  _Atomic int failed;
+} s_generation;
+
+/* Matches found */
+typedef struct {
+  uint64_t counts[KIND_COUNT];
+  s_entry *listed;               /* key: first line, value: kind and line */
+  size_t listed_count;
+  size_t listed_max;
+} s_matches;
+
+/* Fingerprint store: the hash table, then sorted runs */
+typedef struct {
+  s_entry *entries;
+  size_t capacity;               /* Table slots, a power of 2 */
+  size_t max_capacity;           /* Largest table within the memory limit */
+  size_t used;
+  int spilled;                   /* TRUE once entries is a run buffer */
+  FILE **runs;
+  size_t run_count;
+} s_store;
+
+/* One run during the merge */
+typedef struct {
+  FILE *file;
+  s_entry *buffer;
+  size_t count;
+  size_t next;
+} s_run_reader;
+
+/* Print the command line help */
+static void usage(const char *program);
+
+/* Read the next window of records, until it is full or the input ends.
+ * Return FALSE on error. */
+static int read_window(FILE *input, s_window *window, size_t *line_number);
+
+/* Get random fingerprint keys */
+static int make_keys(uint64_t *keys);
+
+/* Generation thread main function */
+static void *generation_run(void *data);
+
+/* Generate and fingerprint a window, with 'thread_count' threads */
+static int generate_window(s_generation *generation, size_t thread_count);
+
+/* Count a match between two entries of the same fingerprint */
+static void add_match(s_matches *matches, uint64_t first_value, uint64_t value);
+
+/* Double the hash table. Return FALSE if out of memory. */
+static int grow_table(s_store *store);
+
+/* Add a fingerprint to the store. Return FALSE on error. */
+static int store_entry(s_store *store, s_matches *matches, const s_entry *entry);
+
+/* Sort the store entries and write them as a run */
+static int write_run(s_store *store);
+
+/* Merge the runs, counting matches */
+static int merge_runs(s_store *store, s_matches *matches);
+
+/* Order of entries: key, then value */
+static int compare_entries(const void *a, const void *b);
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [-p password_file] [-y year] [-l length] [-m MiB] [-r count]\n"
+          "          [-j threads] [-e engine] [input]\n"
+          "  -p  Read the master password from the first line of this file.\n"
+          "      By default, it is asked on the terminal.\n"
+          "  -y  Year (default: current year).\n"
+          "  -l  Report passwords sharing a prefix or a suffix of this length\n"
+          "      (default: %u). 0 for identical passwords only.\n"
+          "  -m  Memory limit of the fingerprints, in MiB (default: %u).\n"
+          "  -r  Number of matches listed (default: %u).\n"
+          "  -j  Number of threads (default: number of cores).\n"
+          "  -e  Generation engine: reference, closed-form (default) or checked.\n"
+          "Input records, one per line, as for dprpwg-batch:\n"
+          "  <domain> [<categories> [<size>]]\n"
+          "Exit status: 0 if no match, 2 if some, 1 on error.\n",
+          program, SHARED_LENGTH, MEMORY_LIMIT, LISTED_MATCHES);
+}
+
+int read_window(FILE *input, s_window *window, size_t *line_number)
+{
+  const char *separators = " \t\r\n";
+
+  window->count = 0;
+  window->text_used = 0;
+
+  while (window->count < WINDOW_RECORDS) {
+    char *domain, *categories, *fixed_size, *end;
+    size_t domain_size;
+
+    if (window->pending) {
+      window->pending = FALSE;
+    } else if (getline(&window->line, &window->line_size, input) >= 0) {
+      (*line_number)++;
+    } else {
+      break;
+    }
+
+    /* No room left for the line: it starts the next window */
+    if (window->text_used + strlen(window->line) + 1 > WINDOW_TEXT_SIZE) {
+      if (!window->count) {
+        fprintf(stderr, "Line %zu: line too long\n", *line_number);
+        return FALSE;
+      }
+
+      window->pending = TRUE;
+      break;
+    }
+
+    domain = strtok(window->line, separators);
+
+    if (!domain || domain[0] == '#') {
+      continue;
+    }
+
+    domain_size = strlen(domain) + 1;
+    categories = strtok(NULL, separators);
+    fixed_size = strtok(NULL, separators);
+
+    window->flags[window->count] = FLAG_LOW_AVAIL | FLAG_UPP_AVAIL
+                                   | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL;
+    window->fixed_sizes[window->count] = 0;
+    window->lines[window->count] = *line_number;
+
+    if (categories && !parse_categories(categories, &window->flags[window->count])) {
+      fprintf(stderr, "Line %zu: invalid symbol categories \"%s\"\n", *line_number, categories);
+      return FALSE;
+    }
+
+    if (fixed_size) {
+      window->fixed_sizes[window->count] = strtoul(fixed_size, &end, 10);
+
+      if (*end || window->fixed_sizes[window->count] > OUTPUT_MAX_LENGTH) {
+        fprintf(stderr, "Line %zu: invalid size \"%s\" (0 to %u)\n",
+                *line_number, fixed_size, OUTPUT_MAX_LENGTH);
+        return FALSE;
+      }
+    }
+
+    if (strtok(NULL, separators)) {
+      fprintf(stderr, "Line %zu: too many fields\n", *line_number);
+      return FALSE;
+    }
+
+    memcpy(window->text + window->text_used, domain, domain_size);
+    window->domains[window->count++] = window->text + window->text_used;
+    window->text_used += domain_size;
+  }
+
+  if (ferror(input)) {
+    perror("input");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+int make_keys(uint64_t *keys)
+{
+  FILE *random = fopen("/dev/urandom", "r");
+  int result;
+
+  if (!random) {
+    perror("/dev/urandom");
+    return FALSE;
+  }
+
+  result = fread(keys, sizeof(uint64_t), KIND_COUNT, random) == KIND_COUNT;
+  fclose(random);
+
+  return result;
+}
+
+void *generation_run(void *data)
+{
+  s_generation *generation = (s_generation *) data;
+  const s_window *window = generation->window;
+  const size_t stride = OUTPUT_MAX_LENGTH + 1;
+  size_t chunk;
+
+  while ((chunk = atomic_fetch_add_explicit(&generation->next_chunk, 1, memory_order_relaxed))
+         * CHUNK_SIZE < window->count) {
+    const size_t first = chunk * CHUNK_SIZE;
+    const size_t count = window->count - first < CHUNK_SIZE ? window->count - first : CHUNK_SIZE;
+    size_t record;
+
+    if (!generate_password_batch_ctx(generation->ctx, generation->year,
+                                     window->domains + first, window->flags + first,
+                                     window->fixed_sizes + first, count,
+                                     generation->passwords + first * stride, stride)) {
+      atomic_store_explicit(&generation->failed, TRUE, memory_order_relaxed);
+    }
+
+    for (record = first; record < first + count; record++) {
+      const char *password = generation->passwords + record * stride;
+      const size_t length = strlen(password);
+      const size_t shared_length = generation->shared_length;
+      s_entry *entries = generation->entries + record * KIND_COUNT;
+      const uint64_t line = (uint64_t) window->lines[record] & LINE_MASK;
+
+      memset(entries, 0, KIND_COUNT * sizeof(s_entry));
+      entries[KIND_PASSWORD].key = fingerprint(password, length, generation->keys[KIND_PASSWORD]);
+      entries[KIND_PASSWORD].value = ((uint64_t) KIND_PASSWORD << KIND_SHIFT) | line;
+
+      if (shared_length && length >= shared_length) {
+        entries[KIND_PREFIX].key = fingerprint(password, shared_length,
+                                               generation->keys[KIND_PREFIX]);
+        entries[KIND_PREFIX].value = ((uint64_t) KIND_PREFIX << KIND_SHIFT) | line;
+        entries[KIND_SUFFIX].key = fingerprint(password + length - shared_length, shared_length,
+                                               generation->keys[KIND_SUFFIX]);
+        entries[KIND_SUFFIX].value = ((uint64_t) KIND_SUFFIX << KIND_SHIFT) | line;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int generate_window(s_generation *generation, size_t thread_count)
+{
+  pthread_t *threads = calloc(thread_count, sizeof(pthread_t));
+  size_t index, started = 0;
+
+  atomic_store(&generation->next_chunk, 0);
+  atomic_store(&generation->failed, FALSE);
+
+  for (index = 0; threads && index < thread_count; index++) {
+    if (pthread_create(&threads[index], NULL, generation_run, generation)) {
+      break;
+    }
+    started++;
+  }
+
+  /* If no thread started, work alone */
+  if (!started) {
+    generation_run(generation);
+  }
+
+  for (index = 0; index < started; index++) {
+    pthread_join(threads[index], NULL);
+  }
+
+  free(threads);
+
+  return !atomic_load(&generation->failed);
+}
+
+void add_match(s_matches *matches, uint64_t first_value, uint64_t value)
+{
+  matches->counts[value >> KIND_SHIFT]++;
+
+  if (matches->listed_count < matches->listed_max) {
+    matches->listed[matches->listed_count].key = first_value & LINE_MASK;
+    matches->listed[matches->listed_count].value = value;
+    matches->listed_count++;
+  }
+}
+
+int grow_table(s_store *store)
+{
+  const size_t capacity = store->capacity * 2;
+  s_entry *entries = calloc(capacity, sizeof(s_entry));
+  size_t index, slot;
+
+  if (!entries) {
+    return FALSE;
+  }
+
+  for (index = 0; index < store->capacity; index++) {
+    if (!store->entries[index].key) {
+      continue;
+    }
+
+    for (slot = (size_t) store->entries[index].key & (capacity - 1); entries[slot].key;
+         slot = (slot + 1) & (capacity - 1)) {
+    }
+
+    entries[slot] = store->entries[index];
+  }
+
+  free(store->entries);
+  store->entries = entries;
+  store->capacity = capacity;
+
+  return TRUE;
+}
+
+int store_entry(s_store *store, s_matches *matches, const s_entry *entry)
+{
+  size_t slot;
+
+  if (!entry->key) {
+    return TRUE;
+  }
+
+  /* Once spilled, fill the buffer, written as a run when full */
+  if (store->spilled) {
+    if (store->used == store->capacity && !write_run(store)) {
+      return FALSE;
+    }
+
+    store->entries[store->used++] = *entry;
+    return TRUE;
+  }
+
+  /* Linear probing: the first equal fingerprint of the same kind is an
+   * earlier record */
+  for (slot = (size_t) entry->key & (store->capacity - 1); store->entries[slot].key;
+       slot = (slot + 1) & (store->capacity - 1)) {
+    if (store->entries[slot].key == entry->key
+        && store->entries[slot].value >> KIND_SHIFT == entry->value >> KIND_SHIFT) {
+      add_match(matches, store->entries[slot].value, entry->value);
+      return TRUE;
+    }
+  }
+
+  /* Table 70% full: twice larger, or if that is over the limit, everything
+   * goes through sorted runs from now on */
+  if (store->used == store->capacity / 10 * 7) {
+    if (store->capacity < store->max_capacity && grow_table(store)) {
+      return store_entry(store, matches, entry);
+    }
+
+    if (!write_run(store)) {
+      return FALSE;
+    }
+
+    store->spilled = TRUE;
+    store->entries[store->used++] = *entry;
+    return TRUE;
+  }
+
+  store->entries[slot] = *entry;
+  store->used++;
+
+  return TRUE;
+}
+
+int compare_entries(const void *a, const void *b)
+{
+  const s_entry *entry_a = (const s_entry *) a, *entry_b = (const s_entry *) b;
+
+  if (entry_a->key != entry_b->key) {
+    return entry_a->key < entry_b->key ? -1 : 1;
+  }
+
+  if (entry_a->value != entry_b->value) {
+    return entry_a->value < entry_b->value ? -1 : 1;
+  }
+
+  return 0;
+}
+
+int write_run(s_store *store)
+{
+  FILE **runs;
+  FILE *run;
+  size_t used = store->used, slot;
+
+  /* The table has holes: pack it first */
+  if (!store->spilled) {
+    used = 0;
+
+    for (slot = 0; slot < store->capacity; slot++) {
+      if (store->entries[slot].key) {
+        store->entries[used++] = store->entries[slot];
+      }
+    }
+  }
+
+  qsort(store->entries, used, sizeof(s_entry), compare_entries);
+
+  runs = realloc(store->runs, (store->run_count + 1) * sizeof(FILE *));
+  run = tmpfile();
+
+  if (runs) {
+    store->runs = runs;
+  }
+
+  if (!runs || !run || fwrite(store->entries, sizeof(s_entry), used, run) != used
+      || fflush(run) || fseek(run, 0, SEEK_SET)) {
+    perror("Temporary file");
+
+    if (run) {
+      fclose(run);
+    }
+
+    return FALSE;
+  }
+
+  store->runs[store->run_count++] = run;
+  store->used = 0;
+
+  return TRUE;
+}
+
+int merge_runs(s_store *store, s_matches *matches)
+{
+  s_run_reader *readers = calloc(store->run_count, sizeof(s_run_reader));
+  size_t *heap = calloc(store->run_count, sizeof(size_t));
+  size_t heap_size = 0, index;
+  s_entry group = { 0, 0 };
+  int result = readers && heap;
+
+  if (!result) {
+    fputs("Out of memory\n", stderr);
+  }
+
+  /* Min-heap of the runs, on their next entry */
+#define READER_ENTRY(reader) (&readers[reader].buffer[readers[reader].next])
+#define HEAP_LESS(a, b) (compare_entries(READER_ENTRY(heap[a]), READER_ENTRY(heap[b])) < 0)
+
+  for (index = 0; result && index < store->run_count; index++) {
+    size_t child;
+
+    readers[index].file = store->runs[index];
+    readers[index].buffer = malloc(RUN_BUFFER_ENTRIES * sizeof(s_entry));
+
+    if (!readers[index].buffer) {
+      fputs("Out of memory\n", stderr);
+      result = FALSE;
+      break;
+    }
+
+    readers[index].count = fread(readers[index].buffer, sizeof(s_entry), RUN_BUFFER_ENTRIES,
+                                 readers[index].file);
+
+    if (!readers[index].count) {
+      continue;
+    }
+
+    /* Sift up */
+    heap[heap_size] = index;
+
+    for (child = heap_size++; child && HEAP_LESS(child, (child - 1) / 2); child = (child - 1) / 2) {
+      size_t swap = heap[child];
+
+      heap[child] = heap[(child - 1) / 2];
+      heap[(child - 1) / 2] = swap;
+    }
+  }
+
+  while (result && heap_size) {
+    const size_t reader = heap[0];
+    const s_entry entry = *READER_ENTRY(reader);
+    size_t parent, child;
+
+    /* Equal fingerprints are adjacent, the earliest line first */
+    if (entry.key == group.key && entry.value >> KIND_SHIFT == group.value >> KIND_SHIFT) {
+      add_match(matches, group.value, entry.value);
+    } else {
+      group = entry;
+    }
+
+    /* Next entry of this run, refilling its buffer if needed */
+    if (++readers[reader].next == readers[reader].count) {
+      readers[reader].next = 0;
+      readers[reader].count = fread(readers[reader].buffer, sizeof(s_entry), RUN_BUFFER_ENTRIES,
+                                    readers[reader].file);
+
+      if (!readers[reader].count) {
+        if (ferror(readers[reader].file)) {
+          perror("Temporary file");
+          result = FALSE;
+        }
+
+        heap[0] = heap[--heap_size];
+      }
+    }
+
+    /* Sift down */
+    for (parent = 0; (child = 2 * parent + 1) < heap_size; parent = child) {
+      size_t swap;
+
+      if (child + 1 < heap_size && HEAP_LESS(child + 1, child)) {
+        child++;
+      }
+
+      if (!HEAP_LESS(child, parent)) {
+        break;
+      }
+
+      swap = heap[child];
+      heap[child] = heap[parent];
+      heap[parent] = swap;
+    }
+  }
+
+#undef HEAP_LESS
+#undef READER_ENTRY
+
+  for (index = 0; readers && index < store->run_count; index++) {
+    free(readers[index].buffer);
+  }
+
+  free(readers);
+  free(heap);
+
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *const kind_names[KIND_COUNT] = { "password", "prefix", "suffix" };
+  char password[MASTER_PASSWORD_MAXLENGTH];
+  char year[YEAR_MAXLENGTH];
+  const char *password_path = NULL, *input_path = NULL;
+  size_t thread_count = 0, memory_limit = MEMORY_LIMIT, line_number = 0, record_count = 0;
+  size_t index, kind;
+  FILE *input = stdin;
+  s_window *window;
+  s_generation generation;
+  s_store store;
+  s_matches matches;
+  struct timespec start, end;
+  double seconds;
+  unsigned int engine;
+  int option, result = TRUE;
+
+  memset(&generation, 0, sizeof(generation));
+  memset(&store, 0, sizeof(store));
+  memset(&matches, 0, sizeof(matches));
+  generation.shared_length = SHARED_LENGTH;
+  matches.listed_max = LISTED_MATCHES;
+
+  /* Default year: the current one */
+  {
+    time_t time_value = time(NULL);
+    struct tm *time_data = localtime(&time_value);
+    snprintf(year, YEAR_MAXLENGTH, "%d", time_data->tm_year + 1900);
+  }
+
+  set_generation_engine(ENGINE_CLOSED_FORM);
+
+  while ((option = getopt(argc, argv, "p:y:l:m:r:j:e:h")) != -1) {
+    switch (option) {
+      case 'p':
+        password_path = optarg;
+        break;
+      case 'y':
+        snprintf(year, YEAR_MAXLENGTH, "%s", optarg);
+        break;
+      case 'l':
+        generation.shared_length = strtoul(optarg, NULL, 10);
+        break;
+      case 'm':
+        memory_limit = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        matches.listed_max = strtoul(optarg, NULL, 10);
+        break;
+      case 'j':
+        thread_count = strtoul(optarg, NULL, 10);
+        break;
+      case 'e':
+        if (!parse_engine(optarg, &engine)) {
+          usage(argv[0]);
+          return 1;
+        }
+        set_generation_engine(engine);
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind < argc) {
+    input_path = argv[optind++];
+  }
+
+  if (optind < argc || !memory_limit) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (!thread_count) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cores > 0 ? (size_t) cores : 1;
+  }
+
+  if (input_path && !(input = fopen(input_path, "r"))) {
+    perror(input_path);
+    return 1;
+  }
+
+  if (!read_master_password(password_path, password, sizeof(password))) {
+    fputs("No master password\n", stderr);
+    return 1;
+  }
+
+  /* The largest table such that, while it is doubled, the old and the new
+   * ones fit within the limit together */
+  store.max_capacity = 1;
+
+  while (store.max_capacity * 3 * sizeof(s_entry) <= memory_limit << 20) {
+    store.max_capacity *= 2;
+  }
+
+  store.capacity = store.max_capacity < TABLE_MIN_CAPACITY ? store.max_capacity : TABLE_MIN_CAPACITY;
+  store.entries = calloc(store.capacity, sizeof(s_entry));
+  window = calloc(1, sizeof(s_window));
+  matches.listed = malloc((matches.listed_max + 1) * sizeof(s_entry));
+  generation.ctx = create_password_context(password);
+  generation.year = year;
+  generation.window = window;
+  generation.passwords = alloc_secure_buffer(WINDOW_RECORDS * (OUTPUT_MAX_LENGTH + 1));
+  generation.entries = malloc(WINDOW_RECORDS * KIND_COUNT * sizeof(s_entry));
+  memset(password, 0, sizeof(password));
+
+  if (window) {
+    window->text = malloc(WINDOW_TEXT_SIZE);
+  }
+
+  if (!store.entries || !window || !window->text || !matches.listed || !generation.ctx
+      || !generation.passwords || !generation.entries) {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+
+  if (!make_keys(generation.keys)) {
+    fputs("No random fingerprint keys\n", stderr);
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while (result && (result = read_window(input, window, &line_number)) && window->count) {
+    if (!generate_window(&generation, thread_count)) {
+      fputs("Generation failed\n", stderr);
+      result = FALSE;
+      break;
+    }
+
+    for (index = 0; result && index < window->count * KIND_COUNT; index++) {
+      result = store_entry(&store, &matches, &generation.entries[index]);
+    }
+
+    record_count += window->count;
+  }
+
+  if (result && store.spilled) {
+    result = write_run(&store) && merge_runs(&store, &matches);
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+  if (result) {
+    printf("%zu passwords\n", record_count);
+    printf("identical passwords: %llu\n", (unsigned long long) matches.counts[KIND_PASSWORD]);
+
+    if (generation.shared_length) {
+      printf("shared %zu chars prefixes: %llu\n", generation.shared_length,
+             (unsigned long long) matches.counts[KIND_PREFIX]);
+      printf("shared %zu chars suffixes: %llu\n", generation.shared_length,
+             (unsigned long long) matches.counts[KIND_SUFFIX]);
+    }
+
+    /* Each match: kind, line of the earliest record, line of this one */
+    qsort(matches.listed, matches.listed_count, sizeof(s_entry), compare_entries);
+
+    for (index = 0; index < matches.listed_count; index++) {
+      printf("%s %llu %llu\n", kind_names[matches.listed[index].value >> KIND_SHIFT],
+             (unsigned long long) matches.listed[index].key,
+             (unsigned long long) (matches.listed[index].value & LINE_MASK));
+    }
+
+    fprintf(stderr, "%zu passwords in %.3f s (%.0f passwords/s, %zu threads, %zu runs)\n",
+            record_count, seconds, (double) record_count / seconds, thread_count,
+            store.run_count);
+  }
+
+  for (index = 0; index < store.run_count; index++) {
+    fclose(store.runs[index]);
+  }
+
+  if (input_path) {
+    fclose(input);
+  }
+
+  free_password_context(generation.ctx);
+  free_secure_buffer(generation.passwords);
+  free(generation.entries);
+  free(store.entries);
+  free(store.runs);
+  free(matches.listed);
+  free(window->text);
+  free(window->line);
+  free(window);
+
+  if (!result) {
+    return 1;
+  }
+
+  for (kind = 0; kind < KIND_COUNT; kind++) {
+    if (matches.counts[kind]) {
+      return 2;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,558 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* The result cache of master password contexts, see dprpwg_cache.h */
+
+#include "dprpwg_cache.h"
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/* Number of shards, a power of two. The shard of a key is given by the
+ * top bits of its hash, the bucket by the low ones. */
+#define CACHE_SHARD_BITS  4U
+#define CACHE_SHARD_COUNT (1U << CACHE_SHARD_BITS)
+
+/* End of a bucket chain */
+#define CACHE_NONE UINT32_MAX
+
+/* Shard lock: writer bit, and reader count below it */
+#define CACHE_WRITER 0x80000000U
+
+/* One lookup in CACHE_TIMING_PERIOD is timed, a power of two: reading the
+ * clock costs as much as a hit */
+#define CACHE_TIMING_PERIOD 16U
+
+#define ROTL64(Value, Bits) (((Value) << (Bits)) | ((Value) >> (64 - (Bits))))
+
+/* One cached password */
+typedef struct {
+  uint64_t hash;
+  uint32_t next;                  /* Next entry of the bucket, or CACHE_NONE */
+  _Atomic unsigned char referenced;   /* CLOCK bit, set by every hit */
+  unsigned int flags;
+  size_t fixed_size;
+  size_t key_length;
+  char key[CACHE_KEY_MAXLENGTH];
+  char password[OUTPUT_MAX_LENGTH + 1];
+  s_generation_stats stats;
+} s_cache_entry;
+
+/* One shard: its own lock, entries, buckets and statistics */
+typedef struct {
+  _Atomic uint32_t lock;
+
+  /* Guarded by the lock */
+  s_cache_entry *entries;
+  uint32_t *buckets;
+  uint32_t bucket_mask;
+  uint32_t capacity;
+  uint32_t used;
+  uint32_t hand;                  /* CLOCK hand */
+
+  _Atomic uint64_t lookups;
+  _Atomic uint64_t hits;
+  _Atomic uint64_t insertions;
+  _Atomic uint64_t evictions;
+  _Atomic uint64_t timed_lookups;
+  _Atomic uint64_t lookup_time_ns;
+} s_cache_shard;
+
+struct s_result_cache {
+  uint64_t hash_key[2];           /* SipHash key, random */
+  size_t capacity;
+  _Atomic uint64_t bypasses;
+  s_cache_shard *shards[CACHE_SHARD_COUNT];
+};
+
+/* Get the key of the hash function */
+static void init_hash_key(s_result_cache *cache);
+
+/* SipHash-1-3 of a buffer */
+static uint64_t siphash(const uint64_t key[2], const unsigned char *data, size_t length);
+
+static void lock_shard_read(s_cache_shard *shard);
+static void unlock_shard_read(s_cache_shard *shard);
+static void lock_shard_write(s_cache_shard *shard);
+static void unlock_shard_write(s_cache_shard *shard);
+
+/* Entry of a key in a shard, or CACHE_NONE. Needs the shard lock. */
+static uint32_t find_entry(const s_cache_shard *shard, const s_cache_key *key);
+
+/* Pick the entry to reuse in a full shard, and unlink it. Needs the
+ * shard write lock. */
+static uint32_t evict_entry(s_cache_shard *shard);
+
+static inline uint64_t elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+  return (uint64_t) (end->tv_sec - start->tv_sec) * 1000000000U
+         + (uint64_t) end->tv_nsec - (uint64_t) start->tv_nsec;
+}
+
+static inline uint64_t min_u64(uint64_t a, uint64_t b)
+{
+  return a < b ? a : b;
+}
+
+static inline s_cache_shard *get_shard(s_result_cache *cache, uint64_t hash)
+{
+  return cache->shards[hash >> (64 - CACHE_SHARD_BITS)];
+}
+
+/* Create a cache */
+s_result_cache *create_result_cache(size_t capacity)
+{
+  s_result_cache *cache;
+  size_t shard_capacity, bucket_count = 1, shard;
+
+  if (!capacity || capacity > (size_t) CACHE_SHARD_COUNT * (CACHE_NONE / 2)) {
+    return NULL;
+  }
+
+  shard_capacity = (capacity + CACHE_SHARD_COUNT - 1) / CACHE_SHARD_COUNT;
+
+  while (bucket_count < shard_capacity) {
+    bucket_count <<= 1;
+  }
+
+  cache = alloc_secure_buffer(sizeof(s_result_cache));
+
+  if (!cache) {
+    return NULL;
+  }
+
+  cache->capacity = shard_capacity * CACHE_SHARD_COUNT;
+  init_hash_key(cache);
+
+  for (shard = 0; shard < CACHE_SHARD_COUNT; shard++) {
+    s_cache_shard *new_shard = alloc_secure_buffer(sizeof(s_cache_shard));
+
+    cache->shards[shard] = new_shard;
+
+    if (!new_shard) {
+      free_result_cache(cache);
+      return NULL;
+    }
+
+    new_shard->entries = alloc_secure_buffer(shard_capacity * sizeof(s_cache_entry));
+    new_shard->buckets = alloc_secure_buffer(bucket_count * sizeof(uint32_t));
+
+    if (!new_shard->entries || !new_shard->buckets) {
+      free_result_cache(cache);
+      return NULL;
+    }
+
+    memset(new_shard->buckets, 0xFF, bucket_count * sizeof(uint32_t));
+    new_shard->bucket_mask = (uint32_t) (bucket_count - 1);
+    new_shard->capacity = (uint32_t) shard_capacity;
+  }
+
+  return cache;
+}
+
+/* Wipe and free a cache */
+void free_result_cache(s_result_cache *cache)
+{
+  size_t shard;
+
+  if (!cache) {
+    return;
+  }
+
+  /* Secure buffers are wiped when freed */
+  for (shard = 0; shard < CACHE_SHARD_COUNT; shard++) {
+    if (cache->shards[shard]) {
+      free_secure_buffer(cache->shards[shard]->entries);
+      free_secure_buffer(cache->shards[shard]->buckets);
+      free_secure_buffer(cache->shards[shard]);
+    }
+  }
+
+  free_secure_buffer(cache);
+}
+
+/* Fill a key */
+int get_cache_key(s_result_cache *cache, s_cache_key *key, const char *domain,
+                  const char *year, size_t fixed_size, unsigned int flags)
+{
+  const size_t domain_length = strlen(domain), year_length = strlen(year);
+  unsigned char data[CACHE_KEY_MAXLENGTH + 12];
+  const uint64_t size = fixed_size;
+  size_t byte;
+
+  if (domain_length + year_length + 2 > CACHE_KEY_MAXLENGTH) {
+    atomic_fetch_add_explicit(&cache->bypasses, 1, memory_order_relaxed);
+    return FALSE;
+  }
+
+  memcpy(key->bytes, domain, domain_length + 1);
+  memcpy(key->bytes + domain_length + 1, year, year_length + 1);
+  key->length = domain_length + year_length + 2;
+  key->flags = flags;
+  key->fixed_size = fixed_size;
+
+  /* Hash the strings, then the flags and size in a fixed byte order */
+  memcpy(data, key->bytes, key->length);
+
+  for (byte = 0; byte < 4; byte++) {
+    data[key->length + byte] = (unsigned char) (flags >> (8 * byte));
+  }
+
+  for (byte = 0; byte < 8; byte++) {
+    data[key->length + 4 + byte] = (unsigned char) (size >> (8 * byte));
+  }
+
+  key->hash = siphash(cache->hash_key, data, key->length + 12);
+
+  return TRUE;
+}
+
+/* Look a key up */
+int lookup_result_cache(s_result_cache *cache, const s_cache_key *key, char *password,
+                        size_t max_length, s_generation_stats *stats)
+{
+  s_cache_shard *shard = get_shard(cache, key->hash);
+  const uint64_t lookup = atomic_fetch_add_explicit(&shard->lookups, 1, memory_order_relaxed);
+  const int timed = stats || !(lookup % CACHE_TIMING_PERIOD);
+  struct timespec start, end;
+  uint32_t index;
+  int hit = FALSE;
+
+  if (timed) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+  }
+
+  lock_shard_read(shard);
+
+  index = find_entry(shard, key);
+
+  if (index != CACHE_NONE) {
+    s_cache_entry *entry = &shard->entries[index];
+    const size_t length = strlen(entry->password);
+
+    /* Too long for the caller: let the generation report it */
+    if (length <= max_length) {
+      memcpy(password, entry->password, length + 1);
+
+      if (stats) {
+        *stats = entry->stats;
+      }
+
+      atomic_store_explicit(&entry->referenced, 1, memory_order_relaxed);
+      hit = TRUE;
+    }
+  }
+
+  unlock_shard_read(shard);
+
+  if (hit) {
+    atomic_fetch_add_explicit(&shard->hits, 1, memory_order_relaxed);
+  }
+
+  if (timed) {
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (hit && stats) {
+      stats->wall_time_ns = elapsed_ns(&start, &end);
+    }
+
+    atomic_fetch_add_explicit(&shard->timed_lookups, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->lookup_time_ns, elapsed_ns(&start, &end),
+                              memory_order_relaxed);
+  }
+
+  return hit;
+}
+
+/* Cache the password of a key */
+void store_result_cache(s_result_cache *cache, const s_cache_key *key, const char *password,
+                        const s_generation_stats *stats)
+{
+  s_cache_shard *shard = get_shard(cache, key->hash);
+  const size_t length = strlen(password);
+  s_cache_entry *entry;
+  uint32_t index, *bucket;
+
+  if (length > OUTPUT_MAX_LENGTH) {
+    return;
+  }
+
+  lock_shard_write(shard);
+
+  /* Another thread may have generated it meanwhile */
+  if (find_entry(shard, key) != CACHE_NONE) {
+    unlock_shard_write(shard);
+    return;
+  }
+
+  if (shard->used < shard->capacity) {
+    index = shard->used++;
+  } else {
+    index = evict_entry(shard);
+    atomic_fetch_add_explicit(&shard->evictions, 1, memory_order_relaxed);
+  }
+
+  entry = &shard->entries[index];
+  bucket = &shard->buckets[key->hash & shard->bucket_mask];
+
+  entry->hash = key->hash;
+  entry->flags = key->flags;
+  entry->fixed_size = key->fixed_size;
+  entry->key_length = key->length;
+  memcpy(entry->key, key->bytes, key->length);
+  memcpy(entry->password, password, length + 1);
+  entry->stats = *stats;
+
+  /* New entries get one CLOCK turn before they can be evicted */
+  atomic_store_explicit(&entry->referenced, 1, memory_order_relaxed);
+  entry->next = *bucket;
+  *bucket = index;
+
+  unlock_shard_write(shard);
+
+  atomic_fetch_add_explicit(&shard->insertions, 1, memory_order_relaxed);
+}
+
+/* Sum the statistics of all the shards */
+void get_result_cache_stats(s_result_cache *cache, s_cache_stats *stats)
+{
+  size_t shard;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->capacity = cache->capacity;
+  stats->bypasses = atomic_load_explicit(&cache->bypasses, memory_order_relaxed);
+
+  for (shard = 0; shard < CACHE_SHARD_COUNT; shard++) {
+    s_cache_shard *current = cache->shards[shard];
+    const uint64_t lookups = atomic_load_explicit(&current->lookups, memory_order_relaxed);
+    const uint64_t hits = min_u64(atomic_load_explicit(&current->hits, memory_order_relaxed),
+                                  lookups);
+
+    lock_shard_read(current);
+    stats->entries += current->used;
+    unlock_shard_read(current);
+
+    stats->hits += hits;
+    stats->misses += lookups - hits;
+    stats->insertions += atomic_load_explicit(&current->insertions, memory_order_relaxed);
+    stats->evictions += atomic_load_explicit(&current->evictions, memory_order_relaxed);
+    stats->timed_lookups += atomic_load_explicit(&current->timed_lookups,
+                                                 memory_order_relaxed);
+    stats->lookup_time_ns += atomic_load_explicit(&current->lookup_time_ns,
+                                                  memory_order_relaxed);
+  }
+}
+
+/* Reset the statistics. Entries stay. */
+void reset_result_cache_stats(s_result_cache *cache)
+{
+  size_t shard;
+
+  atomic_store_explicit(&cache->bypasses, 0, memory_order_relaxed);
+
+  for (shard = 0; shard < CACHE_SHARD_COUNT; shard++) {
+    s_cache_shard *current = cache->shards[shard];
+
+    atomic_store_explicit(&current->lookups, 0, memory_order_relaxed);
+    atomic_store_explicit(&current->hits, 0, memory_order_relaxed);
+    atomic_store_explicit(&current->insertions, 0, memory_order_relaxed);
+    atomic_store_explicit(&current->evictions, 0, memory_order_relaxed);
+    atomic_store_explicit(&current->timed_lookups, 0, memory_order_relaxed);
+    atomic_store_explicit(&current->lookup_time_ns, 0, memory_order_relaxed);
+  }
+}
+
+/* Get the key of the hash function: random, so the buckets of the
+ * domains cannot be guessed */
+static void init_hash_key(s_result_cache *cache)
+{
+  FILE *random = fopen("/dev/urandom", "rb");
+  size_t read_count = 0;
+
+  if (random) {
+    read_count = fread(cache->hash_key, sizeof(cache->hash_key), 1, random);
+    fclose(random);
+  }
+
+  /* No random source: still better than a constant key */
+  if (!read_count) {
+    struct timespec now;
+    uint64_t seed[2];
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seed[0] = (uint64_t) now.tv_sec ^ (uint64_t) (uintptr_t) cache;
+    seed[1] = (uint64_t) now.tv_nsec;
+    cache->hash_key[0] = siphash(seed, (const unsigned char *) &now, sizeof(now));
+    cache->hash_key[1] = siphash(seed, (const unsigned char *) seed, sizeof(seed));
+  }
+}
+
+#define SIP_ROUND(V0, V1, V2, V3) \
+  do { \
+    V0 += V1; V1 = ROTL64(V1, 13); V1 ^= V0; V0 = ROTL64(V0, 32); \
+    V2 += V3; V3 = ROTL64(V3, 16); V3 ^= V2; \
+    V0 += V3; V3 = ROTL64(V3, 21); V3 ^= V0; \
+    V2 += V1; V1 = ROTL64(V1, 17); V1 ^= V2; V2 = ROTL64(V2, 32); \
+  } while (0)
+
+/* SipHash-1-3: one compression round per word, three finalization ones */
+static uint64_t siphash(const uint64_t key[2], const unsigned char *data, size_t length)
+{
+  uint64_t v0 = key[0] ^ 0x736f6d6570736575ULL;
+  uint64_t v1 = key[1] ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = key[0] ^ 0x6c7967656e657261ULL;
+  uint64_t v3 = key[1] ^ 0x7465646279746573ULL;
+  uint64_t word, last = (uint64_t) length << 56;
+  size_t seek, byte;
+
+  for (seek = 0; seek + 8 <= length; seek += 8) {
+    word = 0;
+
+    for (byte = 0; byte < 8; byte++) {
+      word |= (uint64_t) data[seek + byte] << (8 * byte);
+    }
+
+    v3 ^= word;
+    SIP_ROUND(v0, v1, v2, v3);
+    v0 ^= word;
+  }
+
+  for (byte = 0; seek + byte < length; byte++) {
+    last |= (uint64_t) data[seek + byte] << (8 * byte);
+  }
+
+  v3 ^= last;
+  SIP_ROUND(v0, v1, v2, v3);
+  v0 ^= last;
+
+  v2 ^= 0xFF;
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+  SIP_ROUND(v0, v1, v2, v3);
+
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/* Readers wait while a writer holds, or waits for, the shard. Holders
+ * may be preempted: waiters yield rather than spin. */
+static void lock_shard_read(s_cache_shard *shard)
+{
+  uint32_t state = atomic_load_explicit(&shard->lock, memory_order_relaxed);
+
+  for (;;) {
+    if (state & CACHE_WRITER) {
+      sched_yield();
+      state = atomic_load_explicit(&shard->lock, memory_order_relaxed);
+    } else if (atomic_compare_exchange_weak_explicit(&shard->lock, &state, state + 1,
+                                                     memory_order_acquire,
+                                                     memory_order_relaxed)) {
+      return;
+    }
+  }
+}
+
+static void unlock_shard_read(s_cache_shard *shard)
+{
+  atomic_fetch_sub_explicit(&shard->lock, 1, memory_order_release);
+}
+
+/* Writers take the writer bit first, so new readers stay out, then wait
+ * for the current ones */
+static void lock_shard_write(s_cache_shard *shard)
+{
+  uint32_t state = atomic_load_explicit(&shard->lock, memory_order_relaxed);
+
+  for (;;) {
+    if (state & CACHE_WRITER) {
+      sched_yield();
+      state = atomic_load_explicit(&shard->lock, memory_order_relaxed);
+    } else if (atomic_compare_exchange_weak_explicit(&shard->lock, &state,
+                                                     state | CACHE_WRITER,
+                                                     memory_order_acquire,
+                                                     memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  while (atomic_load_explicit(&shard->lock, memory_order_acquire) != CACHE_WRITER) {
+    sched_yield();
+  }
+}
+
+static void unlock_shard_write(s_cache_shard *shard)
+{
+  atomic_store_explicit(&shard->lock, 0, memory_order_release);
+}
+
+/* Entry of a key in a shard */
+static uint32_t find_entry(const s_cache_shard *shard, const s_cache_key *key)
+{
+  uint32_t index = shard->buckets[key->hash & shard->bucket_mask];
+
+  while (index != CACHE_NONE) {
+    const s_cache_entry *entry = &shard->entries[index];
+
+    if (entry->hash == key->hash && entry->flags == key->flags
+        && entry->fixed_size == key->fixed_size && entry->key_length == key->length
+        && !memcmp(entry->key, key->bytes, key->length)) {
+      return index;
+    }
+
+    index = entry->next;
+  }
+
+  return CACHE_NONE;
+}
+
+/* CLOCK: skip, and unmark, the entries hit since the hand last passed */
+static uint32_t evict_entry(s_cache_shard *shard)
+{
+  s_cache_entry *victim;
+  uint32_t index, *link;
+
+  while (atomic_exchange_explicit(&shard->entries[shard->hand].referenced, 0,
+                                  memory_order_relaxed)) {
+    shard->hand = (shard->hand + 1) % shard->capacity;
+  }
+
+  index = shard->hand;
+  shard->hand = (shard->hand + 1) % shard->capacity;
+  victim = &shard->entries[index];
+
+  /* Unlink it from its bucket */
+  link = &shard->buckets[victim->hash & shard->bucket_mask];
+
+  while (*link != index) {
+    link = &shard->entries[*link].next;
+  }
+
+  *link = victim->next;
+
+  /* The whole entry is rewritten: no tail of the old password stays */
+  memset(victim, 0, sizeof(*victim));
+
+  return index;
+}
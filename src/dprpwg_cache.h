@@ -0,0 +1,81 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Internal to the library: the result cache of a master password context,
+ * see enable_password_cache().
+ *
+ * Entries are keyed by the domain, year, flags and fixed size, through a
+ * SipHash-1-3 of them with a random key, so crafted domains cannot pile
+ * up in one bucket. The cache is split in CACHE_SHARD_COUNT shards, each
+ * with its own reader/writer lock: lookups only take the read lock, and
+ * evictions follow the CLOCK policy, so a hit only sets a reference bit.
+ * All the entries are in secure buffers, wiped when evicted. */
+
+#ifndef DPRPWG_CACHE_H
+#define DPRPWG_CACHE_H
+
+#include "dprpwg_lib.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Longest domain and year together, null chars included, to be cached */
+#define CACHE_KEY_MAXLENGTH 256U
+
+typedef struct s_result_cache s_result_cache;
+
+/* Inputs of one generation, and their hash */
+typedef struct {
+  char bytes[CACHE_KEY_MAXLENGTH];  /* Domain and year, null-terminated */
+  size_t length;
+  unsigned int flags;
+  size_t fixed_size;
+  uint64_t hash;
+} s_cache_key;
+
+/* Create a cache of 'capacity' entries. NULL if memory is short. */
+s_result_cache *create_result_cache(size_t capacity);
+
+/* Wipe and free a cache */
+void free_result_cache(s_result_cache *cache);
+
+/* Fill a key. Return FALSE, counting a bypass, if the inputs are too long
+ * to be cached. */
+int get_cache_key(s_result_cache *cache, s_cache_key *key, const char *domain,
+                  const char *year, size_t fixed_size, unsigned int flags);
+
+/* Copy the cached password of a key into 'password', if any and not
+ * longer than max_length, and its generation details into 'stats' (may
+ * be NULL). Return TRUE on a hit. */
+int lookup_result_cache(s_result_cache *cache, const s_cache_key *key, char *password,
+                        size_t max_length, s_generation_stats *stats);
+
+/* Cache the password of a key, evicting an entry if the cache is full */
+void store_result_cache(s_result_cache *cache, const s_cache_key *key, const char *password,
+                        const s_generation_stats *stats);
+
+/* Sum the statistics of all the shards, or reset them */
+void get_result_cache_stats(s_result_cache *cache, s_cache_stats *stats);
+void reset_result_cache_stats(s_result_cache *cache);
+
+#endif /* DPRPWG_CACHE_H */
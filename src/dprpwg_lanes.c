@@ -0,0 +1,338 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include "dprpwg_lanes.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* x86 kernels need GCC (or clang) target attributes and cpu detection */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#  define LANES_X86 1
+#  include <immintrin.h>
+#endif
+
+/* Shared part of the term added at one iteration: password and year */
+static inline uint32_t shared_term(const s_lane_group *group, size_t output_seek,
+                                   size_t pwd_seek, size_t year_seek)
+{
+  return (uint32_t) (group->password_weights[pwd_seek]
+                     + output_seek * pwd_seek * group->password_seek_mul
+                     + group->year_weights[year_seek]
+                     + output_seek * year_seek * group->year_seek_mul);
+}
+
+/* Advance a cursor, and reset it at the end of its string */
+static inline size_t next_seek(size_t seek, size_t length)
+{
+  return ++seek == length ? 0 : seek;
+}
+
+/* Portable kernel. Plain C, one lane after the other. */
+static void lane_kernel_c(const s_lane_group *group, size_t start, size_t end)
+{
+  const size_t lane_count = group->lane_count;
+  size_t output_seek = start % group->output_length;
+  size_t pwd_seek = start % group->password_length;
+  size_t year_seek = start % group->year_length;
+  uint32_t domain_seeks[LANES_MAX];
+  size_t iteration, lane;
+
+  for (lane = 0; lane < lane_count; lane++) {
+    domain_seeks[lane] = (uint32_t) (start % group->domain_lengths[lane]);
+  }
+
+  for (iteration = start; iteration < end; iteration++) {
+    const uint32_t shared = shared_term(group, output_seek, pwd_seek, year_seek);
+    const uint32_t domain_mul = (uint32_t) (output_seek * group->domain_seek_mul);
+    uint32_t *cell = group->hash + output_seek * LANES_MAX;
+
+    for (lane = 0; lane < lane_count; lane++) {
+      const uint32_t seek = domain_seeks[lane];
+
+      if (iteration < group->limits[lane]) {
+        cell[lane] += shared + group->domain_weights[group->domain_offsets[lane] + seek]
+                      + domain_mul * seek;
+      }
+
+      domain_seeks[lane] = seek + 1 == group->domain_lengths[lane] ? 0 : seek + 1;
+    }
+
+    output_seek = next_seek(output_seek, group->output_length);
+    pwd_seek = next_seek(pwd_seek, group->password_length);
+    year_seek = next_seek(year_seek, group->year_length);
+  }
+}
+
+#ifdef LANES_X86
+
+/* SSE4.1 kernel: 4 lanes, the domain weights are loaded one by one */
+__attribute__((target("sse4.1")))
+static void lane_kernel_sse41(const s_lane_group *group, size_t start, size_t end)
+{
+  size_t output_seek = start % group->output_length;
+  size_t pwd_seek = start % group->password_length;
+  size_t year_seek = start % group->year_length;
+  uint32_t domain_seeks[4];
+  size_t iteration, lane;
+  __m128i seek, length, limit;
+  const __m128i one = _mm_set1_epi32(1);
+
+  for (lane = 0; lane < 4; lane++) {
+    domain_seeks[lane] = (uint32_t) (start % group->domain_lengths[lane]);
+  }
+
+  seek = _mm_loadu_si128((const __m128i *) domain_seeks);
+  length = _mm_loadu_si128((const __m128i *) group->domain_lengths);
+  limit = _mm_loadu_si128((const __m128i *) group->limits);
+
+  for (iteration = start; iteration < end; iteration++) {
+    const uint32_t *weights = group->domain_weights;
+    const uint32_t *offsets = group->domain_offsets;
+    __m128i *cell = (__m128i *) (group->hash + output_seek * LANES_MAX);
+    __m128i term, active;
+
+    term = _mm_set_epi32((int) weights[offsets[3] + (uint32_t) _mm_extract_epi32(seek, 3)],
+                         (int) weights[offsets[2] + (uint32_t) _mm_extract_epi32(seek, 2)],
+                         (int) weights[offsets[1] + (uint32_t) _mm_extract_epi32(seek, 1)],
+                         (int) weights[offsets[0] + (uint32_t) _mm_cvtsi128_si32(seek)]);
+    term = _mm_add_epi32(term, _mm_mullo_epi32(seek, _mm_set1_epi32((int) (uint32_t)
+                                                                    (output_seek * group->domain_seek_mul))));
+    term = _mm_add_epi32(term, _mm_set1_epi32((int) shared_term(group, output_seek,
+                                                                pwd_seek, year_seek)));
+
+    /* Only lanes under their limit get the term */
+    active = _mm_cmpgt_epi32(limit, _mm_set1_epi32((int) iteration));
+    _mm_storeu_si128(cell, _mm_add_epi32(_mm_loadu_si128(cell), _mm_and_si128(term, active)));
+
+    seek = _mm_add_epi32(seek, one);
+    seek = _mm_andnot_si128(_mm_cmpeq_epi32(seek, length), seek);
+
+    output_seek = next_seek(output_seek, group->output_length);
+    pwd_seek = next_seek(pwd_seek, group->password_length);
+    year_seek = next_seek(year_seek, group->year_length);
+  }
+}
+
+/* AVX2 kernel: 8 lanes, the domain weights are gathered */
+__attribute__((target("avx2")))
+static void lane_kernel_avx2(const s_lane_group *group, size_t start, size_t end)
+{
+  size_t output_seek = start % group->output_length;
+  size_t pwd_seek = start % group->password_length;
+  size_t year_seek = start % group->year_length;
+  uint32_t domain_seeks[8];
+  size_t iteration, lane;
+  __m256i seek, length, offset, limit;
+  const __m256i one = _mm256_set1_epi32(1);
+
+  for (lane = 0; lane < 8; lane++) {
+    domain_seeks[lane] = (uint32_t) (start % group->domain_lengths[lane]);
+  }
+
+  seek = _mm256_loadu_si256((const __m256i *) domain_seeks);
+  length = _mm256_loadu_si256((const __m256i *) group->domain_lengths);
+  offset = _mm256_loadu_si256((const __m256i *) group->domain_offsets);
+  limit = _mm256_loadu_si256((const __m256i *) group->limits);
+
+  for (iteration = start; iteration < end; iteration++) {
+    __m256i *cell = (__m256i *) (group->hash + output_seek * LANES_MAX);
+    __m256i term, active;
+
+    term = _mm256_i32gather_epi32((const int *) group->domain_weights,
+                                  _mm256_add_epi32(offset, seek), 4);
+    term = _mm256_add_epi32(term, _mm256_mullo_epi32(seek, _mm256_set1_epi32((int) (uint32_t)
+                                                                             (output_seek * group->domain_seek_mul))));
+    term = _mm256_add_epi32(term, _mm256_set1_epi32((int) shared_term(group, output_seek,
+                                                                      pwd_seek, year_seek)));
+
+    /* Only lanes under their limit get the term */
+    active = _mm256_cmpgt_epi32(limit, _mm256_set1_epi32((int) iteration));
+    _mm256_storeu_si256(cell, _mm256_add_epi32(_mm256_loadu_si256(cell),
+                                               _mm256_and_si256(term, active)));
+
+    seek = _mm256_add_epi32(seek, one);
+    seek = _mm256_andnot_si256(_mm256_cmpeq_epi32(seek, length), seek);
+
+    output_seek = next_seek(output_seek, group->output_length);
+    pwd_seek = next_seek(pwd_seek, group->password_length);
+    year_seek = next_seek(year_seek, group->year_length);
+  }
+}
+
+#endif /* LANES_X86 */
+
+static const s_lane_kernel kernel_c = { lane_kernel_c, LANES_MAX, "none" };
+#ifdef LANES_X86
+static const s_lane_kernel kernel_sse41 = { lane_kernel_sse41, 4, "sse4.1" };
+static const s_lane_kernel kernel_avx2 = { lane_kernel_avx2, 8, "avx2" };
+#endif
+
+/* Pick the best kernel for this CPU */
+const s_lane_kernel *get_lane_kernel(void)
+{
+#ifdef LANES_X86
+  const char *restriction = getenv("DPRPWG_SIMD");
+  int allow_avx2 = !restriction || !strcmp(restriction, "avx2");
+  int allow_sse41 = allow_avx2 || !strcmp(restriction, "sse4.1");
+
+  __builtin_cpu_init();
+
+  if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+    return &kernel_avx2;
+  }
+
+  if (allow_sse41 && __builtin_cpu_supports("sse4.1")) {
+    return &kernel_sse41;
+  }
+#endif
+
+  return &kernel_c;
+}
+
+/* Portable count kernel: a compact histogram, one bucket per symbol of
+ * the alphabet, so only a few cache lines are cleared per password */
+static int count_symbols_c(const char *password, size_t length,
+                           const s_count_alphabet *alphabet, uint16_t *counts)
+{
+  uint16_t histogram[COUNT_NO_BUCKET];
+  uint8_t symbol_buckets[COUNT_MAX_LENGTH];
+  size_t seek;
+
+  memset(histogram, 0, alphabet->bucket_count * sizeof(uint16_t));
+
+  for (seek = 0; seek < length; seek++) {
+    const uint8_t bucket = alphabet->buckets[(unsigned char) password[seek]];
+
+    if (bucket == COUNT_NO_BUCKET) {
+      return 0;
+    }
+
+    symbol_buckets[seek] = bucket;
+    histogram[bucket]++;
+  }
+
+  for (seek = 0; seek < length; seek++) {
+    counts[seek] = histogram[symbol_buckets[seek]];
+  }
+
+  return 1;
+}
+
+#ifdef LANES_X86
+
+/* SSE4.1 count kernel: each symbol is compared with the whole password,
+ * 16 chars at a time. The password is copied in a zero padded buffer:
+ * the padding never matches, as passwords have no null char. */
+__attribute__((target("sse4.1,popcnt")))
+static int count_symbols_sse41(const char *password, size_t length,
+                               const s_count_alphabet *alphabet, uint16_t *counts)
+{
+  char padded[COUNT_MAX_LENGTH + 16];
+  const size_t chunk_count = (length + 15) / 16;
+  size_t seek, chunk;
+
+  (void) alphabet;
+  memcpy(padded, password, length);
+  memset(padded + length, 0, chunk_count * 16 - length);
+
+  for (seek = 0; seek < length; seek++) {
+    const __m128i symbol = _mm_set1_epi8(padded[seek]);
+    int count = 0;
+
+    for (chunk = 0; chunk < chunk_count; chunk++) {
+      const __m128i chars = _mm_loadu_si128((const __m128i *) (padded + chunk * 16));
+
+      count += __builtin_popcount((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(chars, symbol)));
+    }
+
+    counts[seek] = (uint16_t) count;
+  }
+
+  memset(padded, 0, chunk_count * 16);
+  return 1;
+}
+
+/* AVX2 count kernel: same, 32 chars at a time */
+__attribute__((target("avx2,popcnt")))
+static int count_symbols_avx2(const char *password, size_t length,
+                              const s_count_alphabet *alphabet, uint16_t *counts)
+{
+  char padded[COUNT_MAX_LENGTH + 32];
+  const size_t chunk_count = (length + 31) / 32;
+  size_t seek, chunk;
+
+  (void) alphabet;
+  memcpy(padded, password, length);
+  memset(padded + length, 0, chunk_count * 32 - length);
+
+  for (seek = 0; seek < length; seek++) {
+    const __m256i symbol = _mm256_set1_epi8(padded[seek]);
+    int count = 0;
+
+    for (chunk = 0; chunk < chunk_count; chunk++) {
+      const __m256i chars = _mm256_loadu_si256((const __m256i *) (padded + chunk * 32));
+
+      count += __builtin_popcount((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, symbol)));
+    }
+
+    counts[seek] = (uint16_t) count;
+  }
+
+  memset(padded, 0, chunk_count * 32);
+  return 1;
+}
+
+#endif /* LANES_X86 */
+
+static const s_count_kernel count_kernel_c = { count_symbols_c, "none" };
+#ifdef LANES_X86
+static const s_count_kernel count_kernel_sse41 = { count_symbols_sse41, "sse4.1" };
+static const s_count_kernel count_kernel_avx2 = { count_symbols_avx2, "avx2" };
+#endif
+
+/* Pick the best count kernel for this CPU */
+const s_count_kernel *get_count_kernel(void)
+{
+#ifdef LANES_X86
+  const char *restriction = getenv("DPRPWG_SIMD");
+  int allow_avx2 = !restriction || !strcmp(restriction, "avx2");
+  int allow_sse41 = allow_avx2 || !strcmp(restriction, "sse4.1");
+
+  __builtin_cpu_init();
+
+  if (!__builtin_cpu_supports("popcnt")) {
+    return &count_kernel_c;
+  }
+
+  if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+    return &count_kernel_avx2;
+  }
+
+  if (allow_sse41 && __builtin_cpu_supports("sse4.1")) {
+    return &count_kernel_sse41;
+  }
+#endif
+
+  return &count_kernel_c;
+}
@@ -0,0 +1,123 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Internal to the library: multi-lane hash loop kernels, and symbol count
+ * kernels for the password strength.
+ *
+ * A "lane group" is up to LANES_MAX passwords sharing the same master
+ * password, year and output length, so only the domain differs. The
+ * kernels run the hash loop of generate_password() for all of them in
+ * lockstep: the password and year terms are computed once per iteration,
+ * the domain term once per lane. */
+
+#ifndef DPRPWG_LANES_H
+#define DPRPWG_LANES_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Maximum number of lanes of any kernel */
+#define LANES_MAX 8U
+
+typedef struct {
+  /* Number of lanes in use, up to the kernel width */
+  size_t lane_count;
+  size_t output_length;
+
+  /* Character terms of each input string, that is for each cursor value j:
+   * s[j] * MUL + s[length - j - 1] * INV_MUL. An empty string must be given
+   * as one zero weight, so its terms are always zero. */
+  const uint32_t *password_weights;
+  size_t password_length;
+  const uint32_t *year_weights;
+  size_t year_length;
+
+  /* Domain weights of all the lanes, one table after the other. Unused
+   * lanes must point to one zero weight. */
+  const uint32_t *domain_weights;
+  uint32_t domain_offsets[LANES_MAX];
+  uint32_t domain_lengths[LANES_MAX];
+
+  uint32_t password_seek_mul;
+  uint32_t domain_seek_mul;
+  uint32_t year_seek_mul;
+
+  /* Iteration limit of each lane. Must be lower than 2^31. Iterations past
+   * the limit of a lane leave it untouched. Unused lanes have a 0 limit. */
+  uint32_t limits[LANES_MAX];
+
+  /* Hash cells, output_length * LANES_MAX, the cell 'output_seek' of lane
+   * 'lane' at output_seek * LANES_MAX + lane. Only the low 16 bits are
+   * meaningful. */
+  uint32_t *hash;
+} s_lane_group;
+
+/* Run the iterations [start, end) of the hash loop on a lane group */
+typedef void (*lane_kernel_fn)(const s_lane_group *group, size_t start, size_t end);
+
+typedef struct {
+  lane_kernel_fn run;
+  size_t width;       /* Number of lanes it processes */
+  const char *name;
+} s_lane_kernel;
+
+/*
+ * Get the best kernel for this CPU: AVX2 (8 lanes), SSE4.1 (4 lanes) or
+ * portable C (8 lanes). The DPRPWG_SIMD environment variable can restrict
+ * the choice to "sse4.1" or "none" (portable C only), to compare them.
+ */
+const s_lane_kernel *get_lane_kernel(void);
+
+/* Longest password a count kernel accepts */
+#define COUNT_MAX_LENGTH 256U
+
+/* Bucket of the bytes out of the alphabet */
+#define COUNT_NO_BUCKET 0xFFU
+
+/* Symbol alphabet of the counted passwords, as a compact histogram: one
+ * bucket per symbol, up to COUNT_NO_BUCKET buckets */
+typedef struct {
+  uint8_t buckets[256];   /* Bucket of each byte value, or COUNT_NO_BUCKET */
+  size_t bucket_count;
+} s_count_alphabet;
+
+/* Write in counts[i] the number of occurrences of password[i] in the
+ * password, for the 'length' chars (1 to COUNT_MAX_LENGTH, none null).
+ * Return 0 if the password cannot be counted: the histogram kernel fails
+ * on a symbol out of the alphabet, the other ones never do. */
+typedef int (*count_kernel_fn)(const char *password, size_t length,
+                               const s_count_alphabet *alphabet, uint16_t *counts);
+
+typedef struct {
+  count_kernel_fn run;
+  const char *name;
+} s_count_kernel;
+
+/*
+ * Get the best symbol count kernel for this CPU: byte comparisons on AVX2
+ * or SSE4.1 vectors (with POPCNT), or a portable C histogram. DPRPWG_SIMD
+ * restricts the choice as for get_lane_kernel().
+ */
+const s_count_kernel *get_count_kernel(void);
+
+#endif /* DPRPWG_LANES_H */
@@ -22,12 +22,22 @@
  */
 
 #include "dprpwg_lib.h"
+#include "dprpwg_lanes.h"
+#include "dprpwg_cache.h"
+#include "dprpwg_stretch.h"
 #include "dprpwg_config.h"
 
+#include <errno.h>
+#include <limits.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
 
 /* Some internal functions declarations */
 
@@ -42,11 +52,583 @@ static inline size_t min(size_t a, size_t b)
   return a < b ? a : b;
 }
 
-/* Check if a password contains all the required symbol categories */
-static int check_password(const char* password, unsigned int flags);
+/* The symbol category flags, without FLAG_STRETCH and its cost */
+#define FLAG_CATEGORIES (FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL)
 
-/* Check if a password contains one of the symbol of a given domain */
-static int check_password_domain(const char* password, const char* domain);
+/* Key stretching: Argon2id passes, lanes, and salt (at least 8 chars).
+ * The salt is fixed: nothing more to remember, see the README. */
+#define STRETCH_PASSES 3U
+#define STRETCH_LANES  16U
+#define STRETCH_SALT   "dprpwg master password"
+
+/* Closed-form engine working memory kept on the stack (uint16_t count).
+ * Enough for 768 input chars (password, domain and year together). */
+#define DIGEST_STACK_SCRATCH_SIZE 3072U
+
+/* One output symbol domain: the symbols, their count, and the reciprocal
+ * used to compute "hash % size" without a division */
+typedef struct {
+  const char *symbols;
+  size_t size;
+  uint32_t reciprocal;
+} s_output_domain;
+
+/* Reciprocal for output_domain_index(). 2^32 / size, rounded up, is exact
+ * for any 16 bits hash and any size up to OUTPUT_DOMAIN_MAXLENGTH. */
+#define OUTPUT_DOMAIN_RECIPROCAL(size) ((uint32_t) (UINT32_C(0xFFFFFFFF) / (size) + 1U))
+
+#define OUTPUT_DOMAIN(symbols) \
+  { symbols, sizeof(symbols) - 1, OUTPUT_DOMAIN_RECIPROCAL(sizeof(symbols) - 1) }
+
+/* The output symbol domains of all the possible flag combinations.
+ * Categories are always in this order: lower case letters, digits,
+ * symbols, upper case letters. */
+static const s_output_domain output_domains[16] = {
+  { "", 0, 0 },
+  OUTPUT_DOMAIN(OUTPUT_LOW),                                     /* L */
+  OUTPUT_DOMAIN(OUTPUT_UPP),                                     /* U */
+  OUTPUT_DOMAIN(OUTPUT_LOW OUTPUT_UPP),                          /* LU */
+  OUTPUT_DOMAIN(OUTPUT_DIG),                                     /* D */
+  OUTPUT_DOMAIN(OUTPUT_LOW OUTPUT_DIG),                          /* LD */
+  OUTPUT_DOMAIN(OUTPUT_DIG OUTPUT_UPP),                          /* DU */
+  OUTPUT_DOMAIN(OUTPUT_LOW OUTPUT_DIG OUTPUT_UPP),               /* LDU */
+  OUTPUT_DOMAIN(OUTPUT_SYM),                                     /* S */
+  OUTPUT_DOMAIN(OUTPUT_LOW OUTPUT_SYM),                          /* LS */
+  OUTPUT_DOMAIN(OUTPUT_SYM OUTPUT_UPP),                          /* SU */
+  OUTPUT_DOMAIN(OUTPUT_LOW OUTPUT_SYM OUTPUT_UPP),               /* LSU */
+  OUTPUT_DOMAIN(OUTPUT_DIG OUTPUT_SYM),                          /* DS */
+  OUTPUT_DOMAIN(OUTPUT_LOW OUTPUT_DIG OUTPUT_SYM),               /* LDS */
+  OUTPUT_DOMAIN(OUTPUT_DIG OUTPUT_SYM OUTPUT_UPP),               /* DSU */
+  OUTPUT_DOMAIN(OUTPUT_LOW OUTPUT_DIG OUTPUT_SYM OUTPUT_UPP)     /* LDSU */
+};
+
+/* Output symbol domain of a flag combination */
+static inline const s_output_domain *get_output_domain(unsigned int flags)
+{
+  return &output_domains[flags & (FLAG_LOW_AVAIL | FLAG_UPP_AVAIL
+                                  | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL)];
+}
+
+/* Same as "hash % output_domain->size", with a multiplication instead of a
+ * division (see "Faster Remainder by Direct Computation", Lemire et al.) */
+static inline size_t output_domain_index(uint16_t hash, const s_output_domain *output_domain)
+{
+  const uint32_t fraction = output_domain->reciprocal * hash;
+
+  return (size_t) (((uint64_t) fraction * output_domain->size) >> 32);
+}
+
+/* The hash loop constants of one input string (password, domain or
+ * year), and its character terms for every byte value: the low 16 bits of
+ * byte * mul and byte * inv_mul, the byte read as a char like the loop
+ * always did */
+typedef struct {
+  unsigned int mul;
+  unsigned int seek_mul;
+  unsigned int inv_mul;
+  uint16_t terms[256];
+  uint16_t inv_terms[256];
+} s_input_constants;
+
+/* Hash profile, see create_hash_profile() */
+struct dprpwg_profile {
+  s_input_constants password;
+  s_input_constants domain;
+  s_input_constants year;
+};
+
+/* Character term tables, computed by the compiler for the default
+ * profile */
+#define PROFILE_TERM(mul, byte) ((uint16_t) ((unsigned int) (char) (byte) * (mul)))
+#define PROFILE_TERMS4(mul, byte) \
+  PROFILE_TERM(mul, (byte)), PROFILE_TERM(mul, (byte) + 1), \
+  PROFILE_TERM(mul, (byte) + 2), PROFILE_TERM(mul, (byte) + 3)
+#define PROFILE_TERMS16(mul, byte) \
+  PROFILE_TERMS4(mul, (byte)), PROFILE_TERMS4(mul, (byte) + 4), \
+  PROFILE_TERMS4(mul, (byte) + 8), PROFILE_TERMS4(mul, (byte) + 12)
+#define PROFILE_TERMS256(mul) \
+  PROFILE_TERMS16(mul, 0), PROFILE_TERMS16(mul, 16), PROFILE_TERMS16(mul, 32), \
+  PROFILE_TERMS16(mul, 48), PROFILE_TERMS16(mul, 64), PROFILE_TERMS16(mul, 80), \
+  PROFILE_TERMS16(mul, 96), PROFILE_TERMS16(mul, 112), PROFILE_TERMS16(mul, 128), \
+  PROFILE_TERMS16(mul, 144), PROFILE_TERMS16(mul, 160), PROFILE_TERMS16(mul, 176), \
+  PROFILE_TERMS16(mul, 192), PROFILE_TERMS16(mul, 208), PROFILE_TERMS16(mul, 224), \
+  PROFILE_TERMS16(mul, 240)
+
+#define INPUT_CONSTANTS(mul, seek_mul, inv_mul) \
+  { mul, seek_mul, inv_mul, { PROFILE_TERMS256(mul) }, { PROFILE_TERMS256(inv_mul) } }
+
+/* The profile of dprpwg_config.h */
+static const dprpwg_profile default_profile = {
+  INPUT_CONSTANTS(PW_MUL, PW_SEEK_MUL, PW_INV_MUL),
+  INPUT_CONSTANTS(DOM_MUL, DOM_SEEK_MUL, DOM_INV_MUL),
+  INPUT_CONSTANTS(YR_MUL, YR_SEEK_MUL, YR_INV_MUL)
+};
+
+/* Constant names of the profile files, in s_hash_constants order */
+#define HASH_CONSTANT_COUNT 9U
+
+static const char * const hash_constant_names[HASH_CONSTANT_COUNT] = {
+  "PW_MUL", "PW_SEEK_MUL", "PW_INV_MUL",
+  "DOM_MUL", "DOM_SEEK_MUL", "DOM_INV_MUL",
+  "YR_MUL", "YR_SEEK_MUL", "YR_INV_MUL"
+};
+
+/* Longest line of a profile file, end of line included */
+#define PROFILE_LINE_MAXLENGTH 256U
+
+/* Everything the generation engines need to know about one request */
+typedef struct {
+  const char *password;
+  const char *domain;
+  const char *year;
+  size_t password_length;
+  size_t domain_length;
+  size_t year_length;
+  size_t output_length;
+  const s_output_domain *output_domain;
+  size_t limit;
+  unsigned int flags;
+  const dprpwg_profile *profile;
+
+  /* Password character terms from a dprpwg_ctx, or NULL */
+  const uint16_t *password_weights;
+} s_generation_input;
+
+/* One input string (password, domain or year), digested for the
+ * closed-form engine. See digest_input() for the details. */
+typedef struct {
+  const char *string;
+  size_t length;
+  unsigned int seek_mul;
+  size_t orbit_count;    /* gcd(length, output length) */
+  size_t orbit_length;   /* length / orbit_count */
+  size_t step_inverse;   /* Inverse of (output length / orbit_count) mod orbit_length */
+  uint16_t *weight_sums; /* Prefix sums of the character terms, per orbit */
+  uint16_t *seek_sums;   /* Prefix sums of the cursor values, per orbit */
+} s_input_digest;
+
+/* Closed-form digest of a context password, for one output length */
+typedef struct {
+  s_input_digest digest;
+  uint16_t scratch[];
+} s_context_digest;
+
+/* Master password context, see create_password_context() */
+struct dprpwg_ctx {
+  char *password;
+  size_t password_length;
+  const dprpwg_profile *profile;
+
+  /* Character terms of each cursor value j, computed once:
+   * password[j] * PW_MUL + password[length - j - 1] * PW_INV_MUL,
+   * with the constants of the context profile */
+  uint16_t *weights;
+
+  /* Closed-form digests, indexed by output length, built on first use */
+  s_context_digest *_Atomic digests[OUTPUT_MAX_LENGTH + 1];
+
+  /* Generated passwords, see enable_password_cache(). NULL if disabled. */
+  s_result_cache *_Atomic cache;
+
+  /* Contexts of the stretched keys, indexed by cost, built on first use */
+  dprpwg_ctx *_Atomic stretched[STRETCH_COST_MAX + 1];
+};
+
+/* Compiled site password policy, see compile_password_policy() */
+struct dprpwg_policy {
+  size_t min_length;
+  size_t max_length;
+
+  /* Required count of each category, indexed by CAT_* - 1 */
+  size_t min_counts[4];
+
+  /* Categories holding allowed chars, as FLAG_*_AVAIL bits */
+  unsigned int flags;
+
+  /* All the allowed chars, in the order of output_domains, and the allowed
+   * chars of each category, indexed by CAT_* - 1 */
+  s_output_domain output_domain;
+  s_output_domain category_domains[4];
+  char symbols[OUTPUT_DOMAIN_MAXLENGTH + 1];
+  char category_symbols[4][OUTPUT_DOMAIN_MAXLENGTH + 1];
+
+  /* CAT_* of every allowed char (custom symbols included), 0 for others */
+  unsigned char categories[256];
+};
+
+/* Fill a zeroed policy from its description. Return POLICY_OK or the
+ * reason it cannot be satisfied. */
+static int build_policy(dprpwg_policy *policy, const s_password_policy *description);
+
+/* Give every policy category its required count of chars */
+static void satisfy_policy(const dprpwg_policy *policy, const uint16_t *password_hash,
+                           char *new_passwd, size_t length);
+
+/* Set the constants and character terms of one input string */
+static void fill_input_constants(s_input_constants *constants, unsigned int mul,
+                                 unsigned int seek_mul, unsigned int inv_mul);
+
+/* Blank the C comments of one line of a profile file, in place.
+ * 'in_comment' tells whether a block comment is still open, from one line
+ * to the next. */
+static void blank_profile_comments(char *line, int *in_comment);
+
+/* Parse one line of a profile file into 'values' (indexed like
+ * hash_constant_names), and mark the constant it gives in 'given'. Return
+ * PROFILE_OK, or the load_hash_profile() error it makes. */
+static int parse_profile_line(const char *line, unsigned int *values, unsigned int *given);
+
+/* Digest of the context password for one output length. NULL if it cannot
+ * be built (memory allocation failure). */
+static const s_input_digest *get_context_digest(dprpwg_ctx *ctx, size_t output_length);
+
+/* Attack calibration: guessed master password length, known domain, and
+ * guesses between two clock reads */
+#define CALIBRATION_GUESS_LENGTH 12U
+#define CALIBRATION_DOMAIN       "www.example.com"
+#define CALIBRATION_CHECK_PERIOD 64U
+
+/* Stretchings timed by calibrate_attack_rate(), the best one is kept */
+#define CALIBRATION_STRETCH_RUNS 4U
+
+/* One thread of calibrate_attack_rate() */
+typedef struct {
+  unsigned int index;
+  double seconds;             /* How long to guess */
+  const char *year;
+  const char *target;         /* The known generated password */
+  unsigned int flags;
+  uint64_t guesses;           /* Guesses done */
+  double elapsed;             /* Time they took */
+  int found;                  /* TRUE if a guess gave the target */
+} s_calibration_worker;
+
+/* Guess master passwords for calibrate_attack_rate(), on one thread */
+static void *calibration_worker(void *data);
+
+/* Best time of a few stretchings at STRETCH_COST_MIN, on one thread.
+ * Negative if memory is short. */
+static double time_stretch(void);
+
+/* Expected time to search half of a space of 2^bits, at 'guesses_per_second' */
+static double crack_seconds(double bits, double guesses_per_second);
+
+/* Argon2id parameters of a master password stretching */
+static void set_stretch_params(s_argon2_params *params, const char *password, unsigned int cost);
+
+/* Number of online cores, at least 1 */
+static unsigned int get_core_count(void);
+
+/* Context of the key stretched from the context password. NULL if it
+ * cannot be built, '*error' telling why. */
+static dprpwg_ctx *get_stretched_context(dprpwg_ctx *ctx, unsigned int cost, int *error);
+
+/* generate_one() with a FLAG_STRETCH in 'flags': stretch the master
+ * password (or get the stretched context), then generate with the key */
+static int generate_stretched(const char         *password,
+                              dprpwg_ctx         *ctx,
+                              const dprpwg_profile *profile,
+                              const char         *domain,
+                              const char         *year,
+                              size_t             fixed_size,
+                              unsigned int       flags,
+                              char               *new_passwd,
+                              size_t             passwd_size,
+                              uint16_t           *hash,
+                              size_t             hash_size,
+                              s_generation_stats *stats);
+
+/* Generation engine selected by set_generation_engine() */
+static unsigned int generation_engine = ENGINE_REFERENCE;
+
+/* Threads selected by set_stretch_threads(), 0 for one per online core */
+static unsigned int stretch_threads = 0;
+
+/* Process-wide counters, see get_generation_counters() */
+static struct {
+  _Atomic uint64_t generations;
+  _Atomic uint64_t iterations;
+  _Atomic uint64_t extension_rounds;
+  _Atomic uint64_t iteration_max_hits;
+  _Atomic uint64_t missing_categories;
+} generation_counters;
+
+/* Walk the hash loop, one iteration at a time. Return the number of
+ * iterations run. */
+static size_t generate_reference(const s_generation_input *input,
+                                 uint16_t *password_hash,
+                                 char *new_passwd);
+
+/* Compute the hash from per-cycle sums. 'digests' are the password, domain
+ * and year digests, or NULL to build them here. Return FALSE if it cannot
+ * run (memory allocation failure), in which case nothing is modified.
+ * Otherwise, '*iterations' is the number of iterations of the hash loop
+ * this stands for. */
+static int generate_closed_form(const s_generation_input *input,
+                                const s_input_digest *digests,
+                                uint16_t *password_hash,
+                                char *new_passwd,
+                                size_t *iterations);
+
+/* Number of uint16_t needed by digest_input() for a string of length n */
+static inline size_t digest_scratch_size(size_t length);
+
+/* Build the closed-form digest of one input string */
+static void digest_input(s_input_digest *digest, const char *string, size_t length,
+                         size_t output_length, const s_input_constants *constants,
+                         uint16_t *scratch);
+
+/* Symbol category of every char: the bit number of its FLAG_*_AVAIL,
+ * plus one. 0 for chars in no category. Must match the OUTPUT_* lists. */
+#define CAT_LOW 1U
+#define CAT_UPP 2U
+#define CAT_DIG 3U
+#define CAT_SYM 4U
+
+static const unsigned char symbol_categories[256] = {
+  ['a'] = CAT_LOW, ['b'] = CAT_LOW, ['c'] = CAT_LOW, ['d'] = CAT_LOW, ['e'] = CAT_LOW,
+  ['f'] = CAT_LOW, ['g'] = CAT_LOW, ['h'] = CAT_LOW, ['i'] = CAT_LOW, ['j'] = CAT_LOW,
+  ['k'] = CAT_LOW, ['l'] = CAT_LOW, ['m'] = CAT_LOW, ['n'] = CAT_LOW, ['o'] = CAT_LOW,
+  ['p'] = CAT_LOW, ['q'] = CAT_LOW, ['r'] = CAT_LOW, ['s'] = CAT_LOW, ['t'] = CAT_LOW,
+  ['u'] = CAT_LOW, ['v'] = CAT_LOW, ['w'] = CAT_LOW, ['x'] = CAT_LOW, ['y'] = CAT_LOW,
+  ['z'] = CAT_LOW,
+  ['A'] = CAT_UPP, ['B'] = CAT_UPP, ['C'] = CAT_UPP, ['D'] = CAT_UPP, ['E'] = CAT_UPP,
+  ['F'] = CAT_UPP, ['G'] = CAT_UPP, ['H'] = CAT_UPP, ['I'] = CAT_UPP, ['J'] = CAT_UPP,
+  ['K'] = CAT_UPP, ['L'] = CAT_UPP, ['M'] = CAT_UPP, ['N'] = CAT_UPP, ['O'] = CAT_UPP,
+  ['P'] = CAT_UPP, ['Q'] = CAT_UPP, ['R'] = CAT_UPP, ['S'] = CAT_UPP, ['T'] = CAT_UPP,
+  ['U'] = CAT_UPP, ['V'] = CAT_UPP, ['W'] = CAT_UPP, ['X'] = CAT_UPP, ['Y'] = CAT_UPP,
+  ['Z'] = CAT_UPP,
+  ['0'] = CAT_DIG, ['1'] = CAT_DIG, ['2'] = CAT_DIG, ['3'] = CAT_DIG, ['4'] = CAT_DIG,
+  ['5'] = CAT_DIG, ['6'] = CAT_DIG, ['7'] = CAT_DIG, ['8'] = CAT_DIG, ['9'] = CAT_DIG,
+  ['('] = CAT_SYM, [')'] = CAT_SYM, ['['] = CAT_SYM, [']'] = CAT_SYM, ['-'] = CAT_SYM,
+  ['_'] = CAT_SYM, ['{'] = CAT_SYM, ['}'] = CAT_SYM, ['='] = CAT_SYM, ['+'] = CAT_SYM,
+  ['!'] = CAT_SYM, [':'] = CAT_SYM, ['/'] = CAT_SYM, [';'] = CAT_SYM, ['.'] = CAT_SYM,
+  [','] = CAT_SYM, ['?'] = CAT_SYM
+};
+
+/* How many chars of each symbol category the password holds, and which
+ * categories are present (as FLAG_*_AVAIL bits) */
+typedef struct {
+  size_t counts[4];
+  unsigned int present;
+} s_category_tracker;
+
+/* Start tracking the categories of a password */
+static void track_categories(s_category_tracker *tracker, const char *password, size_t length);
+
+/* Update the tracker when a password char changes from old_symbol to new_symbol */
+static inline void track_symbol(s_category_tracker *tracker, char old_symbol, char new_symbol)
+{
+  unsigned int category;
+
+  category = symbol_categories[(unsigned char) old_symbol];
+  if (category && !--tracker->counts[category - 1]) {
+    tracker->present &= ~(1U << (category - 1));
+  }
+
+  category = symbol_categories[(unsigned char) new_symbol];
+  if (category && !tracker->counts[category - 1]++) {
+    tracker->present |= 1U << (category - 1);
+  }
+}
+
+/* Check if a tracked password contains all the required symbol categories */
+static inline int has_all_categories(const s_category_tracker *tracker, unsigned int flags)
+{
+  return !(flags & (FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL)
+           & ~tracker->present);
+}
+
+/* One password of a batch, for the lane kernels */
+typedef struct {
+  size_t item;
+  size_t output_length;
+  size_t limit;
+} s_lane_item;
+
+/* Batch generation with the lane kernels, for the reference engine.
+ * Return FALSE if it cannot run (memory allocation failure). */
+static int generate_batch_lanes(const dprpwg_profile *profile,
+                                const char         *password,
+                                const char         *year,
+                                const char * const *domains,
+                                const unsigned int *flags,
+                                const size_t       *fixed_sizes,
+                                size_t             count,
+                                char               *output,
+                                size_t             output_stride,
+                                size_t             max_output_length,
+                                size_t             max_domain_length,
+                                s_generation_counters *counters);
+
+/* Single password generation, with or without a master password context.
+ * 'password' and 'profile' are ignored if 'ctx' is not NULL. */
+static int generate_one(const char         *password,
+                        dprpwg_ctx         *ctx,
+                        const dprpwg_profile *profile,
+                        const char         *domain,
+                        const char         *year,
+                        size_t             fixed_size,
+                        unsigned int       flags,
+                        char               *new_passwd,
+                        size_t             passwd_size,
+                        uint16_t           *hash,
+                        size_t             hash_size,
+                        s_generation_stats *stats);
+
+/* Compute the length of the generated password */
+size_t get_password_length(const char *year, size_t fixed_size)
+{
+  int year_value;
+
+  if (fixed_size > 0) {
+    return fixed_size;
+  }
+
+  /*
+   * Oh yeah, that's arbitrary. The size should be as follow:
+   * - pre 2000:  12
+   * - 2000-2004: 12
+   * - 2005-2009: 13
+   * - 2010-2014: 14
+   * - 2015-2020: 15
+   * ... and I thing you get it.
+   */
+  year_value = atoi(year);
+
+  if (year_value < 2000) {
+    return 12;
+  }
+
+  return max(OUTPUT_MIN_LENGTH,
+             min(OUTPUT_MAX_LENGTH,
+                 12 + (unsigned int)(year_value - 2000) / 5));
+}
+
+/* Compute the number of iteration to use. Depends on the input */
+static inline size_t get_iteration_limit(const s_generation_input *input)
+{
+  return input->output_domain->size * (input->password_length + input->domain_length
+                                      + input->year_length + input->output_length
+                                      + input->flags);
+}
+
+/* Describe one generation in 'stats' (if not NULL), and count it in
+ * 'counters', to be given to add_generation_counters() */
+static void account_generation(size_t base_limit, size_t iterations, size_t output_length,
+                               unsigned int flags, const char *new_passwd,
+                               s_generation_counters *counters, s_generation_stats *stats)
+{
+  s_category_tracker tracker;
+  const size_t extension_rounds = iterations > base_limit
+                                  ? (iterations - base_limit + output_length - 1) / output_length
+                                  : 0;
+  const int iteration_max_reached = iterations >= ITERATION_MAX;
+  int all_categories_present;
+
+  track_categories(&tracker, new_passwd, output_length);
+  all_categories_present = has_all_categories(&tracker, flags);
+
+  counters->generations++;
+  counters->iterations += iterations;
+  counters->extension_rounds += extension_rounds;
+  counters->iteration_max_hits += (uint64_t) iteration_max_reached;
+  counters->missing_categories += (uint64_t) !all_categories_present;
+
+  if (stats) {
+    stats->base_limit = base_limit;
+    stats->iterations = iterations;
+    stats->extension_rounds = extension_rounds;
+    stats->iteration_max_reached = iteration_max_reached;
+    stats->all_categories_present = all_categories_present;
+  }
+}
+
+/* Add local counters to the process-wide ones */
+static void add_generation_counters(const s_generation_counters *counters)
+{
+  if (!counters->generations) {
+    return;
+  }
+
+  atomic_fetch_add_explicit(&generation_counters.generations, counters->generations,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&generation_counters.iterations, counters->iterations,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&generation_counters.extension_rounds, counters->extension_rounds,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&generation_counters.iteration_max_hits, counters->iteration_max_hits,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&generation_counters.missing_categories, counters->missing_categories,
+                            memory_order_relaxed);
+}
+
+/* Run the selected engine on one request. 'password_hash' and 'new_passwd'
+ * must be zeroed. 'digests' are the password, domain and year digests if
+ * the caller already built them, or NULL. 'check_hash' and 'check_passwd'
+ * are the ENGINE_CHECKED buffers (of output_length values, plus one for
+ * check_passwd), allocated here if NULL. */
+static size_t run_generation(const s_generation_input *input,
+                             const s_input_digest *digests,
+                             uint16_t *password_hash,
+                             char *new_passwd,
+                             uint16_t *check_hash,
+                             char *check_passwd)
+{
+  const size_t output_length = input->output_length;
+  size_t iterations, check_iterations;
+
+  switch (generation_engine) {
+    /* The closed-form engine falls back to the reference loop if it
+     * cannot get its working memory */
+    case ENGINE_CLOSED_FORM:
+      if (!generate_closed_form(input, digests, password_hash, new_passwd, &iterations)) {
+        iterations = generate_reference(input, password_hash, new_passwd);
+      }
+      break;
+
+    case ENGINE_CHECKED: {
+      uint16_t *own_hash = NULL;
+      char *own_passwd = NULL;
+
+      if (!check_hash || !check_passwd) {
+        check_hash = own_hash = alloc_secure_buffer(output_length * sizeof(uint16_t));
+        check_passwd = own_passwd = alloc_secure_buffer(output_length + 1);
+      } else {
+        memset(check_hash, 0, output_length * sizeof(uint16_t));
+        memset(check_passwd, 0, output_length + 1);
+      }
+
+      iterations = generate_reference(input, password_hash, new_passwd);
+
+      if (check_hash && check_passwd
+          && generate_closed_form(input, digests, check_hash, check_passwd, &check_iterations)
+          && (memcmp(check_hash, password_hash, output_length * sizeof(uint16_t))
+              || memcmp(check_passwd, new_passwd, output_length + 1)
+              || check_iterations != iterations)) {
+        abort();
+      }
+
+      if (check_hash) {
+        memset(check_hash, 0, output_length * sizeof(uint16_t));
+      }
+
+      if (check_passwd) {
+        memset(check_passwd, 0, output_length + 1);
+      }
+
+      free_secure_buffer(own_hash);
+      free_secure_buffer(own_passwd);
+      break;
+    }
+
+    default:
+      iterations = generate_reference(input, password_hash, new_passwd);
+      break;
+  }
+
+  return iterations;
+}
 
 /* The main function of this tool. Generate a password. */
 void generate_password(const char   *password,
@@ -56,102 +638,1749 @@ void generate_password(const char   *password,
                        char         **new_passwd,
                        unsigned int flags)
 {
+  /* Temporary hash used during generation, if it does not fit the
+   * stack area of generate_password_r() */
+  uint16_t *password_hash = NULL;
+  size_t output_length;
 
-  /* ---- Variable declarations ---- */
-  /* This will be the symbol domain list and its size */
-  char output_domain[OUTPUT_DOMAIN_MAXLENGTH];
-  size_t output_domain_size;
+  /* No symbol category selected? empty password, then */
+  if (!flags) {
+    *new_passwd = calloc(1, sizeof(char));
+    return;
+  }
 
-  /* Aliases for various string lengths */
-  size_t password_length, domain_length, year_length, output_length;
+  /* Memory allocation for output password (and temporary hash) */
+  output_length = get_password_length(year, fixed_size);
+  *new_passwd = malloc((output_length + 1) * sizeof(char));
 
-  /* Temporary hash used during generation */
-  uint16_t* password_hash;
+  if (output_length > OUTPUT_MAX_LENGTH) {
+    password_hash = alloc_secure_buffer(output_length * sizeof(uint16_t));
+  }
 
-  /* Cursors needed when reading the inputs */
-  size_t pwd_seek, domain_seek, year_seek, output_seek;
+  generate_password_r(password, domain, year, fixed_size, flags,
+                      *new_passwd, output_length + 1,
+                      password_hash, password_hash ? output_length : 0);
 
-  /* Control the number of iteration */
-  size_t limit, iteration;
-  /* ---- End of variable declarations ---- */
+  free_secure_buffer(password_hash);
+}
 
-  /* No symbol category selected? empty password, then */
-  if (!flags) {
-    *new_passwd = calloc(1, sizeof(char));
+/* Same as generate_password(), in caller-provided memory */
+int generate_password_r(const char   *password,
+                        const char   *domain,
+                        const char   *year,
+                        size_t       fixed_size,
+                        unsigned int flags,
+                        char         *new_passwd,
+                        size_t       passwd_size,
+                        uint16_t     *hash,
+                        size_t       hash_size)
+{
+  return generate_password_stats(password, domain, year, fixed_size, flags,
+                                 new_passwd, passwd_size, hash, hash_size, NULL);
+}
+
+/* Same as generate_password_r(), telling how the generation went */
+int generate_password_stats(const char         *password,
+                            const char         *domain,
+                            const char         *year,
+                            size_t             fixed_size,
+                            unsigned int       flags,
+                            char               *new_passwd,
+                            size_t             passwd_size,
+                            uint16_t           *hash,
+                            size_t             hash_size,
+                            s_generation_stats *stats)
+{
+  return generate_one(password, NULL, &default_profile, domain, year, fixed_size, flags,
+                      new_passwd, passwd_size, hash, hash_size, stats);
+}
+
+/* Same as generate_password_stats(), with a digested master password */
+int generate_password_ctx(dprpwg_ctx         *ctx,
+                          const char         *domain,
+                          const char         *year,
+                          size_t             fixed_size,
+                          unsigned int       flags,
+                          char               *new_passwd,
+                          size_t             passwd_size,
+                          uint16_t           *hash,
+                          size_t             hash_size,
+                          s_generation_stats *stats)
+{
+  s_result_cache *cache = ctx ? atomic_load_explicit(&ctx->cache, memory_order_acquire) : NULL;
+  s_generation_stats generation_stats;
+  s_cache_key key;
+  int result;
+
+  if (!cache || !domain || !year || !new_passwd || !passwd_size
+      || !get_cache_key(cache, &key, domain, year, fixed_size, flags)) {
+    return generate_one(ctx ? ctx->password : NULL, ctx, NULL, domain, year, fixed_size, flags,
+                        new_passwd, passwd_size, hash, hash_size, stats);
+  }
+
+  /* Cached passwords longer than the buffers are left to the generation,
+   * to fail the same way */
+  if (lookup_result_cache(cache, &key, new_passwd,
+                          hash ? min(passwd_size - 1, hash_size) : passwd_size - 1, stats)) {
+    memset(&key, 0, sizeof(key));
+    return GENERATE_OK;
+  }
+
+  result = generate_one(ctx->password, ctx, NULL, domain, year, fixed_size, flags,
+                        new_passwd, passwd_size, hash, hash_size, &generation_stats);
+
+  if (result == GENERATE_OK) {
+    store_result_cache(cache, &key, new_passwd, &generation_stats);
+  }
+
+  if (stats) {
+    *stats = generation_stats;
+  }
+
+  memset(&key, 0, sizeof(key));
+
+  return result;
+}
+
+/* Same as generate_password_stats(), with the constants of a hash profile */
+int generate_password_profile(const dprpwg_profile *profile,
+                              const char           *password,
+                              const char           *domain,
+                              const char           *year,
+                              size_t               fixed_size,
+                              unsigned int         flags,
+                              char                 *new_passwd,
+                              size_t               passwd_size,
+                              uint16_t             *hash,
+                              size_t               hash_size,
+                              s_generation_stats   *stats)
+{
+  return generate_one(password, NULL, profile, domain, year, fixed_size, flags,
+                      new_passwd, passwd_size, hash, hash_size, stats);
+}
+
+/* Digest a master password */
+dprpwg_ctx *create_password_context(const char *password)
+{
+  return create_password_context_profile(&default_profile, password);
+}
+
+/* Digest a master password, for the constants of a hash profile */
+dprpwg_ctx *create_password_context_profile(const dprpwg_profile *profile,
+                                            const char           *password)
+{
+  dprpwg_ctx *ctx;
+  size_t seek, length;
+
+  if (!profile || !password) {
+    return NULL;
+  }
+
+  length = strlen(password);
+  ctx = alloc_secure_buffer(sizeof(dprpwg_ctx));
+
+  if (!ctx) {
+    return NULL;
+  }
+
+  ctx->password_length = length;
+  ctx->profile = profile;
+  ctx->password = alloc_secure_buffer(length + 1);
+  ctx->weights = alloc_secure_buffer(max(length, 1) * sizeof(uint16_t));
+
+  if (!ctx->password || !ctx->weights) {
+    free_password_context(ctx);
+    return NULL;
+  }
+
+  memcpy(ctx->password, password, length + 1);
+  ctx->weights[0] = 0;
+
+  for (seek = 0; seek < length; seek++) {
+    ctx->weights[seek] = (uint16_t) (profile->password.terms[(unsigned char) password[seek]]
+                                     + profile->password.inv_terms[(unsigned char) password[length - seek - 1]]);
+  }
+
+  return ctx;
+}
+
+/* Wipe and free a master password context */
+void free_password_context(dprpwg_ctx *ctx)
+{
+  size_t output_length;
+  unsigned int cost;
+
+  if (!ctx) {
     return;
   }
 
-  /* ---- Generate the available output symbol domain ---- */
-  memset(output_domain, 0, OUTPUT_DOMAIN_MAXLENGTH);
-  domain_seek = 0;
+  /* Secure buffers are wiped when freed */
+  for (output_length = 0; output_length <= OUTPUT_MAX_LENGTH; output_length++) {
+    free_secure_buffer(atomic_load_explicit(&ctx->digests[output_length], memory_order_acquire));
+  }
+
+  for (cost = STRETCH_COST_MIN; cost <= STRETCH_COST_MAX; cost++) {
+    free_password_context(atomic_load_explicit(&ctx->stretched[cost], memory_order_acquire));
+  }
+
+  free_result_cache(atomic_load_explicit(&ctx->cache, memory_order_acquire));
+  free_secure_buffer(ctx->password);
+  free_secure_buffer(ctx->weights);
+  free_secure_buffer(ctx);
+}
+
+/* Cache the passwords generated with a context */
+int enable_password_cache(dprpwg_ctx *ctx, size_t capacity)
+{
+  s_result_cache *cache, *current = NULL;
+
+  if (!ctx || atomic_load_explicit(&ctx->cache, memory_order_acquire)) {
+    return FALSE;
+  }
+
+  cache = create_result_cache(capacity);
+
+  if (!cache) {
+    return FALSE;
+  }
+
+  /* Another thread may have enabled it meanwhile */
+  if (!atomic_compare_exchange_strong_explicit(&ctx->cache, &current, cache,
+                                               memory_order_acq_rel, memory_order_acquire)) {
+    free_result_cache(cache);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Get the result cache statistics of a context */
+int get_password_cache_stats(dprpwg_ctx *ctx, s_cache_stats *stats)
+{
+  s_result_cache *cache = ctx ? atomic_load_explicit(&ctx->cache, memory_order_acquire) : NULL;
+
+  if (!cache || !stats) {
+    return FALSE;
+  }
+
+  get_result_cache_stats(cache, stats);
+
+  return TRUE;
+}
+
+/* Reset the result cache statistics of a context */
+void reset_password_cache_stats(dprpwg_ctx *ctx)
+{
+  s_result_cache *cache = ctx ? atomic_load_explicit(&ctx->cache, memory_order_acquire) : NULL;
+
+  if (cache) {
+    reset_result_cache_stats(cache);
+  }
+}
+
+/* The profile of dprpwg_config.h */
+const dprpwg_profile *get_default_hash_profile(void)
+{
+  return &default_profile;
+}
+
+/* Build a hash profile from its constants */
+dprpwg_profile *create_hash_profile(const s_hash_constants *constants)
+{
+  dprpwg_profile *profile;
+
+  if (!constants) {
+    return NULL;
+  }
+
+  /* The constants are as secret as the master passwords */
+  profile = alloc_secure_buffer(sizeof(dprpwg_profile));
+
+  if (!profile) {
+    return NULL;
+  }
+
+  fill_input_constants(&profile->password, constants->pw_mul, constants->pw_seek_mul,
+                       constants->pw_inv_mul);
+  fill_input_constants(&profile->domain, constants->dom_mul, constants->dom_seek_mul,
+                       constants->dom_inv_mul);
+  fill_input_constants(&profile->year, constants->yr_mul, constants->yr_seek_mul,
+                       constants->yr_inv_mul);
+
+  return profile;
+}
+
+/* Load a hash profile from a file */
+dprpwg_profile *load_hash_profile(const char *path, int *error)
+{
+  unsigned int values[HASH_CONSTANT_COUNT];
+  unsigned int given = 0;
+  s_hash_constants constants;
+  dprpwg_profile *profile = NULL;
+  char line[PROFILE_LINE_MAXLENGTH];
+  int status = PROFILE_OK, in_comment = FALSE;
+  FILE *file;
+
+  file = path ? fopen(path, "r") : NULL;
+
+  if (!file) {
+    if (error) {
+      *error = PROFILE_UNREADABLE;
+    }
+    return NULL;
+  }
+
+  while (status == PROFILE_OK && fgets(line, sizeof(line), file)) {
+    /* No line is that long in a profile */
+    if (!strchr(line, '\n') && !feof(file)) {
+      status = PROFILE_SYNTAX;
+    } else {
+      blank_profile_comments(line, &in_comment);
+      status = parse_profile_line(line, values, &given);
+    }
+  }
+
+  if (status == PROFILE_OK && ferror(file)) {
+    status = PROFILE_UNREADABLE;
+  }
+
+  /* A block comment left open */
+  if (status == PROFILE_OK && in_comment) {
+    status = PROFILE_SYNTAX;
+  }
+
+  fclose(file);
+
+  if (status == PROFILE_OK && given != (1U << HASH_CONSTANT_COUNT) - 1) {
+    status = PROFILE_INCOMPLETE;
+  }
+
+  if (status == PROFILE_OK) {
+    constants.pw_mul = values[0];
+    constants.pw_seek_mul = values[1];
+    constants.pw_inv_mul = values[2];
+    constants.dom_mul = values[3];
+    constants.dom_seek_mul = values[4];
+    constants.dom_inv_mul = values[5];
+    constants.yr_mul = values[6];
+    constants.yr_seek_mul = values[7];
+    constants.yr_inv_mul = values[8];
+
+    profile = create_hash_profile(&constants);
+    memset(&constants, 0, sizeof(constants));
+
+    if (!profile) {
+      status = PROFILE_UNREADABLE;
+    }
+  }
+
+  /* Wipe what the file held */
+  memset(values, 0, sizeof(values));
+  memset(line, 0, sizeof(line));
 
-  /* For each symbol category: check if it is requested. If so, add the
-   * symbol category list to the output symbol domain */
-  if (flags & FLAG_LOW_AVAIL) {
-    strncpy(output_domain, OUTPUT_LOW, max(strlen(OUTPUT_LOW), OUTPUT_DOMAIN_MAXLENGTH));
-    domain_seek = strlen(OUTPUT_LOW);
+  if (error) {
+    *error = status;
   }
 
-  if (flags & FLAG_DIG_AVAIL) {
-    strncpy(output_domain + domain_seek, OUTPUT_DIG,
-            max(strlen(OUTPUT_DIG), OUTPUT_DOMAIN_MAXLENGTH - domain_seek));
-    domain_seek += strlen(OUTPUT_DIG);
+  return profile;
+}
+
+/* Wipe and free a hash profile */
+void free_hash_profile(dprpwg_profile *profile)
+{
+  /* Not from the secure buffer arena */
+  if (profile == &default_profile) {
+    return;
   }
 
-  if (flags & FLAG_SYM_AVAIL) {
-    strncpy(output_domain + domain_seek, OUTPUT_SYM,
-            max(strlen(OUTPUT_SYM), OUTPUT_DOMAIN_MAXLENGTH - domain_seek));
-    domain_seek += strlen(OUTPUT_SYM);
-  }
+  free_secure_buffer(profile);
+}
+
+/* Set the constants and character terms of one input string */
+static void fill_input_constants(s_input_constants *constants, unsigned int mul,
+                                 unsigned int seek_mul, unsigned int inv_mul)
+{
+  unsigned int byte;
+
+  constants->mul = mul;
+  constants->seek_mul = seek_mul;
+  constants->inv_mul = inv_mul;
+
+  for (byte = 0; byte < 256; byte++) {
+    constants->terms[byte] = PROFILE_TERM(mul, byte);
+    constants->inv_terms[byte] = PROFILE_TERM(inv_mul, byte);
+  }
+}
+
+/* Blank the C comments of a profile line */
+static void blank_profile_comments(char *line, int *in_comment)
+{
+  char *cursor = line;
+
+  while (*cursor) {
+    if (*in_comment) {
+      if (cursor[0] == '*' && cursor[1] == '/') {
+        *in_comment = FALSE;
+        *cursor++ = ' ';
+      }
+      *cursor++ = ' ';
+    } else if (cursor[0] == '/' && cursor[1] == '*') {
+      *in_comment = TRUE;
+      *cursor++ = ' ';
+      *cursor++ = ' ';
+    } else if (cursor[0] == '/' && cursor[1] == '/') {
+      /* Up to the line end */
+      cursor[0] = '\n';
+      cursor[1] = '\0';
+      break;
+    } else {
+      cursor++;
+    }
+  }
+}
+
+/* One line of a hash profile file */
+static int parse_profile_line(const char *line, unsigned int *values, unsigned int *given)
+{
+  const char *cursor = line, *name;
+  size_t name_length, constant, parentheses;
+  unsigned long value;
+  int is_define = FALSE;
+  char *end;
+
+  cursor += strspn(cursor, " \t");
+
+  if (!strncmp(cursor, "#define", 7) && (cursor[7] == ' ' || cursor[7] == '\t')) {
+    is_define = TRUE;
+    cursor += 7;
+    cursor += strspn(cursor, " \t");
+  } else if (*cursor == '#' || *cursor == '\0' || *cursor == '\n' || *cursor == '\r') {
+    return PROFILE_OK;
+  }
+
+  name = cursor;
+  name_length = strspn(cursor, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_");
+  cursor += name_length;
+
+  for (constant = 0; constant < HASH_CONSTANT_COUNT; constant++) {
+    if (strlen(hash_constant_names[constant]) == name_length
+        && !strncmp(hash_constant_names[constant], name, name_length)) {
+      break;
+    }
+  }
+
+  /* The other macros of a dprpwg_config.h (include guard) are ignored */
+  if (constant == HASH_CONSTANT_COUNT) {
+    return is_define ? PROFILE_OK : PROFILE_SYNTAX;
+  }
+
+  if (*given & (1U << constant)) {
+    return PROFILE_INCOMPLETE;
+  }
+
+  /* "NAME value", "NAME = value", or "#define NAME (valueU)" */
+  cursor += strspn(cursor, " \t");
+
+  if (!is_define && *cursor == '=') {
+    cursor++;
+    cursor += strspn(cursor, " \t");
+  }
+
+  parentheses = strspn(cursor, "(");
+  cursor += parentheses;
+
+  if (*cursor < '0' || *cursor > '9') {
+    return PROFILE_SYNTAX;
+  }
+
+  errno = 0;
+  value = strtoul(cursor, &end, 0);
+
+  if (errno || value > UINT_MAX) {
+    return PROFILE_SYNTAX;
+  }
+
+  cursor = end + strspn(end, "uUlL");
+
+  if (strspn(cursor, ")") != parentheses) {
+    return PROFILE_SYNTAX;
+  }
+
+  cursor += parentheses;
+  cursor += strspn(cursor, " \t\r\n");
+
+  /* Trailing '#' comments are fine, C ones are blanked already */
+  if (*cursor && *cursor != '#') {
+    return PROFILE_SYNTAX;
+  }
+
+  values[constant] = (unsigned int) value;
+  *given |= 1U << constant;
+
+  return PROFILE_OK;
+}
+
+/* Digest of the context password, built once per output length */
+static const s_input_digest *get_context_digest(dprpwg_ctx *ctx, size_t output_length)
+{
+  const size_t digest_size = sizeof(s_context_digest)
+                             + digest_scratch_size(ctx->password_length) * sizeof(uint16_t);
+  s_context_digest *digest, *built = NULL;
+
+  digest = atomic_load_explicit(&ctx->digests[output_length], memory_order_acquire);
+
+  if (digest) {
+    return &digest->digest;
+  }
+
+  digest = alloc_secure_buffer(digest_size);
+
+  if (!digest) {
+    return NULL;
+  }
+
+  digest_input(&digest->digest, ctx->password, ctx->password_length, output_length,
+               &ctx->profile->password, digest->scratch);
+
+  /* Another thread may have built it meanwhile: use theirs */
+  if (!atomic_compare_exchange_strong_explicit(&ctx->digests[output_length], &built, digest,
+                                               memory_order_acq_rel, memory_order_acquire)) {
+    free_secure_buffer(digest);
+    digest = built;
+  }
+
+  return &digest->digest;
+}
+
+/* Context of a stretched key, built once per cost */
+static dprpwg_ctx *get_stretched_context(dprpwg_ctx *ctx, unsigned int cost, int *error)
+{
+  dprpwg_ctx *stretched, *built = NULL;
+  char key[STRETCH_KEY_LENGTH + 1];
+
+  if (cost < STRETCH_COST_MIN || cost > STRETCH_COST_MAX) {
+    *error = GENERATE_INVALID;
+    return NULL;
+  }
+
+  stretched = atomic_load_explicit(&ctx->stretched[cost], memory_order_acquire);
+
+  if (stretched) {
+    return stretched;
+  }
+
+  *error = stretch_master_password(ctx->password, cost, key, sizeof(key));
+
+  if (*error != GENERATE_OK) {
+    return NULL;
+  }
+
+  stretched = create_password_context_profile(ctx->profile, key);
+  memset(key, 0, sizeof(key));
+
+  if (!stretched) {
+    *error = GENERATE_NO_MEMORY;
+    return NULL;
+  }
+
+  /* Another thread may have built it meanwhile: use theirs */
+  if (!atomic_compare_exchange_strong_explicit(&ctx->stretched[cost], &built, stretched,
+                                               memory_order_acq_rel, memory_order_acquire)) {
+    free_password_context(stretched);
+    stretched = built;
+  }
+
+  return stretched;
+}
+
+/* Generate one password from a stretched master password */
+static int generate_stretched(const char         *password,
+                              dprpwg_ctx         *ctx,
+                              const dprpwg_profile *profile,
+                              const char         *domain,
+                              const char         *year,
+                              size_t             fixed_size,
+                              unsigned int       flags,
+                              char               *new_passwd,
+                              size_t             passwd_size,
+                              uint16_t           *hash,
+                              size_t             hash_size,
+                              s_generation_stats *stats)
+{
+  char key[STRETCH_KEY_LENGTH + 1];
+  dprpwg_ctx *stretched;
+  struct timespec start, end;
+  int result;
+
+  if (stats) {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+  }
+
+  /* A context keeps its stretched keys, other callers stretch every time */
+  if (ctx) {
+    stretched = get_stretched_context(ctx, GET_STRETCH_COST(flags), &result);
+
+    if (stretched) {
+      result = generate_one(stretched->password, stretched, NULL, domain, year, fixed_size,
+                            flags & FLAG_CATEGORIES, new_passwd, passwd_size,
+                            hash, hash_size, stats);
+    }
+  } else {
+    result = stretch_master_password(password, GET_STRETCH_COST(flags), key, sizeof(key));
+
+    if (result == GENERATE_OK) {
+      result = generate_one(key, NULL, profile, domain, year, fixed_size,
+                            flags & FLAG_CATEGORIES, new_passwd, passwd_size,
+                            hash, hash_size, stats);
+    }
+
+    memset(key, 0, sizeof(key));
+  }
+
+  /* The stretching is part of the time spent */
+  if (stats) {
+    if (result != GENERATE_OK) {
+      stats->all_categories_present = FALSE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->wall_time_ns = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000U
+                          + (uint64_t) end.tv_nsec - (uint64_t) start.tv_nsec;
+  }
+
+  return result;
+}
+
+/* Generate one password */
+static int generate_one(const char         *password,
+                        dprpwg_ctx         *ctx,
+                        const dprpwg_profile *profile,
+                        const char         *domain,
+                        const char         *year,
+                        size_t             fixed_size,
+                        unsigned int       flags,
+                        char               *new_passwd,
+                        size_t             passwd_size,
+                        uint16_t           *hash,
+                        size_t             hash_size,
+                        s_generation_stats *stats)
+{
+
+  /* ---- Variable declarations ---- */
+  /* Temporary hash used during generation, if the caller gives none */
+  uint16_t stack_hash[OUTPUT_MAX_LENGTH];
+
+  /* ENGINE_CHECKED buffers */
+  uint16_t check_hash[OUTPUT_MAX_LENGTH];
+  char check_passwd[OUTPUT_MAX_LENGTH + 1];
+
+  /* What the generation engines get to work with */
+  s_generation_input input;
+
+  /* Closed-form digests when the master password comes from a context:
+   * its own is reused, domain and year ones are built here */
+  s_input_digest digests[3];
+  const s_input_digest *context_digest = NULL;
+  uint16_t digest_scratch[DIGEST_STACK_SCRATCH_SIZE];
+
+  /* Statistics */
+  s_generation_counters counters = { 0, 0, 0, 0, 0 };
+  struct timespec start, end;
+  size_t iterations;
+  /* ---- End of variable declarations ---- */
+
+  if (stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->all_categories_present = TRUE;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+  }
+
+  if (!new_passwd || !passwd_size) {
+    if (stats) {
+      stats->all_categories_present = FALSE;
+    }
+    return GENERATE_TOO_SMALL;
+  }
+
+  new_passwd[0] = '\0';
+
+  if (!password || !domain || !year || (!ctx && !profile)) {
+    if (stats) {
+      stats->all_categories_present = FALSE;
+    }
+    return GENERATE_INVALID;
+  }
+
+  if (flags & FLAG_STRETCH) {
+    return generate_stretched(password, ctx, profile, domain, year, fixed_size, flags,
+                              new_passwd, passwd_size, hash, hash_size, stats);
+  }
+
+  /* No symbol category selected? empty password, then */
+  if (!flags) {
+    return GENERATE_OK;
+  }
+
+  if (!hash) {
+    hash = stack_hash;
+    hash_size = OUTPUT_MAX_LENGTH;
+  }
+
+  /* Never write a truncated password: it would look valid */
+  input.output_length = get_password_length(year, fixed_size);
+
+  if (input.output_length >= passwd_size || input.output_length > hash_size) {
+    if (stats) {
+      stats->all_categories_present = FALSE;
+    }
+    return GENERATE_TOO_SMALL;
+  }
+
+  /* Get the available output symbol domain, and set the string length
+   * aliases */
+  input.password = password;
+  input.domain = domain;
+  input.year = year;
+  input.password_length = strlen(password);
+  input.domain_length = strlen(domain);
+  input.year_length = strlen(year);
+  input.output_domain = get_output_domain(flags);
+  input.flags = flags;
+  input.limit = get_iteration_limit(&input);
+  input.profile = ctx ? ctx->profile : profile;
+  input.password_weights = ctx ? ctx->weights : NULL;
+
+  memset(hash, 0, input.output_length * sizeof(uint16_t));
+  memset(new_passwd, 0, input.output_length + 1);
+
+  /* Only the closed-form engine needs digests. Over the stack scratch,
+   * it builds them all itself. */
+  if (ctx && generation_engine != ENGINE_REFERENCE && input.output_length <= OUTPUT_MAX_LENGTH
+      && digest_scratch_size(input.domain_length) + digest_scratch_size(input.year_length)
+         <= DIGEST_STACK_SCRATCH_SIZE) {
+    context_digest = get_context_digest(ctx, input.output_length);
+  }
+
+  if (context_digest) {
+    digests[0] = *context_digest;
+    digest_input(&digests[1], domain, input.domain_length, input.output_length,
+                 &input.profile->domain, digest_scratch);
+    digest_input(&digests[2], year, input.year_length, input.output_length,
+                 &input.profile->year,
+                 digest_scratch + digest_scratch_size(input.domain_length));
+  }
+
+  if (input.output_length <= OUTPUT_MAX_LENGTH) {
+    iterations = run_generation(&input, context_digest ? digests : NULL,
+                                hash, new_passwd, check_hash, check_passwd);
+  } else {
+    iterations = run_generation(&input, NULL, hash, new_passwd, NULL, NULL);
+  }
+
+  /* Some cleaning. Yes, do some memset() to avoid random data in ram */
+  memset(hash, 0, input.output_length * sizeof(uint16_t));
+
+  if (context_digest) {
+    memset(digest_scratch, 0, (digest_scratch_size(input.domain_length)
+                               + digest_scratch_size(input.year_length)) * sizeof(uint16_t));
+  }
+
+  account_generation(input.limit, iterations, input.output_length, flags, new_passwd,
+                     &counters, stats);
+  add_generation_counters(&counters);
+
+  if (stats) {
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->wall_time_ns = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000U
+                          + (uint64_t) end.tv_nsec - (uint64_t) start.tv_nsec;
+  }
+
+  return GENERATE_OK;
+}
+
+/* Generate passwords for a list of domains */
+int generate_password_batch(const char         *password,
+                            const char         *year,
+                            const char * const *domains,
+                            const unsigned int *flags,
+                            const size_t       *fixed_sizes,
+                            size_t             count,
+                            char               *output,
+                            size_t             output_stride)
+{
+  /* Master password and year digests, valid for one output length */
+  s_input_digest digests[3];
+  size_t digested_length = 0;
+
+  /* One working memory block for the whole batch */
+  uint16_t *scratch, *password_hash, *check_hash, *digest_scratch;
+  char *check_passwd, *item_passwd;
+  size_t scratch_size, max_output_length = 0, max_domain_length = 0;
+  size_t password_length, year_length, default_length, item, iterations;
+  int result = TRUE, lanes_done;
+
+  /* Context of the master password, for the stretched items only: it
+   * stretches the master password once per cost */
+  dprpwg_ctx *stretch_ctx = NULL;
+
+  /* Counted locally, added to the process-wide counters once */
+  s_generation_counters counters = { 0, 0, 0, 0, 0 };
+
+  if (!count) {
+    return TRUE;
+  }
+
+  /* Per-batch setup: master password, year, and the largest item sizes */
+  password_length = strlen(password);
+  year_length = strlen(year);
+  default_length = get_password_length(year, 0);
+
+  for (item = 0; item < count; item++) {
+    max_domain_length = max(max_domain_length, strlen(domains[item]));
+    max_output_length = max(max_output_length,
+                            get_password_length(year, fixed_sizes ? fixed_sizes[item] : 0));
+  }
+
+  /* Hash, ENGINE_CHECKED buffers (hash and two passwords) and digests */
+  scratch_size = 2 * max_output_length + 2 * ((max_output_length + 2) / 2)
+                 + digest_scratch_size(password_length)
+                 + digest_scratch_size(max_domain_length)
+                 + digest_scratch_size(year_length);
+  scratch = alloc_secure_buffer(scratch_size * sizeof(uint16_t));
+
+  if (!scratch) {
+    for (item = 0; item < count; item++) {
+      output[item * output_stride] = '\0';
+    }
+    return FALSE;
+  }
+
+  password_hash = scratch;
+  check_hash = password_hash + max_output_length;
+  check_passwd = (char *) (check_hash + max_output_length);
+  item_passwd = (char *) (check_hash + max_output_length + (max_output_length + 2) / 2);
+  digest_scratch = check_hash + max_output_length + 2 * ((max_output_length + 2) / 2);
+
+  /* The reference engine runs several passwords at once on the lane
+   * kernels. ENGINE_CHECKED does it too, then checks each password against
+   * both engines, one by one. */
+  lanes_done = generation_engine != ENGINE_CLOSED_FORM
+               && generate_batch_lanes(&default_profile, password, year, domains, flags, fixed_sizes, count,
+                                       output, output_stride, max_output_length,
+                                       max_domain_length, &counters);
+
+  for (item = 0; item < count; item++) {
+    s_generation_input input;
+    char *new_passwd = output + item * output_stride;
+    const unsigned int item_flags = flags[item];
+
+    input.output_length = fixed_sizes && fixed_sizes[item] > 0 ? fixed_sizes[item] : default_length;
+
+    /* Empty password when no category is selected, like generate_password(),
+     * or when the password would not fit */
+    if (!item_flags || input.output_length >= output_stride) {
+      if (output_stride) {
+        new_passwd[0] = '\0';
+      }
+
+      if (item_flags) {
+        result = FALSE;
+      }
+
+      continue;
+    }
+
+    if (item_flags & FLAG_STRETCH) {
+      if (!stretch_ctx) {
+        stretch_ctx = create_password_context(password);
+      }
+
+      if (!stretch_ctx
+          || generate_password_ctx(stretch_ctx, domains[item], year,
+                                   fixed_sizes ? fixed_sizes[item] : 0, item_flags,
+                                   new_passwd, output_stride,
+                                   password_hash, max_output_length, NULL) != GENERATE_OK) {
+        new_passwd[0] = '\0';
+        result = FALSE;
+      }
+
+      continue;
+    }
+
+    if (lanes_done && generation_engine == ENGINE_REFERENCE) {
+      continue;
+    }
+
+    input.password = password;
+    input.domain = domains[item];
+    input.year = year;
+    input.password_length = password_length;
+    input.domain_length = strlen(domains[item]);
+    input.year_length = year_length;
+    input.output_domain = get_output_domain(item_flags);
+    input.flags = item_flags;
+    input.limit = get_iteration_limit(&input);
+    input.profile = &default_profile;
+    input.password_weights = NULL;
+
+    /* Digests are only needed by the closed-form engine. Password and
+     * year ones are kept as long as the output length does not change. */
+    if (generation_engine != ENGINE_REFERENCE) {
+      if (digested_length != input.output_length) {
+        digest_input(&digests[0], password, password_length, input.output_length,
+                     &input.profile->password, digest_scratch);
+        digest_input(&digests[2], year, year_length, input.output_length,
+                     &input.profile->year,
+                     digest_scratch + digest_scratch_size(password_length));
+        digested_length = input.output_length;
+      }
+
+      digest_input(&digests[1], input.domain, input.domain_length, input.output_length,
+                   &input.profile->domain,
+                   digest_scratch + digest_scratch_size(password_length)
+                   + digest_scratch_size(year_length));
+    }
+
+    /* Lane kernels output is checked against a second generation */
+    if (lanes_done) {
+      new_passwd = item_passwd;
+    }
+
+    memset(password_hash, 0, input.output_length * sizeof(uint16_t));
+    memset(new_passwd, 0, input.output_length + 1);
+
+    iterations = run_generation(&input, generation_engine != ENGINE_REFERENCE ? digests : NULL,
+                                password_hash, new_passwd, check_hash, check_passwd);
+
+    /* Lane results are counted by the lanes */
+    if (!lanes_done) {
+      account_generation(input.limit, iterations, input.output_length, item_flags,
+                         new_passwd, &counters, NULL);
+    }
+
+    if (lanes_done && memcmp(new_passwd, output + item * output_stride, input.output_length + 1)) {
+      abort();
+    }
+  }
+
+  /* Clean the working memory: it holds traces of the master password */
+  free_secure_buffer(scratch);
+  free_password_context(stretch_ctx);
+
+  add_generation_counters(&counters);
+
+  return result;
+}
+
+/* Generate passwords for a list of domains, with a digested master password */
+int generate_password_batch_ctx(dprpwg_ctx         *ctx,
+                                const char         *year,
+                                const char * const *domains,
+                                const unsigned int *flags,
+                                const size_t       *fixed_sizes,
+                                size_t             count,
+                                char               *output,
+                                size_t             output_stride)
+{
+  /* One temporary hash for the whole batch, as long as its longest
+   * password: the stack one stops at OUTPUT_MAX_LENGTH */
+  uint16_t *hash;
+  size_t item, max_output_length = 0;
+  int result = TRUE;
+
+  if (!count) {
+    return TRUE;
+  }
+
+  /* Without a year, every generation fails as invalid anyway */
+  for (item = 0; year && item < count; item++) {
+    max_output_length = max(max_output_length,
+                            get_password_length(year, fixed_sizes ? fixed_sizes[item] : 0));
+  }
+
+  hash = alloc_secure_buffer(max_output_length * sizeof(uint16_t));
+
+  if (!hash) {
+    for (item = 0; item < count && output_stride; item++) {
+      output[item * output_stride] = '\0';
+    }
+    return FALSE;
+  }
+
+  /* One by one, through the context result cache if any */
+  for (item = 0; item < count; item++) {
+    if (generate_password_ctx(ctx, domains[item], year,
+                              fixed_sizes ? fixed_sizes[item] : 0, flags[item],
+                              output + item * output_stride, output_stride,
+                              hash, max_output_length, NULL) != GENERATE_OK) {
+      result = FALSE;
+    }
+  }
+
+  free_secure_buffer(hash);
+
+  return result;
+}
+
+/* Generate passwords for ranges of years and sizes */
+int generate_password_sweep(const char         *password,
+                            const char         *domain,
+                            const char * const *years,
+                            size_t             year_count,
+                            const size_t       *fixed_sizes,
+                            size_t             size_count,
+                            unsigned int       flags,
+                            char               *output,
+                            size_t             output_stride)
+{
+  /* Password and domain digests, valid for one output length, and the
+   * digest of the current year */
+  s_input_digest digests[3];
+  size_t digested_length = 0;
+
+  /* One working memory block for the whole sweep */
+  uint16_t *scratch, *password_hash, *check_hash, *digest_scratch;
+  char *check_passwd;
+  size_t scratch_size, max_output_length = 0, max_year_length = 0;
+  size_t password_length, domain_length, year, size, iterations;
+  const size_t no_fixed_size = 0;
+  int result = TRUE;
+
+  /* Counted locally, added to the process-wide counters once */
+  s_generation_counters counters = { 0, 0, 0, 0, 0 };
+
+  if (!fixed_sizes) {
+    fixed_sizes = &no_fixed_size;
+    size_count = 1;
+  }
+
+  if (!year_count || !size_count) {
+    return TRUE;
+  }
+
+  /* Stretched master password: a usual sweep with the key */
+  if (flags & FLAG_STRETCH) {
+    char key[STRETCH_KEY_LENGTH + 1];
+
+    if (stretch_master_password(password, GET_STRETCH_COST(flags), key, sizeof(key))
+        != GENERATE_OK) {
+      for (year = 0; year < year_count * size_count && output_stride; year++) {
+        output[year * output_stride] = '\0';
+      }
+      return FALSE;
+    }
+
+    result = generate_password_sweep(key, domain, years, year_count, fixed_sizes, size_count,
+                                     flags & FLAG_CATEGORIES, output, output_stride);
+    memset(key, 0, sizeof(key));
+
+    return result;
+  }
+
+  password_length = strlen(password);
+  domain_length = strlen(domain);
+
+  for (year = 0; year < year_count; year++) {
+    max_year_length = max(max_year_length, strlen(years[year]));
+
+    for (size = 0; size < size_count; size++) {
+      max_output_length = max(max_output_length,
+                              get_password_length(years[year], fixed_sizes[size]));
+    }
+  }
+
+  /* Hash, ENGINE_CHECKED buffers (hash and password) and digests */
+  scratch_size = 2 * max_output_length + (max_output_length + 2) / 2
+                 + digest_scratch_size(password_length)
+                 + digest_scratch_size(domain_length)
+                 + digest_scratch_size(max_year_length);
+  scratch = alloc_secure_buffer(scratch_size * sizeof(uint16_t));
+
+  if (!scratch) {
+    for (year = 0; year < year_count * size_count; year++) {
+      output[year * output_stride] = '\0';
+    }
+    return FALSE;
+  }
+
+  password_hash = scratch;
+  check_hash = password_hash + max_output_length;
+  check_passwd = (char *) (check_hash + max_output_length);
+  digest_scratch = check_hash + max_output_length + (max_output_length + 2) / 2;
+
+  /* Sizes first: for a fixed size, the output length, so the password and
+   * domain digests, are the same for all years */
+  for (size = 0; size < size_count; size++) {
+    for (year = 0; year < year_count; year++) {
+      s_generation_input input;
+      char *new_passwd = output + (year * size_count + size) * output_stride;
+
+      input.output_length = get_password_length(years[year], fixed_sizes[size]);
+
+      /* Empty password when no category is selected, like generate_password(),
+       * or when the password would not fit */
+      if (!flags || input.output_length >= output_stride) {
+        if (output_stride) {
+          new_passwd[0] = '\0';
+        }
+
+        if (flags) {
+          result = FALSE;
+        }
+
+        continue;
+      }
+
+      input.password = password;
+      input.domain = domain;
+      input.year = years[year];
+      input.password_length = password_length;
+      input.domain_length = domain_length;
+      input.year_length = strlen(years[year]);
+      input.output_domain = get_output_domain(flags);
+      input.flags = flags;
+      input.limit = get_iteration_limit(&input);
+      input.profile = &default_profile;
+      input.password_weights = NULL;
+
+      /* Only the year digest is specific to this password */
+      if (generation_engine != ENGINE_REFERENCE) {
+        if (digested_length != input.output_length) {
+          digest_input(&digests[0], password, password_length, input.output_length,
+                       &input.profile->password, digest_scratch);
+          digest_input(&digests[1], domain, domain_length, input.output_length,
+                       &input.profile->domain,
+                       digest_scratch + digest_scratch_size(password_length));
+          digested_length = input.output_length;
+        }
+
+        digest_input(&digests[2], input.year, input.year_length, input.output_length,
+                     &input.profile->year,
+                     digest_scratch + digest_scratch_size(password_length)
+                     + digest_scratch_size(domain_length));
+      }
+
+      memset(password_hash, 0, input.output_length * sizeof(uint16_t));
+      memset(new_passwd, 0, input.output_length + 1);
+
+      iterations = run_generation(&input, generation_engine != ENGINE_REFERENCE ? digests : NULL,
+                                  password_hash, new_passwd, check_hash, check_passwd);
+      account_generation(input.limit, iterations, input.output_length, flags,
+                         new_passwd, &counters, NULL);
+    }
+  }
+
+  /* Clean the working memory: it holds traces of the master password */
+  free_secure_buffer(scratch);
+
+  add_generation_counters(&counters);
+
+  return result;
+}
+
+/* Check and compile a site password policy */
+dprpwg_policy *compile_password_policy(const s_password_policy *description, int *error)
+{
+  dprpwg_policy *policy = NULL;
+  int status;
+
+  if (!description || !(policy = calloc(1, sizeof(*policy)))) {
+    status = POLICY_INVALID;
+  } else {
+    status = build_policy(policy, description);
+  }
+
+  if (status != POLICY_OK) {
+    free(policy);
+    policy = NULL;
+  }
+
+  if (error) {
+    *error = status;
+  }
+
+  return policy;
+}
+
+/* Fill a policy from its description */
+static int build_policy(dprpwg_policy *policy, const s_password_policy *description)
+{
+  /* Categories in CAT_* order, and in output_domains order */
+  const char * const sources[4] = {
+    OUTPUT_LOW, OUTPUT_UPP, OUTPUT_DIG, description->symbols ? description->symbols : OUTPUT_SYM
+  };
+  const size_t min_counts[4] = {
+    description->min_lower, description->min_upper, description->min_digits,
+    description->min_symbols
+  };
+  static const unsigned int output_order[4] = { CAT_LOW, CAT_DIG, CAT_SYM, CAT_UPP };
+  size_t category, seek, required = 0, length = 0;
+
+  /* Custom symbols: printable ASCII chars, but no letter or digit */
+  for (seek = 0; description->symbols && description->symbols[seek]; seek++) {
+    const unsigned char symbol = (unsigned char) description->symbols[seek];
+
+    if (symbol <= ' ' || symbol > '~'
+        || (symbol_categories[symbol] && symbol_categories[symbol] != CAT_SYM)) {
+      return POLICY_INVALID;
+    }
+  }
+
+  policy->max_length = description->max_length ? description->max_length : OUTPUT_MAX_LENGTH;
+
+  if (description->max_length > OUTPUT_MAX_LENGTH
+      || description->min_length > policy->max_length) {
+    return POLICY_INVALID;
+  }
+
+  /* Allowed chars of each category: the available ones, but the forbidden
+   * ones and duplicates */
+  for (category = 0; category < 4; category++) {
+    s_output_domain *domain = &policy->category_domains[category];
+    char *symbols = policy->category_symbols[category];
+
+    if (description->flags & (1U << category)) {
+      for (seek = 0; sources[category][seek]; seek++) {
+        const char symbol = sources[category][seek];
+
+        if ((description->forbidden && strchr(description->forbidden, symbol))
+            || policy->categories[(unsigned char) symbol]) {
+          continue;
+        }
+
+        symbols[domain->size++] = symbol;
+        policy->categories[(unsigned char) symbol] = (unsigned char) (category + 1);
+      }
+    }
+
+    if (domain->size) {
+      domain->symbols = symbols;
+      domain->reciprocal = OUTPUT_DOMAIN_RECIPROCAL(domain->size);
+      policy->flags |= 1U << category;
+    } else if (min_counts[category]) {
+      return POLICY_EMPTY_CATEGORY;
+    }
+
+    policy->min_counts[category] = min_counts[category];
+    required += min_counts[category];
+  }
+
+  if (!policy->flags) {
+    return POLICY_EMPTY_CATEGORY;
+  }
+
+  if (required > policy->max_length) {
+    return POLICY_TOO_LONG;
+  }
+
+  policy->min_length = max(max(description->min_length, required), 1);
+
+  /* All the allowed chars together, to pick from in the hash loop */
+  for (seek = 0; seek < 4; seek++) {
+    const s_output_domain *domain = &policy->category_domains[output_order[seek] - 1];
+
+    if (domain->size) {
+      memcpy(policy->symbols + length, domain->symbols, domain->size);
+      length += domain->size;
+    }
+  }
+
+  policy->output_domain.symbols = policy->symbols;
+  policy->output_domain.size = length;
+  policy->output_domain.reciprocal = OUTPUT_DOMAIN_RECIPROCAL(length);
+
+  return POLICY_OK;
+}
+
+/* Length of a password generated with a policy */
+size_t get_policy_password_length(const dprpwg_policy *policy, const char *year,
+                                  size_t fixed_size)
+{
+  if (fixed_size > 0) {
+    return fixed_size >= policy->min_length && fixed_size <= policy->max_length
+           ? fixed_size : 0;
+  }
+
+  return max(policy->min_length, min(policy->max_length, get_password_length(year, 0)));
+}
+
+/* Generate one password satisfying a policy */
+int generate_password_policy(const char          *password,
+                             const char          *domain,
+                             const char          *year,
+                             size_t              fixed_size,
+                             const dprpwg_policy *policy,
+                             char                *new_passwd,
+                             size_t              passwd_size,
+                             s_generation_stats  *stats)
+{
+  /* Temporary hash, and ENGINE_CHECKED buffers. The policy bounds the
+   * length to OUTPUT_MAX_LENGTH. */
+  uint16_t hash[OUTPUT_MAX_LENGTH];
+  uint16_t check_hash[OUTPUT_MAX_LENGTH];
+  char check_passwd[OUTPUT_MAX_LENGTH + 1];
+
+  s_generation_input input;
+  s_generation_counters counters = { 0, 0, 0, 0, 0 };
+  struct timespec start, end;
+  size_t iterations;
+  int result = GENERATE_OK;
+
+  if (stats) {
+    memset(stats, 0, sizeof(*stats));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+  }
+
+  if (!new_passwd || !passwd_size) {
+    return GENERATE_TOO_SMALL;
+  }
+
+  new_passwd[0] = '\0';
+
+  if (!password || !domain || !year || !policy) {
+    return GENERATE_INVALID;
+  }
+
+  input.output_length = get_policy_password_length(policy, year, fixed_size);
+
+  if (!input.output_length) {
+    result = GENERATE_INFEASIBLE;
+  } else if (input.output_length >= passwd_size) {
+    result = GENERATE_TOO_SMALL;
+  }
+
+  if (result != GENERATE_OK) {
+    return result;
+  }
+
+  input.password = password;
+  input.domain = domain;
+  input.year = year;
+  input.password_length = strlen(password);
+  input.domain_length = strlen(domain);
+  input.year_length = strlen(year);
+  input.output_domain = &policy->output_domain;
+  input.flags = policy->flags;
+  input.limit = get_iteration_limit(&input);
+  input.profile = &default_profile;
+  input.password_weights = NULL;
+
+  /* The categories are given their counts by satisfy_policy(): the engines
+   * have none to wait for, so they run no extension round */
+  input.flags = 0;
+
+  memset(hash, 0, input.output_length * sizeof(uint16_t));
+  memset(new_passwd, 0, input.output_length + 1);
+
+  iterations = run_generation(&input, NULL, hash, new_passwd, check_hash, check_passwd);
+  satisfy_policy(policy, hash, new_passwd, input.output_length);
+
+  /* Some cleaning. Yes, do some memset() to avoid random data in ram */
+  memset(hash, 0, input.output_length * sizeof(uint16_t));
+
+  account_generation(input.limit, iterations, input.output_length, 0, new_passwd,
+                     &counters, stats);
+  add_generation_counters(&counters);
+
+  if (stats) {
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats->wall_time_ns = (uint64_t) (end.tv_sec - start.tv_sec) * 1000000000U
+                          + (uint64_t) end.tv_nsec - (uint64_t) start.tv_nsec;
+  }
+
+  return GENERATE_OK;
+}
+
+/* Replace chars of the categories holding more than their required count
+ * by chars of the categories lacking some. The scan starts at a position
+ * chosen by the hash, and visits every position at most once: as the
+ * required counts fit in the length, the surplus always covers the lack. */
+static void satisfy_policy(const dprpwg_policy *policy, const uint16_t *password_hash,
+                           char *new_passwd, size_t length)
+{
+  size_t counts[4] = { 0, 0, 0, 0 };
+  size_t missing = 0, start = 0, step, category;
+
+  for (step = 0; step < length; step++) {
+    counts[policy->categories[(unsigned char) new_passwd[step]] - 1]++;
+    start += password_hash[step];
+  }
+
+  for (category = 0; category < 4; category++) {
+    if (counts[category] < policy->min_counts[category]) {
+      missing += policy->min_counts[category] - counts[category];
+    }
+  }
+
+  for (step = 0; step < length && missing; step++) {
+    const size_t position = (start + step) % length;
+    const size_t current = policy->categories[(unsigned char) new_passwd[position]] - 1U;
+    const s_output_domain *domain;
+
+    if (counts[current] <= policy->min_counts[current]) {
+      continue;
+    }
+
+    /* The first category lacking chars gets this one */
+    for (category = 0; counts[category] >= policy->min_counts[category]; category++) {
+    }
+
+    domain = &policy->category_domains[category];
+    new_passwd[position] = domain->symbols[output_domain_index(password_hash[position], domain)];
+    counts[current]--;
+    counts[category]++;
+    missing--;
+  }
+}
+
+/* Free a compiled policy */
+void free_password_policy(dprpwg_policy *policy)
+{
+  free(policy);
+}
+
+/* Order of the passwords in the lane kernels: by output length (they must
+ * share it), then by iteration limit (so lanes finish together) */
+static int compare_lane_items(const void *a, const void *b)
+{
+  const s_lane_item *item_a = a, *item_b = b;
+
+  if (item_a->output_length != item_b->output_length) {
+    return item_a->output_length < item_b->output_length ? -1 : 1;
+  }
+
+  if (item_a->limit != item_b->limit) {
+    return item_a->limit < item_b->limit ? -1 : 1;
+  }
+
+  return item_a->item < item_b->item ? -1 : (item_a->item > item_b->item);
+}
+
+/* Character terms of a string, for the lane kernels. An empty string gets
+ * one zero weight. */
+static void lane_weights(uint32_t *weights, const char *string, size_t length,
+                         const s_input_constants *constants)
+{
+  size_t seek;
+
+  weights[0] = 0;
+
+  for (seek = 0; seek < length; seek++) {
+    weights[seek] = (uint32_t) constants->terms[(unsigned char) string[seek]]
+                    + constants->inv_terms[(unsigned char) string[length - seek - 1]];
+  }
+}
+
+/* Write the password of one lane, as it is at this point of the loop */
+static void lane_password(const s_lane_group *group, size_t lane,
+                          const s_output_domain *output_domain, char *new_passwd)
+{
+  size_t output_seek;
+
+  for (output_seek = 0; output_seek < group->output_length; output_seek++) {
+    const uint16_t hash = (uint16_t) group->hash[output_seek * LANES_MAX + lane];
+    new_passwd[output_seek] = output_domain->symbols[output_domain_index(hash, output_domain)];
+  }
+
+  new_passwd[group->output_length] = '\0';
+}
+
+/* Run up to one kernel width of passwords, sharing their output length */
+static void run_lane_group(const s_lane_kernel *kernel, s_lane_group *group,
+                           const s_lane_item *items, const unsigned int *flags,
+                           char *output, size_t output_stride,
+                           s_generation_counters *counters)
+{
+  int done[LANES_MAX];
+  size_t lane, start = 0;
+  const size_t output_length = group->output_length;
+
+  for (lane = 0; lane < group->lane_count; lane++) {
+    done[lane] = FALSE;
+  }
+
+  memset(group->hash, 0, output_length * LANES_MAX * sizeof(uint32_t));
+
+  /* Run the loop up to the next lane limit, then check that lane like the
+   * reference loop does, raising its limit if categories are missing */
+  for (;;) {
+    size_t end = (size_t) -1;
+
+    for (lane = 0; lane < group->lane_count; lane++) {
+      if (!done[lane]) {
+        end = min(end, group->limits[lane]);
+      }
+    }
+
+    if (end == (size_t) -1) {
+      break;
+    }
+
+    kernel->run(group, start, end);
+
+    for (lane = 0; lane < group->lane_count; lane++) {
+      char *new_passwd = output + items[lane].item * output_stride;
+      const unsigned int item_flags = flags[items[lane].item];
+      s_category_tracker tracker;
+
+      if (done[lane] || group->limits[lane] != end) {
+        continue;
+      }
+
+      if (end >= ITERATION_MAX) {
+        done[lane] = TRUE;
+        continue;
+      }
+
+      lane_password(group, lane, get_output_domain(item_flags), new_passwd);
+      track_categories(&tracker, new_passwd, output_length);
+
+      if (has_all_categories(&tracker, item_flags)) {
+        done[lane] = TRUE;
+      } else {
+        group->limits[lane] = (uint32_t) min(end + output_length, ITERATION_MAX);
+      }
+    }
+
+    start = end;
+  }
+
+  /* Every lane stopped at its final limit */
+  for (lane = 0; lane < group->lane_count; lane++) {
+    char *new_passwd = output + items[lane].item * output_stride;
+    const unsigned int item_flags = flags[items[lane].item];
+
+    lane_password(group, lane, get_output_domain(item_flags), new_passwd);
+    account_generation(items[lane].limit, group->limits[lane], output_length, item_flags,
+                       new_passwd, counters, NULL);
+  }
+}
+
+/* Batch generation with the lane kernels */
+static int generate_batch_lanes(const dprpwg_profile *profile,
+                                const char         *password,
+                                const char         *year,
+                                const char * const *domains,
+                                const unsigned int *flags,
+                                const size_t       *fixed_sizes,
+                                size_t             count,
+                                char               *output,
+                                size_t             output_stride,
+                                size_t             max_output_length,
+                                size_t             max_domain_length,
+                                s_generation_counters *counters)
+{
+  const s_lane_kernel *kernel = get_lane_kernel();
+  const size_t password_length = strlen(password);
+  const size_t year_length = strlen(year);
+  const size_t default_length = get_password_length(year, 0);
+  s_lane_item *items;
+  uint32_t *hash, *password_weights, *year_weights, *domain_weights;
+  uint16_t *single_hash;
+  size_t item_count = 0, item, first;
+  s_lane_group group;
+
+  items = malloc(count * sizeof(s_lane_item));
+  hash = alloc_secure_buffer(max_output_length * LANES_MAX * sizeof(uint32_t));
+  password_weights = alloc_secure_buffer((password_length + 1) * sizeof(uint32_t));
+  year_weights = alloc_secure_buffer((year_length + 1) * sizeof(uint32_t));
+  domain_weights = alloc_secure_buffer((max_domain_length * LANES_MAX + 1) * sizeof(uint32_t));
+  single_hash = alloc_secure_buffer(max_output_length * sizeof(uint16_t));
+
+  if (!items || !hash || !password_weights || !year_weights || !domain_weights || !single_hash) {
+    free(items);
+    free_secure_buffer(hash);
+    free_secure_buffer(password_weights);
+    free_secure_buffer(year_weights);
+    free_secure_buffer(domain_weights);
+    free_secure_buffer(single_hash);
+    return FALSE;
+  }
+
+  /* Collect the passwords to generate. The few the kernels cannot run
+   * (no symbol to pick from, or a limit over 2^31) go the usual way. */
+  for (item = 0; item < count; item++) {
+    s_generation_input input;
+    const unsigned int item_flags = flags[item];
+
+    input.output_length = fixed_sizes && fixed_sizes[item] > 0 ? fixed_sizes[item] : default_length;
+
+    if (!item_flags || (item_flags & FLAG_STRETCH) || input.output_length >= output_stride) {
+      continue;
+    }
+
+    input.password = password;
+    input.domain = domains[item];
+    input.year = year;
+    input.password_length = password_length;
+    input.domain_length = strlen(domains[item]);
+    input.year_length = year_length;
+    input.output_domain = get_output_domain(item_flags);
+    input.flags = item_flags;
+    input.limit = get_iteration_limit(&input);
+    input.profile = profile;
+    input.password_weights = NULL;
+
+    if (!input.output_domain->size || input.limit >= (1U << 31)) {
+      char *new_passwd = output + item * output_stride;
+
+      memset(single_hash, 0, input.output_length * sizeof(uint16_t));
+      memset(new_passwd, 0, input.output_length + 1);
+      account_generation(input.limit, generate_reference(&input, single_hash, new_passwd),
+                         input.output_length, item_flags, new_passwd, counters, NULL);
+      continue;
+    }
+
+    items[item_count].item = item;
+    items[item_count].output_length = input.output_length;
+    items[item_count].limit = input.limit;
+    item_count++;
+  }
+
+  qsort(items, item_count, sizeof(s_lane_item), compare_lane_items);
+
+  /* Shared group setup. Domain weights start with one zero weight, for
+   * empty domains and unused lanes. */
+  lane_weights(password_weights, password, password_length, &profile->password);
+  lane_weights(year_weights, year, year_length, &profile->year);
+  domain_weights[0] = 0;
+
+  group.password_weights = password_weights;
+  group.password_length = max(password_length, 1);
+  group.year_weights = year_weights;
+  group.year_length = max(year_length, 1);
+  group.domain_weights = domain_weights;
+  group.password_seek_mul = profile->password.seek_mul;
+  group.domain_seek_mul = profile->domain.seek_mul;
+  group.year_seek_mul = profile->year.seek_mul;
+  group.hash = hash;
+
+  for (first = 0; first < item_count; first += group.lane_count) {
+    size_t lane;
+
+    group.output_length = items[first].output_length;
+
+    for (lane = 0; lane < LANES_MAX; lane++) {
+      const size_t index = first + lane;
+
+      group.domain_offsets[lane] = 0;
+      group.domain_lengths[lane] = 1;
+      group.limits[lane] = 0;
+
+      if (lane >= kernel->width || index >= item_count
+          || items[index].output_length != group.output_length) {
+        continue;
+      }
+
+      group.lane_count = lane + 1;
+      group.limits[lane] = (uint32_t) items[index].limit;
+
+      if (*domains[items[index].item]) {
+        const size_t domain_length = strlen(domains[items[index].item]);
+
+        group.domain_offsets[lane] = (uint32_t) (1 + lane * max_domain_length);
+        group.domain_lengths[lane] = (uint32_t) domain_length;
+        lane_weights(domain_weights + group.domain_offsets[lane], domains[items[index].item],
+                     domain_length, &profile->domain);
+      }
+    }
+
+    run_lane_group(kernel, &group, items + first, flags, output, output_stride, counters);
+  }
+
+  /* Everything holds traces of the master password: secure buffers are
+   * wiped when freed */
+  free(items);
+  free_secure_buffer(hash);
+  free_secure_buffer(password_weights);
+  free_secure_buffer(year_weights);
+  free_secure_buffer(domain_weights);
+  free_secure_buffer(single_hash);
+
+  return TRUE;
+}
+
+/* Select the generation engine */
+int set_generation_engine(unsigned int engine)
+{
+  if (engine != ENGINE_REFERENCE && engine != ENGINE_CLOSED_FORM
+      && engine != ENGINE_CHECKED) {
+    return FALSE;
+  }
+
+  generation_engine = engine;
+  return TRUE;
+}
+
+/* Get the selected generation engine */
+unsigned int get_generation_engine(void)
+{
+  return generation_engine;
+}
+
+/* Read the process-wide counters */
+void get_generation_counters(s_generation_counters *counters)
+{
+  counters->generations = atomic_load_explicit(&generation_counters.generations,
+                                               memory_order_relaxed);
+  counters->iterations = atomic_load_explicit(&generation_counters.iterations,
+                                              memory_order_relaxed);
+  counters->extension_rounds = atomic_load_explicit(&generation_counters.extension_rounds,
+                                                    memory_order_relaxed);
+  counters->iteration_max_hits = atomic_load_explicit(&generation_counters.iteration_max_hits,
+                                                      memory_order_relaxed);
+  counters->missing_categories = atomic_load_explicit(&generation_counters.missing_categories,
+                                                      memory_order_relaxed);
+}
 
-  if (flags & FLAG_UPP_AVAIL) {
-    strncpy(output_domain + domain_seek, OUTPUT_UPP,
-            max(strlen(OUTPUT_UPP), OUTPUT_DOMAIN_MAXLENGTH - domain_seek));
-    domain_seek += strlen(OUTPUT_UPP);
-  }
+/* Reset the process-wide counters */
+void reset_generation_counters(void)
+{
+  atomic_store_explicit(&generation_counters.generations, 0, memory_order_relaxed);
+  atomic_store_explicit(&generation_counters.iterations, 0, memory_order_relaxed);
+  atomic_store_explicit(&generation_counters.extension_rounds, 0, memory_order_relaxed);
+  atomic_store_explicit(&generation_counters.iteration_max_hits, 0, memory_order_relaxed);
+  atomic_store_explicit(&generation_counters.missing_categories, 0, memory_order_relaxed);
+}
 
-  /* ---- Output symbol domain generated ---- */
+/* The historical generation loop */
+static size_t generate_reference(const s_generation_input *input,
+                                 uint16_t *password_hash,
+                                 char *new_passwd)
+{
+  /* Local aliases, so the loop reads like it always did */
+  const char *password = input->password;
+  const char *domain = input->domain;
+  const char *year = input->year;
+  const size_t password_length = input->password_length;
+  const size_t domain_length = input->domain_length;
+  const size_t year_length = input->year_length;
+  const size_t output_length = input->output_length;
+  const char *output_domain = input->output_domain->symbols;
+  const unsigned int flags = input->flags;
+  const uint16_t *password_weights = input->password_weights;
+  const s_input_constants *password_constants = &input->profile->password;
+  const s_input_constants *domain_constants = &input->profile->domain;
+  const s_input_constants *year_constants = &input->profile->year;
+  const unsigned int password_seek_mul = password_constants->seek_mul;
+  const unsigned int domain_seek_mul = domain_constants->seek_mul;
+  const unsigned int year_seek_mul = year_constants->seek_mul;
 
-  /* Set the string length aliases. Yes, they could be 'const'... */
-  password_length = strlen(password);
-  domain_length = strlen(domain);
-  year_length = strlen(year);
-  output_domain_size = strlen(output_domain);
+  /* Cursors needed when reading the inputs */
+  size_t pwd_seek, domain_seek, year_seek, output_seek;
 
-  /* Compute the length of the generated password if this is not fixed */
-  if (fixed_size > 0) {
-    output_length = fixed_size;
-  } else {
-    /*
-     * Oh yeah, that's arbitrary. The size should be as follow:
-     * - pre 2000:  12
-     * - 2000-2004: 12
-     * - 2005-2009: 13
-     * - 2010-2014: 14
-     * - 2015-2020: 15
-     * ... and I thing you get it.
-     */
-    int year_value = atoi(year);
-
-    if (year_value < 2000) {
-      output_length = 12;
-    } else {
-      output_length = max(OUTPUT_MIN_LENGTH,
-                          min(OUTPUT_MAX_LENGTH,
-                              12 + (unsigned int)(year_value - 2000) / 5));
-    }
-  }
+  /* Control the number of iteration */
+  size_t limit, iteration;
 
-  /* Memory allocation for temporary hash and output password */
-  password_hash = calloc(output_length, sizeof(uint16_t));
-  *new_passwd = calloc(output_length + 1, sizeof(char));
+  /* Symbol categories in the password, tracked from the first check on */
+  s_category_tracker tracker;
+  int tracking = FALSE;
+  char symbol;
 
   /* Initialize iteration count and string cursors */
   pwd_seek = domain_seek = year_seek = output_seek = 0;
   iteration = 0;
-
-  /* Compute the number of iteration to use. Depends on the input */
-  limit = output_domain_size * (password_length + domain_length + year_length + output_length + flags);
+  limit = input->limit;
 
   /* One turn of the generation algorithm */
   while (iteration < limit) {
@@ -173,37 +2402,48 @@ void generate_password(const char   *password,
     }
 
     /* If we are given a password... */
-    if (password_length) {
+    if (password_length && password_weights) {
+      /* ... already digested in a context, only the cursor term is left */
+      password_hash[output_seek] = (uint16_t) (password_hash[output_seek]
+                                               + password_weights[pwd_seek]
+                                               + output_seek * pwd_seek * password_seek_mul);
+    } else if (password_length) {
       /* Oh yeah... Do something with the password.
        * Look at the code! Splendid. Neat. Marvelous. */
       password_hash[output_seek] = (password_hash[output_seek]
-                                    + ((unsigned int)(password[pwd_seek])) * PW_MUL
-                                    + output_seek * pwd_seek * PW_SEEK_MUL
-                                    + ((unsigned int)(password[password_length - pwd_seek - 1])) * PW_INV_MUL
+                                    + password_constants->terms[(unsigned char) password[pwd_seek]]
+                                    + output_seek * pwd_seek * password_seek_mul
+                                    + password_constants->inv_terms[(unsigned char) password[password_length - pwd_seek - 1]]
                                    ) % 65536;
     }
 
     /* Use also the domain, ... */
     if (domain_length) {
       password_hash[output_seek] = (password_hash[output_seek]
-                                    + ((unsigned int)(domain[domain_seek])) * DOM_MUL
-                                    + output_seek * domain_seek * DOM_SEEK_MUL
-                                    + ((unsigned int)(domain[domain_length - domain_seek - 1])) * DOM_INV_MUL
+                                    + domain_constants->terms[(unsigned char) domain[domain_seek]]
+                                    + output_seek * domain_seek * domain_seek_mul
+                                    + domain_constants->inv_terms[(unsigned char) domain[domain_length - domain_seek - 1]]
                                    ) % 65536;
     }
 
     /* ... and the year. */
     if (year_length) {
       password_hash[output_seek] = (password_hash[output_seek]
-                                    + ((unsigned int)(year[year_seek])) * YR_MUL
-                                    + output_seek * year_seek * YR_SEEK_MUL
-                                    + ((unsigned int)(year[year_length - year_seek - 1])) * YR_INV_MUL
+                                    + year_constants->terms[(unsigned char) year[year_seek]]
+                                    + output_seek * year_seek * year_seek_mul
+                                    + year_constants->inv_terms[(unsigned char) year[year_length - year_seek - 1]]
                                    ) % 65536;
     }
 
     /* Now we have a new character. Note that it may be modified until
      * the last loop iteration */
-    (*new_passwd)[output_seek] = output_domain[password_hash[output_seek] % output_domain_size];
+    symbol = output_domain[output_domain_index(password_hash[output_seek], input->output_domain)];
+
+    if (tracking) {
+      track_symbol(&tracker, new_passwd[output_seek], symbol);
+    }
+
+    new_passwd[output_seek] = symbol;
 
     /* Increment everything */
     output_seek++;
@@ -215,7 +2455,12 @@ void generate_password(const char   *password,
     /* Stop if we reach the limit AND we have all the requested symbol
      * categories in the password! If it lacks some categories, raise the
      * limit. */
-    if ((iteration == limit && limit < ITERATION_MAX) && !check_password(*new_passwd, flags)) {
+    if (iteration == limit && limit < ITERATION_MAX && !tracking) {
+      track_categories(&tracker, new_passwd, output_length);
+      tracking = TRUE;
+    }
+
+    if ((iteration == limit && limit < ITERATION_MAX) && !has_all_categories(&tracker, flags)) {
       /* Proceed again, but up to a certain point. Note that it means
        * the generated password may not contain all symbols. */
       limit += output_length;
@@ -226,87 +2471,300 @@ void generate_password(const char   *password,
     }
   }
 
-  /* Some cleaning. Yes, do some memset() to avoid random data in ram */
-  memset(output_domain, 0, OUTPUT_DOMAIN_MAXLENGTH * sizeof(char));
-  memset(password_hash, 0, output_length * sizeof(uint16_t));
-  free(password_hash);
+  return iteration;
 }
 
-/* Check the password contains all requested symbol categories */
-static int check_password(const char* password, unsigned int flags)
+/*
+ * ---- Closed-form engine ----
+ *
+ * At iteration i, the hash loop adds to password_hash[i % output_length]
+ * one term per input string s (of length n), and that term only depends
+ * on (i % n) and on the output cursor o = i % output_length:
+ *     s[i % n] * MUL + s[n - (i % n) - 1] * INV_MUL + o * (i % n) * SEEK_MUL
+ * Everything is computed modulo 65536, so the order of the additions does
+ * not matter.
+ *
+ * The hash cell o is visited at iterations o, o + L, o + 2L... (L being
+ * the output length). Along these visits, the input cursor i % n walks an
+ * "orbit": it starts at o % n and moves by L % n each time, so it cycles
+ * through the gcd(n, L) cursor values congruent to o modulo gcd(n, L).
+ * With prefix sums along each orbit, the sum of any number of visits is
+ * a couple of multiplications and lookups.
+ */
+
+/* Extended Euclid: inverse of 'value' modulo 'modulus' (they are coprime) */
+static size_t modular_inverse(size_t value, size_t modulus)
 {
+  long long r0 = (long long) modulus, r1 = (long long) (value % modulus);
+  long long t0 = 0, t1 = 1;
 
-  if (flags & FLAG_DIG_AVAIL) {
-    if (!check_password_domain(password, OUTPUT_DIG)) {
-      return FALSE;
-    }
-  }
+  while (r1) {
+    long long q = r0 / r1, tmp;
 
-  if (flags & FLAG_SYM_AVAIL) {
-    if (!check_password_domain(password, OUTPUT_SYM)) {
-      return FALSE;
-    }
+    tmp = r0 - q * r1;
+    r0 = r1;
+    r1 = tmp;
+    tmp = t0 - q * t1;
+    t0 = t1;
+    t1 = tmp;
   }
 
-  if (flags & FLAG_LOW_AVAIL) {
-    if (!check_password_domain(password, OUTPUT_LOW)) {
-      return FALSE;
-    }
+  if (t0 < 0) {
+    t0 += (long long) modulus;
   }
 
-  if (flags & FLAG_UPP_AVAIL) {
-    if (!check_password_domain(password, OUTPUT_UPP)) {
-      return FALSE;
-    }
+  return (size_t) t0 % modulus;
+}
+
+static size_t gcd(size_t a, size_t b)
+{
+  while (b) {
+    size_t tmp = a % b;
+    a = b;
+    b = tmp;
   }
 
-  return TRUE;
+  return a;
 }
 
-/* Check if 'password' contains at least one symbol from 'domain' */
-static int check_password_domain(const char* password, const char* domain)
+/* Number of uint16_t needed by digest_input() */
+static inline size_t digest_scratch_size(size_t length)
 {
-  size_t password_length, password_seek, domain_length, domain_seek;
+  /* Two prefix sums arrays of (orbit_length + 1) per orbit */
+  return 2 * (length + length);
+}
 
-  password_length = strlen(password);
-  domain_length = strlen(domain);
+/* Build the per-orbit prefix sums of one input string. 'scratch' must hold
+ * digest_scratch_size(length) values, and is used until the digest is not
+ * needed anymore. */
+static void digest_input(s_input_digest *digest, const char *string, size_t length,
+                         size_t output_length, const s_input_constants *constants,
+                         uint16_t *scratch)
+{
+  size_t orbit, step, cursor, seek;
 
-  for (password_seek = 0; password_seek < password_length; password_seek++) {
-    for (domain_seek = 0; domain_seek < domain_length; domain_seek++) {
-      if (password[password_seek] == domain[domain_seek]) {
-        return TRUE;
+  digest->string = string;
+  digest->length = length;
+  digest->seek_mul = constants->seek_mul;
+
+  if (!length) {
+    return;
+  }
+
+  digest->orbit_count = gcd(length, output_length);
+  digest->orbit_length = length / digest->orbit_count;
+  digest->step_inverse = modular_inverse(output_length / digest->orbit_count,
+                                         digest->orbit_length);
+  digest->weight_sums = scratch;
+  digest->seek_sums = scratch + length + digest->orbit_count;
+
+  step = output_length % length;
+
+  for (orbit = 0; orbit < digest->orbit_count; orbit++) {
+    uint16_t *weight_sums = digest->weight_sums + orbit * (digest->orbit_length + 1);
+    uint16_t *seek_sums = digest->seek_sums + orbit * (digest->orbit_length + 1);
+
+    weight_sums[0] = 0;
+    seek_sums[0] = 0;
+    cursor = orbit;
+
+    for (seek = 0; seek < digest->orbit_length; seek++) {
+      weight_sums[seek + 1] = (uint16_t) (weight_sums[seek]
+                                          + constants->terms[(unsigned char) string[cursor]]
+                                          + constants->inv_terms[(unsigned char) string[length - cursor - 1]]);
+      seek_sums[seek + 1] = (uint16_t) (seek_sums[seek] + cursor);
+
+      cursor += step;
+      if (cursor >= length) {
+        cursor -= length;
       }
     }
   }
+}
+
+/* Sum of the terms of one input string, over the first 'visits' visits of
+ * the hash cell 'output_seek' */
+static uint16_t digest_sum(const s_input_digest *digest, size_t output_seek, size_t visits)
+{
+  size_t start, orbit, first, cycles, rest;
+  const uint16_t *weight_sums, *seek_sums;
+  size_t weight, seek;
+  const size_t orbit_length = digest->orbit_length;
+
+  if (!digest->length || !visits) {
+    return 0;
+  }
+
+  /* Find the orbit, and where we enter it */
+  start = output_seek % digest->length;
+  orbit = start % digest->orbit_count;
+  first = ((start - orbit) / digest->orbit_count) * digest->step_inverse % orbit_length;
+
+  weight_sums = digest->weight_sums + orbit * (orbit_length + 1);
+  seek_sums = digest->seek_sums + orbit * (orbit_length + 1);
+
+  /* Whole cycles, then the remaining part (which may wrap around) */
+  cycles = visits / orbit_length;
+  rest = visits % orbit_length;
+
+  weight = cycles * weight_sums[orbit_length];
+  seek = cycles * seek_sums[orbit_length];
+
+  if (first + rest <= orbit_length) {
+    weight += (size_t) weight_sums[first + rest] - weight_sums[first];
+    seek += (size_t) seek_sums[first + rest] - seek_sums[first];
+  } else {
+    weight += (size_t) weight_sums[orbit_length] - weight_sums[first]
+              + weight_sums[first + rest - orbit_length];
+    seek += (size_t) seek_sums[orbit_length] - seek_sums[first]
+            + seek_sums[first + rest - orbit_length];
+  }
 
-  return FALSE;
+  return (uint16_t) (weight + output_seek * seek * digest->seek_mul);
 }
 
+/* One iteration of the hash loop, exactly like generate_reference() does */
+static void hash_iteration(const s_generation_input *input, uint16_t *password_hash,
+                           char *new_passwd, s_category_tracker *tracker, size_t iteration)
+{
+  char symbol;
+  const size_t output_seek = iteration % input->output_length;
+  size_t hash = password_hash[output_seek];
 
-/* Compute a password strength */
-double get_password_strength(const char* password, unsigned int year, unsigned int flags)
+  if (input->password_length) {
+    const size_t seek = iteration % input->password_length;
+    hash += input->profile->password.terms[(unsigned char) input->password[seek]]
+            + output_seek * seek * input->profile->password.seek_mul
+            + input->profile->password.inv_terms[(unsigned char) input->password[input->password_length - seek - 1]];
+  }
+
+  if (input->domain_length) {
+    const size_t seek = iteration % input->domain_length;
+    hash += input->profile->domain.terms[(unsigned char) input->domain[seek]]
+            + output_seek * seek * input->profile->domain.seek_mul
+            + input->profile->domain.inv_terms[(unsigned char) input->domain[input->domain_length - seek - 1]];
+  }
+
+  if (input->year_length) {
+    const size_t seek = iteration % input->year_length;
+    hash += input->profile->year.terms[(unsigned char) input->year[seek]]
+            + output_seek * seek * input->profile->year.seek_mul
+            + input->profile->year.inv_terms[(unsigned char) input->year[input->year_length - seek - 1]];
+  }
+
+  password_hash[output_seek] = (uint16_t) hash;
+  symbol = input->output_domain->symbols[output_domain_index(password_hash[output_seek],
+                                                            input->output_domain)];
+  track_symbol(tracker, new_passwd[output_seek], symbol);
+  new_passwd[output_seek] = symbol;
+}
+
+/* The closed-form generation */
+static int generate_closed_form(const s_generation_input *input,
+                                const s_input_digest *digests,
+                                uint16_t *password_hash,
+                                char *new_passwd,
+                                size_t *iterations)
 {
-  int symbols_count_table[OUTPUT_DOMAIN_MAXLENGTH];
-  double entropy = 0.0;
-  size_t password_length;
-  size_t table_seek, password_seek;
-  size_t alphabet_size = 0;
+  s_input_digest own_digests[3];
+  s_category_tracker tracker;
+  uint16_t stack_scratch[DIGEST_STACK_SCRATCH_SIZE];
+  uint16_t *scratch = NULL;
+  size_t scratch_size = 0, output_seek, iteration;
+  const size_t output_length = input->output_length;
+
+  /* Nothing to pick symbols from: the loop would not run at all */
+  if (!input->output_domain->size || !input->limit) {
+    *iterations = 0;
+    return TRUE;
+  }
+
+  if (!digests) {
+    scratch_size = digest_scratch_size(input->password_length)
+                   + digest_scratch_size(input->domain_length)
+                   + digest_scratch_size(input->year_length);
+
+    /* Usual inputs fit on the stack, only allocate for huge ones */
+    if (scratch_size <= DIGEST_STACK_SCRATCH_SIZE) {
+      scratch = stack_scratch;
+    } else {
+      scratch = alloc_secure_buffer(scratch_size * sizeof(uint16_t));
+    }
+
+    if (!scratch) {
+      return FALSE;
+    }
+
+    digest_input(&own_digests[0], input->password, input->password_length, output_length,
+                 &input->profile->password, scratch);
+    digest_input(&own_digests[1], input->domain, input->domain_length, output_length,
+                 &input->profile->domain,
+                 scratch + digest_scratch_size(input->password_length));
+    digest_input(&own_digests[2], input->year, input->year_length, output_length,
+                 &input->profile->year,
+                 scratch + digest_scratch_size(input->password_length)
+                 + digest_scratch_size(input->domain_length));
+    digests = own_digests;
+  }
 
-  if (flags & FLAG_DIG_AVAIL) {
-    alphabet_size += strlen(OUTPUT_DIG);
+  /* State of the hash after 'limit' iterations. The limit is always at
+   * least the output length, so every cell gets visited. */
+  iteration = input->limit;
+
+  for (output_seek = 0; output_seek < output_length; output_seek++) {
+    const size_t visits = (iteration - output_seek + output_length - 1) / output_length;
+
+    password_hash[output_seek] = (uint16_t) (digest_sum(&digests[0], output_seek, visits)
+                                             + digest_sum(&digests[1], output_seek, visits)
+                                             + digest_sum(&digests[2], output_seek, visits));
+    new_passwd[output_seek] = input->output_domain->symbols[output_domain_index(password_hash[output_seek],
+                                                                                input->output_domain)];
+  }
+
+  /* Extension rounds: same rule as the reference loop */
+  if (iteration < ITERATION_MAX) {
+    track_categories(&tracker, new_passwd, output_length);
   }
 
-  if (flags & FLAG_SYM_AVAIL) {
-    alphabet_size += strlen(OUTPUT_SYM);
+  while (iteration < ITERATION_MAX && !has_all_categories(&tracker, input->flags)) {
+    const size_t limit = min(iteration + output_length, ITERATION_MAX);
+
+    for (; iteration < limit; iteration++) {
+      hash_iteration(input, password_hash, new_passwd, &tracker, iteration);
+    }
   }
 
-  if (flags & FLAG_LOW_AVAIL) {
-    alphabet_size += strlen(OUTPUT_LOW);
+  if (scratch == stack_scratch) {
+    memset(scratch, 0, scratch_size * sizeof(uint16_t));
+  } else {
+    free_secure_buffer(scratch);
   }
 
-  if (flags & FLAG_UPP_AVAIL) {
-    alphabet_size += strlen(OUTPUT_UPP);
+  *iterations = iteration;
+  return TRUE;
+}
+
+
+/* Count the symbol categories of a password, once */
+static void track_categories(s_category_tracker *tracker, const char *password, size_t length)
+{
+  size_t seek;
+
+  memset(tracker, 0, sizeof(*tracker));
+
+  for (seek = 0; seek < length; seek++) {
+    track_symbol(tracker, '\0', password[seek]);
   }
+}
+
+/* Compute a password strength */
+double get_password_strength(const char* password, unsigned int year, unsigned int flags)
+{
+  int symbols_count_table[OUTPUT_DOMAIN_MAXLENGTH];
+  double entropy = 0.0;
+  size_t password_length;
+  size_t table_seek, password_seek;
+  const size_t alphabet_size = get_output_domain(flags)->size;
 
   password_length = strlen(password);
 
@@ -345,3 +2803,413 @@ double get_password_strength(const char* password, unsigned int year, unsigned i
   return entropy * ((double)password_length / (double)(max(year / 5 - 388, 12)))
          * log2((double)alphabet_size) / OVERKILL_PWD_STRENGTH;
 }
+
+/* Compute the strength of many passwords */
+void get_password_strength_batch(const char         *passwords,
+                                 size_t             password_stride,
+                                 size_t             count,
+                                 unsigned int       year,
+                                 const unsigned int *flags,
+                                 double             *strengths)
+{
+  const s_count_kernel *kernel = get_count_kernel();
+  const s_output_domain *alphabet_domain = NULL;
+  s_count_alphabet alphabet;
+  uint16_t counts[OUTPUT_MAX_LENGTH];
+  double count_log2_table[OUTPUT_MAX_LENGTH + 1];
+  size_t table_length = 0;
+  double scale = 0.0;
+  size_t index;
+
+  for (index = 0; index < count; index++) {
+    const char *password = passwords + index * password_stride;
+    const s_output_domain *output_domain = get_output_domain(flags[index]);
+    const size_t password_length = strlen(password);
+    double count_log2_sum = 0.0;
+    size_t password_seek;
+
+    if (password_length == 0) {
+      strengths[index] = 0.0;
+      continue;
+    }
+
+    if (password_length > OUTPUT_MAX_LENGTH) {
+      strengths[index] = get_password_strength(password, year, flags[index]);
+      continue;
+    }
+
+    /* Compact histogram buckets and scale of the alphabet, built again
+     * only when it changes */
+    if (output_domain != alphabet_domain) {
+      memset(alphabet.buckets, COUNT_NO_BUCKET, sizeof(alphabet.buckets));
+
+      for (alphabet.bucket_count = 0; alphabet.bucket_count < output_domain->size;
+           alphabet.bucket_count++) {
+        alphabet.buckets[(unsigned char) output_domain->symbols[alphabet.bucket_count]]
+          = (uint8_t) alphabet.bucket_count;
+      }
+
+      alphabet_domain = output_domain;
+      scale = log2((double) output_domain->size)
+              / ((double) max(year / 5 - 388, 12) * OVERKILL_PWD_STRENGTH);
+    }
+
+    if (!kernel->run(password, password_length, &alphabet, counts)) {
+      strengths[index] = get_password_strength(password, year, flags[index]);
+      continue;
+    }
+
+    /* log2 of every count up to the longest password so far */
+    for (; table_length <= password_length; table_length++) {
+      count_log2_table[table_length] = table_length ? log2((double) table_length) : 0.0;
+    }
+
+    /* Each symbol of count c shows up c times, so this sums c * log2(c)
+     * over the symbols. The entropy is then the sum of -p * log2(p),
+     * p = c / length, times length:
+     * length * log2(length) - sum(c * log2(c)). */
+    for (password_seek = 0; password_seek < password_length; password_seek++) {
+      count_log2_sum += count_log2_table[counts[password_seek]];
+    }
+
+    strengths[index] = ((double) password_length * count_log2_table[password_length]
+                        - count_log2_sum) * scale;
+  }
+
+  memset(counts, 0, sizeof(counts));
+}
+
+/* Measure the master password guess rate of this machine */
+int calibrate_attack_rate(unsigned int threads, double seconds, s_attack_rate *rate)
+{
+  s_calibration_worker *workers;
+  pthread_t *thread_ids;
+  char year[16], target[OUTPUT_MAX_LENGTH + 1];
+  const unsigned int flags = FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL;
+  struct tm time_data;
+  time_t time_value = time(NULL);
+  unsigned int thread, started;
+
+  if (!threads) {
+    threads = get_core_count();
+  }
+
+  workers = calloc(threads, sizeof(s_calibration_worker));
+  thread_ids = calloc(threads, sizeof(pthread_t));
+
+  if (!workers || !thread_ids) {
+    free(workers);
+    free(thread_ids);
+    return FALSE;
+  }
+
+  /* The known password: any master password will do */
+  localtime_r(&time_value, &time_data);
+  snprintf(year, sizeof(year), "%d", time_data.tm_year + 1900);
+  generate_password_r("calibration", CALIBRATION_DOMAIN, year, 0, flags,
+                      target, sizeof(target), NULL, 0);
+
+  for (thread = 0; thread < threads; thread++) {
+    workers[thread].index = thread;
+    workers[thread].seconds = seconds;
+    workers[thread].year = year;
+    workers[thread].target = target;
+    workers[thread].flags = flags;
+  }
+
+  /* The calling thread runs the first worker, and the others are left
+   * out if they cannot be started */
+  for (started = 1; started < threads; started++) {
+    if (pthread_create(&thread_ids[started], NULL, calibration_worker, &workers[started])) {
+      break;
+    }
+  }
+
+  calibration_worker(&workers[0]);
+
+  for (thread = 1; thread < started; thread++) {
+    pthread_join(thread_ids[thread], NULL);
+  }
+
+  rate->guesses_per_second = 0.0;
+  rate->threads = started;
+  rate->output_length = strlen(target);
+  rate->seconds = 0.0;
+
+  for (thread = 0; thread < started; thread++) {
+    rate->guesses_per_second += (double) workers[thread].guesses / workers[thread].elapsed;
+    rate->seconds = workers[thread].elapsed > rate->seconds ? workers[thread].elapsed : rate->seconds;
+  }
+
+  free(workers);
+  free(thread_ids);
+
+  /* Guesses of a stretched master password stretch each candidate too.
+   * Each thread stretches its own candidates. */
+  rate->stretch_seconds = time_stretch() / started;
+
+  return rate->stretch_seconds >= 0.0;
+}
+
+/* Time the cheapest stretching */
+static double time_stretch(void)
+{
+  s_argon2_params params;
+  uint8_t tag[STRETCH_KEY_LENGTH / 2];
+  double best = -1.0;
+  unsigned int run;
+
+  set_stretch_params(&params, "calibration", STRETCH_COST_MIN);
+
+  for (run = 0; run < CALIBRATION_STRETCH_RUNS; run++) {
+    struct timespec start, end;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (!compute_argon2id(&params, 1, tag, sizeof(tag))) {
+      return -1.0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+    best = best < 0.0 || elapsed < best ? elapsed : best;
+  }
+
+  memset(tag, 0, sizeof(tag));
+
+  return best;
+}
+
+/* Guess master passwords, as an attacker knowing one generated password */
+static void *calibration_worker(void *data)
+{
+  s_calibration_worker *worker = (s_calibration_worker *) data;
+  s_generation_input input;
+  s_input_digest digests[3];
+  uint16_t scratch[DIGEST_STACK_SCRATCH_SIZE];
+  uint16_t password_hash[OUTPUT_MAX_LENGTH];
+  char new_passwd[OUTPUT_MAX_LENGTH + 1];
+  char candidate[CALIBRATION_GUESS_LENGTH + 1];
+  struct timespec start, now;
+  size_t iterations, guess, seek;
+
+  /* Candidates walk the printable ASCII chars, from a different first
+   * char on each thread */
+  memset(candidate, 'a', CALIBRATION_GUESS_LENGTH);
+  candidate[0] = (char) (' ' + worker->index % 95);
+  candidate[CALIBRATION_GUESS_LENGTH] = '\0';
+
+  input.password = candidate;
+  input.domain = CALIBRATION_DOMAIN;
+  input.year = worker->year;
+  input.password_length = CALIBRATION_GUESS_LENGTH;
+  input.domain_length = strlen(CALIBRATION_DOMAIN);
+  input.year_length = strlen(worker->year);
+  input.output_length = strlen(worker->target);
+  input.output_domain = get_output_domain(worker->flags);
+  input.flags = worker->flags;
+  input.limit = get_iteration_limit(&input);
+  input.profile = &default_profile;
+  input.password_weights = NULL;
+
+  /* The domain and year are known: digested once */
+  digest_input(&digests[1], input.domain, input.domain_length, input.output_length,
+               &default_profile.domain, scratch + digest_scratch_size(CALIBRATION_GUESS_LENGTH));
+  digest_input(&digests[2], input.year, input.year_length, input.output_length,
+               &default_profile.year,
+               scratch + digest_scratch_size(CALIBRATION_GUESS_LENGTH)
+               + digest_scratch_size(input.domain_length));
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  do {
+    for (guess = 0; guess < CALIBRATION_CHECK_PERIOD; guess++) {
+      /* Next candidate */
+      for (seek = CALIBRATION_GUESS_LENGTH - 1; seek > 0 && candidate[seek] == '~'; seek--) {
+        candidate[seek] = ' ';
+      }
+      candidate[seek]++;
+
+      digest_input(&digests[0], candidate, CALIBRATION_GUESS_LENGTH, input.output_length,
+                   &default_profile.password, scratch);
+      generate_closed_form(&input, digests, password_hash, new_passwd, &iterations);
+      worker->found |= !memcmp(new_passwd, worker->target, input.output_length);
+    }
+
+    worker->guesses += CALIBRATION_CHECK_PERIOD;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    worker->elapsed = (double) (now.tv_sec - start.tv_sec)
+                      + (double) (now.tv_nsec - start.tv_nsec) / 1e9;
+  } while (worker->elapsed < worker->seconds);
+
+  return NULL;
+}
+
+/* Expected brute force times of a generated password and its master password */
+void estimate_crack_time(const char          *password,
+                         unsigned int        flags,
+                         const char          *master_password,
+                         const s_attack_rate *rate,
+                         s_crack_estimate    *estimate)
+{
+  const size_t alphabet_size = get_output_domain(flags)->size;
+  const size_t password_length = strlen(password);
+  size_t pool_size = 0, seek;
+  double master_rate = rate->guesses_per_second;
+  int lower = FALSE, upper = FALSE, digit = FALSE, other = FALSE, high = FALSE;
+
+  estimate->password_bits = password_length && alphabet_size > 1
+                            ? (double) password_length * log2((double) alphabet_size) : 0.0;
+  estimate->password_seconds = crack_seconds(estimate->password_bits, rate->guesses_per_second);
+  estimate->master_bits = 0.0;
+  estimate->master_seconds = 0.0;
+
+  if (!master_password || !*master_password) {
+    return;
+  }
+
+  /* Chars an attacker would try, from the kinds found in the password */
+  for (seek = 0; master_password[seek]; seek++) {
+    const unsigned char symbol = (unsigned char) master_password[seek];
+
+    if (symbol >= 'a' && symbol <= 'z') {
+      lower = TRUE;
+    } else if (symbol >= 'A' && symbol <= 'Z') {
+      upper = TRUE;
+    } else if (symbol >= '0' && symbol <= '9') {
+      digit = TRUE;
+    } else if (symbol < 128) {
+      other = TRUE;
+    } else {
+      high = TRUE;
+    }
+  }
+
+  pool_size = (lower ? 26U : 0U) + (upper ? 26U : 0U) + (digit ? 10U : 0U)
+              + (other ? 33U : 0U) + (high ? 128U : 0U);
+
+  /* Each master password guess stretches the candidate first. The time
+   * doubles with each cost step, like the memory. */
+  if ((flags & FLAG_STRETCH) && master_rate > 0.0) {
+    master_rate = 1.0 / (1.0 / master_rate
+                         + rate->stretch_seconds
+                           * exp2((double) GET_STRETCH_COST(flags) - (double) STRETCH_COST_MIN));
+  }
+
+  estimate->master_bits = pool_size > 1 ? (double) seek * log2((double) pool_size) : 0.0;
+  estimate->master_seconds = crack_seconds(estimate->master_bits, master_rate);
+}
+
+/* Number of online cores */
+static unsigned int get_core_count(void)
+{
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return cores > 0 ? (unsigned int) cores : 1;
+}
+
+/* Half of the search space, at the guess rate */
+static double crack_seconds(double bits, double guesses_per_second)
+{
+  if (guesses_per_second <= 0.0) {
+    return HUGE_VAL;
+  }
+
+  return exp2(bits - 1.0) / guesses_per_second;
+}
+
+/* Stretch a master password into a key */
+int stretch_master_password(const char *password, unsigned int cost, char *key, size_t key_size)
+{
+  static const char hex_digits[] = "0123456789abcdef";
+  s_argon2_params params;
+  uint8_t tag[STRETCH_KEY_LENGTH / 2];
+  size_t seek;
+
+  if (!password || !key || cost < STRETCH_COST_MIN || cost > STRETCH_COST_MAX) {
+    return GENERATE_INVALID;
+  }
+
+  if (key_size <= STRETCH_KEY_LENGTH) {
+    return GENERATE_TOO_SMALL;
+  }
+
+  set_stretch_params(&params, password, cost);
+
+  if (!compute_argon2id(&params, stretch_threads ? stretch_threads : get_core_count(),
+                        tag, sizeof(tag))) {
+    return GENERATE_NO_MEMORY;
+  }
+
+  for (seek = 0; seek < sizeof(tag); seek++) {
+    key[2 * seek] = hex_digits[tag[seek] >> 4];
+    key[2 * seek + 1] = hex_digits[tag[seek] & 0xF];
+  }
+
+  key[STRETCH_KEY_LENGTH] = '\0';
+  memset(tag, 0, sizeof(tag));
+
+  return GENERATE_OK;
+}
+
+/* Argon2id parameters of a stretching */
+static void set_stretch_params(s_argon2_params *params, const char *password, unsigned int cost)
+{
+  memset(params, 0, sizeof(*params));
+  params->password = (const uint8_t *) password;
+  params->password_length = strlen(password);
+  params->salt = (const uint8_t *) STRETCH_SALT;
+  params->salt_length = sizeof(STRETCH_SALT) - 1;
+  params->passes = STRETCH_PASSES;
+  params->memory_kib = 1U << cost;
+  params->lanes = STRETCH_LANES;
+}
+
+/* Select the number of threads stretching master passwords */
+void set_stretch_threads(unsigned int threads)
+{
+  stretch_threads = threads;
+}
+
+/* Get the number of threads stretching master passwords */
+unsigned int get_stretch_threads(void)
+{
+  return stretch_threads;
+}
+
+/* Find the highest key stretching cost within a time budget */
+unsigned int calibrate_stretch_cost(double seconds)
+{
+  char key[STRETCH_KEY_LENGTH + 1];
+  unsigned int cost, found = 0;
+
+  for (cost = STRETCH_COST_MIN; cost <= STRETCH_COST_MAX; cost++) {
+    struct timespec start, end;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (stretch_master_password("calibration", cost, key, sizeof(key)) != GENERATE_OK) {
+      break;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (double) (end.tv_sec - start.tv_sec) + (double) (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (elapsed > seconds && found) {
+      break;
+    }
+
+    found = cost;
+
+    /* The next cost takes twice as long */
+    if (2 * elapsed > seconds) {
+      break;
+    }
+  }
+
+  memset(key, 0, sizeof(key));
+
+  return found;
+}
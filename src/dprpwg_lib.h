@@ -25,6 +25,7 @@
 #define DPRPWG_LIB_H
 
 #include <stddef.h> /* For size_t definition */
+#include <stdint.h> /* For uint16_t definition */
 
 /* Symbol categories */
 #define OUTPUT_LOW "azertyuiopqsdfghjklmwxcvbn"   /* Lower case letters */
@@ -45,6 +46,21 @@
 #define FLAG_DIG_AVAIL  (1U<<2)
 #define FLAG_SYM_AVAIL  (1U<<3)
 
+/* Key stretching flag, with its cost in the upper bits: the master
+ * password is stretched into a key first, see stretch_master_password().
+ * Use FLAG_STRETCH_COST(cost), or'ed with the symbol flags. */
+#define FLAG_STRETCH    (1U<<4)
+#define STRETCH_COST_SHIFT 8U
+#define FLAG_STRETCH_COST(Cost) (FLAG_STRETCH | ((unsigned int) (Cost) << STRETCH_COST_SHIFT))
+#define GET_STRETCH_COST(Flags) (((Flags) >> STRETCH_COST_SHIFT) & 0xFFU)
+
+/* Key stretching cost bounds: the memory used is 2^cost KiB */
+#define STRETCH_COST_MIN 8U     /* 256 KiB */
+#define STRETCH_COST_MAX 24U    /* 16 GiB */
+
+/* Length of a stretched key, as hex chars */
+#define STRETCH_KEY_LENGTH 64U
+
 /* Maximum number of iteration to find a correct password, containing
  * all the required symbol types */
 #define ITERATION_MAX 65536
@@ -52,6 +68,121 @@
 /* Completery arbitrary value for a "impossible to crack" password strength */
 #define OVERKILL_PWD_STRENGTH 30.0
 
+/* generate_password_r() return values */
+#define GENERATE_OK         0   /* Password generated */
+#define GENERATE_TOO_SMALL  1   /* Output or hash buffer too small */
+#define GENERATE_INVALID    2   /* Missing input */
+#define GENERATE_INFEASIBLE 3   /* Size out of the password policy bounds */
+#define GENERATE_NO_MEMORY  4   /* Not enough memory to stretch the master password */
+
+/* compile_password_policy() errors */
+#define POLICY_OK               0   /* Policy compiled */
+#define POLICY_INVALID          1   /* Bad policy description, or no memory */
+#define POLICY_EMPTY_CATEGORY   2   /* A required category, or the whole policy,
+                                     * has no allowed char */
+#define POLICY_TOO_LONG         3   /* Required chars do not fit in max_length */
+
+/* load_hash_profile() errors */
+#define PROFILE_OK          0   /* Profile loaded */
+#define PROFILE_UNREADABLE  1   /* Cannot read the file (see errno), or no memory */
+#define PROFILE_SYNTAX      2   /* A line is neither a comment nor a constant,
+                                 * or a value is not an unsigned int */
+#define PROFILE_INCOMPLETE  3   /* A constant is missing, or given twice */
+
+/* Generation engines, see set_generation_engine() */
+#define ENGINE_REFERENCE    0U  /* Walk every iteration of the hash loop */
+#define ENGINE_CLOSED_FORM  1U  /* Compute the hash from per-cycle sums */
+#define ENGINE_CHECKED      2U  /* Run both, abort() if they disagree */
+
+/* Details of one generation, see generate_password_stats() */
+typedef struct {
+  size_t   base_limit;        /* Iterations planned from the input lengths */
+  size_t   iterations;        /* Iterations actually run */
+  size_t   extension_rounds;  /* Times the limit was raised for missing categories */
+  int      iteration_max_reached;   /* TRUE if the loop ran up to ITERATION_MAX */
+  int      all_categories_present;  /* TRUE if the password holds every
+                                     * requested symbol category */
+  uint64_t wall_time_ns;      /* Time spent in the call, in nanoseconds */
+} s_generation_stats;
+
+/* Process-wide generation counters, see get_generation_counters() */
+typedef struct {
+  uint64_t generations;         /* Passwords generated */
+  uint64_t iterations;          /* Hash loop iterations, all passwords together */
+  uint64_t extension_rounds;    /* Limit extensions, all passwords together */
+  uint64_t iteration_max_hits;  /* Passwords whose loop ran up to ITERATION_MAX */
+  uint64_t missing_categories;  /* Passwords lacking a requested category */
+} s_generation_counters;
+
+/* Digested master password, see create_password_context() */
+typedef struct dprpwg_ctx dprpwg_ctx;
+
+/* Result cache statistics of a context, see enable_password_cache() */
+typedef struct {
+  size_t   capacity;          /* Entries the cache can hold */
+  size_t   entries;           /* Entries it holds */
+  uint64_t hits;              /* Passwords found in the cache */
+  uint64_t misses;            /* Passwords generated, then cached */
+  uint64_t insertions;        /* Entries added */
+  uint64_t evictions;         /* Entries replaced by newer ones */
+  uint64_t bypasses;          /* Domain and year too long to be cached */
+  uint64_t timed_lookups;     /* Lookups timed: one in 16, and all the
+                               * ones of callers asking for stats */
+  uint64_t lookup_time_ns;    /* Time spent in the timed lookups, hits
+                               * and misses together, in nanoseconds */
+} s_cache_stats;
+
+/* Measured attacker speed, see calibrate_attack_rate() */
+typedef struct {
+  double       guesses_per_second;  /* Master password guesses tested per second */
+  unsigned int threads;             /* Threads the guesses were run on */
+  size_t       output_length;       /* Length of the passwords generated */
+  double       seconds;             /* Time the measure took */
+  double       stretch_seconds;     /* Time per guess of STRETCH_COST_MIN
+                                     * stretchings, one per thread */
+} s_attack_rate;
+
+/* Expected brute force times, see estimate_crack_time() */
+typedef struct {
+  double password_bits;       /* log2 of the generated password search space */
+  double password_seconds;    /* Expected time to find the generated password */
+  double master_bits;         /* log2 of the master password search space */
+  double master_seconds;      /* Expected time to find the master password */
+} s_crack_estimate;
+
+/* Site password policy, see compile_password_policy() */
+typedef struct {
+  unsigned int flags;         /* Allowed symbol categories, FLAG_*_AVAIL */
+  size_t       min_length;    /* Minimum password length, 0 for none */
+  size_t       max_length;    /* Maximum password length, 0 for OUTPUT_MAX_LENGTH */
+  size_t       min_lower;     /* Required lower case letters */
+  size_t       min_upper;     /* Required upper case letters */
+  size_t       min_digits;    /* Required digits */
+  size_t       min_symbols;   /* Required symbols */
+  const char   *symbols;      /* Allowed symbols, replacing OUTPUT_SYM. NULL
+                               * for OUTPUT_SYM */
+  const char   *forbidden;    /* Chars never to use, or NULL */
+} s_password_policy;
+
+/* Compiled password policy, see compile_password_policy() */
+typedef struct dprpwg_policy dprpwg_policy;
+
+/* The hash loop multipliers, see create_hash_profile() */
+typedef struct {
+  unsigned int pw_mul;        /* PW_MUL of dprpwg_config.h */
+  unsigned int pw_seek_mul;   /* PW_SEEK_MUL */
+  unsigned int pw_inv_mul;    /* PW_INV_MUL */
+  unsigned int dom_mul;       /* DOM_MUL */
+  unsigned int dom_seek_mul;  /* DOM_SEEK_MUL */
+  unsigned int dom_inv_mul;   /* DOM_INV_MUL */
+  unsigned int yr_mul;        /* YR_MUL */
+  unsigned int yr_seek_mul;   /* YR_SEEK_MUL */
+  unsigned int yr_inv_mul;    /* YR_INV_MUL */
+} s_hash_constants;
+
+/* Hash profile: a set of hash loop multipliers, see create_hash_profile() */
+typedef struct dprpwg_profile dprpwg_profile;
+
 /* That would be in "glib", won't include it for that */
 #ifndef FALSE
 #  define FALSE 0
@@ -72,7 +203,8 @@
  *                    when not used any more.
  * \param flags     Flags to select which symbol categories to use. or'ed
  *                  combinaison of FLAG_LOW_AVAIL, FLAG_UPP_AVAIL, FLAG_DIG_AVAIL
- *                  and FLAG_SYM_AVAIL.
+ *                  and FLAG_SYM_AVAIL. Add FLAG_STRETCH_COST(cost) to stretch
+ *                  the master password first (see stretch_master_password()).
  *
  * This function generates a deterministic, pseudo-random password according
  * to the given inputs. Only the base password should be remembered.
@@ -90,6 +222,9 @@
  * *new_passwd will be allocated by this function. Give it to free() when
  * you don't need it anymore. Oh, and probably to memset() just before,
  * maybe you don't want to have a password somewhere in memory...
+ * Or rather, use generate_password_r() with a buffer from
+ * alloc_secure_buffer(): it never reaches the swap, and is wiped when
+ * freed.
  */
 void generate_password(const char   *password,
                        const char   *domain,
@@ -98,6 +233,535 @@ void generate_password(const char   *password,
                        char         **new_passwd,
                        unsigned int flags);
 
+/**
+ * \brief Password generation in caller-provided memory
+ * \param password  Base, master password, that must be remembered.
+ * \param domain    Domain name where the password is to be used.
+ * \param year      Year, so people are incitated to change password every year.
+ * \param fixed_size  Fixed password size. Ignored if <= 0.
+ * \param flags     Flags to select which symbol categories to use.
+ *                  See generate_password().
+ * \param new_passwd   Buffer receiving the null-terminated password.
+ * \param passwd_size  Size of new_passwd, null char included.
+ * \param hash      Temporary hash used during generation, or NULL to use
+ *                  a stack area of OUTPUT_MAX_LENGTH values.
+ * \param hash_size Number of uint16_t in hash. Ignored if hash is NULL.
+ * \return GENERATE_OK, GENERATE_TOO_SMALL or GENERATE_INVALID.
+ *
+ * Reentrant version of generate_password(), generating the very same
+ * passwords. It does not allocate memory (except the closed-form engine,
+ * for inputs longer than 768 chars together, and ENGINE_CHECKED).
+ *
+ * The password length must be lower than passwd_size, and not greater
+ * than hash_size (or OUTPUT_MAX_LENGTH if hash is NULL). Otherwise,
+ * GENERATE_TOO_SMALL is returned: a truncated password is never written.
+ * On any error, new_passwd is set to an empty string if passwd_size > 0.
+ *
+ * The temporary hash is cleaned before returning. new_passwd is not: give
+ * it to memset() when the password is not needed anymore.
+ */
+int generate_password_r(const char   *password,
+                        const char   *domain,
+                        const char   *year,
+                        size_t       fixed_size,
+                        unsigned int flags,
+                        char         *new_passwd,
+                        size_t       passwd_size,
+                        uint16_t     *hash,
+                        size_t       hash_size);
+
+/**
+ * \brief Password generation in caller-provided memory, with statistics
+ * \param password  Base, master password, that must be remembered.
+ * \param domain    Domain name where the password is to be used.
+ * \param year      Year, so people are incitated to change password every year.
+ * \param fixed_size  Fixed password size. Ignored if <= 0.
+ * \param flags     Flags to select which symbol categories to use.
+ *                  See generate_password().
+ * \param new_passwd   Buffer receiving the null-terminated password.
+ * \param passwd_size  Size of new_passwd, null char included.
+ * \param hash      Temporary hash, see generate_password_r().
+ * \param hash_size Number of uint16_t in hash. Ignored if hash is NULL.
+ * \param stats     Filled with the details of this generation. May be NULL.
+ * \return GENERATE_OK, GENERATE_TOO_SMALL or GENERATE_INVALID.
+ *
+ * Same as generate_password_r(), also telling how the hash loop went: the
+ * limit computed from the inputs, how many times it had to be raised
+ * because a symbol category was missing, and whether it stopped at
+ * ITERATION_MAX. In that last case, the password may lack some requested
+ * categories: all_categories_present tells.
+ *
+ * On error, or if no category is selected, the stats are all zero (but
+ * all_categories_present, TRUE when no category is selected).
+ */
+int generate_password_stats(const char         *password,
+                            const char         *domain,
+                            const char         *year,
+                            size_t             fixed_size,
+                            unsigned int       flags,
+                            char               *new_passwd,
+                            size_t             passwd_size,
+                            uint16_t           *hash,
+                            size_t             hash_size,
+                            s_generation_stats *stats);
+
+/**
+ * \brief Digest a master password once, for many generations
+ * \param password  Base, master password.
+ * \return A new context, to be given to free_password_context(), or NULL
+ *         if password is NULL or memory is short.
+ *
+ * Every term the hash loop adds for the master password depends only on
+ * the master password and the loop cursors. The context computes them
+ * once: the per-char terms right away, the per-cycle sums of the
+ * closed-form engine on first use of each password length. Generations
+ * with generate_password_ctx() then only work on the domain and year.
+ *
+ * A context holds a copy of the master password. It can be used by
+ * several threads at once.
+ */
+dprpwg_ctx *create_password_context(const char *password);
+
+/**
+ * \brief Password generation with a master password context
+ * \param ctx       Master password context, from create_password_context().
+ * \param domain    Domain name where the password is to be used.
+ * \param year      Year, so people are incitated to change password every year.
+ * \param fixed_size  Fixed password size. Ignored if <= 0.
+ * \param flags     Flags to select which symbol categories to use.
+ *                  See generate_password().
+ * \param new_passwd   Buffer receiving the null-terminated password.
+ * \param passwd_size  Size of new_passwd, null char included.
+ * \param hash      Temporary hash, see generate_password_r().
+ * \param hash_size Number of uint16_t in hash. Ignored if hash is NULL.
+ * \param stats     Filled with the details of this generation. May be NULL.
+ * \return GENERATE_OK, GENERATE_TOO_SMALL or GENERATE_INVALID.
+ *
+ * Same as generate_password_stats() with the context master password,
+ * generating the very same passwords.
+ */
+int generate_password_ctx(dprpwg_ctx         *ctx,
+                          const char         *domain,
+                          const char         *year,
+                          size_t             fixed_size,
+                          unsigned int       flags,
+                          char               *new_passwd,
+                          size_t             passwd_size,
+                          uint16_t           *hash,
+                          size_t             hash_size,
+                          s_generation_stats *stats);
+
+/**
+ * \brief Wipe and free a master password context
+ * \param ctx  Context from create_password_context(), or NULL.
+ *
+ * Everything derived from the master password is overwritten with zeros
+ * before being freed, in a way the compiler cannot optimize out.
+ */
+void free_password_context(dprpwg_ctx *ctx);
+
+/**
+ * \brief Cache the passwords generated with a master password context
+ * \param ctx       Context from create_password_context().
+ * \param capacity  Number of passwords the cache can hold.
+ * \return TRUE, or FALSE if ctx is NULL, capacity is 0, the context
+ *         already has a cache or memory is short.
+ *
+ * generate_password_ctx() then looks the domain, year, fixed size and
+ * flags up before generating, and gives the cached password back if
+ * found. Its stats are those of the first generation, but for the wall
+ * time, the lookup time. Cache hits are not generations: they are left
+ * out of get_generation_counters().
+ *
+ * The cache is split in shards with their own locks, and lookups only
+ * take them for reading, so many threads can use it at once. A full
+ * shard evicts one of its entries not used for the longest time (CLOCK
+ * policy). Entries are secure buffers, wiped when evicted and when the
+ * context is freed. Domain and year longer than 250 chars together are
+ * never cached.
+ *
+ * Can be called while other threads generate with the context.
+ */
+int enable_password_cache(dprpwg_ctx *ctx, size_t capacity);
+
+/**
+ * \brief Get the result cache statistics of a context
+ * \param ctx    Context with a cache, see enable_password_cache().
+ * \param stats  Filled with the statistics since the cache was enabled,
+ *               or since reset_password_cache_stats().
+ * \return TRUE, or FALSE if the context has no cache.
+ *
+ * The hit rate is hits / (hits + misses), the mean lookup time
+ * lookup_time_ns / timed_lookups.
+ */
+int get_password_cache_stats(dprpwg_ctx *ctx, s_cache_stats *stats);
+
+/**
+ * \brief Reset the result cache statistics of a context
+ * \param ctx  Context with a cache. Nothing is done if it has none.
+ *
+ * The cached passwords are kept.
+ */
+void reset_password_cache_stats(dprpwg_ctx *ctx);
+
+/**
+ * \brief Hash profile of the dprpwg_config.h the library was built with
+ * \return The default profile, used by every function not given one. It
+ *         is never to be freed.
+ */
+const dprpwg_profile *get_default_hash_profile(void);
+
+/**
+ * \brief Build a hash profile from its multipliers
+ * \param constants  The nine multipliers of the hash loop.
+ * \return A new profile, to be given to free_hash_profile(), or NULL if
+ *         constants is NULL or memory is short.
+ *
+ * A profile replaces the constants of dprpwg_config.h, so one process can
+ * generate the passwords of several configurations. The products of every
+ * byte value by the char multipliers are computed here, once: generations
+ * with a profile run as fast as with the built-in constants.
+ *
+ * The multipliers are as secret as the master passwords: the profile is a
+ * secure buffer (see alloc_secure_buffer()). It is read-only, and can be
+ * used by several threads at once.
+ */
+dprpwg_profile *create_hash_profile(const s_hash_constants *constants);
+
+/**
+ * \brief Load a hash profile from a file
+ * \param path   Profile file.
+ * \param error  Set to PROFILE_OK, or to the reason the profile cannot be
+ *               loaded. May be NULL.
+ * \return A new profile, to be given to free_hash_profile(), or NULL.
+ *
+ * The file gives each of the nine multipliers once, one per line, as
+ * "PW_MUL 7919" or "PW_MUL = 7919". Values are C integer constants:
+ * decimal, octal or hexadecimal, with an optional U or L suffix. Empty
+ * lines and lines starting with '#' are comments, and so are C comments,
+ * block comments over several lines included.
+ *
+ * The "#define PW_MUL (7919U)" lines of a dprpwg_config.h are read as
+ * well, and its other macros ignored: a configuration header, license
+ * block and all, is a valid profile file.
+ */
+dprpwg_profile *load_hash_profile(const char *path, int *error);
+
+/**
+ * \brief Wipe and free a hash profile
+ * \param profile  Profile from create_hash_profile() or load_hash_profile(),
+ *                 or NULL.
+ */
+void free_hash_profile(dprpwg_profile *profile);
+
+/**
+ * \brief Password generation with a hash profile
+ * \param profile   Hash profile, from create_hash_profile(),
+ *                  load_hash_profile() or get_default_hash_profile().
+ * \param password  Base, master password, that must be remembered.
+ * \param domain    Domain name where the password is to be used.
+ * \param year      Year, so people are incitated to change password every year.
+ * \param fixed_size  Fixed password size. Ignored if <= 0.
+ * \param flags     Flags to select which symbol categories to use.
+ *                  See generate_password().
+ * \param new_passwd   Buffer receiving the null-terminated password.
+ * \param passwd_size  Size of new_passwd, null char included.
+ * \param hash      Temporary hash, see generate_password_r().
+ * \param hash_size Number of uint16_t in hash. Ignored if hash is NULL.
+ * \param stats     Filled with the details of this generation. May be NULL.
+ * \return GENERATE_OK, GENERATE_TOO_SMALL, or GENERATE_INVALID (profile
+ *         included).
+ *
+ * Same as generate_password_stats(), with the multipliers of the profile.
+ * With the default profile, it generates the very same passwords.
+ */
+int generate_password_profile(const dprpwg_profile *profile,
+                              const char           *password,
+                              const char           *domain,
+                              const char           *year,
+                              size_t               fixed_size,
+                              unsigned int         flags,
+                              char                 *new_passwd,
+                              size_t               passwd_size,
+                              uint16_t             *hash,
+                              size_t               hash_size,
+                              s_generation_stats   *stats);
+
+/**
+ * \brief Digest a master password, for a hash profile
+ * \param profile   Hash profile. It must outlive the context.
+ * \param password  Base, master password.
+ * \return A new context, to be given to free_password_context(), or NULL
+ *         if profile or password is NULL or memory is short.
+ *
+ * Same as create_password_context(), whose contexts use the default
+ * profile. generate_password_ctx() and generate_password_batch_ctx()
+ * generate the passwords of the context profile.
+ */
+dprpwg_ctx *create_password_context_profile(const dprpwg_profile *profile,
+                                            const char           *password);
+
+/**
+ * \brief Allocate a buffer for secrets
+ * \param size  Size of the buffer, in bytes.
+ * \return A zeroed buffer, to be given to free_secure_buffer(), or NULL if
+ *         memory is short.
+ *
+ * Buffers come from an arena owned by the library, whose pages are locked
+ * in RAM (as far as the locked memory limit allows, see "ulimit -l") and
+ * left out of core dumps. Buffers up to 256 KiB are recycled by
+ * free_secure_buffer() (only a few of each size over 16 KiB) without going
+ * back to the system, so they are cheap to allocate at a high rate. The
+ * library keeps its own secrets (master password contexts, working hashes)
+ * there.
+ *
+ * Use them for master passwords and generated passwords, for instance with
+ * generate_password_r(). It can be used by several threads at once.
+ */
+void *alloc_secure_buffer(size_t size);
+
+/**
+ * \brief Wipe and free a buffer from alloc_secure_buffer()
+ * \param buffer  The buffer, or NULL.
+ *
+ * The whole buffer is overwritten with zeros, in a way the compiler cannot
+ * optimize out, before being recycled. Giving it any other pointer calls
+ * abort().
+ */
+void free_secure_buffer(void *buffer);
+
+/**
+ * \brief Password generation for a list of domains
+ * \param password  Base, master password, used for all the domains.
+ * \param year      Year, used for all the domains.
+ * \param domains   Array of 'count' domain names.
+ * \param flags     Array of 'count' symbol category flags, one per domain.
+ *                  See generate_password().
+ * \param fixed_sizes  Array of 'count' fixed password sizes, one per domain,
+ *                     ignored if <= 0. May be NULL if no size is fixed.
+ * \param count     Number of domains.
+ * \param output    Buffer of 'count' * 'output_stride' chars, written by
+ *                  this function.
+ * \param output_stride  Distance between two passwords in 'output'.
+ * \return TRUE if all passwords were generated, FALSE otherwise.
+ *
+ * This function generates the same passwords as generate_password() would
+ * for each domain, but shares all the master password, year and symbol
+ * category setup across the whole batch, and allocates its working memory
+ * only once. With the reference engine, passwords of the same length are
+ * generated several at once, on SIMD lanes when the CPU has AVX2 or SSE4.1
+ * (the DPRPWG_SIMD environment variable can restrict that to "sse4.1" or
+ * "none"). ENGINE_CHECKED checks every lane result against both engines.
+ *
+ * The password of domains[i] is written as a null-terminated string at
+ * output + i * output_stride. If a password does not fit in output_stride
+ * chars (null char included), an empty string is written instead and this
+ * function returns FALSE. The caller owns the output buffer: memset() it
+ * when the passwords are not needed anymore.
+ */
+int generate_password_batch(const char         *password,
+                            const char         *year,
+                            const char * const *domains,
+                            const unsigned int *flags,
+                            const size_t       *fixed_sizes,
+                            size_t             count,
+                            char               *output,
+                            size_t             output_stride);
+
+/**
+ * \brief Password generation for a list of domains, with a master password
+ *        context
+ * \param ctx       Master password context, from create_password_context().
+ * \param year      Year, used for all the domains.
+ * \param domains   Array of 'count' domain names.
+ * \param flags     Array of 'count' symbol category flags, one per domain.
+ * \param fixed_sizes  Array of 'count' fixed password sizes, or NULL.
+ * \param count     Number of domains.
+ * \param output    Buffer of 'count' * 'output_stride' chars.
+ * \param output_stride  Distance between two passwords in 'output'.
+ * \return TRUE if all passwords were generated, FALSE otherwise.
+ *
+ * Same as generate_password_batch() with the context master password,
+ * generating the very same passwords. Each password is generated as by
+ * generate_password_ctx(): the master password work is shared through the
+ * context, only the domains and the year are digested in each generation.
+ * The temporary hash is allocated once, as long as the longest password of
+ * the batch, so passwords longer than OUTPUT_MAX_LENGTH are generated too.
+ * Passwords in the context result cache are not generated again, see
+ * enable_password_cache().
+ */
+int generate_password_batch_ctx(dprpwg_ctx         *ctx,
+                                const char         *year,
+                                const char * const *domains,
+                                const unsigned int *flags,
+                                const size_t       *fixed_sizes,
+                                size_t             count,
+                                char               *output,
+                                size_t             output_stride);
+
+/**
+ * \brief Password generation for ranges of years and sizes
+ * \param password  Base, master password.
+ * \param domain    Domain name where the passwords are to be used.
+ * \param years     Array of 'year_count' years.
+ * \param year_count  Number of years.
+ * \param fixed_sizes  Array of 'size_count' fixed password sizes, ignored
+ *                     if <= 0. May be NULL: one password per year, of the
+ *                     default size.
+ * \param size_count  Number of sizes. Ignored if fixed_sizes is NULL.
+ * \param flags     Symbol category flags. See generate_password().
+ * \param output    Buffer of year_count * size_count * output_stride chars,
+ *                  written by this function.
+ * \param output_stride  Distance between two passwords in 'output'.
+ * \return TRUE if all passwords were generated, FALSE otherwise.
+ *
+ * Generates, for one domain, the password of every year and size
+ * combination: exactly what generate_password() would for each of them.
+ * With the closed-form engine, the master password and domain work is
+ * only done once per password length; each password then only costs its
+ * year. The reference engine walks the whole loop for every password.
+ *
+ * The password of years[y] and fixed_sizes[s] is written at
+ * output + (y * size_count + s) * output_stride. As in
+ * generate_password_batch(), a password that does not fit is replaced by
+ * an empty string, and this function returns FALSE.
+ */
+int generate_password_sweep(const char         *password,
+                            const char         *domain,
+                            const char * const *years,
+                            size_t             year_count,
+                            const size_t       *fixed_sizes,
+                            size_t             size_count,
+                            unsigned int       flags,
+                            char               *output,
+                            size_t             output_stride);
+
+/**
+ * \brief Check a site password policy and compile it for generation
+ * \param policy  The policy: allowed categories and chars, length bounds,
+ *                and required count of each category.
+ * \param error   Set to POLICY_OK, or to the reason the policy cannot be
+ *                satisfied. May be NULL.
+ * \return A compiled policy, to be given to free_password_policy(), or
+ *         NULL if the policy cannot be satisfied.
+ *
+ * All the feasibility checks are done here, once: a compiled policy can
+ * always be satisfied, for any length within its bounds. The minimum
+ * length is raised to the sum of the required counts if lower.
+ *
+ * 'symbols' may hold any printable ASCII char that is neither a letter nor
+ * a digit; duplicates are ignored. A category is required if its count is
+ * not zero, and must then be allowed in 'flags' and keep at least one char
+ * after removing the 'forbidden' ones.
+ *
+ * A compiled policy is read-only: it can be used by several threads at once.
+ */
+dprpwg_policy *compile_password_policy(const s_password_policy *policy, int *error);
+
+/**
+ * \brief Password generation satisfying a site password policy
+ * \param password  Base, master password, that must be remembered.
+ * \param domain    Domain name where the password is to be used.
+ * \param year      Year, so people are incitated to change password every year.
+ * \param fixed_size  Fixed password size. Ignored if <= 0.
+ * \param policy    Compiled policy, from compile_password_policy().
+ * \param new_passwd   Buffer receiving the null-terminated password.
+ * \param passwd_size  Size of new_passwd, null char included.
+ * \param stats     Filled with the details of this generation. May be NULL.
+ * \return GENERATE_OK, GENERATE_TOO_SMALL, GENERATE_INVALID, or
+ *         GENERATE_INFEASIBLE if fixed_size is out of the policy bounds.
+ *
+ * The password length is the one of get_policy_password_length(). The hash
+ * loop runs its base limit only, picking symbols among the allowed chars.
+ * Then, in one pass over the password, chars of the categories holding
+ * more than their required count are replaced by chars of the categories
+ * lacking some, until none lacks any. The work is bounded by the input
+ * lengths: there are no extension rounds, and ITERATION_MAX is never hit.
+ *
+ * Passwords may differ from the ones of generate_password() with the same
+ * categories: a missing category is repaired, rather than searched for
+ * with more loop iterations.
+ */
+int generate_password_policy(const char          *password,
+                             const char          *domain,
+                             const char          *year,
+                             size_t              fixed_size,
+                             const dprpwg_policy *policy,
+                             char                *new_passwd,
+                             size_t              passwd_size,
+                             s_generation_stats  *stats);
+
+/**
+ * \brief Length of a password generated with a policy
+ * \param policy      Compiled policy, from compile_password_policy().
+ * \param year        Year, as given to generate_password_policy().
+ * \param fixed_size  Fixed password size. Ignored if <= 0.
+ * \return fixed_size if it is given, 0 if it is out of the policy bounds.
+ *         Otherwise, get_password_length() of the year, brought within the
+ *         policy bounds.
+ */
+size_t get_policy_password_length(const dprpwg_policy *policy, const char *year,
+                                  size_t fixed_size);
+
+/**
+ * \brief Free a compiled password policy
+ * \param policy  Policy from compile_password_policy(), or NULL.
+ */
+void free_password_policy(dprpwg_policy *policy);
+
+/**
+ * \brief Length of a generated password
+ * \param year        Year, as given to generate_password().
+ * \param fixed_size  Fixed password size. Ignored if <= 0.
+ * \return The length of the passwords generate_password() would generate
+ *         for this year and fixed size (null char not included).
+ */
+size_t get_password_length(const char *year, size_t fixed_size);
+
+/**
+ * \brief Select the engine used by the password generation functions
+ * \param engine  One of ENGINE_REFERENCE, ENGINE_CLOSED_FORM or ENGINE_CHECKED.
+ * \return TRUE if the engine is known and now selected, FALSE otherwise.
+ *
+ * All engines generate exactly the same passwords; they only differ in
+ * speed. The reference engine walks the hash loop one iteration at a time,
+ * so its cost grows with the alphabet size times the total input length.
+ * The closed-form engine uses the fact that every hash cell is a sum of
+ * terms depending only on the input cursors, which cycle with fixed
+ * periods: it computes each cell from per-cycle partial sums, and only
+ * walks the loop for the extension rounds.
+ *
+ * ENGINE_CHECKED runs both engines and calls abort() if they do not agree.
+ * It is slower than the reference engine, and meant for validation only.
+ *
+ * The selection is process-wide. Set it once at startup, not while other
+ * threads are generating passwords. Default is ENGINE_REFERENCE.
+ */
+int set_generation_engine(unsigned int engine);
+
+/**
+ * \brief Get the currently selected generation engine
+ * \return One of ENGINE_REFERENCE, ENGINE_CLOSED_FORM or ENGINE_CHECKED.
+ */
+unsigned int get_generation_engine(void);
+
+/**
+ * \brief Read the process-wide generation counters
+ * \param counters  Filled with the counters.
+ *
+ * Every password generated by any function of this library, in any thread,
+ * is counted here, so a long-running process can export the totals and
+ * watch for degenerate inputs (ITERATION_MAX hits, missing categories).
+ * The counters are updated atomically, but read one by one: they may be
+ * slightly out of step with each other while other threads generate.
+ */
+void get_generation_counters(s_generation_counters *counters);
+
+/**
+ * \brief Reset the process-wide generation counters to zero
+ */
+void reset_generation_counters(void);
+
 /**
  * \brief Password strength computation
  * \param password  The password
@@ -113,4 +777,157 @@ void generate_password(const char   *password,
  */
 double get_password_strength(const char* password, unsigned int year, unsigned int flags);
 
+/**
+ * \brief Password strength computation for many passwords
+ * \param passwords  Buffer of 'count' null-terminated passwords, one every
+ *                   'password_stride' chars, as written by
+ *                   generate_password_batch().
+ * \param password_stride  Distance between two passwords in 'passwords'.
+ * \param count      Number of passwords.
+ * \param year       Year the passwords will be used.
+ * \param flags      Array of 'count' symbol category flags, one per
+ *                   password. See get_password_strength().
+ * \param strengths  Array of 'count' strengths, written by this function.
+ *
+ * Same as get_password_strength() on each password, much faster on large
+ * batches: the symbols are counted by comparing whole vectors of chars on
+ * CPUs with AVX2 or SSE4.1 (see generate_password_batch() for the
+ * DPRPWG_SIMD environment variable), or in a histogram of one bucket per
+ * symbol category char otherwise, and the logarithms come from a table.
+ *
+ * The sums are not done in the same order, so the results may differ from
+ * get_password_strength() in the last bits: by less than
+ * 1e-12 * (1 + strength).
+ */
+void get_password_strength_batch(const char         *passwords,
+                                 size_t             password_stride,
+                                 size_t             count,
+                                 unsigned int       year,
+                                 const unsigned int *flags,
+                                 double             *strengths);
+
+/**
+ * \brief Stretch a master password into a key
+ * \param password  The master password.
+ * \param cost      Key stretching cost, STRETCH_COST_MIN to STRETCH_COST_MAX.
+ * \param key       Buffer for the key, STRETCH_KEY_LENGTH hex chars and a
+ *                  null char.
+ * \param key_size  Size of 'key'.
+ * \return GENERATE_OK, GENERATE_TOO_SMALL if 'key' is too small,
+ *         GENERATE_INVALID if an input is missing or the cost out of
+ *         bounds, or GENERATE_NO_MEMORY.
+ *
+ * What FLAG_STRETCH_COST(cost) does before generating: the key is
+ * Argon2id (RFC 9106) of the master password, with 2^cost KiB of memory,
+ * 3 passes and 16 lanes, and a fixed salt. It then takes the place of the
+ * master password, so the generated passwords are those of the key with
+ * the same flags, FLAG_STRETCH and the cost left out. Flags without
+ * FLAG_STRETCH generate exactly the same passwords as before.
+ *
+ * Each guess of the master password then costs as much memory and time to
+ * an attacker. The memory is filled by up to 16 threads at once, see
+ * set_stretch_threads(); the key does not depend on their number. A cost
+ * is part of what must be remembered, like the symbol categories: pick it
+ * once, with calibrate_stretch_cost().
+ *
+ * The salt is the same for everybody, so the key only depends on the master
+ * password: a master password context stretches it once per cost, for all
+ * the domains and years, and so does a batch. Password policies do not
+ * stretch. The other side of a fixed salt: a dictionary of common master
+ * passwords can be stretched once and tried against every user.
+ */
+int stretch_master_password(const char *password, unsigned int cost, char *key, size_t key_size);
+
+/**
+ * \brief Select the number of threads stretching master passwords
+ * \param threads  Number of threads, 0 for one per online core.
+ *
+ * Only the time taken depends on it, not the keys. More than 16 threads are
+ * not used. The selection is process-wide. Default is 0.
+ */
+void set_stretch_threads(unsigned int threads);
+
+/**
+ * \brief Get the number of threads stretching master passwords
+ * \return The number given to set_stretch_threads(), 0 for one per online core.
+ */
+unsigned int get_stretch_threads(void);
+
+/**
+ * \brief Find the highest key stretching cost within a time budget
+ * \param seconds  Time one stretching may take, e.g. 0.25.
+ * \return The highest cost whose stretching took at most 'seconds' here,
+ *         with the threads of set_stretch_threads(), STRETCH_COST_MIN if
+ *         even that one took longer, or 0 if memory is short.
+ *
+ * Costs are tried from STRETCH_COST_MIN up, each one taking about twice as
+ * long as the previous one: the search stops before the first one expected
+ * to go over the budget, so it takes about twice the budget. The cost found
+ * only holds for this machine.
+ */
+unsigned int calibrate_stretch_cost(double seconds);
+
+/**
+ * \brief Measure how fast this machine can guess master passwords
+ * \param threads  Threads to run the guesses on, 0 for one per online core.
+ * \param seconds  How long to measure. 0.2 is enough for a stable rate.
+ * \param rate     Filled with the measured rate.
+ * \return TRUE if the rate was measured, FALSE otherwise (no memory).
+ *
+ * Runs what an attacker knowing one domain, year and generated password
+ * would run to find the master password: candidate master passwords are
+ * generated for that domain and year, and compared to the known password.
+ * The attack is done the fastest way this library knows: the closed-form
+ * engine, whatever set_generation_engine() selected, with the domain and
+ * year digested once, on every thread.
+ *
+ * The candidates are 12 chars long, and the passwords are the default
+ * length of the current year, with all the symbol categories: the rate
+ * holds for usual inputs. Dedicated hardware goes faster: take the rate as
+ * a lower bound of what an attacker can do.
+ *
+ * Threads that cannot be started are left out: 'rate->threads' tells how
+ * many ran. A stretching at STRETCH_COST_MIN is timed too, for the guesses
+ * of stretched master passwords: on one thread, the best of a few runs,
+ * each of those threads being taken to stretch its own candidates. It
+ * takes a few milliseconds more.
+ */
+int calibrate_attack_rate(unsigned int threads, double seconds, s_attack_rate *rate);
+
+/**
+ * \brief Expected time to find a generated password, or the master password
+ * \param password  The generated password.
+ * \param flags     Symbol categories the password was generated with, and
+ *                  its FLAG_STRETCH_COST(cost) if any. See
+ *                  get_password_strength().
+ * \param master_password  The master password, or NULL.
+ * \param rate      Attacker speed, from calibrate_attack_rate().
+ * \param estimate  Filled with the search space sizes and times.
+ *
+ * A brute force attack tries half of the search space on average. The
+ * generated password space is its alphabet size to the power of its
+ * length, each guess costing as much as one of 'rate': a site storing the
+ * password with a fast hash can be attacked faster. The master password
+ * space is built from the kinds of chars it holds (26 lower case letters,
+ * 26 upper case, 10 digits, 33 other ASCII chars, 128 non-ASCII bytes): a
+ * master password made of words is found much sooner.
+ *
+ * With FLAG_STRETCH in 'flags', each master password guess stretches the
+ * candidate first: the stretching time of 'rate', doubled for each cost
+ * step over STRETCH_COST_MIN, is added to the time of a guess. It is
+ * scaled from the cheapest cost, whose memory fits in the caches: the
+ * higher costs take longer per KiB, so the time is a lower bound. The
+ * generated password time does not change.
+ *
+ * Getting the master password gives all the generated passwords: the lower
+ * of the two times is the one that matters. The master password fields are
+ * 0 if 'master_password' is NULL. Times over about 1e300 seconds are
+ * infinite.
+ */
+void estimate_crack_time(const char          *password,
+                         unsigned int        flags,
+                         const char          *master_password,
+                         const s_attack_rate *rate,
+                         s_crack_estimate    *estimate);
+
 #endif /* DPRPWG_LIB_H */
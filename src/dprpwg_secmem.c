@@ -0,0 +1,273 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* The secure buffer arena, see alloc_secure_buffer().
+ *
+ * Buffers up to SECURE_CLASS_MAX bytes are carved from arena chunks, in
+ * power of two size classes, and recycled through one free list per class.
+ * Larger buffers get their own mapping. Up to SECURE_LARGE_MAX bytes, they
+ * have power of two classes too, and a few of each class are kept for
+ * reuse when freed; the others are unmapped. All mappings are locked in RAM
+ * (if the system allows it) and excluded from core dumps. Every buffer
+ * starts with a header giving its size class. */
+
+#define _DEFAULT_SOURCE /* MAP_ANONYMOUS, madvise() */
+
+#include "dprpwg_lib.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Arena chunk size */
+#define SECURE_CHUNK_SIZE (64U << 10)
+
+/* Size classes: SECURE_CLASS_MIN << class, up to SECURE_CLASS_MAX */
+#define SECURE_CLASS_MIN   32U
+#define SECURE_CLASS_COUNT 10U
+#define SECURE_CLASS_MAX   (SECURE_CLASS_MIN << (SECURE_CLASS_COUNT - 1))
+
+/* Classes of the buffers with their own mapping, kept for reuse when
+ * freed: SECURE_CLASS_MIN << class, up to SECURE_LARGE_MAX, at most
+ * SECURE_LARGE_KEEP free ones per class */
+#define SECURE_LARGE_COUNT 4U
+#define SECURE_LARGE_MAX   (SECURE_CLASS_MAX << SECURE_LARGE_COUNT)
+#define SECURE_LARGE_KEEP  4U
+
+/* Class of the larger buffers: their own mapping, unmapped when freed */
+#define SECURE_CLASS_LARGE (SECURE_CLASS_COUNT + SECURE_LARGE_COUNT)
+
+/* Header magic value, to catch buffers not from alloc_secure_buffer() */
+#define SECURE_MAGIC 0x64707277U
+
+/* Header before every buffer. Free buffers are linked through it. Its
+ * size keeps the buffers aligned for any type. */
+typedef union s_secure_header {
+  struct {
+    uint32_t magic;
+    uint32_t size_class;
+    size_t mapping_size;              /* Large buffers only */
+    union s_secure_header *next_free;
+  } block;
+  max_align_t align;
+} s_secure_header;
+
+/* The arena. One lock for all: it is only held for a few pointer moves,
+ * pages are mapped and unmapped outside of it. */
+static struct {
+  pthread_mutex_t lock;
+  s_secure_header *free_lists[SECURE_CLASS_LARGE];
+  size_t free_counts[SECURE_CLASS_LARGE];     /* Large classes only */
+  char *chunk;
+  size_t chunk_used;
+} arena = { PTHREAD_MUTEX_INITIALIZER, { NULL }, { 0 }, NULL, SECURE_CHUNK_SIZE };
+
+/* memset() to zero that the compiler may not remove, even right before
+ * the memory is released */
+static void wipe_secure(void *memory, size_t size)
+{
+  static void *(*volatile wipe)(void *, int, size_t) = memset;
+
+  wipe(memory, 0, size);
+}
+
+/* Map zeroed pages for secrets: locked if possible, never dumped */
+static void *map_secure(size_t size)
+{
+  void *mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+
+  /* Over the locked memory limit, the pages may reach the swap: still
+   * better than failing */
+  mlock(mapping, size);
+
+#ifdef MADV_DONTDUMP
+  madvise(mapping, size, MADV_DONTDUMP);
+#endif
+
+  return mapping;
+}
+
+/* Allocate a buffer for secrets */
+void *alloc_secure_buffer(size_t size)
+{
+  s_secure_header *header;
+  char *spare_chunk = NULL;
+  size_t size_class = 0, block_size;
+
+  while (size_class < SECURE_CLASS_LARGE && (SECURE_CLASS_MIN << size_class) < size) {
+    size_class++;
+  }
+
+  /* Larger than any class: a mapping of their own */
+  if (size_class == SECURE_CLASS_LARGE) {
+    if (size > SIZE_MAX - sizeof(s_secure_header)) {
+      return NULL;
+    }
+
+    header = map_secure(size + sizeof(s_secure_header));
+
+    if (!header) {
+      return NULL;
+    }
+
+    header->block.magic = SECURE_MAGIC;
+    header->block.size_class = SECURE_CLASS_LARGE;
+    header->block.mapping_size = size + sizeof(s_secure_header);
+    return header + 1;
+  }
+
+  block_size = sizeof(s_secure_header) + (SECURE_CLASS_MIN << size_class);
+
+  /* Large classes: a kept mapping (wiped when freed), or a new one */
+  if (size_class >= SECURE_CLASS_COUNT) {
+    pthread_mutex_lock(&arena.lock);
+    header = arena.free_lists[size_class];
+
+    if (header) {
+      arena.free_lists[size_class] = header->block.next_free;
+      arena.free_counts[size_class]--;
+    }
+
+    pthread_mutex_unlock(&arena.lock);
+
+    if (!header) {
+      header = map_secure(block_size);
+
+      if (!header) {
+        return NULL;
+      }
+    }
+
+    header->block.magic = SECURE_MAGIC;
+    header->block.size_class = (uint32_t) size_class;
+    header->block.mapping_size = block_size;
+    header->block.next_free = NULL;
+    return header + 1;
+  }
+
+  pthread_mutex_lock(&arena.lock);
+
+  /* A recycled buffer (wiped when freed), or a new one from the chunk */
+  header = arena.free_lists[size_class];
+
+  if (header) {
+    arena.free_lists[size_class] = header->block.next_free;
+  } else {
+    if (arena.chunk_used + block_size > SECURE_CHUNK_SIZE) {
+      char *chunk;
+
+      /* The chunk is full: map a new one without holding the lock */
+      pthread_mutex_unlock(&arena.lock);
+      chunk = map_secure(SECURE_CHUNK_SIZE);
+
+      if (!chunk) {
+        return NULL;
+      }
+
+      pthread_mutex_lock(&arena.lock);
+
+      /* Another thread may have mapped one meanwhile: ours is unmapped */
+      if (arena.chunk_used + block_size > SECURE_CHUNK_SIZE) {
+        arena.chunk = chunk;
+        arena.chunk_used = 0;
+      } else {
+        spare_chunk = chunk;
+      }
+    }
+
+    header = (s_secure_header *) (arena.chunk + arena.chunk_used);
+    arena.chunk_used += block_size;
+  }
+
+  pthread_mutex_unlock(&arena.lock);
+
+  if (spare_chunk) {
+    munmap(spare_chunk, SECURE_CHUNK_SIZE);
+  }
+
+  header->block.magic = SECURE_MAGIC;
+  header->block.size_class = (uint32_t) size_class;
+  header->block.next_free = NULL;
+  return header + 1;
+}
+
+/* Wipe and recycle a secure buffer */
+void free_secure_buffer(void *buffer)
+{
+  s_secure_header *header;
+  size_t size_class;
+
+  if (!buffer) {
+    return;
+  }
+
+  header = (s_secure_header *) buffer - 1;
+
+  /* Not ours: better stop than corrupt the arena */
+  if (header->block.magic != SECURE_MAGIC || header->block.size_class > SECURE_CLASS_LARGE) {
+    abort();
+  }
+
+  size_class = header->block.size_class;
+
+  if (size_class >= SECURE_CLASS_COUNT) {
+    const size_t mapping_size = header->block.mapping_size;
+
+    wipe_secure(header, mapping_size);
+
+    /* Large classes: kept for reuse, up to SECURE_LARGE_KEEP */
+    if (size_class < SECURE_CLASS_LARGE) {
+      pthread_mutex_lock(&arena.lock);
+
+      if (arena.free_counts[size_class] < SECURE_LARGE_KEEP) {
+        header->block.size_class = (uint32_t) size_class;
+        header->block.mapping_size = mapping_size;
+        header->block.next_free = arena.free_lists[size_class];
+        arena.free_lists[size_class] = header;
+        arena.free_counts[size_class]++;
+        header = NULL;
+      }
+
+      pthread_mutex_unlock(&arena.lock);
+    }
+
+    if (header) {
+      munmap(header, mapping_size);
+    }
+    return;
+  }
+
+  wipe_secure(buffer, SECURE_CLASS_MIN << size_class);
+  header->block.magic = 0;
+
+  pthread_mutex_lock(&arena.lock);
+  header->block.next_free = arena.free_lists[size_class];
+  arena.free_lists[size_class] = header;
+  pthread_mutex_unlock(&arena.lock);
+}
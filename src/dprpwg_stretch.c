@@ -0,0 +1,620 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Argon2id and BLAKE2b, see dprpwg_stretch.h */
+
+#include "dprpwg_stretch.h"
+#include "dprpwg_lib.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+/* BLAKE2b block and largest output, in bytes */
+#define BLAKE2B_BLOCK_SIZE 128U
+#define BLAKE2B_OUT_MAX    64U
+
+/* Most threads filling a segment */
+#define ARGON2_THREADS_MAX 64U
+
+/* Argon2 block size, in 64 bits words, and segments per pass */
+#define ARGON2_BLOCK_WORDS 128U
+#define ARGON2_SYNC_POINTS 4U
+
+/* Argon2 version 1.3, and type id of Argon2id */
+#define ARGON2_VERSION 0x13U
+#define ARGON2_TYPE_ID 2U
+
+/* Initial hash length, and the two words appended to it to build the
+ * first blocks of each lane */
+#define ARGON2_PREHASH_SIZE (BLAKE2B_OUT_MAX + 8U)
+
+#define ROTR64(Value, Bits) (((Value) >> (Bits)) | ((Value) << (64 - (Bits))))
+
+/* BLAKE2b state, unkeyed */
+typedef struct {
+  uint64_t h[8];
+  uint64_t t[2];
+  uint8_t buffer[BLAKE2B_BLOCK_SIZE];
+  size_t buffer_length;
+  size_t out_length;
+} s_blake2b;
+
+/* One Argon2 block */
+typedef struct {
+  uint64_t v[ARGON2_BLOCK_WORDS];
+} s_block;
+
+/* The memory of one computation, and the segment being filled */
+typedef struct {
+  s_block *blocks;
+  uint32_t lanes;
+  uint32_t passes;
+  uint32_t lane_length;       /* Blocks per lane */
+  uint32_t segment_length;    /* Blocks per segment */
+  uint32_t pass;
+  uint32_t slice;
+  _Atomic uint32_t next_lane; /* Next lane of the segment to fill */
+} s_argon2_fill;
+
+static const uint64_t blake2b_iv[8] = {
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+  0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+  { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+  {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+  {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+  {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+  { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+  { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+  {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+  { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+/* ---- Internal function declarations ---- */
+
+/* Little-endian loads and stores */
+static inline uint64_t load_le64(const uint8_t *bytes);
+static inline void store_le32(uint8_t *bytes, uint32_t value);
+static inline void store_le64(uint8_t *bytes, uint64_t value);
+
+/* BLAKE2b of 'out_length' bytes (1 to 64), in three steps */
+static void blake2b_init(s_blake2b *state, size_t out_length);
+static void blake2b_update(s_blake2b *state, const void *data, size_t length);
+static void blake2b_final(s_blake2b *state, uint8_t *out);
+
+/* Compress one block into the state, the last one if 'last' */
+static void blake2b_compress(s_blake2b *state, const uint8_t *block, int last);
+
+/* H' of RFC 9106: BLAKE2b of any output length */
+static void blake2b_long(uint8_t *out, size_t out_length, const void *data, size_t length);
+
+/* Argon2 compression: next = G(prev, ref), xor'ed into next if 'with_xor'.
+ * 'r' and 'tmp' are working blocks. */
+static void fill_block(const s_block *prev, const s_block *ref, s_block *next, int with_xor,
+                       s_block *r, s_block *tmp);
+
+/* Next 128 addresses of a data-independent segment, from the block
+ * counter of 'input_block' */
+static void next_addresses(s_block *address_block, s_block *input_block,
+                           const s_block *zero_block, s_block *r, s_block *tmp);
+
+/* Fill one segment of one lane */
+static void fill_segment(s_argon2_fill *fill, uint32_t lane);
+
+/* Fill the lanes of the current segment, until none is left */
+static void *fill_worker(void *data);
+
+/* Index of the reference block within its lane */
+static uint32_t index_alpha(const s_argon2_fill *fill, uint32_t index, uint32_t pseudo_rand,
+                            int same_lane);
+
+/* Compute the Argon2id tag */
+int compute_argon2id(const s_argon2_params *params, unsigned int threads,
+                     uint8_t *tag, size_t tag_length)
+{
+  s_argon2_fill fill;
+  s_blake2b state;
+  pthread_t thread_ids[ARGON2_THREADS_MAX];
+  uint8_t prehash[ARGON2_PREHASH_SIZE], words[4], block_bytes[sizeof(s_block)];
+  const uint32_t parameters[6] = {
+    params->lanes, (uint32_t) tag_length, params->memory_kib, params->passes,
+    ARGON2_VERSION, ARGON2_TYPE_ID
+  };
+  size_t index, word;
+  uint32_t lane, started;
+  s_block final_block;
+
+  if (!params->lanes || !params->passes || params->memory_kib / 8 < params->lanes
+      || params->salt_length < 8 || tag_length < 4 || tag_length > UINT32_MAX) {
+    return FALSE;
+  }
+
+  if (!threads) {
+    threads = 1;
+  }
+
+  threads = threads < params->lanes ? threads : params->lanes;
+  threads = threads < ARGON2_THREADS_MAX ? threads : ARGON2_THREADS_MAX;
+
+  /* Memory: a whole number of segments per lane */
+  fill.lanes = params->lanes;
+  fill.passes = params->passes;
+  fill.segment_length = params->memory_kib / (params->lanes * ARGON2_SYNC_POINTS);
+  fill.lane_length = fill.segment_length * ARGON2_SYNC_POINTS;
+
+  if ((size_t) fill.lane_length * fill.lanes > SIZE_MAX / sizeof(s_block)) {
+    return FALSE;
+  }
+
+  fill.blocks = alloc_secure_buffer((size_t) fill.lane_length * fill.lanes * sizeof(s_block));
+
+  if (!fill.blocks) {
+    return FALSE;
+  }
+
+  /* H0: the parameters and all the inputs, with their lengths */
+  blake2b_init(&state, BLAKE2B_OUT_MAX);
+
+  for (index = 0; index < sizeof(parameters) / sizeof(parameters[0]); index++) {
+    store_le32(words, parameters[index]);
+    blake2b_update(&state, words, sizeof(words));
+  }
+
+  store_le32(words, (uint32_t) params->password_length);
+  blake2b_update(&state, words, sizeof(words));
+  blake2b_update(&state, params->password, params->password_length);
+  store_le32(words, (uint32_t) params->salt_length);
+  blake2b_update(&state, words, sizeof(words));
+  blake2b_update(&state, params->salt, params->salt_length);
+  store_le32(words, (uint32_t) params->secret_length);
+  blake2b_update(&state, words, sizeof(words));
+  blake2b_update(&state, params->secret, params->secret_length);
+  store_le32(words, (uint32_t) params->data_length);
+  blake2b_update(&state, words, sizeof(words));
+  blake2b_update(&state, params->data, params->data_length);
+  blake2b_final(&state, prehash);
+
+  /* First two blocks of each lane */
+  for (lane = 0; lane < fill.lanes; lane++) {
+    for (index = 0; index < 2; index++) {
+      s_block *block = &fill.blocks[(size_t) lane * fill.lane_length + index];
+
+      store_le32(prehash + BLAKE2B_OUT_MAX, (uint32_t) index);
+      store_le32(prehash + BLAKE2B_OUT_MAX + 4, lane);
+      blake2b_long(block_bytes, sizeof(block_bytes), prehash, sizeof(prehash));
+
+      for (word = 0; word < ARGON2_BLOCK_WORDS; word++) {
+        block->v[word] = load_le64(block_bytes + word * 8);
+      }
+    }
+  }
+
+  /* Every segment: the lanes are shared by the threads, the calling one
+   * included. Threads that cannot be started leave their lanes to the
+   * others. */
+  for (fill.pass = 0; fill.pass < fill.passes; fill.pass++) {
+    for (fill.slice = 0; fill.slice < ARGON2_SYNC_POINTS; fill.slice++) {
+      atomic_store_explicit(&fill.next_lane, 0, memory_order_relaxed);
+
+      for (started = 1; started < threads; started++) {
+        if (pthread_create(&thread_ids[started], NULL, fill_worker, &fill)) {
+          break;
+        }
+      }
+
+      fill_worker(&fill);
+
+      for (lane = 1; lane < started; lane++) {
+        pthread_join(thread_ids[lane], NULL);
+      }
+    }
+  }
+
+  /* The tag: hash of the last blocks of all the lanes, xor'ed */
+  final_block = fill.blocks[fill.lane_length - 1];
+
+  for (lane = 1; lane < fill.lanes; lane++) {
+    const s_block *last = &fill.blocks[(size_t) lane * fill.lane_length + fill.lane_length - 1];
+
+    for (word = 0; word < ARGON2_BLOCK_WORDS; word++) {
+      final_block.v[word] ^= last->v[word];
+    }
+  }
+
+  for (word = 0; word < ARGON2_BLOCK_WORDS; word++) {
+    store_le64(block_bytes + word * 8, final_block.v[word]);
+  }
+
+  blake2b_long(tag, tag_length, block_bytes, sizeof(block_bytes));
+
+  /* Everything derives from the password */
+  memset(prehash, 0, sizeof(prehash));
+  memset(block_bytes, 0, sizeof(block_bytes));
+  memset(&final_block, 0, sizeof(final_block));
+  memset(&state, 0, sizeof(state));
+  free_secure_buffer(fill.blocks);
+
+  return TRUE;
+}
+
+/* Fill the lanes of the current segment */
+static void *fill_worker(void *data)
+{
+  s_argon2_fill *fill = (s_argon2_fill *) data;
+  uint32_t lane;
+
+  while ((lane = atomic_fetch_add_explicit(&fill->next_lane, 1, memory_order_relaxed))
+         < fill->lanes) {
+    fill_segment(fill, lane);
+  }
+
+  return NULL;
+}
+
+/* Fill one segment of one lane */
+static void fill_segment(s_argon2_fill *fill, uint32_t lane)
+{
+  s_block address_block, input_block, zero_block, r, tmp;
+  const uint32_t pass = fill->pass, slice = fill->slice, lane_length = fill->lane_length;
+
+  /* Argon2id: data-independent addressing for the first half of the first
+   * pass, data-dependent afterwards */
+  const int independent = pass == 0 && slice < ARGON2_SYNC_POINTS / 2;
+  uint32_t index = pass == 0 && slice == 0 ? 2 : 0;
+  size_t current, previous;
+
+  if (independent) {
+    memset(&zero_block, 0, sizeof(zero_block));
+    memset(&input_block, 0, sizeof(input_block));
+    input_block.v[0] = pass;
+    input_block.v[1] = lane;
+    input_block.v[2] = slice;
+    input_block.v[3] = (uint64_t) lane_length * fill->lanes;
+    input_block.v[4] = fill->passes;
+    input_block.v[5] = ARGON2_TYPE_ID;
+
+    /* The first segment starts at its third block */
+    if (index) {
+      next_addresses(&address_block, &input_block, &zero_block, &r, &tmp);
+    }
+  }
+
+  current = (size_t) lane * lane_length + slice * fill->segment_length + index;
+  previous = current % lane_length ? current - 1 : current + lane_length - 1;
+
+  for (; index < fill->segment_length; index++, current++, previous++) {
+    uint64_t pseudo_rand;
+    uint32_t ref_lane;
+
+    if (current % lane_length == 1) {
+      previous = current - 1;
+    }
+
+    /* Addresses come 128 at a time */
+    if (independent) {
+      if (index % ARGON2_BLOCK_WORDS == 0) {
+        next_addresses(&address_block, &input_block, &zero_block, &r, &tmp);
+      }
+
+      pseudo_rand = address_block.v[index % ARGON2_BLOCK_WORDS];
+    } else {
+      pseudo_rand = fill->blocks[previous].v[0];
+    }
+
+    /* The first segment only refers to its own lane */
+    ref_lane = pass == 0 && slice == 0 ? lane : (uint32_t) ((pseudo_rand >> 32) % fill->lanes);
+
+    fill_block(&fill->blocks[previous],
+               &fill->blocks[(size_t) ref_lane * lane_length
+                             + index_alpha(fill, index, (uint32_t) pseudo_rand, ref_lane == lane)],
+               &fill->blocks[current], pass != 0, &r, &tmp);
+  }
+
+  memset(&address_block, 0, sizeof(address_block));
+  memset(&r, 0, sizeof(r));
+  memset(&tmp, 0, sizeof(tmp));
+}
+
+/* Next 128 addresses of a data-independent segment */
+static void next_addresses(s_block *address_block, s_block *input_block,
+                           const s_block *zero_block, s_block *r, s_block *tmp)
+{
+  input_block->v[6]++;
+  fill_block(zero_block, input_block, address_block, FALSE, r, tmp);
+  fill_block(zero_block, address_block, address_block, FALSE, r, tmp);
+}
+
+/* Index of the reference block within its lane */
+static uint32_t index_alpha(const s_argon2_fill *fill, uint32_t index, uint32_t pseudo_rand,
+                            int same_lane)
+{
+  const uint32_t segment_length = fill->segment_length;
+  uint32_t area_size, start = 0;
+  uint64_t relative;
+
+  /* Blocks that can be referred to: the finished segments, and the blocks
+   * before this one in the current segment of the same lane */
+  if (fill->pass == 0) {
+    if (fill->slice == 0) {
+      area_size = index - 1;
+    } else if (same_lane) {
+      area_size = fill->slice * segment_length + index - 1;
+    } else {
+      area_size = fill->slice * segment_length - (index == 0);
+    }
+  } else {
+    if (same_lane) {
+      area_size = fill->lane_length - segment_length + index - 1;
+    } else {
+      area_size = fill->lane_length - segment_length - (index == 0);
+    }
+
+    start = fill->slice == ARGON2_SYNC_POINTS - 1 ? 0 : (fill->slice + 1) * segment_length;
+  }
+
+  /* Non-uniform mapping, favoring the recent blocks */
+  relative = pseudo_rand;
+  relative = (relative * relative) >> 32;
+  relative = area_size - 1 - ((area_size * relative) >> 32);
+
+  return (uint32_t) ((start + relative) % fill->lane_length);
+}
+
+/* The BlaMka mix of Argon2: BLAKE2b G, with multiplications */
+#define BLAMKA(A, B) ((A) + (B) + 2 * ((A) & 0xFFFFFFFFULL) * ((B) & 0xFFFFFFFFULL))
+
+#define ARGON2_G(A, B, C, D)                  \
+  do {                                        \
+    A = BLAMKA(A, B); D = ROTR64(D ^ A, 32);  \
+    C = BLAMKA(C, D); B = ROTR64(B ^ C, 24);  \
+    A = BLAMKA(A, B); D = ROTR64(D ^ A, 16);  \
+    C = BLAMKA(C, D); B = ROTR64(B ^ C, 63);  \
+  } while (0)
+
+/* BLAKE2b round on 16 words, given by their indices in 'v' */
+#define ARGON2_ROUND(v, i0, i1, i2, i3, i4, i5, i6, i7, i8, i9, i10, i11, i12, i13, i14, i15) \
+  do {                                                                                       \
+    ARGON2_G(v[i0], v[i4], v[i8], v[i12]);                                                   \
+    ARGON2_G(v[i1], v[i5], v[i9], v[i13]);                                                   \
+    ARGON2_G(v[i2], v[i6], v[i10], v[i14]);                                                  \
+    ARGON2_G(v[i3], v[i7], v[i11], v[i15]);                                                  \
+    ARGON2_G(v[i0], v[i5], v[i10], v[i15]);                                                  \
+    ARGON2_G(v[i1], v[i6], v[i11], v[i12]);                                                  \
+    ARGON2_G(v[i2], v[i7], v[i8], v[i13]);                                                   \
+    ARGON2_G(v[i3], v[i4], v[i9], v[i14]);                                                   \
+  } while (0)
+
+/* Argon2 compression function */
+static void fill_block(const s_block *prev, const s_block *ref, s_block *next, int with_xor,
+                       s_block *r, s_block *tmp)
+{
+  uint64_t *v = r->v;
+  size_t word, i;
+
+  for (word = 0; word < ARGON2_BLOCK_WORDS; word++) {
+    v[word] = prev->v[word] ^ ref->v[word];
+    tmp->v[word] = with_xor ? v[word] ^ next->v[word] : v[word];
+  }
+
+  /* The block is an 8x8 matrix of 16 bytes registers: rows, then columns */
+  for (i = 0; i < 8; i++) {
+    const size_t b = 16 * i;
+    ARGON2_ROUND(v, b, b + 1, b + 2, b + 3, b + 4, b + 5, b + 6, b + 7,
+                 b + 8, b + 9, b + 10, b + 11, b + 12, b + 13, b + 14, b + 15);
+  }
+
+  for (i = 0; i < 8; i++) {
+    const size_t b = 2 * i;
+    ARGON2_ROUND(v, b, b + 1, b + 16, b + 17, b + 32, b + 33, b + 48, b + 49,
+                 b + 64, b + 65, b + 80, b + 81, b + 96, b + 97, b + 112, b + 113);
+  }
+
+  for (word = 0; word < ARGON2_BLOCK_WORDS; word++) {
+    next->v[word] = tmp->v[word] ^ v[word];
+  }
+}
+
+/* H' of RFC 9106 */
+static void blake2b_long(uint8_t *out, size_t out_length, const void *data, size_t length)
+{
+  s_blake2b state;
+  uint8_t length_bytes[4], chunk[BLAKE2B_OUT_MAX];
+
+  store_le32(length_bytes, (uint32_t) out_length);
+
+  if (out_length <= BLAKE2B_OUT_MAX) {
+    blake2b_init(&state, out_length);
+    blake2b_update(&state, length_bytes, sizeof(length_bytes));
+    blake2b_update(&state, data, length);
+    blake2b_final(&state, out);
+    return;
+  }
+
+  /* Longer outputs: the first half of a chain of 64 bytes hashes, then
+   * the last hash whole */
+  blake2b_init(&state, BLAKE2B_OUT_MAX);
+  blake2b_update(&state, length_bytes, sizeof(length_bytes));
+  blake2b_update(&state, data, length);
+  blake2b_final(&state, chunk);
+  memcpy(out, chunk, BLAKE2B_OUT_MAX / 2);
+  out += BLAKE2B_OUT_MAX / 2;
+  out_length -= BLAKE2B_OUT_MAX / 2;
+
+  while (out_length > BLAKE2B_OUT_MAX) {
+    blake2b_init(&state, BLAKE2B_OUT_MAX);
+    blake2b_update(&state, chunk, sizeof(chunk));
+    blake2b_final(&state, chunk);
+    memcpy(out, chunk, BLAKE2B_OUT_MAX / 2);
+    out += BLAKE2B_OUT_MAX / 2;
+    out_length -= BLAKE2B_OUT_MAX / 2;
+  }
+
+  blake2b_init(&state, out_length);
+  blake2b_update(&state, chunk, sizeof(chunk));
+  blake2b_final(&state, out);
+
+  memset(chunk, 0, sizeof(chunk));
+}
+
+/* Start a BLAKE2b hash, without key */
+static void blake2b_init(s_blake2b *state, size_t out_length)
+{
+  memcpy(state->h, blake2b_iv, sizeof(state->h));
+  state->h[0] ^= 0x01010000ULL ^ out_length;
+  state->t[0] = 0;
+  state->t[1] = 0;
+  state->buffer_length = 0;
+  state->out_length = out_length;
+}
+
+/* Hash more data. The last block is kept for blake2b_final(). */
+static void blake2b_update(s_blake2b *state, const void *data, size_t length)
+{
+  const uint8_t *bytes = (const uint8_t *) data;
+
+  while (length) {
+    size_t taken;
+
+    if (state->buffer_length == BLAKE2B_BLOCK_SIZE) {
+      state->t[0] += BLAKE2B_BLOCK_SIZE;
+      state->t[1] += state->t[0] < BLAKE2B_BLOCK_SIZE;
+      blake2b_compress(state, state->buffer, FALSE);
+      state->buffer_length = 0;
+    }
+
+    taken = BLAKE2B_BLOCK_SIZE - state->buffer_length;
+    taken = taken < length ? taken : length;
+    memcpy(state->buffer + state->buffer_length, bytes, taken);
+    state->buffer_length += taken;
+    bytes += taken;
+    length -= taken;
+  }
+}
+
+/* Hash the last block, and write the output */
+static void blake2b_final(s_blake2b *state, uint8_t *out)
+{
+  uint8_t h_bytes[BLAKE2B_OUT_MAX];
+  size_t word;
+
+  state->t[0] += state->buffer_length;
+  state->t[1] += state->t[0] < state->buffer_length;
+  memset(state->buffer + state->buffer_length, 0, BLAKE2B_BLOCK_SIZE - state->buffer_length);
+  blake2b_compress(state, state->buffer, TRUE);
+
+  for (word = 0; word < 8; word++) {
+    store_le64(h_bytes + word * 8, state->h[word]);
+  }
+
+  memcpy(out, h_bytes, state->out_length);
+  memset(h_bytes, 0, sizeof(h_bytes));
+  memset(state->buffer, 0, sizeof(state->buffer));
+}
+
+#define BLAKE2B_G(A, B, C, D, X, Y)           \
+  do {                                        \
+    A = A + B + X; D = ROTR64(D ^ A, 32);     \
+    C = C + D;     B = ROTR64(B ^ C, 24);     \
+    A = A + B + Y; D = ROTR64(D ^ A, 16);     \
+    C = C + D;     B = ROTR64(B ^ C, 63);     \
+  } while (0)
+
+/* BLAKE2b compression function */
+static void blake2b_compress(s_blake2b *state, const uint8_t *block, int last)
+{
+  uint64_t m[16], v[16];
+  size_t round, word;
+
+  for (word = 0; word < 16; word++) {
+    m[word] = load_le64(block + word * 8);
+  }
+
+  for (word = 0; word < 8; word++) {
+    v[word] = state->h[word];
+    v[word + 8] = blake2b_iv[word];
+  }
+
+  v[12] ^= state->t[0];
+  v[13] ^= state->t[1];
+
+  if (last) {
+    v[14] = ~v[14];
+  }
+
+  for (round = 0; round < 12; round++) {
+    const uint8_t *s = blake2b_sigma[round];
+
+    BLAKE2B_G(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);
+    BLAKE2B_G(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);
+    BLAKE2B_G(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);
+    BLAKE2B_G(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);
+    BLAKE2B_G(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);
+    BLAKE2B_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+    BLAKE2B_G(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);
+    BLAKE2B_G(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);
+  }
+
+  for (word = 0; word < 8; word++) {
+    state->h[word] ^= v[word] ^ v[word + 8];
+  }
+
+  memset(m, 0, sizeof(m));
+  memset(v, 0, sizeof(v));
+}
+
+static inline uint64_t load_le64(const uint8_t *bytes)
+{
+  uint64_t value = 0;
+  size_t index;
+
+  for (index = 8; index > 0; index--) {
+    value = (value << 8) | bytes[index - 1];
+  }
+
+  return value;
+}
+
+static inline void store_le32(uint8_t *bytes, uint32_t value)
+{
+  size_t index;
+
+  for (index = 0; index < 4; index++) {
+    bytes[index] = (uint8_t) (value >> (8 * index));
+  }
+}
+
+static inline void store_le64(uint8_t *bytes, uint64_t value)
+{
+  size_t index;
+
+  for (index = 0; index < 8; index++) {
+    bytes[index] = (uint8_t) (value >> (8 * index));
+  }
+}
@@ -0,0 +1,61 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Internal to the library: Argon2id (RFC 9106), the memory-hard function
+ * behind FLAG_STRETCH, see stretch_master_password().
+ *
+ * The memory is split in lanes, filled four segments at a time: within a
+ * segment, every lane only reads its own blocks and the finished segments
+ * of the others, so the lanes of a segment are filled by several threads
+ * at once. The result only depends on the number of lanes, not on the
+ * number of threads. BLAKE2b, the underlying hash, is included. */
+
+#ifndef DPRPWG_STRETCH_H
+#define DPRPWG_STRETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Argon2 inputs, as named in RFC 9106. Secret and associated data may be
+ * NULL, if their length is 0. */
+typedef struct {
+  const uint8_t *password;
+  size_t password_length;
+  const uint8_t *salt;        /* At least 8 bytes */
+  size_t salt_length;
+  const uint8_t *secret;
+  size_t secret_length;
+  const uint8_t *data;
+  size_t data_length;
+  uint32_t passes;            /* t, at least 1 */
+  uint32_t memory_kib;        /* m, at least 8 * lanes */
+  uint32_t lanes;             /* p, at least 1 */
+} s_argon2_params;
+
+/* Compute the Argon2id tag of 'params', 'tag_length' bytes (4 or more),
+ * on up to 'threads' threads. Return FALSE if the parameters are invalid,
+ * or memory is short. */
+int compute_argon2id(const s_argon2_params *params, unsigned int threads,
+                     uint8_t *tag, size_t tag_length);
+
+#endif /* DPRPWG_STRETCH_H */
@@ -0,0 +1,141 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Helpers of the tools, see dprpwg_tools.h */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "dprpwg_tools.h"
+#include "dprpwg_lib.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+
+/* Generation engine names, indexed by ENGINE_* */
+static const char *const engine_names[] = { "reference", "closed-form", "checked" };
+
+int read_master_password(const char *path, char *password, size_t size)
+{
+  FILE *file;
+  struct termios saved, silent;
+  int from_terminal = path == NULL;
+  int result = TRUE;
+
+  file = fopen(from_terminal ? "/dev/tty" : path, from_terminal ? "r+" : "r");
+
+  if (!file) {
+    perror(from_terminal ? "/dev/tty" : path);
+    return FALSE;
+  }
+
+  if (from_terminal) {
+    fputs("Master password: ", file);
+    fflush(file);
+    tcgetattr(fileno(file), &saved);
+    silent = saved;
+    silent.c_lflag &= ~(tcflag_t) ECHO;
+    tcsetattr(fileno(file), TCSAFLUSH, &silent);
+  }
+
+  if (!fgets(password, (int) size, file)) {
+    password[0] = '\0';
+    result = FALSE;
+  }
+
+  password[strcspn(password, "\r\n")] = '\0';
+
+  if (from_terminal) {
+    tcsetattr(fileno(file), TCSAFLUSH, &saved);
+    fputs("\n", file);
+  }
+
+  fclose(file);
+
+  return result;
+}
+
+int parse_categories(const char *categories, unsigned int *flags)
+{
+  *flags = 0;
+
+  for (; *categories; categories++) {
+    switch (*categories) {
+      case 'l':
+        *flags |= FLAG_LOW_AVAIL;
+        break;
+      case 'u':
+        *flags |= FLAG_UPP_AVAIL;
+        break;
+      case 'd':
+        *flags |= FLAG_DIG_AVAIL;
+        break;
+      case 's':
+        *flags |= FLAG_SYM_AVAIL;
+        break;
+      default:
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+int parse_engine(const char *name, unsigned int *engine)
+{
+  unsigned int seek;
+
+  for (seek = 0; seek < sizeof(engine_names) / sizeof(engine_names[0]); seek++) {
+    if (!strcmp(name, engine_names[seek])) {
+      *engine = seek;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+const char *get_engine_name(unsigned int engine)
+{
+  return engine < sizeof(engine_names) / sizeof(engine_names[0]) ? engine_names[engine] : "?";
+}
+
+uint64_t fingerprint(const char *data, size_t length, uint64_t key)
+{
+  uint64_t hash = key ^ ((uint64_t) length * UINT64_C(0x9E3779B97F4A7C15));
+  size_t seek;
+
+  /* FNV-1a over the chars, then the MurmurHash3 finalizer */
+  for (seek = 0; seek < length; seek++) {
+    hash = (hash ^ (unsigned char) data[seek]) * UINT64_C(0x100000001B3);
+  }
+
+  hash ^= hash >> 33;
+  hash *= UINT64_C(0xFF51AFD7ED558CCD);
+  hash ^= hash >> 33;
+  hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+  hash ^= hash >> 33;
+
+  /* 0 marks the empty slots of the dprpwg-scan table */
+  return hash ? hash : 1;
+}
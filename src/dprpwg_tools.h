@@ -0,0 +1,55 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Helpers shared by the programs, not part of the library: master
+ * password input, option parsing, and the keyed hash of dprpwg-scan and
+ * dprpwg-lookup. */
+
+#ifndef DPRPWG_TOOLS_H
+#define DPRPWG_TOOLS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Read the master password, from the file 'path', or from the terminal
+ * without echo if 'path' is NULL. The line end is dropped. Return FALSE
+ * if it cannot be read. */
+int read_master_password(const char *path, char *password, size_t size);
+
+/* Parse symbol categories: any of the letters l, u, d and s, into FLAG_*
+ * flags. Return FALSE on another letter. */
+int parse_categories(const char *categories, unsigned int *flags);
+
+/* Parse a generation engine name: "reference", "closed-form" or
+ * "checked", into ENGINE_*. Return FALSE on another name. */
+int parse_engine(const char *name, unsigned int *engine);
+
+/* Name of a generation engine, as parse_engine() takes it */
+const char *get_engine_name(unsigned int engine);
+
+/* Keyed 64 bits hash of 'length' chars, never 0: FNV-1a, then the
+ * MurmurHash3 finalizer. It is not cryptographic, the key only makes the
+ * hashes of a run or an index unpredictable. */
+uint64_t fingerprint(const char *data, size_t length, uint64_t key);
+
+#endif /* DPRPWG_TOOLS_H */
@@ -0,0 +1,72 @@
+#!/bin/sh
+#
+# dprpwg: a Deterministic Pseudo-Random PassWord Generator
+# Copyright (c) 2018 Jean-Baptiste HERVE
+# MIT license, see COPYING.
+#
+# Input handling test of dprpwg-batch, run by "make check".
+#
+# Manifests of exactly one and sixteen pages, without a final newline, are
+# given to dprpwg-batch as files (memory-mapped) and through a pipe (read
+# through a buffer). Both outputs must be the same, and the last record
+# must be there.
+#
+# Binary records are then written for years around the 16 bits limit of
+# their year field: the ones that do not fit must be 0.
+#
+# Usage: tests/check-batch.sh path/to/dprpwg-batch
+
+batch=${1:-bin/dprpwg-batch}
+work=$(mktemp -d) || exit 1
+trap 'rm -rf "$work"' EXIT
+status=0
+
+printf 'check master password\n' > "$work/password"
+page=$(getconf PAGESIZE)
+
+for size in "$page" $((page * 16)); do
+  # Domains only, so the cut can land anywhere; "x" ends the last one
+  { i=0
+    while [ "$i" -lt $((size / 16 + 1)) ]; do
+      printf 'host-%05d.test\n' "$i"
+      i=$((i + 1))
+    done
+  } | head -c $((size - 1)) > "$work/manifest"
+  printf 'x' >> "$work/manifest"
+
+  if ! "$batch" -p "$work/password" -y 2024 -j 2 "$work/manifest" "$work/mapped"; then
+    echo "FAIL dprpwg-batch, $size bytes file without a final newline"
+    status=1
+    continue
+  fi
+
+  cat "$work/manifest" | "$batch" -p "$work/password" -y 2024 -j 2 > "$work/piped"
+
+  if ! cmp -s "$work/mapped" "$work/piped"; then
+    echo "FAIL dprpwg-batch, $size bytes file without a final newline: output differs from a pipe"
+    status=1
+  elif [ "$(wc -l < "$work/mapped")" -ne "$(grep -c . "$work/manifest")" ]; then
+    echo "FAIL dprpwg-batch, $size bytes file without a final newline: records missing"
+    status=1
+  else
+    echo "check-batch: $size bytes file without a final newline OK"
+  fi
+done
+
+# Year field of the first record: after the 32 bytes header and the line
+printf 'host.test\n' > "$work/manifest"
+
+for year in 2024:2024 65535:65535 65536:0 70000:0 2024x:0 twenty:0; do
+  "$batch" -p "$work/password" -y "${year%%:*}" -j 1 -b "$work/manifest" "$work/binary" \
+    2> /dev/null
+  field=$(od -An -tu2 -j40 -N2 "$work/binary" | tr -d ' ')
+
+  if [ "$field" != "${year#*:}" ]; then
+    echo "FAIL dprpwg-batch -b, year ${year%%:*}: year field $field, expected ${year#*:}"
+    status=1
+  fi
+done
+
+[ $status -eq 0 ] && echo "check-batch: binary year fields OK"
+
+exit $status
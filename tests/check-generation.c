@@ -0,0 +1,785 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Test of the generation engines, run by "make check".
+ *
+ * Known answers first: passwords of the original generate_password() loop,
+ * frozen, for fixed inputs. generate_password() and generate_password_r()
+ * must still give them with every engine. They were made with the
+ * dprpwg_config.h constants below, and are skipped with other ones.
+ *
+ * Then random batches: they are generated one by one with
+ * generate_password_r() and the reference engine, and that is the expected
+ * output. The very same inputs are then given to generate_password_batch(),
+ * generate_password_ctx(), generate_password_batch_ctx() (with and without
+ * a result cache) and generate_password_sweep() with every engine, and to
+ * generate_password_r() with the closed-form engine. Every password must be
+ * the same, and so must the batch results.
+ *
+ * The batches mix master password and domain lengths, symbol categories,
+ * years, fixed sizes (over OUTPUT_MAX_LENGTH too), outputs too small for
+ * some of their passwords, inputs whose loop runs up to ITERATION_MAX, and
+ * a few stretched master passwords.
+ *
+ * With -c, the configuration stub is made a profile file: its numbers are
+ * replaced with the dprpwg_config.h ones, comments and all kept, and it is
+ * loaded with load_hash_profile(). generate_password_profile() and the
+ * contexts of create_password_context_profile() must then give the
+ * expected passwords of every batch too.
+ *
+ * The lane kernels are picked once per process: "make check" runs this
+ * program with DPRPWG_SIMD set to "none", "sse4.1" and "avx2" in turn. */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_config.h"
+
+/* Default number of random batches */
+#define CHECK_BATCHES 100U
+
+/* Largest batch */
+#define CHECK_BATCH_MAX 48U
+
+/* Longest password of the checks, in chars */
+#define CHECK_LENGTH_MAX 320U
+
+/* Inputs so long that the base loop limit is already over ITERATION_MAX */
+#define CHECK_LONG_INPUT 1024U
+
+/* Sweep ranges */
+#define CHECK_SWEEP_YEARS 3U
+#define CHECK_SWEEP_SIZES 3U
+
+/* Result cache capacity of the cached context */
+#define CHECK_CACHE_CAPACITY 64U
+
+/* Longest line of the configuration stub */
+#define CHECK_STUB_LINE_MAX 256U
+
+#define ALL_FLAGS (FLAG_LOW_AVAIL | FLAG_UPP_AVAIL | FLAG_DIG_AVAIL | FLAG_SYM_AVAIL)
+
+/* dprpwg_config.h constants of the known answers */
+#define KNOWN_ANSWERS_CONFIG (PW_MUL == 7919U && PW_SEEK_MUL == 104729U \
+                              && PW_INV_MUL == 1299709U && DOM_MUL == 15485863U \
+                              && DOM_SEEK_MUL == 32452843U && DOM_INV_MUL == 49979687U \
+                              && YR_MUL == 67867967U && YR_SEEK_MUL == 86028121U \
+                              && YR_INV_MUL == 104395301U)
+
+/* One random batch: shared master password and year, per domain inputs */
+typedef struct {
+  char password[CHECK_LONG_INPUT + 1];
+  const char *year;
+  size_t count;
+  char domains[CHECK_BATCH_MAX][CHECK_LONG_INPUT + 1];
+  const char *domain_list[CHECK_BATCH_MAX];
+  unsigned int flags[CHECK_BATCH_MAX];
+  size_t fixed_sizes[CHECK_BATCH_MAX];
+  size_t stride;
+} s_check_batch;
+
+/* One known answer. The master password is 'password' repeated 'repeat'
+ * times, so the loop of long inputs is covered too. */
+typedef struct {
+  const char *password;
+  size_t repeat;
+  const char *domain;
+  const char *year;
+  size_t fixed_size;
+  unsigned int flags;
+  const char *expected;
+} s_known_answer;
+
+/* Generation engines under test */
+static const struct {
+  unsigned int engine;
+  const char *name;
+} engines[] = {
+  { ENGINE_REFERENCE, "reference" },
+  { ENGINE_CLOSED_FORM, "closed-form" },
+  { ENGINE_CHECKED, "checked" },
+};
+
+/* dprpwg_config.h constants, by name */
+static const struct {
+  const char *name;
+  unsigned int value;
+} config_constants[] = {
+  { "PW_MUL", PW_MUL },
+  { "PW_SEEK_MUL", PW_SEEK_MUL },
+  { "PW_INV_MUL", PW_INV_MUL },
+  { "DOM_MUL", DOM_MUL },
+  { "DOM_SEEK_MUL", DOM_SEEK_MUL },
+  { "DOM_INV_MUL", DOM_INV_MUL },
+  { "YR_MUL", YR_MUL },
+  { "YR_SEEK_MUL", YR_SEEK_MUL },
+  { "YR_INV_MUL", YR_INV_MUL },
+};
+
+/* Years of the batches: default lengths from 12 to 212 chars, and years
+ * that are not numbers */
+static const char * const years[] = {
+  "", "1999", "2000", "2004", "2024", "2026", "2100", "3000", "20x4",
+};
+
+/* Passwords of the original generate_password() loop: bytes over 127,
+ * fixed sizes, loops up to ITERATION_MAX, and first loop limits already
+ * over ITERATION_MAX */
+static const s_known_answer known_answers[] = {
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0xf,
+    "B7bX;Us2}U:ye1f]e" },
+  { "correct horse battery staple", 1, "example.org", "2026", 0, 0xf,
+    "k.aAN8q],SV!z[dop" },
+  { "correct horse battery staple", 1, "example.com", "2027", 0, 0xf,
+    "!iSu5!Bin!xLHzAfH" },
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0x1,
+    "pvemapxvryuiqisjc" },
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0x2,
+    "VJDKBNUUTTPIZBDHT" },
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0x4,
+    "90607819101699521" },
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0x8,
+    "+;;_:=:\?.{]}:/}{=" },
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0x5,
+    "brleqmlcxpe46skx1" },
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0xa,
+    "NEBICL(TMX_DQ_WLI" },
+  { "correct horse battery staple", 1, "example.com", "2026", 0, 0,
+    "" },
+  { "correct horse battery staple", 1, "example.com", "", 0, 0xf,
+    "4e)!xp9A947E" },
+  { "correct horse battery staple", 1, "example.com", "1999", 0, 0xf,
+    "Lw9Cf}Vm.h}H" },
+  { "correct horse battery staple", 1, "example.com", "2000", 0, 0xf,
+    "Q)iFQh9q8APW" },
+  { "correct horse battery staple", 1, "example.com", "3000", 0, 0xf,
+    ";,irdsDEB.:iA2Ys)}}DdlIZtJ)xogYE]jM1_+;KFXYU9k-=HE86unZ6iTUosc9VL=mrE5gZNk+.vN\?IRXQ1l5"
+    "857NJT3c[Y6i,vcQA=;ONygZn{do37oqvt[}zKvyc{Td}J:kscqT0q7]LoZ/[UhYEMXH+JpOWjNr-WI\?fJPQ1K"
+    "[21ou7qs2D+fmgWCe7!.y.fN+X/tppY38Vtgp3!I" },
+  { "correct horse battery staple", 1, "example.com", "20x4", 0, 0xf,
+    "\?KQ7\?9nRq\?Mp" },
+  { "correct horse battery staple", 1, "example.com", "2026", 8, 0xf,
+    ";Pr{0iA-" },
+  { "correct horse battery staple", 1, "example.com", "2026", 64, 0x7,
+    "kbwDdWdR4kPCH834ZJiiO0MNy0AzsbdsowWYnW0ePHGGNnZj94XmhwunEw0C8tCg" },
+  { "correct horse battery staple", 1, "example.com", "2026", 300, 0xf,
+    "Szbm;-YD7Tf+bN!IFIrga56YRue,!-_gz{k[K0mTLS:0/!9hP621OEj:zG+S3_a=ZZQ0Dl0H.JvYSjR/\?-_P!."
+    "eeT;H6a/fH:kn}9o:16gl=GmdIIbPG4)j\?J\?=TS7ws6K50rdaU:TK:w4_:3Nxp))XhWagS/Y5yNuzFW5smJiQ"
+    "t+pR=NLA;MK/dz[wxoKKjWleC+QMgV{}{)L](j_n\?SAX!4iAOsPp(.WY8RIEh/FJ]ckccUaZaYz!Dmh9{47Ylu"
+    "PhQ5p0iPl\?(tREWt[WOAdYBQAO2wsKAjpK,1}y/iNdZ" },
+  { "", 1, "example.com", "2026", 0, 0xf,
+    "qMxj{Pr413ckom]JV" },
+  { "a", 1, "", "2026", 0, 0xf,
+    "aH5\?2tnzJ6F3y0eKN" },
+  { "a", 1, "b", "", 0, 0xf,
+    "ggggHHHHHHHH" },
+  { "", 1, "", "", 0, 0xf,
+    "aaaaaaaaaaaa" },
+  { "p\303\244ssw\303\266rd", 1, "example.com", "2026", 0, 0xf,
+    "8U/5N5}/FIQkc=BNC" },
+  { "\377\200\177~ ", 1, "d\303\251j\303\240-vu.fr", "2026", 0, 0xf,
+    "P5C)t305ZNk5jCaa6" },
+  { "master", 1, "\351t\351.example", "2\2600", 0, 0xf,
+    "HFA2__PD=RAe" },
+  { "master", 1, "\200\201\202\375\376\377", "2026", 20, 0x9,
+    "od{yh-sx;f}hc:siu[/b" },
+  { "correct horse battery staple", 1, "example.com", "2026", 1, 0xf,
+    "]" },
+  { "correct horse battery staple", 1, "example.com", "2026", 2, 0xf,
+    "}h" },
+  { "correct horse battery staple", 1, "example.com", "2026", 3, 0xf,
+    "{T\?" },
+  { "correct horse battery staple", 1, "example.com", "2026", 3, 0xb,
+    ",qE" },
+  { "p\303\244ssw\303\266rd", 1, "\377", "2026", 2, 0xc,
+    "5]" },
+  { "0123456789abcdef", 64, "example.com", "2026", 0, 0xf,
+    "F{RRJx,VQ+efbSrQp" },
+  { "0123456789abcdef", 64, "example.com", "2026", 3, 0xf,
+    "kyj" },
+  { "\303\251\303\250", 256, "example.com", "2026", 0, 0x6,
+    "H8BDOREUZXZ085WYR" },
+};
+
+/* ---- Internal function declarations ---- */
+
+/* State of the random generator, see -s */
+static uint64_t random_state;
+
+/* Count of the differences found */
+static size_t failures = 0;
+
+/* Print the command line help */
+static void usage(const char *program);
+
+/* Random number in [0, bound[ */
+static size_t random_below(size_t bound);
+
+/* Fill 'string' with 'length' random printable chars */
+static void random_string(char *string, size_t length);
+
+/* Fill a random batch */
+static void make_batch(s_check_batch *batch);
+
+/* Report one difference with the expected password */
+static void report(const char *function, const char *engine, size_t batch_index,
+                   const char *domain, const char *year, size_t fixed_size,
+                   unsigned int flags, const char *expected, const char *actual);
+
+/* Check the known answers with every engine. Return the number of
+ * passwords checked. */
+static size_t check_known_answers(void);
+
+/* Check one batch with every function and engine. Return the number of
+ * passwords checked. */
+static size_t check_batch(const s_check_batch *batch, size_t batch_index,
+                          char *expected, char *output, uint16_t *hash);
+
+/* Check generate_password_sweep() on the first domain of a batch */
+static size_t check_sweep(const s_check_batch *batch, size_t batch_index,
+                          char *expected, char *output, uint16_t *hash);
+
+/* Load the configuration stub as a profile, once as is (it must fail) and
+ * once with the dprpwg_config.h numbers. Return the profile, or NULL. */
+static dprpwg_profile *load_stub_profile(const char *stub_path);
+
+/* Check a batch with a profile of the dprpwg_config.h constants, after
+ * check_batch() made the expected passwords */
+static size_t check_profile(const s_check_batch *batch, size_t batch_index,
+                            const dprpwg_profile *profile, const char *expected,
+                            char *output, uint16_t *hash);
+
+void usage(const char *program)
+{
+  fprintf(stderr,
+          "Usage: %s [-s seed] [-n batches] [-c config_stub]\n"
+          "  -s  Seed of the random inputs (default: 1).\n"
+          "  -n  Number of random batches (default: %u).\n"
+          "  -c  Configuration stub to check as a profile file, with the\n"
+          "      dprpwg_config.h numbers (src/dprpwg_config.stub.h).\n"
+          "Exits with 1 if any password differs from the known answers or from\n"
+          "the reference engine.\n",
+          program, CHECK_BATCHES);
+}
+
+size_t random_below(size_t bound)
+{
+  /* xorshift64* */
+  random_state ^= random_state >> 12;
+  random_state ^= random_state << 25;
+  random_state ^= random_state >> 27;
+  return (size_t) ((random_state * 2685821657736338717ULL) >> 32) % bound;
+}
+
+void random_string(char *string, size_t length)
+{
+  size_t seek;
+
+  /* All printable ASCII, space included */
+  for (seek = 0; seek < length; seek++) {
+    string[seek] = (char) (' ' + random_below(95));
+  }
+
+  string[length] = '\0';
+}
+
+void make_batch(s_check_batch *batch)
+{
+  size_t item;
+
+  random_string(batch->password, random_below(16) ? random_below(33) : CHECK_LONG_INPUT);
+  batch->year = years[random_below(sizeof(years) / sizeof(years[0]))];
+  batch->count = 1 + random_below(CHECK_BATCH_MAX);
+
+  for (item = 0; item < batch->count; item++) {
+    random_string(batch->domains[item], random_below(32) ? random_below(41) : CHECK_LONG_INPUT);
+    batch->domain_list[item] = batch->domains[item];
+
+    /* All categories half of the time: it is the usual case, and the one
+     * whose loop is raised the most on tiny passwords */
+    batch->flags[item] = random_below(2) ? ALL_FLAGS : (unsigned int) random_below(16);
+
+    if (!random_below(64)) {
+      batch->flags[item] |= FLAG_STRETCH_COST(STRETCH_COST_MIN);
+    }
+
+    switch (random_below(8)) {
+      case 0:
+        /* Up to ITERATION_MAX when a category is missing */
+        batch->fixed_sizes[item] = 1 + random_below(3);
+        break;
+      case 1:
+        batch->fixed_sizes[item] = 4 + random_below(60);
+        break;
+      case 2:
+        batch->fixed_sizes[item] = OUTPUT_MAX_LENGTH - 64 + random_below(CHECK_LENGTH_MAX - OUTPUT_MAX_LENGTH + 64);
+        break;
+      default:
+        batch->fixed_sizes[item] = 0;
+        break;
+    }
+  }
+
+  /* Sometimes too small for some passwords */
+  batch->stride = random_below(8) ? CHECK_LENGTH_MAX + 1 : 1 + random_below(32);
+}
+
+void report(const char *function, const char *engine, size_t batch_index,
+            const char *domain, const char *year, size_t fixed_size,
+            unsigned int flags, const char *expected, const char *actual)
+{
+  failures++;
+
+  fprintf(stderr,
+          "FAIL %s (%s engine), batch %zu: domain length %zu, year \"%s\", fixed size %zu,"
+          " flags %#x\n  expected \"%s\"\n  got      \"%s\"\n",
+          function, engine, batch_index, strlen(domain), year, fixed_size, flags,
+          expected, actual);
+}
+
+size_t check_known_answers(void)
+{
+  char password[CHECK_LONG_INPUT + 1], new_passwd[CHECK_LENGTH_MAX + 1];
+  uint16_t hash[CHECK_LENGTH_MAX];
+  char *allocated;
+  size_t answer, engine, repeat, checked = 0;
+
+  for (answer = 0; answer < sizeof(known_answers) / sizeof(known_answers[0]); answer++) {
+    const s_known_answer *known = &known_answers[answer];
+
+    password[0] = '\0';
+
+    for (repeat = 0; repeat < known->repeat; repeat++) {
+      strcat(password, known->password);
+    }
+
+    for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+      set_generation_engine(engines[engine].engine);
+
+      generate_password(password, known->domain, known->year, known->fixed_size,
+                        &allocated, known->flags);
+
+      if (!allocated || strcmp(allocated, known->expected)) {
+        report("generate_password (known answer)", engines[engine].name, answer,
+               known->domain, known->year, known->fixed_size, known->flags,
+               known->expected, allocated ? allocated : "(NULL)");
+      }
+      free(allocated);
+
+      generate_password_r(password, known->domain, known->year, known->fixed_size,
+                          known->flags, new_passwd, sizeof(new_passwd), hash, CHECK_LENGTH_MAX);
+
+      if (strcmp(new_passwd, known->expected)) {
+        report("generate_password_r (known answer)", engines[engine].name, answer,
+               known->domain, known->year, known->fixed_size, known->flags,
+               known->expected, new_passwd);
+      }
+      checked += 2;
+    }
+  }
+
+  return checked;
+}
+
+size_t check_batch(const s_check_batch *batch, size_t batch_index,
+                   char *expected, char *output, uint16_t *hash)
+{
+  dprpwg_ctx *contexts[2];
+  size_t item, engine, context, checked = 0;
+  int expected_result = TRUE, result, pass;
+
+  /* Expected passwords, one by one on the reference engine */
+  set_generation_engine(ENGINE_REFERENCE);
+
+  for (item = 0; item < batch->count; item++) {
+    if (generate_password_r(batch->password, batch->domains[item], batch->year,
+                            batch->fixed_sizes[item], batch->flags[item],
+                            expected + item * batch->stride, batch->stride,
+                            hash, CHECK_LENGTH_MAX) != GENERATE_OK) {
+      expected_result = FALSE;
+    }
+  }
+
+  /* Closed-form engine, one by one */
+  set_generation_engine(ENGINE_CLOSED_FORM);
+
+  for (item = 0; item < batch->count; item++) {
+    char *new_passwd = output + item * batch->stride;
+
+    generate_password_r(batch->password, batch->domains[item], batch->year,
+                        batch->fixed_sizes[item], batch->flags[item],
+                        new_passwd, batch->stride, hash, CHECK_LENGTH_MAX);
+
+    if (strcmp(new_passwd, expected + item * batch->stride)) {
+      report("generate_password_r", "closed-form", batch_index, batch->domains[item],
+             batch->year, batch->fixed_sizes[item], batch->flags[item],
+             expected + item * batch->stride, new_passwd);
+    }
+    checked++;
+  }
+
+  /* Master password contexts: plain, and cached */
+  contexts[0] = create_password_context(batch->password);
+  contexts[1] = create_password_context(batch->password);
+
+  if (!contexts[0] || !contexts[1] || !enable_password_cache(contexts[1], CHECK_CACHE_CAPACITY)) {
+    fputs("Cannot create a master password context\n", stderr);
+    exit(1);
+  }
+
+  /* Plain context, one by one */
+  for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+    set_generation_engine(engines[engine].engine);
+
+    for (item = 0; item < batch->count; item++) {
+      char *new_passwd = output + item * batch->stride;
+
+      generate_password_ctx(contexts[0], batch->domains[item], batch->year,
+                            batch->fixed_sizes[item], batch->flags[item], new_passwd,
+                            batch->stride, hash, CHECK_LENGTH_MAX, NULL);
+
+      if (strcmp(new_passwd, expected + item * batch->stride)) {
+        report("generate_password_ctx", engines[engine].name, batch_index,
+               batch->domains[item], batch->year, batch->fixed_sizes[item],
+               batch->flags[item], expected + item * batch->stride, new_passwd);
+      }
+      checked++;
+    }
+  }
+
+  /* Batches: plain, with a context, and with the cached context (twice, so
+   * the second pass comes from the cache) */
+  for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+    set_generation_engine(engines[engine].engine);
+
+    for (context = 0; context <= 2; context++) {
+      for (pass = 0; pass < (context == 2 ? 2 : 1); pass++) {
+        const char *function = context ? "generate_password_batch_ctx" : "generate_password_batch";
+
+        memset(output, 'X', batch->count * batch->stride);
+
+        if (context) {
+          result = generate_password_batch_ctx(contexts[context - 1], batch->year,
+                                               batch->domain_list, batch->flags,
+                                               batch->fixed_sizes, batch->count,
+                                               output, batch->stride);
+        } else {
+          result = generate_password_batch(batch->password, batch->year, batch->domain_list,
+                                           batch->flags, batch->fixed_sizes, batch->count,
+                                           output, batch->stride);
+        }
+
+        if (result != expected_result) {
+          failures++;
+          fprintf(stderr, "FAIL %s (%s engine), batch %zu: returned %d, expected %d\n",
+                  function, engines[engine].name, batch_index, result, expected_result);
+        }
+
+        for (item = 0; item < batch->count; item++) {
+          const char *new_passwd = output + item * batch->stride;
+
+          if (!memchr(new_passwd, '\0', batch->stride)) {
+            report(function, engines[engine].name, batch_index, batch->domains[item],
+                   batch->year, batch->fixed_sizes[item], batch->flags[item],
+                   expected + item * batch->stride, "(not null-terminated)");
+          } else if (strcmp(new_passwd, expected + item * batch->stride)) {
+            report(function, engines[engine].name, batch_index, batch->domains[item],
+                   batch->year, batch->fixed_sizes[item], batch->flags[item],
+                   expected + item * batch->stride, new_passwd);
+          }
+          checked++;
+        }
+      }
+    }
+  }
+
+  free_password_context(contexts[0]);
+  free_password_context(contexts[1]);
+
+  return checked;
+}
+
+size_t check_sweep(const s_check_batch *batch, size_t batch_index,
+                   char *expected, char *output, uint16_t *hash)
+{
+  const char *sweep_years[CHECK_SWEEP_YEARS];
+  size_t sizes[CHECK_SWEEP_SIZES], year, size, engine, checked = 0;
+  const size_t stride = CHECK_LENGTH_MAX + 1;
+  const unsigned int flags = batch->flags[0];
+  int expected_result = TRUE, result;
+
+  for (year = 0; year < CHECK_SWEEP_YEARS; year++) {
+    sweep_years[year] = years[random_below(sizeof(years) / sizeof(years[0]))];
+  }
+
+  for (size = 0; size < CHECK_SWEEP_SIZES; size++) {
+    sizes[size] = size ? batch->fixed_sizes[random_below(batch->count)] : 0;
+  }
+
+  set_generation_engine(ENGINE_REFERENCE);
+
+  for (year = 0; year < CHECK_SWEEP_YEARS; year++) {
+    for (size = 0; size < CHECK_SWEEP_SIZES; size++) {
+      if (generate_password_r(batch->password, batch->domains[0], sweep_years[year],
+                              sizes[size], flags,
+                              expected + (year * CHECK_SWEEP_SIZES + size) * stride, stride,
+                              hash, CHECK_LENGTH_MAX) != GENERATE_OK) {
+        expected_result = FALSE;
+      }
+    }
+  }
+
+  for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+    set_generation_engine(engines[engine].engine);
+
+    result = generate_password_sweep(batch->password, batch->domains[0], sweep_years,
+                                     CHECK_SWEEP_YEARS, sizes, CHECK_SWEEP_SIZES, flags,
+                                     output, stride);
+
+    if (result != expected_result) {
+      failures++;
+      fprintf(stderr, "FAIL generate_password_sweep (%s engine), batch %zu: returned %d,"
+              " expected %d\n", engines[engine].name, batch_index, result, expected_result);
+    }
+
+    for (year = 0; year < CHECK_SWEEP_YEARS; year++) {
+      for (size = 0; size < CHECK_SWEEP_SIZES; size++) {
+        const size_t seek = (year * CHECK_SWEEP_SIZES + size) * stride;
+
+        if (strcmp(output + seek, expected + seek)) {
+          report("generate_password_sweep", engines[engine].name, batch_index,
+                 batch->domains[0], sweep_years[year], sizes[size], flags,
+                 expected + seek, output + seek);
+        }
+        checked++;
+      }
+    }
+  }
+
+  return checked;
+}
+
+dprpwg_profile *load_stub_profile(const char *stub_path)
+{
+  char line[CHECK_STUB_LINE_MAX], name[32], profile_path[] = "/tmp/check-generation-XXXXXX";
+  dprpwg_profile *profile;
+  FILE *stub, *output;
+  size_t constant;
+  int fd, error, result = TRUE;
+
+  /* Placeholders are not numbers */
+  profile = load_hash_profile(stub_path, &error);
+
+  if (profile || error != PROFILE_SYNTAX) {
+    fprintf(stderr, "FAIL load_hash_profile(\"%s\"): error %d, expected %d\n",
+            stub_path, error, PROFILE_SYNTAX);
+    failures++;
+    free_hash_profile(profile);
+  }
+
+  stub = fopen(stub_path, "r");
+  fd = mkstemp(profile_path);
+  output = fd >= 0 ? fdopen(fd, "w") : NULL;
+
+  if (!stub || !output) {
+    perror(!stub ? stub_path : profile_path);
+    result = FALSE;
+  }
+
+  /* "#define PW_MUL (<YOUR_NUMBER>U)" to "#define PW_MUL (7919U)" */
+  while (result && fgets(line, sizeof(line), stub)) {
+    char *number = strstr(line, "<YOUR_NUMBER>");
+
+    /* The comments mention placeholders too: they are left alone */
+    if (number && sscanf(line, " #define %31s", name) == 1) {
+      for (constant = 0; constant < sizeof(config_constants) / sizeof(config_constants[0]);
+           constant++) {
+        if (!strcmp(name, config_constants[constant].name)) {
+          break;
+        }
+      }
+
+      if (constant == sizeof(config_constants) / sizeof(config_constants[0])) {
+        fprintf(stderr, "%s: unknown constant: %s", stub_path, line);
+        result = FALSE;
+        break;
+      }
+
+      fprintf(output, "%.*s%u%s", (int) (number - line), line,
+              config_constants[constant].value, number + strlen("<YOUR_NUMBER>"));
+    } else {
+      fputs(line, output);
+    }
+  }
+
+  if (stub) {
+    fclose(stub);
+  }
+
+  if (output) {
+    fclose(output);
+  } else if (fd >= 0) {
+    close(fd);
+  }
+
+  profile = NULL;
+
+  if (result) {
+    profile = load_hash_profile(profile_path, &error);
+
+    if (!profile) {
+      fprintf(stderr, "FAIL load_hash_profile(\"%s\" with numbers): error %d\n",
+              stub_path, error);
+      failures++;
+    }
+  }
+
+  if (fd >= 0) {
+    unlink(profile_path);
+  }
+
+  return profile;
+}
+
+size_t check_profile(const s_check_batch *batch, size_t batch_index,
+                     const dprpwg_profile *profile, const char *expected,
+                     char *output, uint16_t *hash)
+{
+  dprpwg_ctx *ctx;
+  size_t item, engine, checked = 0;
+
+  ctx = create_password_context_profile(profile, batch->password);
+
+  if (!ctx) {
+    fputs("Cannot create a master password context\n", stderr);
+    exit(1);
+  }
+
+  for (engine = 0; engine < sizeof(engines) / sizeof(engines[0]); engine++) {
+    set_generation_engine(engines[engine].engine);
+
+    for (item = 0; item < batch->count; item++) {
+      char *new_passwd = output + item * batch->stride;
+
+      generate_password_profile(profile, batch->password, batch->domains[item], batch->year,
+                                batch->fixed_sizes[item], batch->flags[item], new_passwd,
+                                batch->stride, hash, CHECK_LENGTH_MAX, NULL);
+
+      if (strcmp(new_passwd, expected + item * batch->stride)) {
+        report("generate_password_profile", engines[engine].name, batch_index,
+               batch->domains[item], batch->year, batch->fixed_sizes[item],
+               batch->flags[item], expected + item * batch->stride, new_passwd);
+      }
+
+      generate_password_ctx(ctx, batch->domains[item], batch->year, batch->fixed_sizes[item],
+                            batch->flags[item], new_passwd, batch->stride,
+                            hash, CHECK_LENGTH_MAX, NULL);
+
+      if (strcmp(new_passwd, expected + item * batch->stride)) {
+        report("create_password_context_profile", engines[engine].name, batch_index,
+               batch->domains[item], batch->year, batch->fixed_sizes[item],
+               batch->flags[item], expected + item * batch->stride, new_passwd);
+      }
+      checked += 2;
+    }
+  }
+
+  free_password_context(ctx);
+
+  return checked;
+}
+
+int main(int argc, char *argv[])
+{
+  s_check_batch *batch;
+  char *expected, *output;
+  uint16_t hash[CHECK_LENGTH_MAX];
+  unsigned long seed = 1, batch_count = CHECK_BATCHES;
+  size_t batch_index, checked = 0;
+  const char *simd = getenv("DPRPWG_SIMD"), *stub_path = NULL;
+  dprpwg_profile *profile = NULL;
+  int option;
+
+  while ((option = getopt(argc, argv, "s:n:c:h")) != -1) {
+    switch (option) {
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 'n':
+        batch_count = strtoul(optarg, NULL, 10);
+        break;
+      case 'c':
+        stub_path = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return option == 'h' ? 0 : 1;
+    }
+  }
+
+  if (KNOWN_ANSWERS_CONFIG) {
+    checked += check_known_answers();
+  } else {
+    puts("check-generation: known answers skipped, dprpwg_config.h has other constants");
+  }
+
+  if (stub_path && !(profile = load_stub_profile(stub_path))) {
+    return 1;
+  }
+
+  /* xorshift never leaves zero */
+  random_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+  batch = malloc(sizeof(*batch));
+  expected = malloc(CHECK_BATCH_MAX * (CHECK_LENGTH_MAX + 1));
+  output = malloc(CHECK_BATCH_MAX * (CHECK_LENGTH_MAX + 1));
+
+  if (!batch || !expected || !output) {
+    fputs("Out of memory\n", stderr);
+    return 1;
+  }
+
+  for (batch_index = 0; batch_index < batch_count; batch_index++) {
+    make_batch(batch);
+    checked += check_batch(batch, batch_index, expected, output, hash);
+
+    if (profile) {
+      checked += check_profile(batch, batch_index, profile, expected, output, hash);
+    }
+    checked += check_sweep(batch, batch_index, expected, output, hash);
+  }
+
+  printf("check-generation (DPRPWG_SIMD=%s, seed %lu): %zu passwords checked, %zu failures\n",
+         simd ? simd : "", seed, checked, failures);
+
+  free(batch);
+  free(expected);
+  free(output);
+  free_hash_profile(profile);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * dprpwg: a Deterministic Pseudo-Random PassWord Generator
+ * Copyright (c) 2018 Jean-Baptiste HERVE
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/* Test of the key stretching, run by "make check".
+ *
+ * Argon2id first: the known answer of RFC 9106, section 5.3, must come out
+ * whatever the number of threads filling the memory. Then the keys of
+ * stretch_master_password() must not depend on set_stretch_threads(). */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "dprpwg_lib.h"
+#include "dprpwg_stretch.h"
+
+/* Highest cost of the stretch_master_password() checks */
+#define CHECK_COST_MAX (STRETCH_COST_MIN + 2U)
+
+/* Thread counts to compare, 0 for one per online core */
+static const unsigned int thread_counts[] = { 1, 2, 4, 16, 0 };
+
+/* RFC 9106, section 5.3: Argon2id, version 0x13 */
+static const uint8_t rfc_tag[] = {
+  0x0d, 0x64, 0x0d, 0xf5, 0x8d, 0x78, 0x76, 0x6c, 0x08, 0xc0, 0x37, 0xa3, 0x4a, 0x8b, 0x53, 0xc9,
+  0xd0, 0x1e, 0xf0, 0x45, 0x2d, 0x75, 0xb6, 0x5e, 0xb5, 0x25, 0x20, 0xe9, 0x6b, 0x01, 0xe6, 0x59,
+};
+
+/* ---- Internal function declarations ---- */
+
+/* Count of the failed checks */
+static size_t failures = 0;
+
+/* Check the RFC 9106 known answer on every thread count. Return the
+ * number of tags checked. */
+static size_t check_known_answer(void);
+
+/* Check that the keys of every cost do not depend on the thread count.
+ * Return the number of keys checked. */
+static size_t check_threads(void);
+
+size_t check_known_answer(void)
+{
+  uint8_t password[32], salt[16], secret[8], data[12], tag[sizeof(rfc_tag)];
+  s_argon2_params params;
+  size_t count, checked = 0;
+
+  memset(password, 0x01, sizeof(password));
+  memset(salt, 0x02, sizeof(salt));
+  memset(secret, 0x03, sizeof(secret));
+  memset(data, 0x04, sizeof(data));
+
+  memset(&params, 0, sizeof(params));
+  params.password = password;
+  params.password_length = sizeof(password);
+  params.salt = salt;
+  params.salt_length = sizeof(salt);
+  params.secret = secret;
+  params.secret_length = sizeof(secret);
+  params.data = data;
+  params.data_length = sizeof(data);
+  params.passes = 3;
+  params.memory_kib = 32;
+  params.lanes = 4;
+
+  for (count = 0; count < sizeof(thread_counts) / sizeof(thread_counts[0]); count++) {
+    memset(tag, 0, sizeof(tag));
+
+    if (!compute_argon2id(&params, thread_counts[count], tag, sizeof(tag))
+        || memcmp(tag, rfc_tag, sizeof(tag))) {
+      fprintf(stderr, "FAIL compute_argon2id (RFC 9106 known answer), %u threads\n",
+              thread_counts[count]);
+      failures++;
+    }
+    checked++;
+  }
+
+  return checked;
+}
+
+size_t check_threads(void)
+{
+  char expected[STRETCH_KEY_LENGTH + 1], key[STRETCH_KEY_LENGTH + 1];
+  unsigned int cost;
+  size_t count, checked = 0;
+
+  for (cost = STRETCH_COST_MIN; cost <= CHECK_COST_MAX; cost++) {
+    set_stretch_threads(thread_counts[0]);
+
+    if (stretch_master_password("check-stretch", cost, expected, sizeof(expected))
+        != GENERATE_OK) {
+      fprintf(stderr, "FAIL stretch_master_password, cost %u, %u threads\n", cost,
+              thread_counts[0]);
+      failures++;
+      continue;
+    }
+
+    for (count = 1; count < sizeof(thread_counts) / sizeof(thread_counts[0]); count++) {
+      set_stretch_threads(thread_counts[count]);
+      key[0] = '\0';
+
+      if (stretch_master_password("check-stretch", cost, key, sizeof(key)) != GENERATE_OK
+          || strcmp(key, expected)) {
+        fprintf(stderr, "FAIL stretch_master_password, cost %u, %u threads\n"
+                "  expected \"%s\"\n  got      \"%s\"\n",
+                cost, thread_counts[count], expected, key);
+        failures++;
+      }
+      checked++;
+    }
+  }
+
+  set_stretch_threads(0);
+
+  return checked;
+}
+
+int main(void)
+{
+  size_t checked = 0;
+
+  checked += check_known_answer();
+  checked += check_threads();
+
+  printf("check-stretch: %zu keys checked, %zu failures\n", checked, failures);
+
+  return failures ? 1 : 0;
+}